@@ -211,6 +211,31 @@ int decompress_blob_lz4(const void *src, uint64_t src_size,
         size = le64toh( *(le64_t*)src );
         if (size < 0 || (unsigned) size != le64toh(*(le64_t*)src))
                 return -EFBIG;
+
+        if (dst_max > 0 && dst_max < (size_t) size) {
+                /* Only the beginning is wanted, do not decompress
+                 * (or allocate room for) more of it */
+                if (dst_max > *dst_alloc_size) {
+                        out = realloc(*dst, dst_max);
+                        if (!out)
+                                return -ENOMEM;
+                        *dst = out;
+                        *dst_alloc_size = dst_max;
+                } else
+                        out = *dst;
+
+                r = LZ4_decompress_safe_partial((char*)src + 8, out, src_size - 8,
+                                                dst_max, dst_max);
+                if (r >= 0 && (size_t) r >= dst_max) {
+                        *dst_size = dst_max;
+                        return 0;
+                }
+
+                /* lz4 before 1.8.3 always decodes full "sequences",
+                 * and might not fit them into the buffer. Fall back
+                 * to decompressing the full blob. */
+        }
+
         if ((size_t) size > *dst_alloc_size) {
                 out = realloc(*dst, size);
                 if (!out)
@@ -224,7 +249,7 @@ int decompress_blob_lz4(const void *src, uint64_t src_size,
         if (r < 0 || r != size)
                 return -EBADMSG;
 
-        *dst_size = size;
+        *dst_size = dst_max > 0 ? MIN((size_t) size, dst_max) : (size_t) size;
         return 0;
 #else
         return -EPROTONOSUPPORT;
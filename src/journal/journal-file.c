@@ -1666,9 +1666,33 @@ uint64_t journal_file_hash_table_n_items(Object *o) {
         return (le64toh(o->object.size) - offsetof(Object, hash_table.items)) / sizeof(HashItem);
 }
 
+/* Where linking continues in a chain of entry arrays: the last array seen, and the number of items in the
+ * arrays before it */
+typedef struct ArrayTail {
+        uint64_t array;
+        uint64_t total;
+} ArrayTail;
+
+/* Number of data objects remembered while appending a batch of entries, a power of two */
+#define APPEND_CACHE_SIZE 64U
+
+typedef struct AppendCacheItem {
+        const void *data;
+        uint64_t size;
+        uint64_t hash;
+        uint64_t offset;
+        ArrayTail tail;
+} AppendCacheItem;
+
+typedef struct AppendCache {
+        AppendCacheItem items[APPEND_CACHE_SIZE];
+        ArrayTail entry_array_tail;
+} AppendCache;
+
 static int link_entry_into_array(JournalFile *f,
                                  le64_t *first,
                                  le64_t *idx,
+                                 ArrayTail *tail,
                                  uint64_t p) {
         int r;
         uint64_t n = 0, ap = 0, q, i, a, hidx;
@@ -1682,6 +1706,13 @@ static int link_entry_into_array(JournalFile *f,
 
         a = le64toh(*first);
         i = hidx = le64toh(*idx);
+
+        /* Skip the arrays that were full already when we last came here */
+        if (tail && tail->array > 0 && hidx >= tail->total) {
+                a = tail->array;
+                i = hidx - tail->total;
+        }
+
         while (a > 0) {
 
                 r = journal_file_move_to_object(f, OBJECT_ENTRY_ARRAY, a, &o);
@@ -1692,6 +1723,10 @@ static int link_entry_into_array(JournalFile *f,
                 if (i < n) {
                         o->entry_array.items[i] = htole64(p);
                         *idx = htole64(hidx + 1);
+
+                        if (tail)
+                                *tail = (ArrayTail) { a, hidx - i };
+
                         return 0;
                 }
 
@@ -1737,6 +1772,9 @@ static int link_entry_into_array(JournalFile *f,
 
         *idx = htole64(hidx + 1);
 
+        if (tail)
+                *tail = (ArrayTail) { q, hidx - i };
+
         return 0;
 }
 
@@ -1744,6 +1782,7 @@ static int link_entry_into_array_plus_one(JournalFile *f,
                                           le64_t *extra,
                                           le64_t *first,
                                           le64_t *idx,
+                                          ArrayTail *tail,
                                           uint64_t p) {
 
         int r;
@@ -1760,7 +1799,7 @@ static int link_entry_into_array_plus_one(JournalFile *f,
                 le64_t i;
 
                 i = htole64(le64toh(*idx) - 1);
-                r = link_entry_into_array(f, first, &i, p);
+                r = link_entry_into_array(f, first, &i, tail, p);
                 if (r < 0)
                         return r;
         }
@@ -1769,7 +1808,8 @@ static int link_entry_into_array_plus_one(JournalFile *f,
         return 0;
 }
 
-static int journal_file_link_entry_item(JournalFile *f, Object *o, uint64_t offset, uint64_t i) {
+static int journal_file_link_entry_item(JournalFile *f, AppendCache *c, Object *o, uint64_t offset, uint64_t i) {
+        ArrayTail *tail = NULL;
         uint64_t p;
         int r;
         assert(f);
@@ -1780,6 +1820,14 @@ static int journal_file_link_entry_item(JournalFile *f, Object *o, uint64_t offs
         if (p == 0)
                 return -EINVAL;
 
+        if (c) {
+                AppendCacheItem *ci;
+
+                ci = c->items + (le64toh(o->entry.items[i].hash) & (APPEND_CACHE_SIZE - 1));
+                if (ci->offset == p)
+                        tail = &ci->tail;
+        }
+
         r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
         if (r < 0)
                 return r;
@@ -1788,10 +1836,11 @@ static int journal_file_link_entry_item(JournalFile *f, Object *o, uint64_t offs
                                               &o->data.entry_offset,
                                               &o->data.entry_array_offset,
                                               &o->data.n_entries,
+                                              tail,
                                               offset);
 }
 
-static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
+static int journal_file_link_entry(JournalFile *f, AppendCache *c, Object *o, uint64_t offset) {
         uint64_t n, i;
         int r;
 
@@ -1809,6 +1858,7 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         r = link_entry_into_array(f,
                                   &f->header->entry_array_offset,
                                   &f->header->n_entries,
+                                  c ? &c->entry_array_tail : NULL,
                                   offset);
         if (r < 0)
                 return r;
@@ -1826,7 +1876,7 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
         /* Link up the items */
         n = journal_file_entry_n_items(o);
         for (i = 0; i < n; i++) {
-                r = journal_file_link_entry_item(f, o, offset, i);
+                r = journal_file_link_entry_item(f, c, o, offset, i);
                 if (r < 0)
                         return r;
         }
@@ -1836,6 +1886,7 @@ static int journal_file_link_entry(JournalFile *f, Object *o, uint64_t offset) {
 
 static int journal_file_append_entry_internal(
                 JournalFile *f,
+                AppendCache *c,
                 const dual_timestamp *ts,
                 uint64_t xor_hash,
                 const EntryItem items[], unsigned n_items,
@@ -1870,7 +1921,7 @@ static int journal_file_append_entry_internal(
                 return r;
 #endif
 
-        r = journal_file_link_entry(f, o, np);
+        r = journal_file_link_entry(f, c, o, np);
         if (r < 0)
                 return r;
 
@@ -1984,22 +2035,69 @@ static int entry_item_cmp(const void *_a, const void *_b) {
         return 0;
 }
 
-int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+static int journal_file_append_data_cached(
+                JournalFile *f,
+                AppendCache *c,
+                const void *data, uint64_t size,
+                le64_t *ret_hash, uint64_t *ret_offset) {
+
+        AppendCacheItem *ci;
+        uint64_t hash, p;
+        Object *o;
+        int r;
+
+        assert(f);
+        assert(c);
+        assert(data || size == 0);
+
+        /* Entries written together usually share most of their fields, which need to be looked up in the hash
+         * table only once then */
+
+        hash = hash64(data, size);
+
+        ci = c->items + (hash & (APPEND_CACHE_SIZE - 1));
+        if (ci->offset > 0 && ci->hash == hash && ci->size == size &&
+            (size == 0 || memcmp(ci->data, data, size) == 0)) {
+                *ret_hash = htole64(hash);
+                *ret_offset = ci->offset;
+                return 0;
+        }
+
+        r = journal_file_append_data(f, data, size, &o, &p);
+        if (r < 0)
+                return r;
+
+        *ci = (AppendCacheItem) {
+                .data = data,
+                .size = size,
+                .hash = hash,
+                .offset = p,
+        };
+
+        *ret_hash = o->data.hash;
+        *ret_offset = p;
+
+        return 0;
+}
+
+static int append_entry(
+                JournalFile *f,
+                AppendCache *c,
+                const dual_timestamp *ts,
+                const struct iovec iovec[], unsigned n_iovec,
+                uint64_t *seqnum,
+                Object **ret, uint64_t *offset) {
+
         unsigned i;
         EntryItem *items;
         int r;
         uint64_t xor_hash = 0;
-        struct dual_timestamp _ts;
 
         assert(f);
         assert(f->header);
+        assert(ts);
         assert(iovec || n_iovec == 0);
 
-        if (!ts) {
-                dual_timestamp_get(&_ts);
-                ts = &_ts;
-        }
-
 #if HAVE_GCRYPT
         r = journal_file_maybe_append_tag(f, ts->realtime);
         if (r < 0)
@@ -2011,22 +2109,32 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
 
         for (i = 0; i < n_iovec; i++) {
                 uint64_t p;
-                Object *o;
+                le64_t h;
 
-                r = journal_file_append_data(f, iovec[i].iov_base, iovec[i].iov_len, &o, &p);
-                if (r < 0)
-                        return r;
+                if (c) {
+                        r = journal_file_append_data_cached(f, c, iovec[i].iov_base, iovec[i].iov_len, &h, &p);
+                        if (r < 0)
+                                return r;
+                } else {
+                        Object *o;
+
+                        r = journal_file_append_data(f, iovec[i].iov_base, iovec[i].iov_len, &o, &p);
+                        if (r < 0)
+                                return r;
+
+                        h = o->data.hash;
+                }
 
-                xor_hash ^= le64toh(o->data.hash);
+                xor_hash ^= le64toh(h);
                 items[i].object_offset = htole64(p);
-                items[i].hash = o->data.hash;
+                items[i].hash = h;
         }
 
         /* Order by the position on disk, in order to improve seek
          * times for rotating media. */
         qsort_safe(items, n_iovec, sizeof(EntryItem), entry_item_cmp);
 
-        r = journal_file_append_entry_internal(f, ts, xor_hash, items, n_iovec, seqnum, ret, offset);
+        r = journal_file_append_entry_internal(f, c, ts, xor_hash, items, n_iovec, seqnum, ret, offset);
 
         /* If the memory mapping triggered a SIGBUS then we return an
          * IO error and ignore the error code passed down to us, since
@@ -2036,6 +2144,24 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
         if (mmap_cache_got_sigbus(f->mmap, f->cache_fd))
                 r = -EIO;
 
+        return r;
+}
+
+int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqnum, Object **ret, uint64_t *offset) {
+        int r;
+        struct dual_timestamp _ts;
+
+        assert(f);
+        assert(f->header);
+        assert(iovec || n_iovec == 0);
+
+        if (!ts) {
+                dual_timestamp_get(&_ts);
+                ts = &_ts;
+        }
+
+        r = append_entry(f, NULL, ts, iovec, n_iovec, seqnum, ret, offset);
+
         if (f->post_change_timer)
                 schedule_post_change(f);
         else
@@ -2044,6 +2170,47 @@ int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const st
         return r;
 }
 
+int journal_file_append_entries(JournalFile *f, const JournalAppendEntry entries[], unsigned n_entries, uint64_t *seqnum, unsigned *ret_n_appended) {
+        _cleanup_free_ AppendCache *c = NULL;
+        unsigned i;
+        int r = 0;
+
+        assert(f);
+        assert(f->header);
+        assert(entries || n_entries == 0);
+
+        /* Like journal_file_append_entry() for each of the entries, but data objects are looked up only once
+         * for all of them, the arrays of entries they are linked into are followed to their end only once,
+         * and the change is posted once. Stops at the first entry that cannot be appended, and returns the
+         * number of entries appended before it.
+         *
+         * journald does not use this: it writes each message as it is dispatched, and flushing the runtime
+         * journal appends straight from its mapping with journal_file_copy_entry(), while a batch would need
+         * all fields copied out first, as mapped objects do not stay valid across reads. */
+
+        c = new0(AppendCache, 1);
+        if (!c)
+                return -ENOMEM;
+
+        for (i = 0; i < n_entries; i++) {
+                r = append_entry(f, c, &entries[i].ts, entries[i].iovec, entries[i].n_iovec, seqnum, NULL, NULL);
+                if (r < 0)
+                        break;
+        }
+
+        if (i > 0 || r < 0) {
+                if (f->post_change_timer)
+                        schedule_post_change(f);
+                else
+                        journal_file_post_change(f);
+        }
+
+        if (ret_n_appended)
+                *ret_n_appended = i;
+
+        return r;
+}
+
 typedef struct ChainCacheItem {
         uint64_t first; /* the array at the beginning of the chain */
         uint64_t array; /* the cached array */
@@ -3657,7 +3824,7 @@ int journal_file_copy_entry(JournalFile *from, JournalFile *to, Object *o, uint6
                         return r;
         }
 
-        r = journal_file_append_entry_internal(to, &ts, xor_hash, items, n, seqnum, ret, offset);
+        r = journal_file_append_entry_internal(to, NULL, &ts, xor_hash, items, n, seqnum, ret, offset);
 
         if (mmap_cache_got_sigbus(to->mmap, to->cache_fd))
                 return -EIO;
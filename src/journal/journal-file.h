@@ -95,6 +95,7 @@ typedef struct JournalFile {
         direction_t last_direction;
         LocationType location_type;
         uint64_t last_n_entries;
+        unsigned candidate_idx; /* position in the heap of candidate entries of sd_journal */
 
         char *path;
         struct stat last_stat;
@@ -145,6 +146,13 @@ typedef struct JournalFile {
 #endif
 } JournalFile;
 
+/* An entry for journal_file_append_entries() */
+typedef struct JournalAppendEntry {
+        dual_timestamp ts;
+        const struct iovec *iovec;
+        unsigned n_iovec;
+} JournalAppendEntry;
+
 int journal_file_open(
                 int fd,
                 const char *fname,
@@ -216,6 +224,7 @@ uint64_t journal_file_hash_table_n_items(Object *o) _pure_;
 
 int journal_file_append_object(JournalFile *f, ObjectType type, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_append_entry(JournalFile *f, const dual_timestamp *ts, const struct iovec iovec[], unsigned n_iovec, uint64_t *seqno, Object **ret, uint64_t *offset);
+int journal_file_append_entries(JournalFile *f, const JournalAppendEntry entries[], unsigned n_entries, uint64_t *seqno, unsigned *ret_n_appended);
 
 int journal_file_find_data_object(JournalFile *f, const void *data, uint64_t size, Object **ret, uint64_t *offset);
 int journal_file_find_data_object_with_hash(JournalFile *f, const void *data, uint64_t size, uint64_t hash, Object **ret, uint64_t *offset);
@@ -31,11 +31,22 @@
 #include "journal-def.h"
 #include "journal-file.h"
 #include "list.h"
+#include "prioq.h"
 #include "set.h"
 
 typedef struct Match Match;
 typedef struct Location Location;
 typedef struct Directory Directory;
+typedef struct FieldIndexEntry FieldIndexEntry;
+typedef struct DataCacheEntry DataCacheEntry;
+typedef struct PendingFile PendingFile;
+
+/* Number of decompressed data objects kept around */
+#define DATA_CACHE_SIZE 8
+
+/* Flag for sd_journal_open(), sd_journal_open_directory() and sd_journal_open_directory_fd(), not part of the
+ * public API: archived files are only opened when the location iterated from might be in their time range */
+#define JOURNAL_OPEN_LAZY (1 << 30)
 
 typedef enum MatchType {
         MATCH_DISCRETE,
@@ -82,6 +93,31 @@ struct Directory {
         bool is_root;
 };
 
+struct FieldIndexEntry {
+        uint64_t hash;
+        uint64_t item;
+
+        /* The field name, in sd_journal.field_index_names */
+        size_t name_offset;
+        size_t name_length;
+};
+
+struct DataCacheEntry {
+        JournalFile *file;
+        uint64_t offset;
+        uint64_t last_used;
+
+        void *data;
+        size_t size;
+        size_t allocated;
+};
+
+struct PendingFile {
+        char *path;
+        usec_t head_realtime;
+        usec_t tail_realtime;
+};
+
 struct sd_journal {
         int toplevel_fd;
 
@@ -91,11 +127,38 @@ struct sd_journal {
         OrderedHashmap *files;
         MMapCache *mmap;
 
+        /* The archived files not opened yet, with JOURNAL_OPEN_LAZY. Those that reach beyond pending_down_usec
+         * or before pending_up_usec have been opened already. */
+        OrderedHashmap *pending_files;
+        usec_t pending_down_usec, pending_up_usec;
+
         Location current_location;
 
         JournalFile *current_file;
         uint64_t current_field;
 
+        /* The files which have a candidate entry in the direction we are iterating in, ordered by it, and the
+         * files which hit EOF but might still grow. Rebuilt after seeking, changing the direction or matches,
+         * and adding files. */
+        Prioq *candidates;
+        Set *files_at_tail;
+        direction_t candidates_direction;
+        bool candidates_valid;
+
+        /* The field names of the current entry, ordered by their hash, for sd_journal_get_data(). Built when
+         * it is first called on an entry. */
+        FieldIndexEntry *field_index;
+        size_t n_field_index, field_index_allocated;
+        char *field_index_names;
+        size_t field_index_names_size, field_index_names_allocated;
+        JournalFile *field_index_file;
+        uint64_t field_index_offset;
+        bool field_index_complete;
+
+        /* Recently decompressed data objects, least recently used is replaced first */
+        DataCacheEntry data_cache[DATA_CACHE_SIZE];
+        uint64_t data_cache_clock;
+
         Match *level0, *level1, *level2;
 
         pid_t original_pid;
@@ -2087,7 +2087,7 @@ int main(int argc, char *argv[]) {
         bool need_seek = false;
         sd_id128_t previous_boot_id;
         bool previous_boot_id_valid = false, first_line = true;
-        int n_shown = 0;
+        int n_shown = 0, lazy;
         bool ellipsized = false;
 
         setlocale(LC_ALL, "");
@@ -2174,10 +2174,13 @@ int main(int argc, char *argv[]) {
                 assert_not_reached("Unknown action");
         }
 
+        /* When showing a time range, archived files outside of it need not be opened at all */
+        lazy = arg_action == ACTION_SHOW && (arg_since_set || arg_until_set) ? JOURNAL_OPEN_LAZY : 0;
+
         if (arg_directory)
-                r = sd_journal_open_directory(&j, arg_directory, arg_journal_type);
+                r = sd_journal_open_directory(&j, arg_directory, arg_journal_type | lazy);
         else if (arg_root)
-                r = sd_journal_open_directory(&j, arg_root, arg_journal_type | SD_JOURNAL_OS_ROOT);
+                r = sd_journal_open_directory(&j, arg_root, arg_journal_type | SD_JOURNAL_OS_ROOT | lazy);
         else if (arg_file_stdin) {
                 int ifd = STDIN_FILENO;
                 r = sd_journal_open_files_fd(&j, &ifd, 1, 0);
@@ -2229,11 +2232,11 @@ int main(int argc, char *argv[]) {
                         goto finish;
                 }
 
-                r = sd_journal_open_directory_fd(&j, fd, SD_JOURNAL_OS_ROOT);
+                r = sd_journal_open_directory_fd(&j, fd, SD_JOURNAL_OS_ROOT | lazy);
                 if (r < 0)
                         safe_close(fd);
         } else
-                r = sd_journal_open(&j, !arg_merge*SD_JOURNAL_LOCAL_ONLY + arg_journal_type);
+                r = sd_journal_open(&j, (!arg_merge*SD_JOURNAL_LOCAL_ONLY + arg_journal_type) | lazy);
         if (r < 0) {
                 log_error_errno(r, "Failed to open %s: %m", arg_directory ?: arg_file ? "files" : "journal");
                 goto finish;
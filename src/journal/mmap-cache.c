@@ -68,13 +68,18 @@ struct MMapFileDescriptor {
         int fd;
         bool sigbus;
         LIST_HEAD(Window, windows);
+
+        /* Per context, the last offset asked for, and the number of consecutive misses that were small steps
+         * forward from the previous access */
+        uint64_t last_offset[MMAP_CACHE_MAX_CONTEXTS];
+        unsigned n_sequential[MMAP_CACHE_MAX_CONTEXTS];
 };
 
 struct MMapCache {
         int n_ref;
         unsigned n_windows;
 
-        unsigned n_hit, n_missed;
+        unsigned n_hit, n_missed, n_evicted, n_sequential;
 
         Hashmap *fds;
         Context *contexts[MMAP_CACHE_MAX_CONTEXTS];
@@ -92,6 +97,11 @@ struct MMapCache {
 # define WINDOW_SIZE (8ULL*1024ULL*1024ULL)
 #endif
 
+/* A miss at most this far ahead of the previous access of the same context to the same file continues a
+ * forward scan. Windows of scans double in size with every further miss, up to the given number of times. */
+#define SEQUENTIAL_STEP_MAX (64ULL*1024ULL)
+#define SEQUENTIAL_SHIFT_MAX 2U
+
 MMapCache* mmap_cache_new(void) {
         MMapCache *m;
 
@@ -197,6 +207,7 @@ static Window *window_add(MMapCache *m, MMapFileDescriptor *f, int prot, bool ke
                 w = m->last_unused;
                 window_unlink(w);
                 zero(*w);
+                m->n_evicted++;
         }
 
         w->cache = m;
@@ -335,6 +346,7 @@ static int make_room(MMapCache *m) {
                 return 0;
 
         window_free(m->last_unused);
+        m->n_evicted++;
         return 1;
 }
 
@@ -468,6 +480,7 @@ static int add_mmap(
                 size_t *ret_size) {
 
         uint64_t woffset, wsize;
+        unsigned n_sequential;
         Context *c;
         Window *w;
         void *d;
@@ -479,11 +492,21 @@ static int add_mmap(
         assert(size > 0);
         assert(ret);
 
+        n_sequential = f->n_sequential[context];
+
         woffset = offset & ~((uint64_t) page_size() - 1ULL);
         wsize = size + (offset - woffset);
         wsize = PAGE_ALIGN(wsize);
 
-        if (wsize < WINDOW_SIZE) {
+        if (n_sequential > 0) {
+                uint64_t ssize;
+
+                /* A forward scan will not look back, hence map ahead only, and more the longer it goes on */
+                ssize = WINDOW_SIZE << MIN(n_sequential, SEQUENTIAL_SHIFT_MAX);
+                if (wsize < ssize)
+                        wsize = ssize;
+
+        } else if (wsize < WINDOW_SIZE) {
                 uint64_t delta;
 
                 delta = PAGE_ALIGN((WINDOW_SIZE - wsize) / 2);
@@ -512,6 +535,14 @@ static int add_mmap(
         if (r < 0)
                 return r;
 
+        if (n_sequential > 0) {
+                /* Have the kernel start reading the window in right away. MADV_SEQUENTIAL is not used, as
+                 * other contexts may pick up the window for random accesses, and scans may turn around. */
+                (void) madvise(d, wsize, MADV_WILLNEED);
+
+                m->n_sequential++;
+        }
+
         c = context_add(m, context);
         if (!c)
                 goto outofmem;
@@ -545,6 +576,7 @@ int mmap_cache_get(
                 void **ret,
                 size_t *ret_size) {
 
+        uint64_t last_offset;
         int r;
 
         assert(m);
@@ -554,6 +586,9 @@ int mmap_cache_get(
         assert(ret);
         assert(context < MMAP_CACHE_MAX_CONTEXTS);
 
+        last_offset = f->last_offset[context];
+        f->last_offset[context] = offset;
+
         /* Check whether the current context is the right one already */
         r = try_context(m, f, prot, context, keep_always, offset, size, ret, ret_size);
         if (r != 0) {
@@ -570,6 +605,13 @@ int mmap_cache_get(
 
         m->n_missed++;
 
+        /* Contexts are shared by all files, hence scans through several files at once are told apart by
+         * looking at the accesses to each file separately */
+        if (offset >= last_offset && offset - last_offset <= SEQUENTIAL_STEP_MAX)
+                f->n_sequential[context]++;
+        else
+                f->n_sequential[context] = 0;
+
         /* Create a new mmap */
         return add_mmap(m, f, prot, context, keep_always, offset, size, st, ret, ret_size);
 }
@@ -586,6 +628,30 @@ unsigned mmap_cache_get_missed(MMapCache *m) {
         return m->n_missed;
 }
 
+void mmap_cache_get_stats(MMapCache *m, MMapCacheStats *ret) {
+        MMapFileDescriptor *f;
+        Iterator i;
+        Window *w;
+
+        assert(m);
+        assert(ret);
+
+        *ret = (MMapCacheStats) {
+                .n_hit = m->n_hit,
+                .n_missed = m->n_missed,
+                .n_evicted = m->n_evicted,
+                .n_sequential = m->n_sequential,
+                .n_windows = m->n_windows,
+        };
+
+        LIST_FOREACH(unused, w, m->unused)
+                ret->n_unused++;
+
+        HASHMAP_FOREACH(f, m->fds, i)
+                LIST_FOREACH(by_fd, w, f->windows)
+                        ret->mapped += w->size;
+}
+
 static void mmap_cache_process_sigbus(MMapCache *m) {
         bool found = false;
         MMapFileDescriptor *f;
@@ -660,6 +726,7 @@ bool mmap_cache_got_sigbus(MMapCache *m, MMapFileDescriptor *f) {
 
 MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
         MMapFileDescriptor *f;
+        unsigned i;
         int r;
 
         assert(m);
@@ -680,6 +747,10 @@ MMapFileDescriptor* mmap_cache_add_fd(MMapCache *m, int fd) {
         f->cache = m;
         f->fd = fd;
 
+        /* Nothing was read yet, hence nothing continues */
+        for (i = 0; i < MMAP_CACHE_MAX_CONTEXTS; i++)
+                f->last_offset[i] = UINT64_MAX;
+
         r = hashmap_put(m->fds, FD_TO_PTR(fd), f);
         if (r < 0)
                 return mfree(f);
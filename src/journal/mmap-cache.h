@@ -29,6 +29,16 @@
 typedef struct MMapCache MMapCache;
 typedef struct MMapFileDescriptor MMapFileDescriptor;
 
+typedef struct MMapCacheStats {
+        unsigned n_hit;
+        unsigned n_missed;
+        unsigned n_evicted;    /* windows unmapped to make room for new ones */
+        unsigned n_sequential; /* windows mapped for forward scans */
+        unsigned n_windows;
+        unsigned n_unused;
+        uint64_t mapped;       /* bytes */
+} MMapCacheStats;
+
 MMapCache* mmap_cache_new(void);
 MMapCache* mmap_cache_ref(MMapCache *m);
 MMapCache* mmap_cache_unref(MMapCache *m);
@@ -49,5 +59,6 @@ void mmap_cache_free_fd(MMapCache *m, MMapFileDescriptor *f);
 
 unsigned mmap_cache_get_hit(MMapCache *m);
 unsigned mmap_cache_get_missed(MMapCache *m);
+void mmap_cache_get_stats(MMapCache *m, MMapCacheStats *ret);
 
 bool mmap_cache_got_sigbus(MMapCache *m, MMapFileDescriptor *f);
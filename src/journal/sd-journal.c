@@ -23,6 +23,8 @@
 #include <inttypes.h>
 #include <linux/magic.h>
 #include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stddef.h>
 #include <sys/inotify.h>
 #include <sys/vfs.h>
@@ -48,6 +50,7 @@
 #include "lookup3.h"
 #include "missing.h"
 #include "path-util.h"
+#include "prioq.h"
 #include "process-util.h"
 #include "replace-var.h"
 #include "stat-util.h"
@@ -64,6 +67,9 @@
 #define DEFAULT_DATA_THRESHOLD (64*1024)
 
 static void remove_file_real(sd_journal *j, JournalFile *f);
+static void data_cache_flush(sd_journal *j, JournalFile *f);
+static void data_cache_free(sd_journal *j);
+static int open_pending_files(sd_journal *j, direction_t direction, usec_t usec);
 
 static bool journal_pid_changed(sd_journal *j) {
         assert(j);
@@ -116,6 +122,27 @@ static int journal_put_error(sd_journal *j, int r, const char *path) {
         return 0;
 }
 
+static void remove_candidate(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
+
+        /* prioq_remove() leaves the index alone, but update_candidate() relies on it */
+        if (prioq_remove(j->candidates, f, &f->candidate_idx) > 0)
+                f->candidate_idx = PRIOQ_IDX_NULL;
+}
+
+static void clear_candidates(sd_journal *j) {
+        JournalFile *f;
+
+        assert(j);
+
+        while ((f = prioq_pop(j->candidates)))
+                f->candidate_idx = PRIOQ_IDX_NULL;
+
+        set_clear(j->files_at_tail);
+        j->candidates_valid = false;
+}
+
 static void detach_location(sd_journal *j) {
         Iterator i;
         JournalFile *f;
@@ -125,6 +152,8 @@ static void detach_location(sd_journal *j) {
         j->current_file = NULL;
         j->current_field = 0;
 
+        clear_candidates(j);
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i)
                 journal_file_reset_location(f);
 }
@@ -819,49 +848,147 @@ static int next_beyond_location(sd_journal *j, JournalFile *f, direction_t direc
         }
 }
 
-static int real_journal_next(sd_journal *j, direction_t direction) {
-        JournalFile *f, *new_file = NULL;
+static int compare_candidates(const void *a, const void *b) {
+        JournalFile *x = (JournalFile*) a, *y = (JournalFile*) b;
+
+        assert(x->last_direction == y->last_direction);
+
+        /* The entry to return next comes first */
+        if (x->last_direction == DIRECTION_DOWN)
+                return journal_file_compare_locations(x, y);
+        else
+                return journal_file_compare_locations(y, x);
+}
+
+static int update_candidate(sd_journal *j, JournalFile *f, direction_t direction) {
+        int r;
+
+        assert(j);
+        assert(f);
+
+        r = next_beyond_location(j, f, direction);
+        if (r < 0) {
+                log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
+                remove_file_real(j, f);
+                return 0;
+        } else if (r == 0) {
+                f->location_type = LOCATION_TAIL;
+                remove_candidate(j, f);
+
+                /* Archived files do not get new entries anymore */
+                if (f->header->state == STATE_ARCHIVED) {
+                        set_remove(j->files_at_tail, f);
+                        return 0;
+                }
+
+                r = set_put(j->files_at_tail, f);
+                return r < 0 ? r : 0;
+        }
+
+        set_remove(j->files_at_tail, f);
+
+        if (f->candidate_idx == PRIOQ_IDX_NULL)
+                return prioq_put(j->candidates, f, &f->candidate_idx);
+
+        return prioq_reshuffle(j->candidates, f, &f->candidate_idx);
+}
+
+static int update_candidates(sd_journal *j, direction_t direction) {
+        JournalFile *f;
         Iterator i;
+        int r;
+
+        assert(j);
+
+        r = prioq_ensure_allocated(&j->candidates, compare_candidates);
+        if (r < 0)
+                return r;
+
+        r = set_ensure_allocated(&j->files_at_tail, NULL);
+        if (r < 0)
+                return r;
+
+        if (!j->candidates_valid || j->candidates_direction != direction) {
+                clear_candidates(j);
+
+                ORDERED_HASHMAP_FOREACH(f, j->files, i) {
+                        r = update_candidate(j, f, direction);
+                        if (r < 0)
+                                return r;
+                }
+
+                j->candidates_direction = direction;
+                j->candidates_valid = true;
+
+                return 0;
+        }
+
+        /* Only the file we returned the previous entry from needs to move on, and files which hit EOF before
+         * might have grown since */
+        if (j->current_file && j->current_file->location_type == LOCATION_DISCRETE) {
+                r = update_candidate(j, j->current_file, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        SET_FOREACH(f, j->files_at_tail, i) {
+                r = update_candidate(j, f, direction);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int real_journal_next(sd_journal *j, direction_t direction) {
+        JournalFile *new_file;
         Object *o;
         int r;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
 
-        ORDERED_HASHMAP_FOREACH(f, j->files, i) {
-                bool found;
+        r = open_pending_files(j, direction,
+                               IN_SET(j->current_location.type, LOCATION_SEEK, LOCATION_DISCRETE) &&
+                               j->current_location.realtime_set ? j->current_location.realtime : USEC_INFINITY);
+        if (r < 0)
+                return r;
 
-                r = next_beyond_location(j, f, direction);
-                if (r < 0) {
-                        log_debug_errno(r, "Can't iterate through %s, ignoring: %m", f->path);
-                        remove_file_real(j, f);
-                        continue;
-                } else if (r == 0) {
-                        f->location_type = LOCATION_TAIL;
-                        continue;
-                }
+        r = update_candidates(j, direction);
+        if (r < 0) {
+                j->candidates_valid = false;
+                return r;
+        }
+
+        for (;;) {
+                int k;
 
+                new_file = prioq_peek(j->candidates);
                 if (!new_file)
-                        found = true;
-                else {
-                        int k;
+                        return 0;
 
-                        k = journal_file_compare_locations(f, new_file);
+                if (j->current_location.type != LOCATION_DISCRETE)
+                        break;
 
-                        found = direction == DIRECTION_DOWN ? k < 0 : k > 0;
-                }
+                /* The candidate might be the same entry as the one we returned from another file before */
+                k = compare_with_location(new_file, &j->current_location);
+                if (direction == DIRECTION_DOWN ? k > 0 : k < 0)
+                        break;
 
-                if (found)
-                        new_file = f;
+                r = update_candidate(j, new_file, direction);
+                if (r < 0) {
+                        j->candidates_valid = false;
+                        return r;
+                }
         }
 
-        if (!new_file)
-                return 0;
-
         r = journal_file_move_to_object(new_file, OBJECT_ENTRY, new_file->current_offset, &o);
         if (r < 0)
                 return r;
 
+        /* The file gets a new candidate on the next call */
+        remove_candidate(j, new_file);
+
         set_location(j, new_file, o);
 
         return 1;
@@ -1257,16 +1384,29 @@ static const char *skip_slash(const char *p) {
         return p;
 }
 
-static int add_any_file(sd_journal *j, int fd, const char *path) {
+static void note_file_path(sd_journal *j, const char *path) {
+        assert(j);
+        assert(path);
+
+        if (!j->has_runtime_files && path_has_prefix(j, path, "/run"))
+                j->has_runtime_files = true;
+        else if (!j->has_persistent_files && path_has_prefix(j, path, "/var"))
+                j->has_persistent_files = true;
+}
+
+static int add_any_file(sd_journal *j, int fd, bool close_fd, const char *path) {
         JournalFile *f = NULL;
-        bool close_fd = false;
         int r, k;
 
         assert(j);
         assert(fd >= 0 || path);
+        assert(fd >= 0 || !close_fd);
 
-        if (path && ordered_hashmap_get(j->files, path))
+        if (path && ordered_hashmap_get(j->files, path)) {
+                if (close_fd)
+                        safe_close(fd);
                 return 0;
+        }
 
         if (ordered_hashmap_size(j->files) >= JOURNAL_FILES_MAX) {
                 log_debug("Too many open journal files, not adding %s.", path);
@@ -1290,25 +1430,26 @@ static int add_any_file(sd_journal *j, int fd, const char *path) {
 
         r = journal_file_open(fd, path, O_RDONLY, 0, false, false, NULL, j->mmap, NULL, NULL, &f);
         if (r < 0) {
-                if (close_fd)
-                        safe_close(fd);
                 log_debug_errno(r, "Failed to open journal file %s: %m", path);
                 goto fail;
         }
 
         /* journal_file_dump(f); */
 
+        f->close_fd = close_fd;
+        close_fd = false;
+
         r = ordered_hashmap_put(j->files, f->path, f);
         if (r < 0) {
-                f->close_fd = close_fd;
                 (void) journal_file_close(f);
                 goto fail;
         }
 
-        if (!j->has_runtime_files && path_has_prefix(j, f->path, "/run"))
-                j->has_runtime_files = true;
-        else if (!j->has_persistent_files && path_has_prefix(j, f->path, "/var"))
-                j->has_persistent_files = true;
+        /* The new file needs to be looked at before returning the next entry */
+        f->candidate_idx = PRIOQ_IDX_NULL;
+        j->candidates_valid = false;
+
+        note_file_path(j, f->path);
 
         log_debug("File %s added.", f->path);
 
@@ -1319,6 +1460,9 @@ static int add_any_file(sd_journal *j, int fd, const char *path) {
         return 0;
 
 fail:
+        if (close_fd)
+                safe_close(fd);
+
         k = journal_put_error(j, r, path);
         if (k < 0)
                 return k;
@@ -1326,152 +1470,455 @@ fail:
         return r;
 }
 
-static int add_file(sd_journal *j, const char *prefix, const char *filename) {
-        const char *path;
+/* Opening a file is not worth starting a thread for, hence every worker gets several */
+#define OPEN_JOBS_PER_WORKER 4U
+#define OPEN_WORKERS_MAX 8U
 
-        assert(j);
-        assert(prefix);
-        assert(filename);
+typedef struct OpenJob {
+        char *path;
+        int fd;
+        int error;
+        Header header;
+        size_t header_size;
+} OpenJob;
 
-        if (j->no_new_files)
-                return 0;
+typedef struct OpenQueue {
+        int toplevel_fd;
+        OpenJob *jobs;
+        size_t n_jobs;
+        size_t next;
+} OpenQueue;
 
-        if (!file_type_wanted(j->flags, filename))
-                return 0;
+static void open_job_run(int toplevel_fd, OpenJob *job) {
+        ssize_t n;
 
-        path = strjoina(prefix, "/", filename);
-        return add_any_file(j, -1, path);
+        assert(job);
+
+        if (toplevel_fd >= 0)
+                job->fd = openat(toplevel_fd, skip_slash(job->path), O_RDONLY|O_CLOEXEC);
+        else
+                job->fd = open(job->path, O_RDONLY|O_CLOEXEC);
+        if (job->fd < 0) {
+                job->error = -errno;
+                return;
+        }
+
+        /* This brings the header into the page cache, where journal_file_open() is going to find it. Whether
+         * it is valid is checked there, hence errors are ignored. */
+        n = pread(job->fd, &job->header, sizeof(job->header), 0);
+        if (n > 0)
+                job->header_size = (size_t) n;
 }
 
-static void remove_file(sd_journal *j, const char *prefix, const char *filename) {
-        const char *path;
-        JournalFile *f;
+static void *open_worker(void *p) {
+        OpenQueue *q = p;
 
-        assert(j);
-        assert(prefix);
-        assert(filename);
+        for (;;) {
+                size_t i;
 
-        path = strjoina(prefix, "/", filename);
-        f = ordered_hashmap_get(j->files, path);
-        if (!f)
-                return;
+                i = __sync_fetch_and_add(&q->next, 1);
+                if (i >= q->n_jobs)
+                        return NULL;
 
-        remove_file_real(j, f);
+                open_job_run(q->toplevel_fd, q->jobs + i);
+        }
 }
 
-static void remove_file_real(sd_journal *j, JournalFile *f) {
+static void open_jobs_run(sd_journal *j, OpenJob *jobs, size_t n_jobs) {
+        pthread_t threads[OPEN_WORKERS_MAX];
+        OpenQueue q = {
+                .toplevel_fd = j->toplevel_fd,
+                .jobs = jobs,
+                .n_jobs = n_jobs,
+        };
+        unsigned n_threads = 0, i;
+        sigset_t ss, saved_ss;
+
         assert(j);
-        assert(f);
+        assert(jobs || n_jobs == 0);
 
-        ordered_hashmap_remove(j->files, f->path);
+        /* Opens the files and reads their headers on a few threads, as on a cold cache this is mostly waiting
+         * for the disk. The main thread takes jobs too, and does all of them if threads cannot be started. The
+         * workers are started with all signals blocked, so that they do not affect signal handling. */
 
-        log_debug("File %s removed.", f->path);
+        if (n_jobs >= 2 * OPEN_JOBS_PER_WORKER &&
+            sigfillset(&ss) >= 0 &&
+            pthread_sigmask(SIG_BLOCK, &ss, &saved_ss) == 0) {
 
-        if (j->current_file == f) {
-                j->current_file = NULL;
-                j->current_field = 0;
-        }
+                while (n_threads < MIN(n_jobs / OPEN_JOBS_PER_WORKER - 1, OPEN_WORKERS_MAX)) {
+                        if (pthread_create(threads + n_threads, NULL, open_worker, &q) != 0)
+                                break;
 
-        if (j->unique_file == f) {
-                /* Jump to the next unique_file or NULL if that one was last */
-                j->unique_file = ordered_hashmap_next(j->files, j->unique_file->path);
-                j->unique_offset = 0;
-                if (!j->unique_file)
-                        j->unique_file_lost = true;
-        }
+                        n_threads++;
+                }
 
-        if (j->fields_file == f) {
-                j->fields_file = ordered_hashmap_next(j->files, j->fields_file->path);
-                j->fields_offset = 0;
-                if (!j->fields_file)
-                        j->fields_file_lost = true;
+                (void) pthread_sigmask(SIG_SETMASK, &saved_ss, NULL);
         }
 
-        (void) journal_file_close(f);
+        (void) open_worker(&q);
 
-        j->current_invalidate_counter++;
+        for (i = 0; i < n_threads; i++)
+                (void) pthread_join(threads[i], NULL);
 }
 
-static int dirname_is_machine_id(const char *fn) {
-        sd_id128_t id, machine;
+static bool header_is_archived(const Header *h, size_t size) {
+        assert(h);
+
+        return size >= offsetof(Header, n_data) &&
+                memcmp(h->signature, HEADER_SIGNATURE, 8) == 0 &&
+                h->state == STATE_ARCHIVED &&
+                le64toh(h->n_entries) > 0 &&
+                le64toh(h->head_entry_realtime) <= le64toh(h->tail_entry_realtime);
+}
+
+static int add_pending_file(sd_journal *j, const char *path, const Header *h) {
+        PendingFile *p;
         int r;
 
-        r = sd_id128_get_machine(&machine);
+        assert(j);
+        assert(path);
+        assert(h);
+
+        r = ordered_hashmap_ensure_allocated(&j->pending_files, &string_hash_ops);
         if (r < 0)
                 return r;
 
-        r = sd_id128_from_string(fn, &id);
-        if (r < 0)
+        p = new0(PendingFile, 1);
+        if (!p)
+                return -ENOMEM;
+
+        p->path = strdup(path);
+        if (!p->path) {
+                free(p);
+                return -ENOMEM;
+        }
+
+        p->head_realtime = le64toh(h->head_entry_realtime);
+        p->tail_realtime = le64toh(h->tail_entry_realtime);
+
+        r = ordered_hashmap_put(j->pending_files, p->path, p);
+        if (r < 0) {
+                free(p->path);
+                free(p);
                 return r;
+        }
 
-        return sd_id128_equal(id, machine);
+        /* Every location needs to be checked against the new file */
+        j->pending_down_usec = USEC_INFINITY;
+        j->pending_up_usec = 0;
+
+        note_file_path(j, p->path);
+
+        log_debug("File %s deferred.", p->path);
+
+        return 0;
 }
 
-static int add_directory(sd_journal *j, const char *prefix, const char *dirname) {
-        _cleanup_free_ char *path = NULL;
-        _cleanup_closedir_ DIR *d = NULL;
-        struct dirent *de = NULL;
-        Directory *m;
-        int r, k;
+static void pending_file_free(PendingFile *p) {
+        if (!p)
+                return;
+
+        free(p->path);
+        free(p);
+}
+
+static int add_files(sd_journal *j, char **paths) {
+        _cleanup_free_ OpenJob *jobs = NULL;
+        size_t n_jobs = 0, i;
+        char **p;
 
         assert(j);
-        assert(prefix);
 
-        /* Adds a journal file directory to watch. If the directory is already tracked this updates the inotify watch
-         * and reenumerates directory contents */
+        /* Adds the files found in a directory. They are opened in parallel, but added in the order in which
+         * they were found, as if one after the other. */
 
-        if (dirname)
-                path = strjoin(prefix, "/", dirname);
-        else
-                path = strdup(prefix);
-        if (!path) {
-                r = -ENOMEM;
-                goto fail;
+        jobs = new0(OpenJob, strv_length(paths));
+        if (!jobs)
+                return -ENOMEM;
+
+        STRV_FOREACH(p, paths) {
+                if (ordered_hashmap_get(j->files, *p) || ordered_hashmap_get(j->pending_files, *p))
+                        continue;
+
+                jobs[n_jobs++] = (OpenJob) {
+                        .path = *p,
+                        .fd = -1,
+                };
         }
 
-        log_debug("Considering directory %s.", path);
+        open_jobs_run(j, jobs, n_jobs);
 
-        /* We consider everything local that is in a directory for the local machine ID, or that is stored in /run */
-        if ((j->flags & SD_JOURNAL_LOCAL_ONLY) &&
-            !((dirname && dirname_is_machine_id(dirname) > 0) || path_has_prefix(j, path, "/run")))
-            return 0;
+        for (i = 0; i < n_jobs; i++) {
+                OpenJob *job = jobs + i;
+                int k;
 
+                if (job->error < 0) {
+                        log_debug_errno(job->error, "Failed to open journal file %s: %m", job->path);
 
-        if (j->toplevel_fd < 0)
-                d = opendir(path);
-        else
-                /* Open the specified directory relative to the toplevel fd. Enforce that the path specified is
-                 * relative, by dropping the initial slash */
-                d = xopendirat(j->toplevel_fd, skip_slash(path), 0);
-        if (!d) {
-                r = log_debug_errno(errno, "Failed to open directory %s: %m", path);
-                goto fail;
-        }
+                        k = journal_put_error(j, job->error, job->path);
+                        if (k < 0)
+                                goto fail;
 
-        m = hashmap_get(j->directories_by_path, path);
-        if (!m) {
-                m = new0(Directory, 1);
-                if (!m) {
-                        r = -ENOMEM;
-                        goto fail;
+                        continue;
                 }
 
-                m->is_root = false;
-                m->path = path;
+                if ((j->flags & JOURNAL_OPEN_LAZY) && header_is_archived(&job->header, job->header_size)) {
+                        job->fd = safe_close(job->fd);
 
-                if (hashmap_put(j->directories_by_path, m->path, m) < 0) {
-                        free(m);
-                        r = -ENOMEM;
-                        goto fail;
+                        k = add_pending_file(j, job->path, &job->header);
+                        if (k >= 0)
+                                continue;
+
+                        log_debug_errno(k, "Failed to defer journal file %s, opening it right away: %m", job->path);
                 }
 
-                path = NULL; /* avoid freeing in cleanup */
-                j->current_invalidate_counter++;
+                k = add_any_file(j, job->fd, true, job->path);
+                job->fd = -1;
+                if (k == -ENOMEM)
+                        goto fail;
+        }
 
-                log_debug("Directory %s added.", m->path);
+        return 0;
 
-        } else if (m->is_root)
-                return 0;
+fail:
+        for (; i < n_jobs; i++)
+                safe_close(jobs[i].fd);
+
+        return -ENOMEM;
+}
+
+static bool pending_file_wanted(PendingFile *p, direction_t direction, usec_t usec) {
+        assert(p);
+
+        if (usec == USEC_INFINITY)
+                return true;
+
+        return direction == DIRECTION_DOWN ? p->tail_realtime >= usec : p->head_realtime <= usec;
+}
+
+static int open_pending_files(sd_journal *j, direction_t direction, usec_t usec) {
+        PendingFile *p;
+        Iterator i;
+        int r;
+
+        assert(j);
+
+        /* Opens the deferred files which might have entries when iterating from usec in the given direction,
+         * or all of them if usec is USEC_INFINITY. Entries of different files are assumed to be ordered by
+         * their wallclock time, the same way sd_journal_seek_realtime_usec() works. */
+
+        if (ordered_hashmap_isempty(j->pending_files))
+                return 0;
+
+        if (usec != USEC_INFINITY &&
+            (direction == DIRECTION_DOWN ? usec >= j->pending_down_usec : usec <= j->pending_up_usec))
+                return 0;
+
+        ORDERED_HASHMAP_FOREACH(p, j->pending_files, i) {
+                if (!pending_file_wanted(p, direction, usec))
+                        continue;
+
+                (void) ordered_hashmap_remove(j->pending_files, p->path);
+
+                r = add_any_file(j, -1, false, p->path);
+                pending_file_free(p);
+                if (r == -ENOMEM)
+                        return r;
+        }
+
+        if (usec == USEC_INFINITY)
+                return 0;
+
+        if (direction == DIRECTION_DOWN)
+                j->pending_down_usec = usec;
+        else
+                j->pending_up_usec = usec;
+
+        return 0;
+}
+
+static int open_all_pending_files(sd_journal *j) {
+        return open_pending_files(j, DIRECTION_DOWN, USEC_INFINITY);
+}
+
+static int add_file(sd_journal *j, const char *prefix, const char *filename) {
+        const char *path;
+
+        assert(j);
+        assert(prefix);
+        assert(filename);
+
+        if (j->no_new_files)
+                return 0;
+
+        if (!file_type_wanted(j->flags, filename))
+                return 0;
+
+        path = strjoina(prefix, "/", filename);
+        return add_any_file(j, -1, false, path);
+}
+
+static int collect_file(sd_journal *j, const char *prefix, const char *filename, char ***paths) {
+        char *path;
+
+        assert(j);
+        assert(prefix);
+        assert(filename);
+        assert(paths);
+
+        if (j->no_new_files)
+                return 0;
+
+        if (!file_type_wanted(j->flags, filename))
+                return 0;
+
+        path = strjoin(prefix, "/", filename);
+        if (!path)
+                return -ENOMEM;
+
+        return strv_consume(paths, path);
+}
+
+static void remove_file(sd_journal *j, const char *prefix, const char *filename) {
+        const char *path;
+        JournalFile *f;
+
+        assert(j);
+        assert(prefix);
+        assert(filename);
+
+        path = strjoina(prefix, "/", filename);
+
+        pending_file_free(ordered_hashmap_remove(j->pending_files, path));
+
+        f = ordered_hashmap_get(j->files, path);
+        if (!f)
+                return;
+
+        remove_file_real(j, f);
+}
+
+static void remove_file_real(sd_journal *j, JournalFile *f) {
+        assert(j);
+        assert(f);
+
+        ordered_hashmap_remove(j->files, f->path);
+        remove_candidate(j, f);
+        set_remove(j->files_at_tail, f);
+
+        log_debug("File %s removed.", f->path);
+
+        if (j->current_file == f) {
+                j->current_file = NULL;
+                j->current_field = 0;
+        }
+
+        if (j->field_index_file == f)
+                j->field_index_file = NULL;
+
+        data_cache_flush(j, f);
+
+        if (j->unique_file == f) {
+                /* Jump to the next unique_file or NULL if that one was last */
+                j->unique_file = ordered_hashmap_next(j->files, j->unique_file->path);
+                j->unique_offset = 0;
+                if (!j->unique_file)
+                        j->unique_file_lost = true;
+        }
+
+        if (j->fields_file == f) {
+                j->fields_file = ordered_hashmap_next(j->files, j->fields_file->path);
+                j->fields_offset = 0;
+                if (!j->fields_file)
+                        j->fields_file_lost = true;
+        }
+
+        (void) journal_file_close(f);
+
+        j->current_invalidate_counter++;
+}
+
+static int dirname_is_machine_id(const char *fn) {
+        sd_id128_t id, machine;
+        int r;
+
+        r = sd_id128_get_machine(&machine);
+        if (r < 0)
+                return r;
+
+        r = sd_id128_from_string(fn, &id);
+        if (r < 0)
+                return r;
+
+        return sd_id128_equal(id, machine);
+}
+
+static int add_directory(sd_journal *j, const char *prefix, const char *dirname) {
+        _cleanup_strv_free_ char **files = NULL;
+        _cleanup_free_ char *path = NULL;
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de = NULL;
+        Directory *m;
+        int r, k;
+
+        assert(j);
+        assert(prefix);
+
+        /* Adds a journal file directory to watch. If the directory is already tracked this updates the inotify watch
+         * and reenumerates directory contents */
+
+        if (dirname)
+                path = strjoin(prefix, "/", dirname);
+        else
+                path = strdup(prefix);
+        if (!path) {
+                r = -ENOMEM;
+                goto fail;
+        }
+
+        log_debug("Considering directory %s.", path);
+
+        /* We consider everything local that is in a directory for the local machine ID, or that is stored in /run */
+        if ((j->flags & SD_JOURNAL_LOCAL_ONLY) &&
+            !((dirname && dirname_is_machine_id(dirname) > 0) || path_has_prefix(j, path, "/run")))
+            return 0;
+
+
+        if (j->toplevel_fd < 0)
+                d = opendir(path);
+        else
+                /* Open the specified directory relative to the toplevel fd. Enforce that the path specified is
+                 * relative, by dropping the initial slash */
+                d = xopendirat(j->toplevel_fd, skip_slash(path), 0);
+        if (!d) {
+                r = log_debug_errno(errno, "Failed to open directory %s: %m", path);
+                goto fail;
+        }
+
+        m = hashmap_get(j->directories_by_path, path);
+        if (!m) {
+                m = new0(Directory, 1);
+                if (!m) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                m->is_root = false;
+                m->path = path;
+
+                if (hashmap_put(j->directories_by_path, m->path, m) < 0) {
+                        free(m);
+                        r = -ENOMEM;
+                        goto fail;
+                }
+
+                path = NULL; /* avoid freeing in cleanup */
+                j->current_invalidate_counter++;
+
+                log_debug("Directory %s added.", m->path);
+
+        } else if (m->is_root)
+                return 0;
 
         if (m->wd <= 0 && j->inotify_fd >= 0) {
                 /* Watch this directory, if it not being watched yet. */
@@ -1488,10 +1935,15 @@ static int add_directory(sd_journal *j, const char *prefix, const char *dirname)
         FOREACH_DIRENT_ALL(de, d, r = log_debug_errno(errno, "Failed to read directory %s: %m", m->path); goto fail) {
 
                 if (dirent_is_file_with_suffix(de, ".journal") ||
-                    dirent_is_file_with_suffix(de, ".journal~"))
-                        (void) add_file(j, m->path, de->d_name);
+                    dirent_is_file_with_suffix(de, ".journal~")) {
+                        r = collect_file(j, m->path, de->d_name, &files);
+                        if (r < 0)
+                                goto fail;
+                }
         }
 
+        (void) add_files(j, files);
+
         check_network(j, dirfd(d));
 
         return 0;
@@ -1506,8 +1958,10 @@ fail:
 
 static int add_root_directory(sd_journal *j, const char *p, bool missing_ok) {
 
+        _cleanup_strv_free_ char **files = NULL, **dirs = NULL;
         _cleanup_closedir_ DIR *d = NULL;
         struct dirent *de;
+        char **dirname;
         Directory *m;
         int r, k;
 
@@ -1612,12 +2066,22 @@ static int add_root_directory(sd_journal *j, const char *p, bool missing_ok) {
 
                 if (dirent_is_file_with_suffix(de, ".journal") ||
                     dirent_is_file_with_suffix(de, ".journal~"))
-                        (void) add_file(j, m->path, de->d_name);
+                        r = collect_file(j, m->path, de->d_name, &files);
                 else if (IN_SET(de->d_type, DT_DIR, DT_LNK, DT_UNKNOWN) &&
                          sd_id128_from_string(de->d_name, &id) >= 0)
-                        (void) add_directory(j, m->path, de->d_name);
+                        r = strv_extend(&dirs, de->d_name);
+                else
+                        continue;
+                if (r < 0)
+                        goto fail;
         }
 
+        /* The files of the root directory come first, then those of the subdirectories */
+        (void) add_files(j, files);
+
+        STRV_FOREACH(dirname, dirs)
+                (void) add_directory(j, m->path, *dirname);
+
         check_network(j, dirfd(d));
 
         return 0;
@@ -1752,7 +2216,8 @@ fail:
 #define OPEN_ALLOWED_FLAGS                              \
         (SD_JOURNAL_LOCAL_ONLY |                        \
          SD_JOURNAL_RUNTIME_ONLY |                      \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER)
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         JOURNAL_OPEN_LAZY)
 
 _public_ int sd_journal_open(sd_journal **ret, int flags) {
         sd_journal *j;
@@ -1825,7 +2290,8 @@ fail:
 
 #define OPEN_DIRECTORY_ALLOWED_FLAGS                    \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         JOURNAL_OPEN_LAZY)
 
 _public_ int sd_journal_open_directory(sd_journal **ret, const char *path, int flags) {
         sd_journal *j;
@@ -1867,7 +2333,7 @@ _public_ int sd_journal_open_files(sd_journal **ret, const char **paths, int fla
                 return -ENOMEM;
 
         STRV_FOREACH(path, paths) {
-                r = add_any_file(j, -1, *path);
+                r = add_any_file(j, -1, false, *path);
                 if (r < 0)
                         goto fail;
         }
@@ -1884,7 +2350,8 @@ fail:
 
 #define OPEN_DIRECTORY_FD_ALLOWED_FLAGS         \
         (SD_JOURNAL_OS_ROOT |                           \
-         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER )
+         SD_JOURNAL_SYSTEM | SD_JOURNAL_CURRENT_USER |  \
+         JOURNAL_OPEN_LAZY)
 
 _public_ int sd_journal_open_directory_fd(sd_journal **ret, int fd, int flags) {
         sd_journal *j;
@@ -1955,7 +2422,7 @@ _public_ int sd_journal_open_files_fd(sd_journal **ret, int fds[], unsigned n_fd
                         goto fail;
                 }
 
-                r = add_any_file(j, fds[i], NULL);
+                r = add_any_file(j, fds[i], false, NULL);
                 if (r < 0)
                         goto fail;
         }
@@ -1985,6 +2452,12 @@ _public_ void sd_journal_close(sd_journal *j) {
         sd_journal_flush_matches(j);
 
         ordered_hashmap_free_with_destructor(j->files, journal_file_close);
+        ordered_hashmap_free_with_destructor(j->pending_files, pending_file_free);
+        prioq_free(j->candidates);
+        set_free(j->files_at_tail);
+        free(j->field_index);
+        free(j->field_index_names);
+        data_cache_free(j);
 
         while ((d = hashmap_first(j->directories_by_path)))
                 remove_directory(j, d);
@@ -1998,7 +2471,11 @@ _public_ void sd_journal_close(sd_journal *j) {
         safe_close(j->inotify_fd);
 
         if (j->mmap) {
-                log_debug("mmap cache statistics: %u hit, %u miss", mmap_cache_get_hit(j->mmap), mmap_cache_get_missed(j->mmap));
+                MMapCacheStats stats;
+
+                mmap_cache_get_stats(j->mmap, &stats);
+                log_debug("mmap cache statistics: %u hit, %u miss, %u evicted, %u sequential",
+                          stats.n_hit, stats.n_missed, stats.n_evicted, stats.n_sequential);
                 mmap_cache_unref(j->mmap);
         }
 
@@ -2100,38 +2577,184 @@ static bool field_is_valid(const char *field) {
         return true;
 }
 
-_public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **data, size_t *size) {
-        JournalFile *f;
-        uint64_t i, n;
-        size_t field_length;
+#if HAVE_XZ || HAVE_LZ4
+static int decompress_data(sd_journal *j, JournalFile *f, Object *o, uint64_t offset, int compression, uint64_t l,
+                           const void **data, size_t *size) {
+        DataCacheEntry *c, *oldest = NULL;
         int r;
-        Object *o;
 
-        assert_return(j, -EINVAL);
-        assert_return(!journal_pid_changed(j), -ECHILD);
-        assert_return(field, -EINVAL);
-        assert_return(data, -EINVAL);
-        assert_return(size, -EINVAL);
-        assert_return(field_is_valid(field), -EINVAL);
+        assert(j);
+        assert(f);
+        assert(o);
 
-        f = j->current_file;
-        if (!f)
-                return -EADDRNOTAVAIL;
+        for (c = j->data_cache; c < j->data_cache + ELEMENTSOF(j->data_cache); c++) {
+                if (c->file == f && c->offset == offset) {
+                        c->last_used = ++j->data_cache_clock;
 
-        if (f->current_offset <= 0)
-                return -EADDRNOTAVAIL;
+                        *data = c->data;
+                        *size = c->size;
 
-        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+                        return 0;
+                }
+
+                if (!oldest || c->last_used < oldest->last_used)
+                        oldest = c;
+        }
+
+        c = oldest;
+        c->file = NULL;
+        c->last_used = 0;
+
+        r = decompress_blob(compression,
+                            o->data.payload, l, &c->data,
+                            &c->allocated, &c->size, j->data_threshold);
         if (r < 0)
                 return r;
 
-        field_length = strlen(field);
+        c->file = f;
+        c->offset = offset;
+        c->last_used = ++j->data_cache_clock;
+
+        *data = c->data;
+        *size = c->size;
+
+        return 0;
+}
+#endif
+
+static void data_cache_flush(sd_journal *j, JournalFile *f) {
+        DataCacheEntry *c;
+
+        assert(j);
+
+        /* Forgets the objects of f, or all of them, but keeps the buffers for reuse */
+        for (c = j->data_cache; c < j->data_cache + ELEMENTSOF(j->data_cache); c++)
+                if (!f || c->file == f) {
+                        c->file = NULL;
+                        c->last_used = 0;
+                }
+}
+
+static void data_cache_free(sd_journal *j) {
+        DataCacheEntry *c;
+
+        assert(j);
+
+        for (c = j->data_cache; c < j->data_cache + ELEMENTSOF(j->data_cache); c++) {
+                c->file = NULL;
+                c->data = mfree(c->data);
+                c->allocated = 0;
+        }
+}
+
+static int return_data(sd_journal *j, JournalFile *f, Object *o, uint64_t offset, const void **data, size_t *size) {
+        size_t t;
+        uint64_t l;
+        int compression;
+
+        l = le64toh(o->object.size) - offsetof(Object, data.payload);
+        t = (size_t) l;
+
+        /* We can't read objects larger than 4G on a 32bit machine */
+        if ((uint64_t) t != l)
+                return -E2BIG;
+
+        compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+        if (compression) {
+#if HAVE_XZ || HAVE_LZ4
+                return decompress_data(j, f, o, offset, compression, l, data, size);
+#else
+                return -EPROTONOSUPPORT;
+#endif
+        } else {
+                *data = o->data.payload;
+                *size = t;
+        }
+
+        return 0;
+}
+
+/* Field names are looked for in this many bytes of the data objects. Longer ones are valid, but journald does
+ * not generate them, hence entries with such fields are scanned instead. */
+#define FIELD_INDEX_NAME_MAX 64U
+
+static int field_index_compare(const void *a, const void *b) {
+        const FieldIndexEntry *x = a, *y = b;
+
+        if (x->hash < y->hash)
+                return -1;
+        if (x->hash > y->hash)
+                return 1;
+
+        /* Return the first of several fields with the same name, like a scan would */
+        if (x->item < y->item)
+                return -1;
+        if (x->item > y->item)
+                return 1;
+
+        return 0;
+}
+
+static int field_index_add(sd_journal *j, uint64_t item, const void *payload, uint64_t size) {
+        const char *eq;
+        size_t k;
+
+        assert(j);
+        assert(payload);
+
+        eq = memchr(payload, '=', MIN(size, (uint64_t) FIELD_INDEX_NAME_MAX + 1));
+        if (!eq) {
+                if (size > FIELD_INDEX_NAME_MAX)
+                        j->field_index_complete = false;
+
+                return 0;
+        }
+
+        k = eq - (const char*) payload;
+        if (k == 0)
+                return 0;
+
+        if (!GREEDY_REALLOC(j->field_index, j->field_index_allocated, j->n_field_index + 1))
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(j->field_index_names, j->field_index_names_allocated, j->field_index_names_size + k))
+                return -ENOMEM;
+
+        memcpy(j->field_index_names + j->field_index_names_size, payload, k);
+
+        j->field_index[j->n_field_index++] = (FieldIndexEntry) {
+                .hash = hash64(payload, k),
+                .item = item,
+                .name_offset = j->field_index_names_size,
+                .name_length = k,
+        };
+
+        j->field_index_names_size += k;
+
+        return 0;
+}
+
+static int build_field_index(sd_journal *j, JournalFile *f) {
+        uint64_t i, n;
+        Object *o;
+        int r;
+
+        assert(j);
+        assert(f);
+
+        j->field_index_file = NULL;
+        j->n_field_index = 0;
+        j->field_index_names_size = 0;
+        j->field_index_complete = true;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+        if (r < 0)
+                return r;
 
         n = journal_file_entry_n_items(o);
         for (i = 0; i < n; i++) {
                 uint64_t p, l;
                 le64_t le_hash;
-                size_t t;
                 int compression;
 
                 p = le64toh(o->entry.items[i].object_offset);
@@ -2148,46 +2771,122 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
                 compression = o->object.flags & OBJECT_COMPRESSION_MASK;
                 if (compression) {
 #if HAVE_XZ || HAVE_LZ4
-                        r = decompress_startswith(compression,
-                                                  o->data.payload, l,
-                                                  &f->compress_buffer, &f->compress_buffer_size,
-                                                  field, field_length, '=');
+                        size_t rsize;
+
+                        /* Only the field name is needed here, the payload is decompressed when asked for */
+                        r = decompress_blob(compression,
+                                            o->data.payload, l,
+                                            &f->compress_buffer, &f->compress_buffer_size, &rsize,
+                                            FIELD_INDEX_NAME_MAX + 1);
                         if (r < 0)
                                 log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
                                                 object_compressed_to_string(compression), l, p);
-                        else if (r > 0) {
-
-                                size_t rsize;
-
-                                r = decompress_blob(compression,
-                                                    o->data.payload, l,
-                                                    &f->compress_buffer, &f->compress_buffer_size, &rsize,
-                                                    j->data_threshold);
+                        else {
+                                r = field_index_add(j, i, f->compress_buffer, rsize);
                                 if (r < 0)
                                         return r;
-
-                                *data = f->compress_buffer;
-                                *size = (size_t) rsize;
-
-                                return 0;
                         }
 #else
                         return -EPROTONOSUPPORT;
 #endif
-                } else if (l >= field_length+1 &&
-                           memcmp(o->data.payload, field, field_length) == 0 &&
-                           o->data.payload[field_length] == '=') {
+                } else {
+                        r = field_index_add(j, i, o->data.payload, l);
+                        if (r < 0)
+                                return r;
+                }
 
-                        t = (size_t) l;
+                r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+                if (r < 0)
+                        return r;
+        }
 
-                        if ((uint64_t) t != l)
-                                return -E2BIG;
+        qsort_safe(j->field_index, j->n_field_index, sizeof(FieldIndexEntry), field_index_compare);
 
-                        *data = o->data.payload;
-                        *size = t;
+        j->field_index_file = f;
+        j->field_index_offset = f->current_offset;
 
-                        return 0;
+        return 0;
+}
+
+static bool field_index_find(sd_journal *j, const char *field, size_t field_length, uint64_t *ret) {
+        size_t lower = 0, upper;
+        uint64_t hash;
+
+        assert(j);
+        assert(field);
+        assert(ret);
+
+        hash = hash64(field, field_length);
+
+        upper = j->n_field_index;
+        while (lower < upper) {
+                size_t middle = lower + (upper - lower) / 2;
+
+                if (j->field_index[middle].hash < hash)
+                        lower = middle + 1;
+                else
+                        upper = middle;
+        }
+
+        for (; lower < j->n_field_index && j->field_index[lower].hash == hash; lower++) {
+                FieldIndexEntry *e = j->field_index + lower;
+
+                if (e->name_length == field_length &&
+                    memcmp(j->field_index_names + e->name_offset, field, field_length) == 0) {
+                        *ret = e->item;
+                        return true;
                 }
+        }
+
+        return false;
+}
+
+static int get_data_by_scan(sd_journal *j, JournalFile *f, const char *field, size_t field_length,
+                            const void **data, size_t *size) {
+        uint64_t i, n;
+        Object *o;
+        int r;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+        if (r < 0)
+                return r;
+
+        n = journal_file_entry_n_items(o);
+        for (i = 0; i < n; i++) {
+                uint64_t p, l;
+                le64_t le_hash;
+                int compression;
+
+                p = le64toh(o->entry.items[i].object_offset);
+                le_hash = o->entry.items[i].hash;
+                r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+                if (r < 0)
+                        return r;
+
+                if (le_hash != o->data.hash)
+                        return -EBADMSG;
+
+                l = le64toh(o->object.size) - offsetof(Object, data.payload);
+
+                compression = o->object.flags & OBJECT_COMPRESSION_MASK;
+                if (compression) {
+#if HAVE_XZ || HAVE_LZ4
+                        r = decompress_startswith(compression,
+                                                  o->data.payload, l,
+                                                  &f->compress_buffer, &f->compress_buffer_size,
+                                                  field, field_length, '=');
+                        if (r < 0)
+                                log_debug_errno(r, "Cannot decompress %s object of length %"PRIu64" at offset "OFSfmt": %m",
+                                                object_compressed_to_string(compression), l, p);
+                        else if (r > 0)
+                                return return_data(j, f, o, p, data, size);
+#else
+                        return -EPROTONOSUPPORT;
+#endif
+                } else if (l >= field_length+1 &&
+                           memcmp(o->data.payload, field, field_length) == 0 &&
+                           o->data.payload[field_length] == '=')
+                        return return_data(j, f, o, p, data, size);
 
                 r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
                 if (r < 0)
@@ -2197,41 +2896,53 @@ _public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **
         return -ENOENT;
 }
 
-static int return_data(sd_journal *j, JournalFile *f, Object *o, const void **data, size_t *size) {
-        size_t t;
-        uint64_t l;
-        int compression;
+_public_ int sd_journal_get_data(sd_journal *j, const char *field, const void **data, size_t *size) {
+        JournalFile *f;
+        uint64_t i, p;
+        size_t field_length;
+        int r;
+        Object *o;
 
-        l = le64toh(o->object.size) - offsetof(Object, data.payload);
-        t = (size_t) l;
+        assert_return(j, -EINVAL);
+        assert_return(!journal_pid_changed(j), -ECHILD);
+        assert_return(field, -EINVAL);
+        assert_return(data, -EINVAL);
+        assert_return(size, -EINVAL);
+        assert_return(field_is_valid(field), -EINVAL);
 
-        /* We can't read objects larger than 4G on a 32bit machine */
-        if ((uint64_t) t != l)
-                return -E2BIG;
+        f = j->current_file;
+        if (!f)
+                return -EADDRNOTAVAIL;
 
-        compression = o->object.flags & OBJECT_COMPRESSION_MASK;
-        if (compression) {
-#if HAVE_XZ || HAVE_LZ4
-                size_t rsize;
-                int r;
+        if (f->current_offset <= 0)
+                return -EADDRNOTAVAIL;
 
-                r = decompress_blob(compression,
-                                    o->data.payload, l, &f->compress_buffer,
-                                    &f->compress_buffer_size, &rsize, j->data_threshold);
-                if (r < 0)
-                        return r;
+        field_length = strlen(field);
 
-                *data = f->compress_buffer;
-                *size = (size_t) rsize;
-#else
-                return -EPROTONOSUPPORT;
-#endif
-        } else {
-                *data = o->data.payload;
-                *size = t;
+        /* Callers usually ask for several fields of an entry, hence index them all on the first call */
+        if (j->field_index_file != f || j->field_index_offset != f->current_offset) {
+                r = build_field_index(j, f);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to index fields of entry at offset "OFSfmt" of %s, scanning them instead: %m",
+                                        f->current_offset, f->path);
         }
 
-        return 0;
+        if (j->field_index_file != f || !j->field_index_complete)
+                return get_data_by_scan(j, f, field, field_length, data, size);
+
+        if (!field_index_find(j, field, field_length, &i))
+                return -ENOENT;
+
+        r = journal_file_move_to_object(f, OBJECT_ENTRY, f->current_offset, &o);
+        if (r < 0)
+                return r;
+
+        p = le64toh(o->entry.items[i].object_offset);
+        r = journal_file_move_to_object(f, OBJECT_DATA, p, &o);
+        if (r < 0)
+                return r;
+
+        return return_data(j, f, o, p, data, size);
 }
 
 _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t *size) {
@@ -2270,7 +2981,7 @@ _public_ int sd_journal_enumerate_data(sd_journal *j, const void **data, size_t
         if (le_hash != o->data.hash)
                 return -EBADMSG;
 
-        r = return_data(j, f, o, data, size);
+        r = return_data(j, f, o, p, data, size);
         if (r < 0)
                 return r;
 
@@ -2493,6 +3204,7 @@ _public_ int sd_journal_wait(sd_journal *j, uint64_t timeout_usec) {
 _public_ int sd_journal_get_cutoff_realtime_usec(sd_journal *j, uint64_t *from, uint64_t *to) {
         Iterator i;
         JournalFile *f;
+        PendingFile *p;
         bool first = true;
         uint64_t fmin = 0, tmax = 0;
         int r;
@@ -2523,6 +3235,18 @@ _public_ int sd_journal_get_cutoff_realtime_usec(sd_journal *j, uint64_t *from,
                 }
         }
 
+        /* The range of the deferred files is known from their header already */
+        ORDERED_HASHMAP_FOREACH(p, j->pending_files, i) {
+                if (first) {
+                        fmin = p->head_realtime;
+                        tmax = p->tail_realtime;
+                        first = false;
+                } else {
+                        fmin = MIN(p->head_realtime, fmin);
+                        tmax = MAX(p->tail_realtime, tmax);
+                }
+        }
+
         if (from)
                 *from = fmin;
         if (to)
@@ -2542,6 +3266,10 @@ _public_ int sd_journal_get_cutoff_monotonic_usec(sd_journal *j, sd_id128_t boot
         assert_return(from || to, -EINVAL);
         assert_return(from != to, -EINVAL);
 
+        r = open_all_pending_files(j);
+        if (r < 0)
+                return r;
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 usec_t fr, t;
 
@@ -2577,6 +3305,8 @@ void journal_print_header(sd_journal *j) {
 
         assert(j);
 
+        (void) open_all_pending_files(j);
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 if (newline)
                         putchar('\n');
@@ -2591,11 +3321,16 @@ _public_ int sd_journal_get_usage(sd_journal *j, uint64_t *bytes) {
         Iterator i;
         JournalFile *f;
         uint64_t sum = 0;
+        int r;
 
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
         assert_return(bytes, -EINVAL);
 
+        r = open_all_pending_files(j);
+        if (r < 0)
+                return r;
+
         ORDERED_HASHMAP_FOREACH(f, j->files, i) {
                 struct stat st;
 
@@ -2642,9 +3377,15 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
         k = strlen(j->unique_field);
 
         if (!j->unique_file) {
+                int r;
+
                 if (j->unique_file_lost)
                         return 0;
 
+                r = open_all_pending_files(j);
+                if (r < 0)
+                        return r;
+
                 j->unique_file = ordered_hashmap_first(j->files);
                 if (!j->unique_file)
                         return 0;
@@ -2700,7 +3441,7 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                         return -EBADMSG;
                 }
 
-                r = return_data(j, j->unique_file, o, &odata, &ol);
+                r = return_data(j, j->unique_file, o, j->unique_offset, &odata, &ol);
                 if (r < 0)
                         return r;
 
@@ -2743,7 +3484,7 @@ _public_ int sd_journal_enumerate_unique(sd_journal *j, const void **data, size_
                 if (found)
                         continue;
 
-                r = return_data(j, j->unique_file, o, data, l);
+                r = return_data(j, j->unique_file, o, j->unique_offset, data, l);
                 if (r < 0)
                         return r;
 
@@ -2771,6 +3512,10 @@ _public_ int sd_journal_enumerate_fields(sd_journal *j, const char **field) {
                 if (j->fields_file_lost)
                         return 0;
 
+                r = open_all_pending_files(j);
+                if (r < 0)
+                        return r;
+
                 j->fields_file = ordered_hashmap_first(j->files);
                 if (!j->fields_file)
                         return 0;
@@ -2980,6 +3725,10 @@ _public_ int sd_journal_set_data_threshold(sd_journal *j, size_t sz) {
         assert_return(j, -EINVAL);
         assert_return(!journal_pid_changed(j), -ECHILD);
 
+        /* Cached objects might have been truncated differently */
+        if (sz != j->data_threshold)
+                data_cache_flush(j, NULL);
+
         j->data_threshold = sz;
         return 0;
 }
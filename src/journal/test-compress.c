@@ -245,15 +245,44 @@ static void test_lz4_decompress_partial(void) {
         assert_se(r >= 0);
         log_info("Decompressed partial %i/%i → %i", 12, HUGE_SIZE, r);
 
-        /* We expect this to fail, because that's how current lz4 works. If this
-         * call succeeds, then lz4 has been fixed, and we need to change our code.
-         */
         r = LZ4_decompress_safe_partial(buf, huge,
                                         compressed,
                                         12, HUGE_SIZE-1);
+#if LZ4_VERSION_NUMBER >= 10803
+        /* Since 1.8.3 lz4 stops once the target size is reached, which
+         * decompress_blob_lz4() relies on to decompress prefixes only. */
+        assert_se(r >= 12);
+#else
+        /* We expect this to fail, because that's how older lz4 works,
+         * and decompress_blob_lz4() falls back to full decompression. */
         assert_se(r < 0);
+#endif
         log_info("Decompressed partial %i/%i → %i", 12, HUGE_SIZE-1, r);
 }
+
+static void test_lz4_decompress_blob_max(const char *data, size_t data_len) {
+        _cleanup_free_ char *compressed = NULL, *decompressed = NULL;
+        size_t csize, usize = 0, size;
+
+        log_info("/* testing LZ4 blob decompression of a prefix */");
+
+        compressed = malloc(data_len);
+        assert_se(compressed);
+        assert_se(compress_blob_lz4(data, data_len, compressed, data_len, &csize) == 0);
+
+        /* Like when looking for the field name only */
+        assert_se(decompress_blob_lz4(compressed, csize, (void **) &decompressed, &usize, &size, 65) == 0);
+        assert_se(size == 65);
+        assert_se(memcmp(decompressed, data, size) == 0);
+#if LZ4_VERSION_NUMBER >= 10803
+        /* Older versions fall back to decompressing everything */
+        assert_se(usize < data_len);
+#endif
+
+        assert_se(decompress_blob_lz4(compressed, csize, (void **) &decompressed, &usize, &size, 0) == 0);
+        assert_se(size == data_len);
+        assert_se(memcmp(decompressed, data, size) == 0);
+}
 #endif
 
 int main(int argc, char *argv[]) {
@@ -318,6 +347,7 @@ int main(int argc, char *argv[]) {
                              compress_stream_lz4, decompress_stream_lz4, srcfile);
 
         test_lz4_decompress_partial();
+        test_lz4_decompress_blob_max(huge, sizeof(huge));
 #else
         log_info("/* LZ4 test skipped */");
 #endif
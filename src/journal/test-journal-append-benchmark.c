@@ -0,0 +1,218 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Writes entries with the fields journald adds to every message, from a few services, one at a time with
+ * journal_file_append_entry() and in batches with journal_file_append_entries(), and reports how many
+ * entries per second each way manages. Changes are posted on a timer, like journald does, so that both ways
+ * only differ in how entries are added. Both files must end up with the same entries. */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "log.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+#define N_FIELDS 12
+
+static unsigned arg_entries;
+static unsigned arg_batch = 64;
+
+static const char* const units[] = {
+        "systemd-logind.service",
+        "NetworkManager.service",
+        "sshd.service",
+        "cron.service",
+        "dbus.service",
+        "user@1000.service",
+};
+
+typedef struct Entry {
+        char buf[N_FIELDS][LINE_MAX];
+        struct iovec iovec[N_FIELDS];
+} Entry;
+
+static void make_entry(Entry *e, unsigned i) {
+        unsigned u = i % ELEMENTSOF(units), n = 0;
+
+        xsprintf(e->buf[n++], "MESSAGE=Processing request %u from client %u", i, i * 7919 % 1000);
+        xsprintf(e->buf[n++], "PRIORITY=%u", 6 - (i % 17 == 0));
+        xsprintf(e->buf[n++], "SYSLOG_IDENTIFIER=%.*s", (int) strcspn(units[u], ".@"), units[u]);
+        xsprintf(e->buf[n++], "_PID=%u", 100 + u);
+        xsprintf(e->buf[n++], "_UID=%u", u == 5 ? 1000 : 0);
+        xsprintf(e->buf[n++], "_COMM=%.*s", (int) strcspn(units[u], ".@"), units[u]);
+        xsprintf(e->buf[n++], "_SYSTEMD_UNIT=%s", units[u]);
+        xsprintf(e->buf[n++], "_SYSTEMD_CGROUP=/system.slice/%s", units[u]);
+        xsprintf(e->buf[n++], "_TRANSPORT=%s", i % 3 == 0 ? "journal" : "stdout");
+        xsprintf(e->buf[n++], "_HOSTNAME=%s", "localhost");
+        xsprintf(e->buf[n++], "_BOOT_ID=%s", "4e1b5e0cd7a5410e8fa5a04ac4c0e6a2");
+        xsprintf(e->buf[n++], "_MACHINE_ID=%s", "8d5bb0b01e2c4b0d9e6bd8b4c6a1f6d0");
+
+        assert_se(n == N_FIELDS);
+
+        for (n = 0; n < N_FIELDS; n++)
+                e->iovec[n] = IOVEC_MAKE_STRING(e->buf[n]);
+}
+
+static usec_t write_journal(const char *fn, bool batched) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_free_ JournalAppendEntry *batch = NULL;
+        _cleanup_free_ Entry *entries = NULL;
+        dual_timestamp ts = {
+                .realtime = 1500000000 * USEC_PER_SEC,
+                .monotonic = USEC_PER_SEC,
+        };
+        JournalMetrics metrics;
+        JournalFile *f;
+        usec_t t, total = 0;
+        unsigned i, k;
+
+        /* The hash tables are sized for files this large, as journald would */
+        journal_reset_metrics(&metrics);
+        metrics.max_size = 1024ULL * 1024ULL * 1024ULL;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(journal_file_open(-1, fn, O_RDWR|O_CREAT, 0644, false, false, &metrics, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_enable_post_change_timer(f, e, USEC_PER_SEC) >= 0);
+
+        entries = new(Entry, arg_batch);
+        batch = new(JournalAppendEntry, arg_batch);
+        assert_se(entries && batch);
+
+        for (i = 0; i < arg_entries; i += k) {
+                unsigned n = MIN(arg_batch, arg_entries - i);
+
+                /* Only the writing is measured */
+                for (k = 0; k < n; k++) {
+                        make_entry(entries + k, i + k);
+
+                        ts.realtime++;
+                        ts.monotonic++;
+
+                        batch[k] = (JournalAppendEntry) {
+                                .ts = ts,
+                                .iovec = entries[k].iovec,
+                                .n_iovec = N_FIELDS,
+                        };
+                }
+
+                t = now(CLOCK_MONOTONIC);
+
+                if (batched) {
+                        unsigned appended;
+
+                        assert_se(journal_file_append_entries(f, batch, n, NULL, &appended) == 0);
+                        assert_se(appended == n);
+                } else
+                        for (k = 0; k < n; k++)
+                                assert_se(journal_file_append_entry(f, &batch[k].ts, batch[k].iovec, batch[k].n_iovec, NULL, NULL, NULL) == 0);
+
+                total += now(CLOCK_MONOTONIC) - t;
+        }
+
+        assert_se(le64toh(f->header->n_entries) == arg_entries);
+
+        (void) journal_file_close(f);
+
+        return total;
+}
+
+static void report(const char *what, usec_t t) {
+        char a[FORMAT_TIMESPAN_MAX];
+
+        log_info("%s: %u entries in %s, %.0f entries/s",
+                 what, arg_entries, format_timespan(a, sizeof(a), t, 1),
+                 t > 0 ? (double) arg_entries * USEC_PER_SEC / t : 0.0);
+}
+
+static void compare_files(const char *a, const char *b) {
+        JournalFile *f, *g;
+        Object *o;
+        uint64_t p = 0, q = 0;
+        unsigned n = 0;
+
+        assert_se(journal_file_open(-1, a, O_RDONLY, 0, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(journal_file_open(-1, b, O_RDONLY, 0, false, false, NULL, NULL, NULL, NULL, &g) == 0);
+
+        /* The files are written the same way, hence objects end up at the same offsets */
+        for (;;) {
+                uint64_t xor_hash;
+                int r, s;
+
+                r = journal_file_next_entry(f, p, DIRECTION_DOWN, &o, &p);
+                assert_se(r >= 0);
+                xor_hash = r > 0 ? le64toh(o->entry.xor_hash) : 0;
+
+                s = journal_file_next_entry(g, q, DIRECTION_DOWN, &o, &q);
+                assert_se(s == r);
+                if (r == 0)
+                        break;
+
+                assert_se(p == q);
+                assert_se(le64toh(o->entry.xor_hash) == xor_hash);
+                n++;
+        }
+
+        assert_se(n == arg_entries);
+        assert_se(le64toh(f->header->n_data) == le64toh(g->header->n_data));
+        assert_se(le64toh(f->header->tail_object_offset) == le64toh(g->header->tail_object_offset));
+
+        (void) journal_file_close(f);
+        (void) journal_file_close(g);
+}
+
+int main(int argc, char *argv[]) {
+        char t[] = "/tmp/journal-append-XXXXXX";
+
+        test_setup_logging(LOG_INFO);
+
+        /* journal_file_open requires a valid machine id */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return EXIT_TEST_SKIP;
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_entries) >= 0);
+        else
+                arg_entries = slow_tests_enabled() ? 1000000 : 50000;
+
+        if (argc >= 3)
+                assert_se(safe_atou(argv[2], &arg_batch) >= 0 && arg_batch > 0);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        report("one by one", write_journal("single.journal", false));
+        report("batched", write_journal("batched.journal", true));
+
+        compare_files("single.journal", "batched.journal");
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return 0;
+}
@@ -20,16 +20,20 @@
 ***/
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "sd-journal.h"
 
 #include "alloc-util.h"
+#include "fs-util.h"
 #include "journal-file.h"
 #include "journal-vacuum.h"
 #include "log.h"
 #include "parse-util.h"
 #include "rm-rf.h"
+#include "string-util.h"
+#include "strv.h"
 #include "util.h"
 
 /* This program tests skipping around in a multi-file journal.
@@ -289,6 +293,308 @@ static void test_sequence_numbers(void) {
         }
 }
 
+/* The entries of the journal files in the order sd_journal_next() used to return them, before it kept the files
+ * in a priority queue: for every entry, the next entry of each file is looked at, and the first one wins. */
+static size_t linear_scan(char **paths, usec_t **ret_realtime, char ***ret_path) {
+        _cleanup_free_ usec_t *realtime = NULL;
+        _cleanup_strv_free_ char **path = NULL;
+        size_t n_files, n = 0, allocated = 0, allocated_path = 0, i;
+        JournalFile **f;
+        uint64_t *p;
+
+        n_files = strv_length(paths);
+        f = newa(JournalFile*, n_files);
+        p = newa0(uint64_t, n_files);
+
+        for (i = 0; i < n_files; i++)
+                assert_ret(journal_file_open(-1, paths[i], O_RDONLY, 0, false, false, NULL, NULL, NULL, NULL, &f[i]));
+
+        for (;;) {
+                JournalFile *best = NULL;
+                uint64_t best_offset = 0;
+                usec_t best_realtime = 0;
+                size_t best_i = 0;
+
+                for (i = 0; i < n_files; i++) {
+                        uint64_t offset;
+                        Object *o;
+                        int r;
+
+                        r = journal_file_next_entry(f[i], p[i], DIRECTION_DOWN, &o, &offset);
+                        assert_ret(r);
+                        if (r == 0)
+                                continue;
+
+                        journal_file_save_location(f[i], o, offset);
+                        if (!best || journal_file_compare_locations(f[i], best) < 0) {
+                                best = f[i];
+                                best_i = i;
+                                best_offset = offset;
+                                best_realtime = le64toh(o->entry.realtime);
+                        }
+                }
+
+                if (!best)
+                        break;
+
+                p[best_i] = best_offset;
+
+                assert_se(GREEDY_REALLOC(realtime, allocated, n + 1));
+                assert_se(GREEDY_REALLOC0(path, allocated_path, n + 2));
+                realtime[n] = best_realtime;
+                assert_se(path[n] = strdup(paths[best_i]));
+                n++;
+        }
+
+        for (i = 0; i < n_files; i++)
+                test_close(f[i]);
+
+        *ret_realtime = realtime;
+        realtime = NULL;
+        if (ret_path) {
+                *ret_path = path;
+                path = NULL;
+        }
+
+        return n;
+}
+
+static char **journal_files_in_cwd(void) {
+        _cleanup_strv_free_ char **files = NULL;
+        char **l = NULL, **i;
+
+        assert_ret(get_files_in_directory(".", &files));
+
+        STRV_FOREACH(i, files)
+                if (endswith(*i, ".journal"))
+                        assert_se(strv_extend(&l, *i) >= 0);
+
+        strv_sort(l);
+
+        return l;
+}
+
+static void test_check_realtime(sd_journal *j, usec_t expected) {
+        usec_t t;
+
+        assert_ret(sd_journal_get_realtime_usec(j, &t));
+        assert_se(t == expected);
+}
+
+/* Walks several interleaved files up and down, seeking around, and compares with the linear scan */
+static void test_candidates(void) {
+        char t[] = "/tmp/journal-candidates-XXXXXX";
+        _cleanup_strv_free_ char **paths = NULL, **cursors = NULL;
+        _cleanup_free_ usec_t *expected = NULL;
+        uint64_t seqnum[2] = {};
+        JournalFile *f[4];
+        size_t n, pos, i;
+        sd_journal *j;
+        int r;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        /* two pairs of files share their sequence numbers, the pairs are ordered by time */
+        f[0] = test_open("a.journal");
+        assert_ret(journal_file_open(-1, "b.journal", O_RDWR|O_CREAT, 0644, true, false, NULL, NULL, NULL, f[0], &f[1]));
+        f[2] = test_open("c.journal");
+        assert_ret(journal_file_open(-1, "d.journal", O_RDWR|O_CREAT, 0644, true, false, NULL, NULL, NULL, f[2], &f[3]));
+
+        /* like journald, each pair counts its entries together */
+        srand(4711);
+        for (i = 1; i <= 400; i++) {
+                unsigned k = rand() % ELEMENTSOF(f);
+
+                append_number(f[k], i, &seqnum[k / 2]);
+        }
+
+        for (i = 0; i < ELEMENTSOF(f); i++)
+                test_close(f[i]);
+
+        paths = journal_files_in_cwd();
+        assert_se(strv_length(paths) == ELEMENTSOF(f));
+        n = linear_scan(paths, &expected, NULL);
+        assert_se(n == 400);
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+
+        assert_ret(sd_journal_seek_head(j));
+        for (i = 0; i < n; i++) {
+                char *c;
+
+                assert_se(sd_journal_next(j) == 1);
+                test_check_realtime(j, expected[i]);
+
+                assert_ret(sd_journal_get_cursor(j, &c));
+                assert_se(strv_consume(&cursors, c) >= 0);
+        }
+        assert_se(sd_journal_next(j) == 0);
+
+        assert_ret(sd_journal_seek_tail(j));
+        for (i = n; i > 0; i--) {
+                assert_se(sd_journal_previous(j) == 1);
+                test_check_realtime(j, expected[i - 1]);
+        }
+        assert_se(sd_journal_previous(j) == 0);
+        pos = 0;
+
+        for (i = 0; i < 4000; i++) {
+                size_t m;
+
+                switch (rand() % 16) {
+
+                case 0 ... 5:
+                        r = sd_journal_next(j);
+                        assert_se(r == (pos + 1 < n));
+                        pos += r;
+                        break;
+
+                case 6 ... 11:
+                        r = sd_journal_previous(j);
+                        assert_se(r == (pos > 0));
+                        pos -= r;
+                        break;
+
+                case 12:
+                        assert_ret(sd_journal_seek_head(j));
+                        assert_se(sd_journal_next(j) == 1);
+                        pos = 0;
+                        break;
+
+                case 13:
+                        assert_ret(sd_journal_seek_tail(j));
+                        assert_se(sd_journal_previous(j) == 1);
+                        pos = n - 1;
+                        break;
+
+                case 14:
+                        m = rand() % n;
+                        assert_ret(sd_journal_seek_realtime_usec(j, expected[m]));
+                        assert_se(sd_journal_next(j) == 1);
+                        pos = m;
+                        break;
+
+                case 15:
+                        m = rand() % n;
+                        assert_ret(sd_journal_seek_cursor(j, cursors[m]));
+                        assert_se((rand() % 2 ? sd_journal_next(j) : sd_journal_previous(j)) == 1);
+                        assert_se(sd_journal_test_cursor(j, cursors[m]) > 0);
+                        pos = m;
+                        break;
+                }
+
+                test_check_realtime(j, expected[pos]);
+        }
+
+        sd_journal_close(j);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
+static void read_all(sd_journal *j, usec_t **returned, size_t *n, size_t *allocated) {
+        int r;
+
+        while ((r = sd_journal_next(j)) > 0) {
+                assert_se(GREEDY_REALLOC(*returned, *allocated, *n + 1));
+                assert_ret(sd_journal_get_realtime_usec(j, *returned + *n));
+                (*n)++;
+        }
+        assert_ret(r);
+}
+
+/* Files which grow, get rotated and get removed while they are being iterated */
+static void test_candidates_rotate(void) {
+        char t[] = "/tmp/journal-candidates-rotate-XXXXXX";
+        _cleanup_strv_free_ char **paths = NULL, **expected_path = NULL;
+        _cleanup_free_ usec_t *returned = NULL, *expected = NULL;
+        size_t n = 0, allocated = 0, n_expected, i, k;
+        char buf[SD_ID128_STRING_MAX];
+        JournalFile *system, *user;
+        const char *archived = NULL, *machine;
+        uint64_t seqnum = 0;
+        sd_id128_t id;
+        char **p;
+        sd_journal *j;
+        int number = 0;
+
+        assert_se(mkdtemp(t));
+
+        /* as written by journald, only subdirectories are watched for renamed files */
+        assert_ret(sd_id128_randomize(&id));
+        machine = strjoina(t, "/", sd_id128_to_string(id, buf));
+        assert_se(mkdir(machine, 0755) >= 0);
+        assert_se(chdir(machine) >= 0);
+
+        system = test_open("system.journal");
+        assert_ret(journal_file_open(-1, "user-1000.journal", O_RDWR|O_CREAT, 0644, true, false, NULL, NULL, NULL, system, &user));
+
+        for (i = 0; i < 10; i++)
+                append_number(rand() % 2 ? system : user, ++number, &seqnum);
+
+        assert_ret(sd_journal_open_directory(&j, t, 0));
+        assert_ret(sd_journal_get_fd(j));
+        read_all(j, &returned, &n, &allocated);
+        assert_se(n == 10);
+
+        /* the files at their end grow */
+        for (i = 0; i < 10; i++)
+                append_number(rand() % 2 ? system : user, ++number, &seqnum);
+        read_all(j, &returned, &n, &allocated);
+        assert_se(n == 20);
+
+        /* the file is renamed, and a new one takes its place */
+        assert_ret(journal_file_rotate(&system, false, false, NULL));
+        for (i = 0; i < 10; i++)
+                append_number(rand() % 2 ? system : user, ++number, &seqnum);
+        assert_ret(sd_journal_process(j));
+        read_all(j, &returned, &n, &allocated);
+        assert_se(n == 30);
+
+        paths = journal_files_in_cwd();
+        assert_se(strv_length(paths) == 3);
+        n_expected = linear_scan(paths, &expected, &expected_path);
+        assert_se(n_expected == n);
+        assert_se(memcmp(returned, expected, n * sizeof(usec_t)) == 0);
+
+        STRV_FOREACH(p, paths)
+                if (strchr(*p, '@'))
+                        archived = *p;
+        assert_se(archived);
+
+        /* the archived file goes away halfway through */
+        assert_ret(sd_journal_seek_head(j));
+        assert_se(sd_journal_next_skip(j, 15) == 15);
+        test_check_realtime(j, expected[14]);
+
+        assert_se(unlink(archived) >= 0);
+        assert_ret(sd_journal_process(j));
+
+        n = 0;
+        read_all(j, &returned, &n, &allocated);
+
+        for (i = 15, k = 0; i < n_expected; i++) {
+                if (streq(expected_path[i], archived))
+                        continue;
+
+                assert_se(k < n);
+                assert_se(returned[k++] == expected[i]);
+        }
+        assert_se(k == n);
+
+        sd_journal_close(j);
+        test_close(system);
+        test_close(user);
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+}
+
 int main(int argc, char *argv[]) {
         log_set_max_level(LOG_DEBUG);
 
@@ -303,5 +609,8 @@ int main(int argc, char *argv[]) {
 
         test_sequence_numbers();
 
+        test_candidates();
+        test_candidates_rotate();
+
         return 0;
 }
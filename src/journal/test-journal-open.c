@@ -0,0 +1,314 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "fs-util.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "journal-internal.h"
+#include "log.h"
+#include "rm-rf.h"
+#include "set.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "util.h"
+
+/* Checks that the files of a directory are opened in parallel with the same result as one after the other,
+ * and that with JOURNAL_OPEN_LAZY the archived files are opened as they are needed. */
+
+#define N_ARCHIVED 10U
+#define N_ENTRIES 5U
+
+static usec_t head_realtime[N_ARCHIVED + 1];
+
+static void append_number(JournalFile *f, int n, uint64_t *seqnum) {
+        static dual_timestamp previous_ts = {};
+        struct iovec iovec[1];
+        dual_timestamp ts;
+        char *p;
+
+        dual_timestamp_get(&ts);
+
+        if (ts.monotonic <= previous_ts.monotonic)
+                ts.monotonic = previous_ts.monotonic + 1;
+
+        if (ts.realtime <= previous_ts.realtime)
+                ts.realtime = previous_ts.realtime + 1;
+
+        previous_ts = ts;
+
+        assert_se(asprintf(&p, "NUMBER=%d", n) >= 0);
+        iovec[0].iov_base = p;
+        iovec[0].iov_len = strlen(p);
+        assert_se(journal_file_append_entry(f, &ts, iovec, 1, seqnum, NULL, NULL) >= 0);
+        free(p);
+}
+
+/* N_ARCHIVED archived files one after the other, followed by the active one */
+static void setup_files(void) {
+        uint64_t seqnum = 0;
+        unsigned i, k;
+        int number = 0;
+
+        for (i = 0; i <= N_ARCHIVED; i++) {
+                char path[STRLEN("archived-99.journal") + 1];
+                JournalFile *f;
+
+                if (i < N_ARCHIVED)
+                        xsprintf(path, "archived-%02u.journal", i);
+                else
+                        strcpy(path, "system.journal");
+
+                assert_se(journal_file_open(-1, path, O_RDWR|O_CREAT, 0644, false, false, NULL, NULL, NULL, NULL, &f) == 0);
+
+                for (k = 0; k < N_ENTRIES; k++)
+                        append_number(f, ++number, &seqnum);
+
+                head_realtime[i] = le64toh(f->header->head_entry_realtime);
+
+                f->archive = i < N_ARCHIVED;
+                (void) journal_file_close(f);
+        }
+}
+
+static void test_lazy_iterate(const char *t) {
+        sd_journal *j;
+        usec_t from, to, u;
+        unsigned n;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_journal_open_directory(&j, t, JOURNAL_OPEN_LAZY) >= 0);
+        assert_se(ordered_hashmap_size(j->files) == 1);
+        assert_se(ordered_hashmap_size(j->pending_files) == N_ARCHIVED);
+
+        /* the range of the deferred files is known from their headers */
+        assert_se(sd_journal_get_cutoff_realtime_usec(j, &from, &to) == 1);
+        assert_se(from == head_realtime[0]);
+        assert_se(to > head_realtime[N_ARCHIVED]);
+        assert_se(ordered_hashmap_size(j->pending_files) == N_ARCHIVED);
+
+        /* iterating down from a point in time opens the files reaching beyond it */
+        assert_se(sd_journal_seek_realtime_usec(j, head_realtime[7]) >= 0);
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(sd_journal_get_realtime_usec(j, &u) >= 0);
+        assert_se(u == head_realtime[7]);
+        assert_se(ordered_hashmap_size(j->pending_files) == 7);
+
+        for (n = 1; (r = sd_journal_next(j)) > 0; n++)
+                ;
+        assert_se(r == 0);
+        assert_se(n == 4 * N_ENTRIES);
+        assert_se(ordered_hashmap_size(j->pending_files) == 7);
+
+        /* and iterating up from an earlier point the ones starting before it, but not the one in between */
+        assert_se(sd_journal_seek_realtime_usec(j, head_realtime[5]) >= 0);
+        assert_se(sd_journal_previous(j) == 1);
+        assert_se(sd_journal_get_realtime_usec(j, &u) >= 0);
+        assert_se(u == head_realtime[5]);
+        assert_se(ordered_hashmap_size(j->pending_files) == 1);
+
+        for (n = 1; (r = sd_journal_previous(j)) > 0; n++)
+                ;
+        assert_se(r == 0);
+        assert_se(n == 5 * N_ENTRIES + 1);
+        assert_se(ordered_hashmap_size(j->pending_files) == 1);
+
+        sd_journal_close(j);
+
+        /* the head needs all of them */
+        assert_se(sd_journal_open_directory(&j, t, JOURNAL_OPEN_LAZY) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_next(j) == 1);
+        assert_se(ordered_hashmap_isempty(j->pending_files));
+        assert_se(sd_journal_get_realtime_usec(j, &u) >= 0);
+        assert_se(u == head_realtime[0]);
+
+        for (n = 1; (r = sd_journal_next(j)) > 0; n++)
+                ;
+        assert_se(r == 0);
+        assert_se(n == (N_ARCHIVED + 1) * N_ENTRIES);
+
+        sd_journal_close(j);
+}
+
+static void test_lazy_all_files(const char *t) {
+        sd_journal *j;
+        uint64_t usage, lazy_usage;
+        const char *field;
+        const void *data;
+        size_t l;
+        unsigned n;
+
+        log_info("/* %s */", __func__);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+        assert_se(ordered_hashmap_isempty(j->pending_files));
+        assert_se(sd_journal_get_usage(j, &usage) >= 0);
+        sd_journal_close(j);
+
+        assert_se(sd_journal_open_directory(&j, t, JOURNAL_OPEN_LAZY) >= 0);
+        assert_se(!ordered_hashmap_isempty(j->pending_files));
+        assert_se(sd_journal_get_usage(j, &lazy_usage) >= 0);
+        assert_se(ordered_hashmap_isempty(j->pending_files));
+        assert_se(lazy_usage == usage);
+        sd_journal_close(j);
+
+        assert_se(sd_journal_open_directory(&j, t, JOURNAL_OPEN_LAZY) >= 0);
+        assert_se(sd_journal_query_unique(j, "NUMBER") >= 0);
+        for (n = 0; sd_journal_enumerate_unique(j, &data, &l) > 0; n++)
+                ;
+        assert_se(n == (N_ARCHIVED + 1) * N_ENTRIES);
+        assert_se(ordered_hashmap_isempty(j->pending_files));
+        sd_journal_close(j);
+
+        assert_se(sd_journal_open_directory(&j, t, JOURNAL_OPEN_LAZY) >= 0);
+        assert_se(sd_journal_enumerate_fields(j, &field) > 0);
+        assert_se(ordered_hashmap_isempty(j->pending_files));
+        sd_journal_close(j);
+}
+
+static int open_one(const char *path, sd_journal **ret) {
+        const char *paths[] = { path, NULL };
+
+        return sd_journal_open_files(ret, paths, 0);
+}
+
+static void test_parallel(const char *t) {
+        _cleanup_strv_free_ char **files = NULL, **good = NULL, **good_abs = NULL;
+        _cleanup_set_free_ Set *errors = NULL;
+        _cleanup_close_ int fd = -1;
+        uint8_t buf[300];
+        sd_journal *j, *serial;
+        const char *path;
+        JournalFile *f;
+        Iterator i;
+        char **p;
+        void *e;
+        int r;
+
+        log_info("/* %s */", __func__);
+
+        /* broken files among the good ones */
+        assert_se(symlink("nonexistent", "dangling.journal") >= 0);
+        assert_se(write_string_file("garbage.journal", "this is not a journal file", WRITE_STRING_FILE_CREATE) >= 0);
+        assert_se(touch("empty.journal") >= 0);
+        fd = open("archived-00.journal", O_RDONLY|O_CLOEXEC);
+        assert_se(fd >= 0);
+        assert_se(pread(fd, buf, sizeof(buf), 0) == sizeof(buf));
+        fd = safe_close(fd);
+        fd = open("truncated.journal", O_WRONLY|O_CREAT|O_CLOEXEC, 0644);
+        assert_se(fd >= 0);
+        assert_se(loop_write(fd, buf, sizeof(buf), false) >= 0);
+        fd = safe_close(fd);
+        if (getuid() != 0) {
+                assert_se(touch("unreadable.journal") >= 0);
+                assert_se(chmod("unreadable.journal", 0) >= 0);
+        }
+
+        /* enough files to start threads */
+        assert_se(get_files_in_directory(".", &files) >= 0);
+        assert_se(strv_length(files) >= 15);
+
+        /* the files which open on their own, in the order the directory lists them */
+        errors = set_new(NULL);
+        assert_se(errors);
+        STRV_FOREACH(p, files) {
+                if (!endswith(*p, ".journal"))
+                        continue;
+
+                path = strjoina(t, "/", *p);
+                r = open_one(path, &serial);
+                if (r < 0) {
+                        log_debug_errno(r, "Opening %s on its own failed: %m", *p);
+                        assert_se(set_put(errors, INT_TO_PTR(r)) >= 0);
+                        continue;
+                }
+
+                sd_journal_close(serial);
+                assert_se(strv_extend(&good, *p) >= 0);
+                assert_se(strv_extend(&good_abs, path) >= 0);
+        }
+        assert_se(strv_length(good) == N_ARCHIVED + 1);
+
+        assert_se(sd_journal_open_directory(&j, t, 0) >= 0);
+
+        /* the same files, in the same order */
+        assert_se(ordered_hashmap_size(j->files) == strv_length(good));
+        p = good_abs;
+        ORDERED_HASHMAP_FOREACH_KEY(f, path, j->files, i)
+                assert_se(streq(path, *(p++)));
+
+        /* with the same failures */
+        assert_se(hashmap_size(j->errors) == set_size(errors));
+        SET_FOREACH(e, errors, i)
+                assert_se(hashmap_contains(j->errors, e));
+
+        /* with the same entries */
+        assert_se(sd_journal_open_files(&serial, (const char**) good_abs, 0) >= 0);
+        assert_se(sd_journal_seek_head(j) >= 0);
+        assert_se(sd_journal_seek_head(serial) >= 0);
+        for (;;) {
+                _cleanup_free_ char *c = NULL;
+
+                r = sd_journal_next(j);
+                assert_se(r >= 0);
+                assert_se(sd_journal_next(serial) == r);
+                if (r == 0)
+                        break;
+
+                assert_se(sd_journal_get_cursor(serial, &c) >= 0);
+                assert_se(sd_journal_test_cursor(j, c) > 0);
+        }
+
+        sd_journal_close(serial);
+        sd_journal_close(j);
+}
+
+int main(int argc, char *argv[]) {
+        char t[] = "/tmp/journal-open-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        /* journal_file_open requires a valid machine id */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return EXIT_TEST_SKIP;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        setup_files();
+
+        test_lazy_iterate(t);
+        test_lazy_all_files(t);
+        test_parallel(t);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return 0;
+}
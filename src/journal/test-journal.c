@@ -21,11 +21,20 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#if HAVE_LZ4
+#include <lz4.h>
+#endif
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
 #include "journal-authenticate.h"
 #include "journal-file.h"
+#include "journal-internal.h"
 #include "journal-vacuum.h"
 #include "log.h"
 #include "rm-rf.h"
+#include "string-util.h"
 
 static bool arg_keep = false;
 
@@ -165,6 +174,76 @@ static void test_empty(void) {
         (void) journal_file_close(f4);
 }
 
+#if HAVE_LZ4
+#define HUGE_FIELD_SIZE (4096*1024)
+
+static void test_field_index_lz4(void) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        _cleanup_free_ char *coredump = NULL;
+        static const char message[] = "MESSAGE=huge";
+        const char *paths[2] = {};
+        dual_timestamp ts;
+        JournalFile *f;
+        struct iovec iovec[2];
+        const void *d;
+        size_t l;
+        char t[] = "/tmp/journal-XXXXXX";
+
+        log_set_max_level(LOG_DEBUG);
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        assert_se(journal_file_open(-1, "test-lz4.journal", O_RDWR|O_CREAT, 0666, true, false, NULL, NULL, NULL, NULL, &f) == 0);
+        assert_se(f->compress_lz4);
+
+        coredump = malloc(HUGE_FIELD_SIZE);
+        assert_se(coredump);
+        memset(coredump, 'x', HUGE_FIELD_SIZE);
+        memcpy(coredump, "COREDUMP=", 9);
+
+        dual_timestamp_get(&ts);
+
+        iovec[0].iov_base = (void*) message;
+        iovec[0].iov_len = strlen(message);
+        iovec[1].iov_base = coredump;
+        iovec[1].iov_len = HUGE_FIELD_SIZE;
+        assert_se(journal_file_append_entry(f, &ts, iovec, 2, NULL, NULL, NULL) == 0);
+
+        (void) journal_file_close(f);
+
+        paths[0] = strjoina(t, "/test-lz4.journal");
+        assert_se(sd_journal_open_files(&j, paths, 0) >= 0);
+        assert_se(sd_journal_next(j) == 1);
+
+        /* Looking up any field indexes the names of all fields of the entry */
+        assert_se(sd_journal_get_data(j, "MESSAGE", &d, &l) >= 0);
+        assert_se(l == strlen(message));
+        assert_se(memcmp(d, message, l) == 0);
+
+        f = ordered_hashmap_first(j->files);
+        assert_se(f);
+#if LZ4_VERSION_NUMBER >= 10803
+        /* The name of the compressed field was found without decompressing all of it */
+        assert_se(f->compress_buffer_size < HUGE_FIELD_SIZE);
+#endif
+
+        assert_se(sd_journal_set_data_threshold(j, 0) >= 0);
+        assert_se(sd_journal_get_data(j, "COREDUMP", &d, &l) >= 0);
+        assert_se(l == HUGE_FIELD_SIZE);
+        assert_se(memcmp(d, coredump, l) == 0);
+
+        log_info("Done...");
+
+        if (arg_keep)
+                log_info("Not removing %s", t);
+        else
+                assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        puts("------------------------------------------------------------");
+}
+#endif
+
 int main(int argc, char *argv[]) {
         arg_keep = argc > 1;
 
@@ -174,6 +253,9 @@ int main(int argc, char *argv[]) {
 
         test_non_empty();
         test_empty();
+#if HAVE_LZ4
+        test_field_index_lz4();
+#endif
 
         return 0;
 }
@@ -0,0 +1,182 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Writes a journal spread over several files, with the entries of all files interleaved in time, and reads it
+ * forward and backward through sd_journal, like journalctl would, reporting the statistics of the mmap
+ * cache. The pages of the files are dropped from the page cache before each pass. */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sd-journal.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "journal-file.h"
+#include "journal-internal.h"
+#include "log.h"
+#include "macro.h"
+#include "mmap-cache.h"
+#include "parse-util.h"
+#include "random-util.h"
+#include "rm-rf.h"
+#include "stdio-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "util.h"
+
+static unsigned arg_files = 4;
+static unsigned arg_entries;
+
+static void write_journal(void) {
+        _cleanup_free_ JournalFile **files = NULL;
+        dual_timestamp ts;
+        char message[512];
+        unsigned i;
+
+        files = new0(JournalFile*, arg_files);
+        assert_se(files);
+
+        for (i = 0; i < arg_files; i++) {
+                char fn[STRLEN("file-.journal") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(fn, "file-%u.journal", i);
+                assert_se(journal_file_open(-1, fn, O_RDWR|O_CREAT, 0644, true, false, NULL, NULL, NULL, NULL, files + i) == 0);
+        }
+
+        dual_timestamp_get(&ts);
+
+        for (i = 0; i < arg_entries; i++) {
+                char number[STRLEN("NUMBER=") + DECIMAL_STR_MAX(unsigned)];
+                struct iovec iovec[3];
+                size_t n, k;
+
+                ts.realtime++;
+                ts.monotonic++;
+
+                /* Messages of varying length, which mostly do not repeat, like real ones */
+                n = snprintf(message, sizeof(message), "MESSAGE=entry %u of %u ", i, arg_entries);
+                k = random_u32() % (sizeof(message) - n);
+                memset(message + n, 'a' + random_u32() % 26, k);
+                message[n + k] = 0;
+
+                xsprintf(number, "NUMBER=%u", i);
+
+                iovec[0] = IOVEC_MAKE_STRING(message);
+                iovec[1] = IOVEC_MAKE_STRING(number);
+                iovec[2] = IOVEC_MAKE_STRING("_TRANSPORT=stdout");
+
+                assert_se(journal_file_append_entry(files[i % arg_files], &ts, iovec, ELEMENTSOF(iovec), NULL, NULL, NULL) == 0);
+        }
+
+        for (i = 0; i < arg_files; i++)
+                (void) journal_file_close(files[i]);
+}
+
+static void drop_page_cache(void) {
+        unsigned i;
+
+        sync();
+
+        for (i = 0; i < arg_files; i++) {
+                _cleanup_close_ int fd = -1;
+                char fn[STRLEN("file-.journal") + DECIMAL_STR_MAX(unsigned)];
+
+                xsprintf(fn, "file-%u.journal", i);
+
+                fd = open(fn, O_RDONLY|O_CLOEXEC);
+                assert_se(fd >= 0);
+
+                (void) posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+}
+
+static void read_journal(const char *directory, bool backwards) {
+        _cleanup_(sd_journal_closep) sd_journal *j = NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_BYTES_MAX];
+        MMapCacheStats stats;
+        unsigned n = 0;
+        usec_t t;
+
+        drop_page_cache();
+
+        assert_se(sd_journal_open_directory(&j, directory, 0) >= 0);
+
+        t = now(CLOCK_MONOTONIC);
+
+        if (backwards)
+                assert_se(sd_journal_seek_tail(j) >= 0);
+
+        for (;;) {
+                const void *data;
+                size_t l;
+                int r;
+
+                r = backwards ? sd_journal_previous(j) : sd_journal_next(j);
+                assert_se(r >= 0);
+                if (r == 0)
+                        break;
+
+                assert_se(sd_journal_get_data(j, "MESSAGE", &data, &l) >= 0);
+                n++;
+        }
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        assert_se(n == arg_entries);
+
+        mmap_cache_get_stats(j->mmap, &stats);
+
+        log_info("%s: %u entries in %s, %u hit, %u miss, %u evicted, %u sequential, %u windows (%u unused) mapping %s",
+                 backwards ? "backward" : "forward",
+                 n, format_timespan(a, sizeof(a), t, 1),
+                 stats.n_hit, stats.n_missed, stats.n_evicted, stats.n_sequential,
+                 stats.n_windows, stats.n_unused,
+                 format_bytes(b, sizeof(b), stats.mapped));
+}
+
+int main(int argc, char *argv[]) {
+        char t[] = "/tmp/journal-mmap-XXXXXX";
+
+        test_setup_logging(LOG_INFO);
+
+        /* journal_file_open requires a valid machine id */
+        if (access("/etc/machine-id", F_OK) != 0)
+                return EXIT_TEST_SKIP;
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_files) >= 0 && arg_files > 0);
+
+        if (argc >= 3)
+                assert_se(safe_atou(argv[2], &arg_entries) >= 0);
+        else
+                arg_entries = slow_tests_enabled() ? 1000000 : 20000;
+
+        assert_se(mkdtemp(t));
+        assert_se(chdir(t) >= 0);
+
+        write_journal();
+
+        read_journal(t, false);
+        read_journal(t, true);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return 0;
+}
@@ -0,0 +1,476 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <linux/filter.h>
+#include <sys/socket.h>
+
+#include "alloc-util.h"
+#include "arp-mux.h"
+#include "ether-addr-util.h"
+#include "fd-util.h"
+#include "io-util.h"
+#include "siphash24.h"
+#include "socket-util.h"
+
+typedef struct ArpMuxKey {
+        int ifindex;
+        be32_t address;
+} ArpMuxKey;
+
+typedef struct ArpMuxHandler {
+        ArpMuxKey key;
+        struct ether_addr mac;
+        arp_mux_handler_t callback;
+        void *userdata;
+} ArpMuxHandler;
+
+struct ArpMuxPacket {
+        int ifindex;
+        struct ether_arp arp;
+};
+
+static void arp_mux_key_hash_func(const void *p, struct siphash *state) {
+        const ArpMuxKey *k = p;
+
+        assert(k);
+
+        siphash24_compress(&k->ifindex, sizeof(k->ifindex), state);
+        siphash24_compress(&k->address, sizeof(k->address), state);
+}
+
+static int arp_mux_key_compare_func(const void *_a, const void *_b) {
+        const ArpMuxKey *a = _a, *b = _b;
+
+        if (a->ifindex != b->ifindex)
+                return a->ifindex < b->ifindex ? -1 : 1;
+
+        return memcmp(&a->address, &b->address, sizeof(a->address));
+}
+
+static const struct hash_ops arp_mux_key_hash_ops = {
+        .hash = arp_mux_key_hash_func,
+        .compare = arp_mux_key_compare_func
+};
+
+static void arp_mux_reset(sd_ipv4acd_mux *mux) {
+        assert(mux);
+
+        mux->io_event_source = sd_event_source_unref(mux->io_event_source);
+        mux->send_event_source = sd_event_source_unref(mux->send_event_source);
+        mux->fd = safe_close(mux->fd);
+
+        mux->n_send_queue = 0;
+}
+
+static void arp_mux_maybe_reset(sd_ipv4acd_mux *mux) {
+        assert(mux);
+
+        if (hashmap_isempty(mux->handlers))
+                arp_mux_reset(mux);
+}
+
+static void arp_mux_deliver(sd_ipv4acd_mux *mux, int ifindex, const uint8_t address[4], const struct ether_arp *packet) {
+        const ArpMuxHandler *h;
+        ArpMuxKey key = {
+                .ifindex = ifindex,
+        };
+
+        assert(mux);
+
+        memcpy(&key.address, address, sizeof(key.address));
+
+        h = hashmap_get(mux->handlers, &key);
+        if (!h)
+                return;
+
+        /* Packets sent by the instance itself, the filter of a dedicated socket drops those */
+        if (memcmp(packet->arp_sha, &h->mac, ETH_ALEN) == 0)
+                return;
+
+        h->callback(packet, h->userdata);
+}
+
+static int arp_mux_receive(sd_ipv4acd_mux *mux) {
+        union sockaddr_union sa = {};
+        socklen_t salen = sizeof(sa);
+        struct ether_arp packet;
+        ssize_t n;
+
+        assert(mux);
+
+        n = recvfrom(mux->fd, &packet, sizeof(packet), MSG_DONTWAIT, &sa.sa, &salen);
+        if (n < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                return log_arp_mux_errno(errno, "Failed to read ARP packet: %m");
+        }
+        if ((size_t) n != sizeof(packet)) {
+                log_arp_mux("Ignoring too short ARP packet.");
+                return 1;
+        }
+
+        /* Either address may be the one somebody else is probing for, announcing or defending. Look the
+         * second one up only after the first handler returned, as it might have stopped its instance, or
+         * restarted it with a different address. */
+        arp_mux_deliver(mux, sa.ll.sll_ifindex, packet.arp_spa, &packet);
+
+        if (mux->fd >= 0 && memcmp(packet.arp_spa, packet.arp_tpa, sizeof(packet.arp_tpa)) != 0)
+                arp_mux_deliver(mux, sa.ll.sll_ifindex, packet.arp_tpa, &packet);
+
+        return 1;
+}
+
+static int arp_mux_dispatch(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        sd_ipv4acd_mux *mux = userdata;
+        unsigned i;
+
+        assert(mux);
+
+        /* Handlers might stop their instance and thus drop the last registration, which closes the
+         * socket. Don't hog the event loop if somebody floods us either. */
+        sd_ipv4acd_mux_ref(mux);
+
+        for (i = 0; i < ARP_MUX_BATCH && mux->fd >= 0; i++)
+                if (arp_mux_receive(mux) <= 0)
+                        break;
+
+        sd_ipv4acd_mux_unref(mux);
+
+        return 0;
+}
+
+static int arp_mux_flush(sd_event_source *s, void *userdata) {
+        sd_ipv4acd_mux *mux = userdata;
+        size_t i = 0;
+
+        assert(mux);
+        assert(mux->fd >= 0);
+
+        while (i < mux->n_send_queue) {
+                struct mmsghdr mh[ARP_MUX_BATCH] = {};
+                union sockaddr_union sa[ARP_MUX_BATCH];
+                struct iovec iov[ARP_MUX_BATCH];
+                unsigned n;
+                int k;
+
+                for (n = 0; n < ARP_MUX_BATCH && i + n < mux->n_send_queue; n++) {
+                        ArpMuxPacket *p = mux->send_queue + i + n;
+
+                        sa[n] = (union sockaddr_union) {
+                                .ll.sll_family = AF_PACKET,
+                                .ll.sll_protocol = htobe16(ETH_P_ARP),
+                                .ll.sll_ifindex = p->ifindex,
+                                .ll.sll_halen = ETH_ALEN,
+                                .ll.sll_addr = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+                        };
+                        iov[n] = IOVEC_MAKE(&p->arp, sizeof(p->arp));
+
+                        mh[n].msg_hdr.msg_name = &sa[n].sa;
+                        mh[n].msg_hdr.msg_namelen = sizeof(sa[n].ll);
+                        mh[n].msg_hdr.msg_iov = iov + n;
+                        mh[n].msg_hdr.msg_iovlen = 1;
+                }
+
+                k = sendmmsg(mux->fd, mh, n, 0);
+                if (k < 0) {
+                        /* Only the first packet of the batch failed, e.g. because its interface went away
+                         * in the meantime. Skip it and carry on with the rest. */
+                        log_arp_mux_errno(errno, "Failed to send ARP packet on interface %i: %m",
+                                          mux->send_queue[i].ifindex);
+                        k = 1;
+                }
+
+                i += k;
+        }
+
+        mux->n_send_queue = 0;
+
+        return 0;
+}
+
+int arp_mux_queue(sd_ipv4acd_mux *mux, int ifindex, be32_t address, const struct ether_addr *mac, bool announce) {
+        ArpMuxPacket *p;
+        int r;
+
+        assert(mux);
+        assert(mux->fd >= 0);
+        assert(ifindex > 0);
+        assert(address != 0);
+        assert(mac);
+
+        if (!mux->send_event_source) {
+                r = sd_event_add_defer(mux->event, &mux->send_event_source, arp_mux_flush, mux);
+                if (r < 0)
+                        return r;
+
+                /* Let all other sources due in this iteration, i.e. the timers of other instances, queue
+                 * their packets first */
+                r = sd_event_source_set_priority(mux->send_event_source, SD_EVENT_PRIORITY_IDLE);
+                if (r < 0) {
+                        mux->send_event_source = sd_event_source_unref(mux->send_event_source);
+                        return r;
+                }
+
+                (void) sd_event_source_set_description(mux->send_event_source, "ipv4acd-mux-send");
+        }
+
+        if (!GREEDY_REALLOC(mux->send_queue, mux->send_queue_allocated, mux->n_send_queue + 1))
+                return -ENOMEM;
+
+        p = mux->send_queue + mux->n_send_queue++;
+        *p = (ArpMuxPacket) {
+                .ifindex = ifindex,
+                .arp.ea_hdr.ar_hrd = htobe16(ARPHRD_ETHER),
+                .arp.ea_hdr.ar_pro = htobe16(ETHERTYPE_IP),
+                .arp.ea_hdr.ar_hln = ETH_ALEN,
+                .arp.ea_hdr.ar_pln = sizeof(be32_t),
+                .arp.ea_hdr.ar_op = htobe16(ARPOP_REQUEST),
+        };
+
+        memcpy(p->arp.arp_sha, mac, ETH_ALEN);
+        memcpy(p->arp.arp_tpa, &address, sizeof(address));
+
+        if (announce)
+                memcpy(p->arp.arp_spa, &address, sizeof(address));
+
+        return sd_event_source_set_enabled(mux->send_event_source, SD_EVENT_ONESHOT);
+}
+
+void arp_mux_dequeue(sd_ipv4acd_mux *mux, int ifindex, be32_t address) {
+        size_t i, n = 0;
+
+        assert(mux);
+
+        for (i = 0; i < mux->n_send_queue; i++) {
+                const ArpMuxPacket *p = mux->send_queue + i;
+
+                if (p->ifindex != ifindex || memcmp(p->arp.arp_tpa, &address, sizeof(address)) != 0)
+                        mux->send_queue[n++] = *p;
+        }
+
+        mux->n_send_queue = n;
+}
+
+static int arp_mux_open(sd_ipv4acd_mux *mux) {
+        static const struct sock_filter filter[] = {
+                BPF_STMT(BPF_LD + BPF_W + BPF_LEN, 0),                                         /* A <- packet length */
+                BPF_JUMP(BPF_JMP + BPF_JGE + BPF_K, sizeof(struct ether_arp), 1, 0),           /* packet >= arp packet ? */
+                BPF_STMT(BPF_RET + BPF_K, 0),                                                  /* ignore */
+                BPF_STMT(BPF_LD + BPF_H + BPF_ABS, offsetof(struct ether_arp, ea_hdr.ar_hrd)), /* A <- header */
+                BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ARPHRD_ETHER, 1, 0),                       /* header == ethernet ? */
+                BPF_STMT(BPF_RET + BPF_K, 0),                                                  /* ignore */
+                BPF_STMT(BPF_LD + BPF_H + BPF_ABS, offsetof(struct ether_arp, ea_hdr.ar_pro)), /* A <- protocol */
+                BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ETHERTYPE_IP, 1, 0),                       /* protocol == IP ? */
+                BPF_STMT(BPF_RET + BPF_K, 0),                                                  /* ignore */
+                BPF_STMT(BPF_LD + BPF_B + BPF_ABS, offsetof(struct ether_arp, ea_hdr.ar_hln)), /* A <- hardware address length */
+                BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, sizeof(struct ether_addr), 1, 0),          /* length == sizeof(ether_addr)? */
+                BPF_STMT(BPF_RET + BPF_K, 0),                                                  /* ignore */
+                BPF_STMT(BPF_LD + BPF_B + BPF_ABS, offsetof(struct ether_arp, ea_hdr.ar_pln)), /* A <- protocol address length */
+                BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, sizeof(struct in_addr), 1, 0),             /* length == sizeof(in_addr) ? */
+                BPF_STMT(BPF_RET + BPF_K, 0),                                                  /* ignore */
+                BPF_STMT(BPF_LD + BPF_H + BPF_ABS, offsetof(struct ether_arp, ea_hdr.ar_op)),  /* A <- operation */
+                BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ARPOP_REQUEST, 2, 0),                      /* protocol == request ? */
+                BPF_JUMP(BPF_JMP + BPF_JEQ + BPF_K, ARPOP_REPLY, 1, 0),                        /* protocol == reply ? */
+                BPF_STMT(BPF_RET + BPF_K, 0),                                                  /* ignore */
+                BPF_STMT(BPF_RET + BPF_K, sizeof(struct ether_arp)),                           /* return the ARP packet */
+        };
+        static const struct sock_fprog fprog = {
+                .len = ELEMENTSOF(filter),
+                .filter = (struct sock_filter*) filter
+        };
+        /* Not bound to any interface, the sender and target addresses are matched in the hash table */
+        union sockaddr_union link = {
+                .ll.sll_family = AF_PACKET,
+                .ll.sll_protocol = htobe16(ETH_P_ARP),
+        };
+        _cleanup_close_ int s = -1;
+        int r;
+
+        assert(mux);
+        assert(mux->fd < 0);
+
+        s = socket(PF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (s < 0)
+                return -errno;
+
+        r = setsockopt(s, SOL_SOCKET, SO_ATTACH_FILTER, &fprog, sizeof(fprog));
+        if (r < 0)
+                return -errno;
+
+        r = bind(s, &link.sa, sizeof(link.ll));
+        if (r < 0)
+                return -errno;
+
+        r = sd_event_add_io(mux->event, &mux->io_event_source, s, EPOLLIN, arp_mux_dispatch, mux);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(mux->io_event_source, mux->event_priority);
+        if (r < 0) {
+                mux->io_event_source = sd_event_source_unref(mux->io_event_source);
+                return r;
+        }
+
+        (void) sd_event_source_set_description(mux->io_event_source, "ipv4acd-mux-io");
+
+        mux->fd = s;
+        s = -1;
+
+        return 0;
+}
+
+int arp_mux_add(sd_ipv4acd_mux *mux, int ifindex, be32_t address, const struct ether_addr *mac,
+                arp_mux_handler_t cb, void *userdata) {
+        _cleanup_free_ ArpMuxHandler *h = NULL;
+        int r;
+
+        assert(mux);
+        assert(ifindex > 0);
+        assert(address != 0);
+        assert(mac);
+        assert(cb);
+
+        if (!mux->event)
+                return -EINVAL;
+
+        h = new(ArpMuxHandler, 1);
+        if (!h)
+                return -ENOMEM;
+
+        *h = (ArpMuxHandler) {
+                .key.ifindex = ifindex,
+                .key.address = address,
+                .mac = *mac,
+                .callback = cb,
+                .userdata = userdata,
+        };
+
+        if (hashmap_contains(mux->handlers, &h->key))
+                return -EBUSY;
+
+        r = hashmap_ensure_allocated(&mux->handlers, &arp_mux_key_hash_ops);
+        if (r < 0)
+                return r;
+
+        if (mux->fd < 0) {
+                r = arp_mux_open(mux);
+                if (r < 0)
+                        return r;
+        }
+
+        r = hashmap_put(mux->handlers, &h->key, h);
+        if (r < 0) {
+                arp_mux_maybe_reset(mux);
+                return r;
+        }
+
+        h = NULL;
+        return 0;
+}
+
+void arp_mux_remove(sd_ipv4acd_mux *mux, int ifindex, be32_t address) {
+        ArpMuxKey key = {
+                .ifindex = ifindex,
+                .address = address,
+        };
+
+        assert(mux);
+
+        free(hashmap_remove(mux->handlers, &key));
+
+        arp_mux_maybe_reset(mux);
+}
+
+sd_ipv4acd_mux *sd_ipv4acd_mux_ref(sd_ipv4acd_mux *mux) {
+
+        if (!mux)
+                return NULL;
+
+        assert(mux->n_ref > 0);
+        mux->n_ref++;
+
+        return mux;
+}
+
+sd_ipv4acd_mux *sd_ipv4acd_mux_unref(sd_ipv4acd_mux *mux) {
+
+        if (!mux)
+                return NULL;
+
+        assert(mux->n_ref > 0);
+        mux->n_ref--;
+
+        if (mux->n_ref > 0)
+                return NULL;
+
+        /* Every started sd_ipv4acd object holds a reference, hence there can't be any left */
+        assert(hashmap_isempty(mux->handlers));
+
+        arp_mux_reset(mux);
+        sd_event_unref(mux->event);
+        hashmap_free(mux->handlers);
+        free(mux->send_queue);
+        return mfree(mux);
+}
+
+int sd_ipv4acd_mux_new(sd_ipv4acd_mux **ret) {
+        sd_ipv4acd_mux *mux;
+
+        assert_return(ret, -EINVAL);
+
+        mux = new0(sd_ipv4acd_mux, 1);
+        if (!mux)
+                return -ENOMEM;
+
+        mux->n_ref = 1;
+        mux->fd = -1;
+
+        *ret = mux;
+        return 0;
+}
+
+int sd_ipv4acd_mux_attach_event(sd_ipv4acd_mux *mux, sd_event *event, int64_t priority) {
+        int r;
+
+        assert_return(mux, -EINVAL);
+        assert_return(mux->fd < 0, -EBUSY);
+        assert_return(!mux->event, -EBUSY);
+
+        if (event)
+                mux->event = sd_event_ref(event);
+        else {
+                r = sd_event_default(&mux->event);
+                if (r < 0)
+                        return r;
+        }
+
+        mux->event_priority = priority;
+
+        return 0;
+}
+
+int sd_ipv4acd_mux_detach_event(sd_ipv4acd_mux *mux) {
+
+        assert_return(mux, -EINVAL);
+        assert_return(mux->fd < 0, -EBUSY);
+
+        mux->event = sd_event_unref(mux->event);
+        return 0;
+}
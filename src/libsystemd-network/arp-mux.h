@@ -0,0 +1,66 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <net/ethernet.h>
+#include <netinet/if_ether.h>
+
+#include "sd-event.h"
+#include "sd-ipv4acd.h"
+
+#include "hashmap.h"
+#include "log.h"
+#include "sparse-endian.h"
+
+/* Maximum number of packets read from the shared socket in one event loop iteration, and sent with a
+ * single sendmmsg() call */
+#define ARP_MUX_BATCH 16U
+
+typedef struct ArpMuxPacket ArpMuxPacket;
+
+typedef void (*arp_mux_handler_t)(const struct ether_arp *packet, void *userdata);
+
+struct sd_ipv4acd_mux {
+        unsigned n_ref;
+
+        int fd;
+
+        sd_event *event;
+        int64_t event_priority;
+        sd_event_source *io_event_source;
+
+        /* (ifindex, address) → ArpMuxHandler */
+        Hashmap *handlers;
+
+        /* Probes and announcements queued up by all instances during one event loop iteration, sent
+         * in batches once everything else due in it has been dispatched */
+        sd_event_source *send_event_source;
+        ArpMuxPacket *send_queue;
+        size_t n_send_queue, send_queue_allocated;
+};
+
+int arp_mux_add(sd_ipv4acd_mux *mux, int ifindex, be32_t address, const struct ether_addr *mac,
+                arp_mux_handler_t cb, void *userdata);
+void arp_mux_remove(sd_ipv4acd_mux *mux, int ifindex, be32_t address);
+
+int arp_mux_queue(sd_ipv4acd_mux *mux, int ifindex, be32_t address, const struct ether_addr *mac, bool announce);
+void arp_mux_dequeue(sd_ipv4acd_mux *mux, int ifindex, be32_t address);
+
+#define log_arp_mux_errno(error, fmt, ...) log_internal(LOG_DEBUG, error, __FILE__, __LINE__, __func__, "ARP: " fmt, ##__VA_ARGS__)
+#define log_arp_mux(fmt, ...) log_arp_mux_errno(0, fmt, ##__VA_ARGS__)
@@ -0,0 +1,544 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <errno.h>
+#include <netinet/icmp6.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "icmp6-mux.h"
+#include "icmp6-util.h"
+#include "in-addr-util.h"
+#include "io-util.h"
+#include "socket-util.h"
+#include "string-util.h"
+
+typedef struct Icmp6MuxHandler {
+        icmp6_mux_handler_t callback;
+        void *userdata;
+} Icmp6MuxHandler;
+
+struct Icmp6MuxPacket {
+        int ifindex;
+        struct in6_addr dst;
+        size_t offset;
+        size_t size;
+};
+
+static Hashmap **icmp6_mux_handlers(sd_icmp6_mux *mux, uint8_t type) {
+        assert(mux);
+
+        switch (type) {
+
+        case ND_ROUTER_SOLICIT:
+                return &mux->solicitation_handlers;
+
+        case ND_ROUTER_ADVERT:
+                return &mux->advertisement_handlers;
+
+        default:
+                return NULL;
+        }
+}
+
+static void icmp6_mux_reset(sd_icmp6_mux *mux) {
+        assert(mux);
+
+        mux->io_event_source = sd_event_source_unref(mux->io_event_source);
+        mux->send_event_source = sd_event_source_unref(mux->send_event_source);
+        mux->fd = safe_close(mux->fd);
+
+        mux->n_send_queue = 0;
+        mux->send_buffer_size = 0;
+}
+
+static void icmp6_mux_maybe_reset(sd_icmp6_mux *mux) {
+        assert(mux);
+
+        if (hashmap_isempty(mux->solicitation_handlers) &&
+            hashmap_isempty(mux->advertisement_handlers))
+                icmp6_mux_reset(mux);
+}
+
+static int icmp6_mux_receive(sd_icmp6_mux *mux) {
+        union {
+                struct cmsghdr cmsghdr;
+                uint8_t buf[CMSG_SPACE(sizeof(int)) + /* ttl */
+                            CMSG_SPACE(sizeof(struct in6_pktinfo)) +
+                            CMSG_SPACE(sizeof(struct timeval))];
+        } control = {};
+        struct iovec iov = {};
+        union sockaddr_union sa = {};
+        struct msghdr msg = {
+                .msg_name = &sa.sa,
+                .msg_namelen = sizeof(sa),
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+                .msg_control = &control,
+                .msg_controllen = sizeof(control),
+        };
+        triple_timestamp timestamp = {};
+        const Icmp6MuxHandler *h;
+        struct cmsghdr *cmsg;
+        Hashmap **handlers;
+        ssize_t buflen, len;
+        int ifindex = 0;
+
+        assert(mux);
+
+        buflen = next_datagram_size_fd(mux->fd);
+        if (IN_SET(buflen, -EAGAIN, -EINTR))
+                return 0;
+        if (buflen < 0)
+                return log_icmp6_mux_errno(buflen, "Failed to determine datagram size to read: %m");
+
+        if (!GREEDY_REALLOC(mux->buffer, mux->buffer_allocated, MAX(buflen, 1)))
+                return -ENOMEM;
+
+        iov = IOVEC_MAKE(mux->buffer, mux->buffer_allocated);
+
+        len = recvmsg(mux->fd, &msg, MSG_DONTWAIT);
+        if (len < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                return log_icmp6_mux_errno(errno, "Failed to read ICMPv6 datagram: %m");
+        }
+
+        if ((size_t) len < sizeof(struct icmp6_hdr))
+                return 1;
+
+        if (msg.msg_namelen != sizeof(struct sockaddr_in6) || sa.in6.sin6_family != AF_INET6) {
+                log_icmp6_mux("Received invalid source address from ICMPv6 socket. Ignoring.");
+                return 1;
+        }
+
+        if (in_addr_is_link_local(AF_INET6, (union in_addr_union*) &sa.in6.sin6_addr) <= 0) {
+                _cleanup_free_ char *addr = NULL;
+
+                (void) in_addr_to_string(AF_INET6, (union in_addr_union*) &sa.in6.sin6_addr, &addr);
+                log_icmp6_mux("Received ICMPv6 message from non-link-local address %s. Ignoring.", strna(addr));
+                return 1;
+        }
+
+        CMSG_FOREACH(cmsg, &msg) {
+                if (cmsg->cmsg_level == SOL_IPV6 &&
+                    cmsg->cmsg_type == IPV6_HOPLIMIT &&
+                    cmsg->cmsg_len == CMSG_LEN(sizeof(int))) {
+                        int hops = *(int*) CMSG_DATA(cmsg);
+
+                        if (hops != 255) {
+                                log_icmp6_mux("Received ICMPv6 message with invalid hop limit. Ignoring.");
+                                return 1;
+                        }
+                }
+
+                if (cmsg->cmsg_level == SOL_IPV6 &&
+                    cmsg->cmsg_type == IPV6_PKTINFO &&
+                    cmsg->cmsg_len == CMSG_LEN(sizeof(struct in6_pktinfo)))
+                        ifindex = ((struct in6_pktinfo*) CMSG_DATA(cmsg))->ipi6_ifindex;
+
+                if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SO_TIMESTAMP &&
+                    cmsg->cmsg_len == CMSG_LEN(sizeof(struct timeval)))
+                        triple_timestamp_from_realtime(&timestamp, timeval_load((struct timeval*) CMSG_DATA(cmsg)));
+        }
+
+        handlers = icmp6_mux_handlers(mux, ((struct icmp6_hdr*) mux->buffer)->icmp6_type);
+        if (!handlers)
+                return 1;
+
+        h = hashmap_get(*handlers, INT_TO_PTR(ifindex));
+        if (!h)
+                return 1;
+
+        if (!triple_timestamp_is_set(&timestamp))
+                triple_timestamp_get(&timestamp);
+
+        (void) h->callback(mux->buffer, len, &sa.in6.sin6_addr, &timestamp, h->userdata);
+        return 1;
+}
+
+static int icmp6_mux_dispatch(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        sd_icmp6_mux *mux = userdata;
+        unsigned i;
+
+        assert(mux);
+
+        /* Handlers might stop their object and thus drop the last registration, which closes the
+         * socket. Don't hog the event loop if somebody floods us either. */
+        sd_icmp6_mux_ref(mux);
+
+        for (i = 0; i < ICMP6_MUX_BATCH && mux->fd >= 0; i++)
+                if (icmp6_mux_receive(mux) <= 0)
+                        break;
+
+        sd_icmp6_mux_unref(mux);
+
+        return 0;
+}
+
+static int icmp6_mux_flush(sd_event_source *s, void *userdata) {
+        sd_icmp6_mux *mux = userdata;
+        size_t i = 0;
+
+        assert(mux);
+        assert(mux->fd >= 0);
+
+        while (i < mux->n_send_queue) {
+                struct mmsghdr mh[ICMP6_MUX_BATCH] = {};
+                struct sockaddr_in6 sa[ICMP6_MUX_BATCH];
+                struct iovec iov[ICMP6_MUX_BATCH];
+                unsigned n;
+                int k;
+
+                for (n = 0; n < ICMP6_MUX_BATCH && i + n < mux->n_send_queue; n++) {
+                        const Icmp6MuxPacket *p = mux->send_queue + i + n;
+
+                        sa[n] = (struct sockaddr_in6) {
+                                .sin6_family = AF_INET6,
+                                .sin6_addr = p->dst,
+                                .sin6_scope_id = p->ifindex,
+                        };
+                        iov[n] = IOVEC_MAKE(mux->send_buffer + p->offset, p->size);
+
+                        mh[n].msg_hdr.msg_name = sa + n;
+                        mh[n].msg_hdr.msg_namelen = sizeof(sa[n]);
+                        mh[n].msg_hdr.msg_iov = iov + n;
+                        mh[n].msg_hdr.msg_iovlen = 1;
+                }
+
+                k = sendmmsg(mux->fd, mh, n, 0);
+                if (k < 0) {
+                        /* Only the first message of the batch failed, e.g. because its interface went away
+                         * in the meantime. Skip it and carry on with the rest. */
+                        log_icmp6_mux_errno(errno, "Failed to send ICMPv6 message on interface %i: %m",
+                                            mux->send_queue[i].ifindex);
+                        k = 1;
+                }
+
+                i += k;
+        }
+
+        mux->n_send_queue = 0;
+        mux->send_buffer_size = 0;
+
+        return 0;
+}
+
+int icmp6_mux_queue(sd_icmp6_mux *mux, int ifindex, const struct in6_addr *dst, const void *packet, size_t size) {
+        Icmp6MuxPacket *p;
+        int r;
+
+        assert(mux);
+        assert(mux->fd >= 0);
+        assert(ifindex > 0);
+        assert(packet);
+
+        if (!mux->send_event_source) {
+                r = sd_event_add_defer(mux->event, &mux->send_event_source, icmp6_mux_flush, mux);
+                if (r < 0)
+                        return r;
+
+                /* Let all other sources due in this iteration, i.e. the timers of other links, queue their
+                 * messages first */
+                r = sd_event_source_set_priority(mux->send_event_source, SD_EVENT_PRIORITY_IDLE);
+                if (r < 0) {
+                        mux->send_event_source = sd_event_source_unref(mux->send_event_source);
+                        return r;
+                }
+
+                (void) sd_event_source_set_description(mux->send_event_source, "icmp6-mux-send");
+        }
+
+        if (!GREEDY_REALLOC(mux->send_queue, mux->send_queue_allocated, mux->n_send_queue + 1))
+                return -ENOMEM;
+
+        if (!GREEDY_REALLOC(mux->send_buffer, mux->send_buffer_allocated, mux->send_buffer_size + size))
+                return -ENOMEM;
+
+        p = mux->send_queue + mux->n_send_queue++;
+        *p = (Icmp6MuxPacket) {
+                .ifindex = ifindex,
+                .dst = dst ? *dst : (struct in6_addr) IN6ADDR_ALL_NODES_MULTICAST_INIT,
+                .offset = mux->send_buffer_size,
+                .size = size,
+        };
+
+        memcpy(mux->send_buffer + p->offset, packet, size);
+        mux->send_buffer_size += size;
+
+        return sd_event_source_set_enabled(mux->send_event_source, SD_EVENT_ONESHOT);
+}
+
+void icmp6_mux_dequeue(sd_icmp6_mux *mux, int ifindex) {
+        size_t i, n = 0;
+
+        assert(mux);
+
+        /* The data stays in the send buffer until the next flush, only forget about the messages */
+        for (i = 0; i < mux->n_send_queue; i++)
+                if (mux->send_queue[i].ifindex != ifindex)
+                        mux->send_queue[n++] = mux->send_queue[i];
+
+        mux->n_send_queue = n;
+}
+
+static int icmp6_mux_open(sd_icmp6_mux *mux) {
+        struct icmp6_filter filter = {};
+        static const int zero = 0, one = 1, hops = 255;
+        _cleanup_close_ int s = -1;
+        int r;
+
+        assert(mux);
+        assert(mux->fd < 0);
+
+        s = socket(AF_INET6, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, IPPROTO_ICMPV6);
+        if (s < 0)
+                return -errno;
+
+        ICMP6_FILTER_SETBLOCKALL(&filter);
+        ICMP6_FILTER_SETPASS(ND_ROUTER_SOLICIT, &filter);
+        ICMP6_FILTER_SETPASS(ND_ROUTER_ADVERT, &filter);
+
+        r = setsockopt(s, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(filter));
+        if (r < 0)
+                return -errno;
+
+        /* The socket is not bound to any interface: learn the receiving one from IPV6_PKTINFO, and pick
+         * the outgoing one with the scope id of each destination address */
+        r = setsockopt(s, IPPROTO_IPV6, IPV6_RECVPKTINFO, &one, sizeof(one));
+        if (r < 0)
+                return -errno;
+
+        r = setsockopt(s, IPPROTO_IPV6, IPV6_MULTICAST_LOOP, &zero, sizeof(zero));
+        if (r < 0)
+                return -errno;
+
+        r = setsockopt(s, IPPROTO_IPV6, IPV6_MULTICAST_HOPS, &hops, sizeof(hops));
+        if (r < 0)
+                return -errno;
+
+        r = setsockopt(s, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &hops, sizeof(hops));
+        if (r < 0)
+                return -errno;
+
+        r = setsockopt(s, SOL_IPV6, IPV6_RECVHOPLIMIT, &one, sizeof(one));
+        if (r < 0)
+                return -errno;
+
+        r = setsockopt(s, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one));
+        if (r < 0)
+                return -errno;
+
+        r = sd_event_add_io(mux->event, &mux->io_event_source, s, EPOLLIN, icmp6_mux_dispatch, mux);
+        if (r < 0)
+                return r;
+
+        r = sd_event_source_set_priority(mux->io_event_source, mux->event_priority);
+        if (r < 0) {
+                mux->io_event_source = sd_event_source_unref(mux->io_event_source);
+                return r;
+        }
+
+        (void) sd_event_source_set_description(mux->io_event_source, "icmp6-mux-io");
+
+        mux->fd = s;
+        s = -1;
+
+        return 0;
+}
+
+static int icmp6_mux_set_membership(sd_icmp6_mux *mux, uint8_t type, int ifindex, bool b) {
+        struct ipv6_mreq mreq = {
+                .ipv6mr_multiaddr = IN6ADDR_ALL_ROUTERS_MULTICAST_INIT,
+                .ipv6mr_interface = ifindex,
+        };
+
+        assert(mux);
+
+        /* Advertisements are sent to all nodes, which every interface is a member of, and an unbound
+         * socket receives all groups joined by the host. Solicitations are sent to all routers though,
+         * which the kernel only joins when forwarding is enabled. Every membership is charged against
+         * the socket's option memory, hence don't take any we don't need. */
+        if (type != ND_ROUTER_SOLICIT)
+                return 0;
+
+        if (setsockopt(mux->fd, IPPROTO_IPV6, b ? IPV6_ADD_MEMBERSHIP : IPV6_DROP_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+                return -errno;
+
+        return 0;
+}
+
+int icmp6_mux_add(sd_icmp6_mux *mux, uint8_t type, int ifindex, icmp6_mux_handler_t cb, void *userdata) {
+        _cleanup_free_ Icmp6MuxHandler *h = NULL;
+        Hashmap **handlers;
+        int r;
+
+        assert(mux);
+        assert(ifindex > 0);
+        assert(cb);
+
+        handlers = icmp6_mux_handlers(mux, type);
+        assert(handlers);
+
+        if (!mux->event)
+                return -EINVAL;
+
+        if (hashmap_contains(*handlers, INT_TO_PTR(ifindex)))
+                return -EBUSY;
+
+        h = new(Icmp6MuxHandler, 1);
+        if (!h)
+                return -ENOMEM;
+
+        h->callback = cb;
+        h->userdata = userdata;
+
+        if (mux->fd < 0) {
+                r = icmp6_mux_open(mux);
+                if (r < 0)
+                        return r;
+        }
+
+        r = hashmap_ensure_allocated(handlers, NULL);
+        if (r < 0)
+                goto fail;
+
+        r = hashmap_put(*handlers, INT_TO_PTR(ifindex), h);
+        if (r < 0)
+                goto fail;
+
+        r = icmp6_mux_set_membership(mux, type, ifindex, true);
+        if (r < 0) {
+                hashmap_remove(*handlers, INT_TO_PTR(ifindex));
+                goto fail;
+        }
+
+        h = NULL;
+        return 0;
+
+fail:
+        icmp6_mux_maybe_reset(mux);
+        return r;
+}
+
+void icmp6_mux_remove(sd_icmp6_mux *mux, uint8_t type, int ifindex) {
+        Icmp6MuxHandler *h;
+        Hashmap **handlers;
+
+        assert(mux);
+
+        handlers = icmp6_mux_handlers(mux, type);
+        assert(handlers);
+
+        h = hashmap_remove(*handlers, INT_TO_PTR(ifindex));
+        if (!h)
+                return;
+
+        free(h);
+
+        /* This fails if the interface is already gone, in which case the kernel dropped the
+         * membership anyway */
+        (void) icmp6_mux_set_membership(mux, type, ifindex, false);
+
+        icmp6_mux_maybe_reset(mux);
+}
+
+_public_ int sd_icmp6_mux_new(sd_icmp6_mux **ret) {
+        sd_icmp6_mux *mux;
+
+        assert_return(ret, -EINVAL);
+
+        mux = new0(sd_icmp6_mux, 1);
+        if (!mux)
+                return -ENOMEM;
+
+        mux->n_ref = 1;
+        mux->fd = -1;
+
+        *ret = mux;
+        return 0;
+}
+
+_public_ sd_icmp6_mux *sd_icmp6_mux_ref(sd_icmp6_mux *mux) {
+
+        if (!mux)
+                return NULL;
+
+        assert(mux->n_ref > 0);
+        mux->n_ref++;
+
+        return mux;
+}
+
+_public_ sd_icmp6_mux *sd_icmp6_mux_unref(sd_icmp6_mux *mux) {
+
+        if (!mux)
+                return NULL;
+
+        assert(mux->n_ref > 0);
+        mux->n_ref--;
+
+        if (mux->n_ref > 0)
+                return NULL;
+
+        /* Every started sd_ndisc and sd_radv object holds a reference, hence there can't be any left */
+        assert(hashmap_isempty(mux->solicitation_handlers));
+        assert(hashmap_isempty(mux->advertisement_handlers));
+
+        icmp6_mux_reset(mux);
+        sd_event_unref(mux->event);
+        hashmap_free(mux->solicitation_handlers);
+        hashmap_free(mux->advertisement_handlers);
+        free(mux->buffer);
+        free(mux->send_queue);
+        free(mux->send_buffer);
+        return mfree(mux);
+}
+
+_public_ int sd_icmp6_mux_attach_event(sd_icmp6_mux *mux, sd_event *event, int64_t priority) {
+        int r;
+
+        assert_return(mux, -EINVAL);
+        assert_return(mux->fd < 0, -EBUSY);
+        assert_return(!mux->event, -EBUSY);
+
+        if (event)
+                mux->event = sd_event_ref(event);
+        else {
+                r = sd_event_default(&mux->event);
+                if (r < 0)
+                        return r;
+        }
+
+        mux->event_priority = priority;
+
+        return 0;
+}
+
+_public_ int sd_icmp6_mux_detach_event(sd_icmp6_mux *mux) {
+
+        assert_return(mux, -EINVAL);
+        assert_return(mux->fd < 0, -EBUSY);
+
+        mux->event = sd_event_unref(mux->event);
+        return 0;
+}
@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <netinet/in.h>
+
+#include "sd-event.h"
+#include "sd-ndisc.h"
+
+#include "hashmap.h"
+#include "log.h"
+#include "time-util.h"
+
+/* Maximum number of datagrams read from the shared socket in one event loop iteration, and sent
+ * with a single sendmmsg() call */
+#define ICMP6_MUX_BATCH 16U
+
+typedef struct Icmp6MuxPacket Icmp6MuxPacket;
+
+typedef int (*icmp6_mux_handler_t)(const void *packet, size_t size, const struct in6_addr *src,
+                                   const triple_timestamp *timestamp, void *userdata);
+
+struct sd_icmp6_mux {
+        unsigned n_ref;
+
+        int fd;
+
+        sd_event *event;
+        int64_t event_priority;
+        sd_event_source *io_event_source;
+
+        /* ifindex → Icmp6MuxHandler, per ICMPv6 message type */
+        Hashmap *solicitation_handlers;
+        Hashmap *advertisement_handlers;
+
+        uint8_t *buffer;
+        size_t buffer_allocated;
+
+        /* Unsolicited messages queued up by all links during one event loop iteration, sent in
+         * batches once everything else due in it has been dispatched */
+        sd_event_source *send_event_source;
+        Icmp6MuxPacket *send_queue;
+        size_t n_send_queue, send_queue_allocated;
+        uint8_t *send_buffer;
+        size_t send_buffer_size, send_buffer_allocated;
+};
+
+int icmp6_mux_add(sd_icmp6_mux *mux, uint8_t type, int ifindex, icmp6_mux_handler_t cb, void *userdata);
+void icmp6_mux_remove(sd_icmp6_mux *mux, uint8_t type, int ifindex);
+
+int icmp6_mux_queue(sd_icmp6_mux *mux, int ifindex, const struct in6_addr *dst, const void *packet, size_t size);
+void icmp6_mux_dequeue(sd_icmp6_mux *mux, int ifindex);
+
+#define log_icmp6_mux_errno(error, fmt, ...) log_internal(LOG_DEBUG, error, __FILE__, __LINE__, __func__, "ICMPv6: " fmt, ##__VA_ARGS__)
+#define log_icmp6_mux(fmt, ...) log_icmp6_mux_errno(0, fmt, ##__VA_ARGS__)
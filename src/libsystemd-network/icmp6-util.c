@@ -129,10 +129,11 @@ int icmp6_bind_router_advertisement(int index) {
         return icmp6_bind_router_message(&filter, &mreq);
 }
 
-int icmp6_send_router_solicitation(int s, const struct ether_addr *ether_addr) {
+int icmp6_send_router_solicitation(int s, int ifindex, const struct ether_addr *ether_addr) {
         struct sockaddr_in6 dst = {
                 .sin6_family = AF_INET6,
                 .sin6_addr = IN6ADDR_ALL_ROUTERS_MULTICAST_INIT,
+                .sin6_scope_id = ifindex,
         };
         struct {
                 struct nd_router_solicit rs;
@@ -34,6 +34,6 @@
 
 int icmp6_bind_router_solicitation(int index);
 int icmp6_bind_router_advertisement(int index);
-int icmp6_send_router_solicitation(int s, const struct ether_addr *ether_addr);
+int icmp6_send_router_solicitation(int s, int ifindex, const struct ether_addr *ether_addr);
 int icmp6_receive(int fd, void *buffer, size_t size, struct in6_addr *dst,
                   triple_timestamp *timestamp);
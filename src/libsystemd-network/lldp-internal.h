@@ -21,6 +21,8 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <linux/if_ether.h>
+
 #include "sd-event.h"
 #include "sd-lldp.h"
 
@@ -28,12 +30,33 @@
 #include "log.h"
 #include "prioq.h"
 
+/* Number of frames read from the shared socket with a single recvmmsg() call */
+#define LLDP_RECEIVER_BATCH 16U
+
+struct sd_lldp_receiver {
+        unsigned n_ref;
+
+        int fd;
+
+        sd_event *event;
+        int64_t event_priority;
+        sd_event_source *io_event_source;
+
+        /* sd_lldp objects currently started on this receiver, by their ifindex */
+        Hashmap *lldp_by_ifindex;
+
+        uint8_t buffer[LLDP_RECEIVER_BATCH][ETH_FRAME_LEN];
+};
+
 struct sd_lldp {
         unsigned n_ref;
 
         int ifindex;
         int fd;
 
+        sd_lldp_receiver *receiver;
+        bool receiving;
+
         sd_event *event;
         int64_t event_priority;
         sd_event_source *io_event_source;
@@ -26,6 +26,32 @@
 #include "lldp-network.h"
 #include "socket-util.h"
 
+static const uint8_t lldp_multicast_suffixes[] = { 0x00, 0x03, 0x0E };
+
+int lldp_network_set_membership(int fd, int ifindex, bool b) {
+        struct packet_mreq mreq = {
+                .mr_ifindex = ifindex,
+                .mr_type = PACKET_MR_MULTICAST,
+                .mr_alen = ETH_ALEN,
+                .mr_address = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x00 }
+        };
+        unsigned i;
+
+        assert(fd >= 0);
+        assert(ifindex > 0);
+
+        /* Join (or leave) the three LLDP multicast groups: nearest bridge, nearest non-TPMR bridge and
+         * nearest customer bridge */
+        for (i = 0; i < ELEMENTSOF(lldp_multicast_suffixes); i++) {
+                mreq.mr_address[ETH_ALEN - 1] = lldp_multicast_suffixes[i];
+
+                if (setsockopt(fd, SOL_PACKET, b ? PACKET_ADD_MEMBERSHIP : PACKET_DROP_MEMBERSHIP, &mreq, sizeof(mreq)) < 0)
+                        return -errno;
+        }
+
+        return 0;
+}
+
 int lldp_network_bind_raw_socket(int ifindex) {
 
         static const struct sock_filter filter[] = {
@@ -48,13 +74,6 @@ int lldp_network_bind_raw_socket(int ifindex) {
                 .filter = (struct sock_filter*) filter,
         };
 
-        struct packet_mreq mreq = {
-                .mr_ifindex = ifindex,
-                .mr_type = PACKET_MR_MULTICAST,
-                .mr_alen = ETH_ALEN,
-                .mr_address = { 0x01, 0x80, 0xC2, 0x00, 0x00, 0x00 }
-        };
-
         union sockaddr_union saddrll = {
                 .ll.sll_family = AF_PACKET,
                 .ll.sll_ifindex = ifindex,
@@ -63,7 +82,10 @@ int lldp_network_bind_raw_socket(int ifindex) {
         _cleanup_close_ int fd = -1;
         int r;
 
-        assert(ifindex > 0);
+        /* An ifindex of 0 returns a socket that is not bound to any interface, and receives LLDP frames
+         * from all interfaces it has been made a member of the multicast groups on, see
+         * lldp_network_set_membership(). */
+        assert(ifindex >= 0);
 
         fd = socket(PF_PACKET, SOCK_RAW|SOCK_CLOEXEC|SOCK_NONBLOCK,
                     htobe16(ETHERTYPE_LLDP));
@@ -74,19 +96,11 @@ int lldp_network_bind_raw_socket(int ifindex) {
         if (r < 0)
                 return -errno;
 
-        r = setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
-        if (r < 0)
-                return -errno;
-
-        mreq.mr_address[ETH_ALEN - 1] = 0x03;
-        r = setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
-        if (r < 0)
-                return -errno;
-
-        mreq.mr_address[ETH_ALEN - 1] = 0x0E;
-        r = setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
-        if (r < 0)
-                return -errno;
+        if (ifindex > 0) {
+                r = lldp_network_set_membership(fd, ifindex, true);
+                if (r < 0)
+                        return r;
+        }
 
         r = bind(fd, &saddrll.sa, sizeof(saddrll.ll));
         if (r < 0)
@@ -21,6 +21,9 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <stdbool.h>
+
 #include "sd-event.h"
 
 int lldp_network_bind_raw_socket(int ifindex);
+int lldp_network_set_membership(int fd, int ifindex, bool b);
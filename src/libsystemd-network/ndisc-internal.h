@@ -34,6 +34,9 @@ struct sd_ndisc {
         int ifindex;
         int fd;
 
+        sd_icmp6_mux *mux;
+        bool muxed;
+
         sd_event *event;
         int event_priority;
 
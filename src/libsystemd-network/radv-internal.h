@@ -34,6 +34,12 @@ assert_cc(SD_RADV_DEFAULT_MIN_TIMEOUT_USEC <= SD_RADV_DEFAULT_MAX_TIMEOUT_USEC)
 #define SD_RADV_MIN_DELAY_BETWEEN_RAS           3
 #define SD_RADV_MAX_RA_DELAY_TIME_USEC          (500*USEC_PER_MSEC)
 
+/* Lets the timers of many links elapse in the same event loop wakeup, so that their unsolicited
+ * advertisements can be sent together. Only used for the regular advertisements, which are minutes apart by
+ * default. The initial ones are only a few seconds apart, and keep the tight accuracy. */
+#define SD_RADV_TIMEOUT_ACCURACY_USEC           (1*USEC_PER_SEC)
+#define SD_RADV_INITIAL_TIMEOUT_ACCURACY_USEC   (1*USEC_PER_MSEC)
+
 #define SD_RADV_OPT_RDNSS                       25
 #define SD_RADV_OPT_DNSSL                       31
 
@@ -66,6 +72,8 @@ struct sd_radv {
         uint16_t lifetime;
 
         int fd;
+        sd_icmp6_mux *mux;
+        bool muxed;
         unsigned ra_sent;
         sd_event_source *recv_event_source;
         sd_event_source *timeout_event_source;
@@ -76,6 +84,12 @@ struct sd_radv {
         size_t n_rdnss;
         struct sd_radv_opt_dns *rdnss;
         struct sd_radv_opt_dns *dnssl;
+
+        /* Wire image of the advertisement, rebuilt only after the configuration changed. The router
+         * and prefix lifetimes are patched in before each transmission. */
+        uint8_t *packet;
+        size_t packet_size;
+        size_t packet_prefixes_offset;
 };
 
 struct sd_radv_prefix {
@@ -28,6 +28,7 @@
 #include "sd-ipv4acd.h"
 
 #include "alloc-util.h"
+#include "arp-mux.h"
 #include "arp-util.h"
 #include "ether-addr-util.h"
 #include "fd-util.h"
@@ -50,6 +51,9 @@
 #define RATE_LIMIT_INTERVAL_USEC (60U * USEC_PER_SEC)
 #define DEFEND_INTERVAL_USEC (10U * USEC_PER_SEC)
 
+/* Leeway given to the timers of instances sharing a socket, so that their packets are sent together */
+#define MUX_TIMER_ACCURACY_USEC (250U * USEC_PER_MSEC)
+
 typedef enum IPv4ACDState {
         IPV4ACD_STATE_INIT,
         IPV4ACD_STATE_STARTED,
@@ -69,6 +73,9 @@ struct sd_ipv4acd {
         int ifindex;
         int fd;
 
+        sd_ipv4acd_mux *mux;
+        bool muxed;
+
         unsigned n_iteration;
         unsigned n_conflict;
 
@@ -110,6 +117,12 @@ static void ipv4acd_reset(sd_ipv4acd *acd) {
 
         acd->fd = safe_close(acd->fd);
 
+        if (acd->muxed) {
+                arp_mux_dequeue(acd->mux, acd->ifindex, acd->address);
+                arp_mux_remove(acd->mux, acd->ifindex, acd->address);
+                acd->muxed = false;
+        }
+
         ipv4acd_set_state(acd, IPV4ACD_STATE_INIT, true);
 }
 
@@ -135,6 +148,7 @@ sd_ipv4acd *sd_ipv4acd_unref(sd_ipv4acd *acd) {
 
         ipv4acd_reset(acd);
         sd_ipv4acd_detach_event(acd);
+        sd_ipv4acd_mux_unref(acd->mux);
 
         return mfree(acd);
 }
@@ -184,19 +198,23 @@ static int ipv4acd_on_timeout(sd_event_source *s, uint64_t usec, void *userdata)
 
 static int ipv4acd_set_next_wakeup(sd_ipv4acd *acd, usec_t usec, usec_t random_usec) {
         _cleanup_(sd_event_source_unrefp) sd_event_source *timer = NULL;
-        usec_t next_timeout, time_now;
+        usec_t next_timeout, time_now, accuracy = 0;
         int r;
 
         assert(acd);
 
+        /* The leeway is taken off the random part, so that the intervals of the RFC are still kept */
+        if (acd->muxed)
+                accuracy = MIN(random_usec, MUX_TIMER_ACCURACY_USEC);
+
         next_timeout = usec;
 
-        if (random_usec > 0)
-                next_timeout += (usec_t) random_u64() % random_usec;
+        if (random_usec > accuracy)
+                next_timeout += (usec_t) random_u64() % (random_usec - accuracy);
 
         assert_se(sd_event_now(acd->event, clock_boottime_or_monotonic(), &time_now) >= 0);
 
-        r = sd_event_add_time(acd->event, &timer, clock_boottime_or_monotonic(), time_now + next_timeout, 0, ipv4acd_on_timeout, acd);
+        r = sd_event_add_time(acd->event, &timer, clock_boottime_or_monotonic(), time_now + next_timeout, accuracy, ipv4acd_on_timeout, acd);
         if (r < 0)
                 return r;
 
@@ -213,7 +231,19 @@ static int ipv4acd_set_next_wakeup(sd_ipv4acd *acd, usec_t usec, usec_t random_u
         return 0;
 }
 
-static bool ipv4acd_arp_conflict(sd_ipv4acd *acd, struct ether_arp *arp) {
+static int ipv4acd_send(sd_ipv4acd *acd, bool announce) {
+        assert(acd);
+
+        if (acd->muxed)
+                return arp_mux_queue(acd->mux, acd->ifindex, acd->address, &acd->mac_addr, announce);
+
+        if (announce)
+                return arp_send_announcement(acd->fd, acd->ifindex, acd->address, &acd->mac_addr);
+
+        return arp_send_probe(acd->fd, acd->ifindex, acd->address, &acd->mac_addr);
+}
+
+static bool ipv4acd_arp_conflict(sd_ipv4acd *acd, const struct ether_arp *arp) {
         assert(acd);
         assert(arp);
 
@@ -254,7 +284,7 @@ static int ipv4acd_on_timeout(sd_event_source *s, uint64_t usec, void *userdata)
         case IPV4ACD_STATE_WAITING_PROBE:
         case IPV4ACD_STATE_PROBING:
                 /* Send a probe */
-                r = arp_send_probe(acd->fd, acd->ifindex, acd->address, &acd->mac_addr);
+                r = ipv4acd_send(acd, false);
                 if (r < 0) {
                         log_ipv4acd_errno(acd, r, "Failed to send ARP probe: %m");
                         goto fail;
@@ -291,7 +321,7 @@ static int ipv4acd_on_timeout(sd_event_source *s, uint64_t usec, void *userdata)
                 _fallthrough_;
         case IPV4ACD_STATE_WAITING_ANNOUNCE:
                 /* Send announcement packet */
-                r = arp_send_announcement(acd->fd, acd->ifindex, acd->address, &acd->mac_addr);
+                r = ipv4acd_send(acd, true);
                 if (r < 0) {
                         log_ipv4acd_errno(acd, r, "Failed to send ARP announcement: %m");
                         goto fail;
@@ -337,40 +367,18 @@ static void ipv4acd_on_conflict(sd_ipv4acd *acd) {
         ipv4acd_client_notify(acd, SD_IPV4ACD_EVENT_CONFLICT);
 }
 
-static int ipv4acd_on_packet(
-                sd_event_source *s,
-                int fd,
-                uint32_t revents,
-                void *userdata) {
-
-        sd_ipv4acd *acd = userdata;
-        struct ether_arp packet;
-        ssize_t n;
+static void ipv4acd_handle_packet(sd_ipv4acd *acd, const struct ether_arp *packet) {
         int r;
 
-        assert(s);
         assert(acd);
-        assert(fd >= 0);
-
-        n = recv(fd, &packet, sizeof(struct ether_arp), 0);
-        if (n < 0) {
-                if (IN_SET(errno, EAGAIN, EINTR))
-                        return 0;
-
-                log_ipv4acd_errno(acd, errno, "Failed to read ARP packet: %m");
-                goto fail;
-        }
-        if ((size_t) n != sizeof(struct ether_arp)) {
-                log_ipv4acd(acd, "Ignoring too short ARP packet.");
-                return 0;
-        }
+        assert(packet);
 
         switch (acd->state) {
 
         case IPV4ACD_STATE_ANNOUNCING:
         case IPV4ACD_STATE_RUNNING:
 
-                if (ipv4acd_arp_conflict(acd, &packet)) {
+                if (ipv4acd_arp_conflict(acd, packet)) {
                         usec_t ts;
 
                         assert_se(sd_event_now(acd->event, clock_boottime_or_monotonic(), &ts) >= 0);
@@ -378,7 +386,7 @@ static int ipv4acd_on_packet(
                         /* Defend address */
                         if (ts > acd->defend_window) {
                                 acd->defend_window = ts + DEFEND_INTERVAL_USEC;
-                                r = arp_send_announcement(acd->fd, acd->ifindex, acd->address, &acd->mac_addr);
+                                r = ipv4acd_send(acd, true);
                                 if (r < 0) {
                                         log_ipv4acd_errno(acd, r, "Failed to send ARP announcement: %m");
                                         goto fail;
@@ -393,7 +401,7 @@ static int ipv4acd_on_packet(
         case IPV4ACD_STATE_WAITING_PROBE:
         case IPV4ACD_STATE_PROBING:
         case IPV4ACD_STATE_WAITING_ANNOUNCE:
-                /* BPF ensures this packet indicates a conflict */
+                /* BPF, or the lookup of the shared socket, ensures this packet indicates a conflict */
                 ipv4acd_on_conflict(acd);
                 break;
 
@@ -401,13 +409,52 @@ static int ipv4acd_on_packet(
                 assert_not_reached("Invalid state.");
         }
 
-        return 0;
+        return;
 
 fail:
         sd_ipv4acd_stop(acd);
+}
+
+static int ipv4acd_on_packet(
+                sd_event_source *s,
+                int fd,
+                uint32_t revents,
+                void *userdata) {
+
+        sd_ipv4acd *acd = userdata;
+        struct ether_arp packet;
+        ssize_t n;
+
+        assert(s);
+        assert(acd);
+        assert(fd >= 0);
+
+        n = recv(fd, &packet, sizeof(struct ether_arp), 0);
+        if (n < 0) {
+                if (IN_SET(errno, EAGAIN, EINTR))
+                        return 0;
+
+                log_ipv4acd_errno(acd, errno, "Failed to read ARP packet: %m");
+                sd_ipv4acd_stop(acd);
+                return 0;
+        }
+        if ((size_t) n != sizeof(struct ether_arp)) {
+                log_ipv4acd(acd, "Ignoring too short ARP packet.");
+                return 0;
+        }
+
+        ipv4acd_handle_packet(acd, &packet);
         return 0;
 }
 
+static void ipv4acd_mux_recv(const struct ether_arp *packet, void *userdata) {
+        sd_ipv4acd *acd = userdata;
+
+        assert(acd);
+
+        ipv4acd_handle_packet(acd, packet);
+}
+
 int sd_ipv4acd_set_ifindex(sd_ipv4acd *acd, int ifindex) {
         assert_return(acd, -EINVAL);
         assert_return(ifindex > 0, -EINVAL);
@@ -474,6 +521,16 @@ int sd_ipv4acd_set_address(sd_ipv4acd *acd, const struct in_addr *address) {
         return 0;
 }
 
+int sd_ipv4acd_set_mux(sd_ipv4acd *acd, sd_ipv4acd_mux *mux) {
+        assert_return(acd, -EINVAL);
+        assert_return(acd->state == IPV4ACD_STATE_INIT, -EBUSY);
+
+        sd_ipv4acd_mux_unref(acd->mux);
+        acd->mux = sd_ipv4acd_mux_ref(mux);
+
+        return 0;
+}
+
 int sd_ipv4acd_is_running(sd_ipv4acd *acd) {
         assert_return(acd, false);
 
@@ -490,24 +547,33 @@ int sd_ipv4acd_start(sd_ipv4acd *acd) {
         assert_return(!ether_addr_is_null(&acd->mac_addr), -EINVAL);
         assert_return(acd->state == IPV4ACD_STATE_INIT, -EBUSY);
 
-        r = arp_network_bind_raw_socket(acd->ifindex, acd->address, &acd->mac_addr);
-        if (r < 0)
-                return r;
+        if (acd->mux) {
+                r = arp_mux_add(acd->mux, acd->ifindex, acd->address, &acd->mac_addr, ipv4acd_mux_recv, acd);
+                if (r < 0)
+                        return r;
 
-        safe_close(acd->fd);
-        acd->fd = r;
-        acd->defend_window = 0;
-        acd->n_conflict = 0;
+                acd->muxed = true;
+        } else {
+                r = arp_network_bind_raw_socket(acd->ifindex, acd->address, &acd->mac_addr);
+                if (r < 0)
+                        return r;
 
-        r = sd_event_add_io(acd->event, &acd->receive_message_event_source, acd->fd, EPOLLIN, ipv4acd_on_packet, acd);
-        if (r < 0)
-                goto fail;
+                safe_close(acd->fd);
+                acd->fd = r;
 
-        r = sd_event_source_set_priority(acd->receive_message_event_source, acd->event_priority);
-        if (r < 0)
-                goto fail;
+                r = sd_event_add_io(acd->event, &acd->receive_message_event_source, acd->fd, EPOLLIN, ipv4acd_on_packet, acd);
+                if (r < 0)
+                        goto fail;
+
+                r = sd_event_source_set_priority(acd->receive_message_event_source, acd->event_priority);
+                if (r < 0)
+                        goto fail;
+
+                (void) sd_event_source_set_description(acd->receive_message_event_source, "ipv4acd-receive-message");
+        }
 
-        (void) sd_event_source_set_description(acd->receive_message_event_source, "ipv4acd-receive-message");
+        acd->defend_window = 0;
+        acd->n_conflict = 0;
 
         r = ipv4acd_set_next_wakeup(acd, 0, 0);
         if (r < 0)
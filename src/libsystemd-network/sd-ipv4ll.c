@@ -193,6 +193,13 @@ int sd_ipv4ll_set_address_seed(sd_ipv4ll *ll, uint64_t seed) {
         return 0;
 }
 
+int sd_ipv4ll_set_mux(sd_ipv4ll *ll, sd_ipv4acd_mux *mux) {
+        assert_return(ll, -EINVAL);
+        assert_return(sd_ipv4ll_is_running(ll) == 0, -EBUSY);
+
+        return sd_ipv4acd_set_mux(ll->acd, mux);
+}
+
 int sd_ipv4ll_is_running(sd_ipv4ll *ll) {
         assert_return(ll, false);
 
@@ -20,12 +20,14 @@
 ***/
 
 #include <arpa/inet.h>
+#include <linux/if_packet.h>
 #include <linux/sockios.h>
 
 #include "sd-lldp.h"
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "io-util.h"
 #include "lldp-internal.h"
 #include "lldp-neighbor.h"
 #include "lldp-network.h"
@@ -239,9 +241,187 @@ static int lldp_receive_datagram(sd_event_source *s, int fd, uint32_t revents, v
         return lldp_handle_datagram(lldp, n);
 }
 
+static void lldp_receiver_reset(sd_lldp_receiver *receiver) {
+        assert(receiver);
+
+        receiver->io_event_source = sd_event_source_unref(receiver->io_event_source);
+        receiver->fd = safe_close(receiver->fd);
+}
+
+static void lldp_receiver_handle(sd_lldp_receiver *receiver, struct mmsghdr *mh, const uint8_t *buf) {
+        _cleanup_(sd_lldp_neighbor_unrefp) sd_lldp_neighbor *n = NULL;
+        const struct sockaddr_ll *sll = mh->msg_hdr.msg_name;
+        struct cmsghdr *cmsg;
+        sd_lldp *lldp;
+
+        assert(receiver);
+        assert(mh);
+        assert(buf);
+
+        if (mh->msg_hdr.msg_flags & MSG_TRUNC) {
+                log_lldp("Dropping oversized datagram.");
+                return;
+        }
+
+        if (mh->msg_hdr.msg_namelen < sizeof(struct sockaddr_ll) || sll->sll_pkttype == PACKET_OUTGOING)
+                return;
+
+        lldp = hashmap_get(receiver->lldp_by_ifindex, INT_TO_PTR(sll->sll_ifindex));
+        if (!lldp)
+                return;
+
+        n = lldp_neighbor_new(mh->msg_len);
+        if (!n)
+                return;
+
+        memcpy(LLDP_NEIGHBOR_RAW(n), buf, mh->msg_len);
+
+        triple_timestamp_get(&n->timestamp);
+        CMSG_FOREACH(cmsg, &mh->msg_hdr)
+                if (cmsg->cmsg_level == SOL_SOCKET &&
+                    cmsg->cmsg_type == SCM_TIMESTAMPNS &&
+                    cmsg->cmsg_len == CMSG_LEN(sizeof(struct timespec))) {
+                        triple_timestamp_from_realtime(&n->timestamp, timespec_load((struct timespec*) CMSG_DATA(cmsg)));
+                        break;
+                }
+
+        /* The callback might stop or even drop the object */
+        sd_lldp_ref(lldp);
+        (void) lldp_handle_datagram(lldp, n);
+        sd_lldp_unref(lldp);
+}
+
+static int lldp_receiver_dispatch(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        sd_lldp_receiver *receiver = userdata;
+        int n, i;
+
+        assert(fd >= 0);
+        assert(receiver);
+
+        /* Read as many frames as we can with as few syscalls as possible, and hand each to the sd_lldp
+         * object of the interface it was received on. */
+        sd_lldp_receiver_ref(receiver);
+
+        do {
+                struct mmsghdr mh[LLDP_RECEIVER_BATCH] = {};
+                struct iovec iov[LLDP_RECEIVER_BATCH];
+                union sockaddr_union sa[LLDP_RECEIVER_BATCH];
+                uint8_t control[LLDP_RECEIVER_BATCH][CMSG_SPACE(sizeof(struct timespec))];
+
+                for (i = 0; i < (int) LLDP_RECEIVER_BATCH; i++) {
+                        iov[i] = IOVEC_MAKE(receiver->buffer[i], sizeof(receiver->buffer[i]));
+
+                        mh[i].msg_hdr.msg_name = &sa[i];
+                        mh[i].msg_hdr.msg_namelen = sizeof(sa[i]);
+                        mh[i].msg_hdr.msg_iov = iov + i;
+                        mh[i].msg_hdr.msg_iovlen = 1;
+                        mh[i].msg_hdr.msg_control = control[i];
+                        mh[i].msg_hdr.msg_controllen = sizeof(control[i]);
+                }
+
+                /* The callbacks may stop the last sd_lldp object and start one again, which replaces the
+                 * socket. Hence always read from the current one, not from the fd this was dispatched for. */
+                n = recvmmsg(receiver->fd, mh, LLDP_RECEIVER_BATCH, MSG_DONTWAIT, NULL);
+                if (n < 0) {
+                        if (!IN_SET(errno, EAGAIN, EINTR))
+                                log_lldp_errno(errno, "Failed to read LLDP datagrams: %m");
+
+                        break;
+                }
+
+                for (i = 0; i < n && receiver->fd >= 0; i++)
+                        lldp_receiver_handle(receiver, mh + i, receiver->buffer[i]);
+
+        } while (n == (int) LLDP_RECEIVER_BATCH && receiver->fd >= 0);
+
+        sd_lldp_receiver_unref(receiver);
+
+        return 0;
+}
+
+static int lldp_receiver_add(sd_lldp_receiver *receiver, sd_lldp *lldp) {
+        int r;
+
+        assert(receiver);
+        assert(lldp);
+        assert(lldp->ifindex > 0);
+
+        if (!receiver->event)
+                return -EINVAL;
+
+        if (receiver->fd < 0) {
+                static const int one = 1;
+
+                receiver->fd = lldp_network_bind_raw_socket(0);
+                if (receiver->fd < 0)
+                        return receiver->fd;
+
+                /* Ask for the receive timestamp along with each frame, the SIOCGSTAMPNS ioctl only
+                 * reports the one of the last frame read */
+                (void) setsockopt(receiver->fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+
+                r = sd_event_add_io(receiver->event, &receiver->io_event_source, receiver->fd, EPOLLIN, lldp_receiver_dispatch, receiver);
+                if (r < 0)
+                        goto fail;
+
+                r = sd_event_source_set_priority(receiver->io_event_source, receiver->event_priority);
+                if (r < 0)
+                        goto fail;
+
+                (void) sd_event_source_set_description(receiver->io_event_source, "lldp-receiver-io");
+        }
+
+        r = hashmap_ensure_allocated(&receiver->lldp_by_ifindex, NULL);
+        if (r < 0)
+                goto fail;
+
+        r = hashmap_put(receiver->lldp_by_ifindex, INT_TO_PTR(lldp->ifindex), lldp);
+        if (r < 0)
+                goto fail;
+
+        r = lldp_network_set_membership(receiver->fd, lldp->ifindex, true);
+        if (r < 0) {
+                hashmap_remove(receiver->lldp_by_ifindex, INT_TO_PTR(lldp->ifindex));
+                goto fail;
+        }
+
+        return 0;
+
+fail:
+        if (hashmap_isempty(receiver->lldp_by_ifindex))
+                lldp_receiver_reset(receiver);
+        return r;
+}
+
+static void lldp_receiver_remove(sd_lldp_receiver *receiver, sd_lldp *lldp) {
+        assert(receiver);
+        assert(lldp);
+
+        if (!hashmap_remove_value(receiver->lldp_by_ifindex, INT_TO_PTR(lldp->ifindex), lldp))
+                return;
+
+        /* This fails if the interface is already gone, in which case the kernel dropped the
+         * memberships anyway */
+        (void) lldp_network_set_membership(receiver->fd, lldp->ifindex, false);
+
+        if (hashmap_isempty(receiver->lldp_by_ifindex))
+                lldp_receiver_reset(receiver);
+}
+
+static bool lldp_is_running(sd_lldp *lldp) {
+        assert(lldp);
+
+        return lldp->fd >= 0 || lldp->receiving;
+}
+
 static void lldp_reset(sd_lldp *lldp) {
         assert(lldp);
 
+        if (lldp->receiving) {
+                lldp_receiver_remove(lldp->receiver, lldp);
+                lldp->receiving = false;
+        }
+
         lldp->timer_event_source = sd_event_source_unref(lldp->timer_event_source);
         lldp->io_event_source = sd_event_source_unref(lldp->io_event_source);
         lldp->fd = safe_close(lldp->fd);
@@ -254,11 +434,22 @@ _public_ int sd_lldp_start(sd_lldp *lldp) {
         assert_return(lldp->event, -EINVAL);
         assert_return(lldp->ifindex > 0, -EINVAL);
 
-        if (lldp->fd >= 0)
+        if (lldp_is_running(lldp))
                 return 0;
 
         assert(!lldp->io_event_source);
 
+        if (lldp->receiver) {
+                r = lldp_receiver_add(lldp->receiver, lldp);
+                if (r < 0)
+                        return r;
+
+                lldp->receiving = true;
+
+                log_lldp("Started LLDP client on shared receiver");
+                return 1;
+        }
+
         lldp->fd = lldp_network_bind_raw_socket(lldp->ifindex);
         if (lldp->fd < 0)
                 return lldp->fd;
@@ -284,7 +475,7 @@ fail:
 _public_ int sd_lldp_stop(sd_lldp *lldp) {
         assert_return(lldp, -EINVAL);
 
-        if (lldp->fd < 0)
+        if (!lldp_is_running(lldp))
                 return 0;
 
         log_lldp("Stopping LLDP client");
@@ -299,7 +490,7 @@ _public_ int sd_lldp_attach_event(sd_lldp *lldp, sd_event *event, int64_t priori
         int r;
 
         assert_return(lldp, -EINVAL);
-        assert_return(lldp->fd < 0, -EBUSY);
+        assert_return(!lldp_is_running(lldp), -EBUSY);
         assert_return(!lldp->event, -EBUSY);
 
         if (event)
@@ -318,7 +509,7 @@ _public_ int sd_lldp_attach_event(sd_lldp *lldp, sd_event *event, int64_t priori
 _public_ int sd_lldp_detach_event(sd_lldp *lldp) {
 
         assert_return(lldp, -EINVAL);
-        assert_return(lldp->fd < 0, -EBUSY);
+        assert_return(!lldp_is_running(lldp), -EBUSY);
 
         lldp->event = sd_event_unref(lldp->event);
         return 0;
@@ -342,12 +533,22 @@ _public_ int sd_lldp_set_callback(sd_lldp *lldp, sd_lldp_callback_t cb, void *us
 _public_ int sd_lldp_set_ifindex(sd_lldp *lldp, int ifindex) {
         assert_return(lldp, -EINVAL);
         assert_return(ifindex > 0, -EINVAL);
-        assert_return(lldp->fd < 0, -EBUSY);
+        assert_return(!lldp_is_running(lldp), -EBUSY);
 
         lldp->ifindex = ifindex;
         return 0;
 }
 
+_public_ int sd_lldp_set_receiver(sd_lldp *lldp, sd_lldp_receiver *receiver) {
+        assert_return(lldp, -EINVAL);
+        assert_return(!lldp_is_running(lldp), -EBUSY);
+
+        sd_lldp_receiver_unref(lldp->receiver);
+        lldp->receiver = sd_lldp_receiver_ref(receiver);
+
+        return 0;
+}
+
 _public_ sd_lldp* sd_lldp_ref(sd_lldp *lldp) {
 
         if (!lldp)
@@ -373,6 +574,7 @@ _public_ sd_lldp* sd_lldp_unref(sd_lldp *lldp) {
         lldp_reset(lldp);
         sd_lldp_detach_event(lldp);
         lldp_flush_neighbors(lldp);
+        sd_lldp_receiver_unref(lldp->receiver);
 
         hashmap_free(lldp->neighbor_by_id);
         prioq_free(lldp->neighbor_by_expiry);
@@ -408,6 +610,82 @@ _public_ int sd_lldp_new(sd_lldp **ret) {
         return 0;
 }
 
+_public_ int sd_lldp_receiver_new(sd_lldp_receiver **ret) {
+        sd_lldp_receiver *receiver;
+
+        assert_return(ret, -EINVAL);
+
+        receiver = new0(sd_lldp_receiver, 1);
+        if (!receiver)
+                return -ENOMEM;
+
+        receiver->n_ref = 1;
+        receiver->fd = -1;
+
+        *ret = receiver;
+        return 0;
+}
+
+_public_ sd_lldp_receiver* sd_lldp_receiver_ref(sd_lldp_receiver *receiver) {
+
+        if (!receiver)
+                return NULL;
+
+        assert(receiver->n_ref > 0);
+        receiver->n_ref++;
+
+        return receiver;
+}
+
+_public_ sd_lldp_receiver* sd_lldp_receiver_unref(sd_lldp_receiver *receiver) {
+
+        if (!receiver)
+                return NULL;
+
+        assert(receiver->n_ref > 0);
+        receiver->n_ref--;
+
+        if (receiver->n_ref > 0)
+                return NULL;
+
+        /* Every started sd_lldp object holds a reference, hence there can't be any left */
+        assert(hashmap_isempty(receiver->lldp_by_ifindex));
+
+        lldp_receiver_reset(receiver);
+        sd_event_unref(receiver->event);
+        hashmap_free(receiver->lldp_by_ifindex);
+        return mfree(receiver);
+}
+
+_public_ int sd_lldp_receiver_attach_event(sd_lldp_receiver *receiver, sd_event *event, int64_t priority) {
+        int r;
+
+        assert_return(receiver, -EINVAL);
+        assert_return(receiver->fd < 0, -EBUSY);
+        assert_return(!receiver->event, -EBUSY);
+
+        if (event)
+                receiver->event = sd_event_ref(event);
+        else {
+                r = sd_event_default(&receiver->event);
+                if (r < 0)
+                        return r;
+        }
+
+        receiver->event_priority = priority;
+
+        return 0;
+}
+
+_public_ int sd_lldp_receiver_detach_event(sd_lldp_receiver *receiver) {
+
+        assert_return(receiver, -EINVAL);
+        assert_return(receiver->fd < 0, -EBUSY);
+
+        receiver->event = sd_event_unref(receiver->event);
+        return 0;
+}
+
 static int neighbor_compare_func(const void *a, const void *b) {
         const sd_lldp_neighbor * const*x = a, * const *y = b;
 
@@ -25,6 +25,7 @@
 
 #include "alloc-util.h"
 #include "fd-util.h"
+#include "icmp6-mux.h"
 #include "icmp6-util.h"
 #include "in-addr-util.h"
 #include "ndisc-internal.h"
@@ -36,6 +37,12 @@
 
 #define NDISC_TIMEOUT_NO_RA_USEC (NDISC_ROUTER_SOLICITATION_INTERVAL * NDISC_MAX_ROUTER_SOLICITATIONS)
 
+static bool ndisc_is_running(sd_ndisc *nd) {
+        assert(nd);
+
+        return nd->fd >= 0 || nd->muxed;
+}
+
 static void ndisc_callback(sd_ndisc *ndisc, sd_ndisc_event event, sd_ndisc_router *rt) {
         assert(ndisc);
 
@@ -63,7 +70,7 @@ _public_ int sd_ndisc_set_callback(
 _public_ int sd_ndisc_set_ifindex(sd_ndisc *nd, int ifindex) {
         assert_return(nd, -EINVAL);
         assert_return(ifindex > 0, -EINVAL);
-        assert_return(nd->fd < 0, -EBUSY);
+        assert_return(!ndisc_is_running(nd), -EBUSY);
 
         nd->ifindex = ifindex;
         return 0;
@@ -84,7 +91,7 @@ _public_ int sd_ndisc_attach_event(sd_ndisc *nd, sd_event *event, int64_t priori
         int r;
 
         assert_return(nd, -EINVAL);
-        assert_return(nd->fd < 0, -EBUSY);
+        assert_return(!ndisc_is_running(nd), -EBUSY);
         assert_return(!nd->event, -EBUSY);
 
         if (event)
@@ -100,10 +107,20 @@ _public_ int sd_ndisc_attach_event(sd_ndisc *nd, sd_event *event, int64_t priori
         return 0;
 }
 
+_public_ int sd_ndisc_set_mux(sd_ndisc *nd, sd_icmp6_mux *mux) {
+        assert_return(nd, -EINVAL);
+        assert_return(!ndisc_is_running(nd), -EBUSY);
+
+        sd_icmp6_mux_unref(nd->mux);
+        nd->mux = sd_icmp6_mux_ref(mux);
+
+        return 0;
+}
+
 _public_ int sd_ndisc_detach_event(sd_ndisc *nd) {
 
         assert_return(nd, -EINVAL);
-        assert_return(nd->fd < 0, -EBUSY);
+        assert_return(!ndisc_is_running(nd), -EBUSY);
 
         nd->event = sd_event_unref(nd->event);
         return 0;
@@ -129,6 +146,11 @@ _public_ sd_ndisc *sd_ndisc_ref(sd_ndisc *nd) {
 static int ndisc_reset(sd_ndisc *nd) {
         assert(nd);
 
+        if (nd->muxed) {
+                icmp6_mux_remove(nd->mux, ND_ROUTER_ADVERT, nd->ifindex);
+                nd->muxed = false;
+        }
+
         nd->timeout_event_source = sd_event_source_unref(nd->timeout_event_source);
         nd->timeout_no_ra = sd_event_source_unref(nd->timeout_no_ra);
         nd->retransmit_time = 0;
@@ -151,6 +173,7 @@ _public_ sd_ndisc *sd_ndisc_unref(sd_ndisc *nd) {
 
         ndisc_reset(nd);
         sd_ndisc_detach_event(nd);
+        sd_icmp6_mux_unref(nd->mux);
         return mfree(nd);
 }
 
@@ -266,6 +289,35 @@ static int ndisc_recv(sd_event_source *s, int fd, uint32_t revents, void *userda
         return ndisc_handle_datagram(nd, rt);
 }
 
+static int ndisc_mux_recv(const void *packet, size_t size, const struct in6_addr *src,
+                          const triple_timestamp *timestamp, void *userdata) {
+        _cleanup_(sd_ndisc_router_unrefp) sd_ndisc_router *rt = NULL;
+        sd_ndisc *nd = userdata;
+
+        assert(packet);
+        assert(src);
+        assert(timestamp);
+        assert(nd);
+
+        /* Source address, hop limit and interface have already been checked by the multiplexer */
+        rt = ndisc_router_new(size);
+        if (!rt)
+                return -ENOMEM;
+
+        memcpy(NDISC_ROUTER_RAW(rt), packet, size);
+        rt->address = *src;
+        rt->timestamp = *timestamp;
+
+        nd->timeout_event_source = sd_event_source_unref(nd->timeout_event_source);
+
+        /* The callback might stop or even drop the object */
+        sd_ndisc_ref(nd);
+        (void) ndisc_handle_datagram(nd, rt);
+        sd_ndisc_unref(nd);
+
+        return 0;
+}
+
 static usec_t ndisc_timeout_compute_random(usec_t val) {
         /* compute a time that is random within ±10% of the given value */
         return val - val / 10 +
@@ -314,7 +366,7 @@ static int ndisc_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
                 goto fail;
         }
 
-        r = icmp6_send_router_solicitation(nd->fd, &nd->mac_addr);
+        r = icmp6_send_router_solicitation(nd->muxed ? nd->mux->fd : nd->fd, nd->ifindex, &nd->mac_addr);
         if (r < 0) {
                 log_ndisc_errno(r, "Error sending Router Solicitation: %m");
                 goto fail;
@@ -348,7 +400,7 @@ static int ndisc_timeout_no_ra(sd_event_source *s, uint64_t usec, void *userdata
 _public_ int sd_ndisc_stop(sd_ndisc *nd) {
         assert_return(nd, -EINVAL);
 
-        if (nd->fd < 0)
+        if (!ndisc_is_running(nd))
                 return 0;
 
         log_ndisc("Stopping IPv6 Router Solicitation client");
@@ -365,7 +417,7 @@ _public_ int sd_ndisc_start(sd_ndisc *nd) {
         assert_return(nd->event, -EINVAL);
         assert_return(nd->ifindex > 0, -EINVAL);
 
-        if (nd->fd >= 0)
+        if (ndisc_is_running(nd))
                 return 0;
 
         assert(!nd->recv_event_source);
@@ -375,19 +427,27 @@ _public_ int sd_ndisc_start(sd_ndisc *nd) {
         if (r < 0)
                 goto fail;
 
-        nd->fd = icmp6_bind_router_solicitation(nd->ifindex);
-        if (nd->fd < 0)
-                return nd->fd;
+        if (nd->mux) {
+                r = icmp6_mux_add(nd->mux, ND_ROUTER_ADVERT, nd->ifindex, ndisc_mux_recv, nd);
+                if (r < 0)
+                        return r;
 
-        r = sd_event_add_io(nd->event, &nd->recv_event_source, nd->fd, EPOLLIN, ndisc_recv, nd);
-        if (r < 0)
-                goto fail;
+                nd->muxed = true;
+        } else {
+                nd->fd = icmp6_bind_router_solicitation(nd->ifindex);
+                if (nd->fd < 0)
+                        return nd->fd;
 
-        r = sd_event_source_set_priority(nd->recv_event_source, nd->event_priority);
-        if (r < 0)
-                goto fail;
+                r = sd_event_add_io(nd->event, &nd->recv_event_source, nd->fd, EPOLLIN, ndisc_recv, nd);
+                if (r < 0)
+                        goto fail;
+
+                r = sd_event_source_set_priority(nd->recv_event_source, nd->event_priority);
+                if (r < 0)
+                        goto fail;
 
-        (void) sd_event_source_set_description(nd->recv_event_source, "ndisc-receive-message");
+                (void) sd_event_source_set_description(nd->recv_event_source, "ndisc-receive-message");
+        }
 
         r = sd_event_add_time(nd->event, &nd->timeout_event_source, clock_boottime_or_monotonic(), 0, 0, ndisc_timeout, nd);
         if (r < 0)
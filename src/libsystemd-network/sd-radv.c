@@ -28,8 +28,10 @@
 #include "alloc-util.h"
 #include "dns-domain.h"
 #include "fd-util.h"
+#include "icmp6-mux.h"
 #include "icmp6-util.h"
 #include "in-addr-util.h"
+#include "io-util.h"
 #include "radv-internal.h"
 #include "socket-util.h"
 #include "string-util.h"
@@ -92,6 +94,12 @@ _public_ sd_event *sd_radv_get_event(sd_radv *ra) {
 
 static void radv_reset(sd_radv *ra) {
 
+        if (ra->muxed) {
+                icmp6_mux_dequeue(ra->mux, ra->ifindex);
+                icmp6_mux_remove(ra->mux, ND_ROUTER_SOLICIT, ra->ifindex);
+                ra->muxed = false;
+        }
+
         ra->timeout_event_source =
                 sd_event_source_unref(ra->timeout_event_source);
 
@@ -130,22 +138,49 @@ _public_ sd_radv *sd_radv_unref(sd_radv *ra) {
 
         free(ra->rdnss);
         free(ra->dnssl);
+        free(ra->packet);
 
         radv_reset(ra);
 
         sd_radv_detach_event(ra);
+        sd_icmp6_mux_unref(ra->mux);
         return mfree(ra);
 }
 
-static int radv_send(sd_radv *ra, const struct in6_addr *dst,
-                     const uint32_t router_lifetime) {
+static void radv_packet_invalidate(sd_radv *ra) {
+        assert(ra);
+
+        ra->packet = mfree(ra->packet);
+        ra->packet_size = 0;
+}
+
+static void radv_prefixes_changed(sd_radv *ra) {
+        usec_t time_now;
+
+        assert(ra);
+
+        radv_packet_invalidate(ra);
+
+        if (ra->state != SD_RADV_STATE_ADVERTISING || !ra->timeout_event_source)
+                return;
+
+        /* RFC 4861, Section 6.2.4, the advertised prefixes changed: advertise them right away, and
+         * start over with the initial Router Advertisements, without interrupting the service */
+        if (sd_event_now(ra->event, clock_boottime_or_monotonic(), &time_now) < 0)
+                return;
+
+        ra->ra_sent = 0;
+        (void) sd_event_source_set_time(ra->timeout_event_source, time_now);
+}
+
+static int radv_packet_build(sd_radv *ra) {
         static const struct ether_addr mac_zero = {};
         sd_radv_prefix *p;
-        struct sockaddr_in6 dst_addr = {
-                .sin6_family = AF_INET6,
-                .sin6_addr = IN6ADDR_ALL_NODES_MULTICAST_INIT,
+        struct nd_router_advert adv = {
+                .nd_ra_type = ND_ROUTER_ADVERT,
+                .nd_ra_curhoplimit = ra->hop_limit,
+                .nd_ra_flags_reserved = ra->flags,
         };
-        struct nd_router_advert adv = {};
         struct {
                 struct nd_opt_hdr opthdr;
                 struct ether_addr slladdr;
@@ -155,89 +190,163 @@ static int radv_send(sd_radv *ra, const struct in6_addr *dst,
                         .nd_opt_len = (sizeof(struct nd_opt_hdr) +
                                        sizeof(struct ether_addr) - 1) /8 + 1,
                 },
+                .slladdr = ra->mac_addr,
         };
         struct nd_opt_mtu opt_mtu =  {
                 .nd_opt_mtu_type = ND_OPT_MTU,
                 .nd_opt_mtu_len = 1,
+                .nd_opt_mtu_mtu = htobe32(ra->mtu),
         };
-        /* Reserve iov space for RA header, linkaddr, MTU, N prefixes, RDNSS
-           and DNSSL */
-        struct iovec iov[5 + ra->n_prefixes];
-        struct msghdr msg = {
-                .msg_name = &dst_addr,
-                .msg_namelen = sizeof(dst_addr),
-                .msg_iov = iov,
-        };
-        usec_t time_now;
-        int r;
+        /* MAC address is optional, either because the link does not use L2
+           addresses or load sharing is desired. See RFC 4861, Section 4.2 */
+        bool with_mac = memcmp(&mac_zero, &ra->mac_addr, sizeof(mac_zero)) != 0;
+        size_t size, prefixes_offset;
+        uint8_t *packet, *q;
 
-        r = sd_event_now(ra->event, clock_boottime_or_monotonic(), &time_now);
-        if (r < 0)
-                return r;
+        assert(ra);
 
-        if (dst && !in_addr_is_null(AF_INET6, (union in_addr_union*) dst))
-                dst_addr.sin6_addr = *dst;
+        size = sizeof(adv);
+        if (with_mac)
+                size += sizeof(opt_mac);
+        if (ra->mtu)
+                size += sizeof(opt_mtu);
 
-        adv.nd_ra_type = ND_ROUTER_ADVERT;
-        adv.nd_ra_curhoplimit = ra->hop_limit;
-        adv.nd_ra_flags_reserved = ra->flags;
-        adv.nd_ra_router_lifetime = htobe16(router_lifetime);
-        iov[msg.msg_iovlen].iov_base = &adv;
-        iov[msg.msg_iovlen].iov_len = sizeof(adv);
-        msg.msg_iovlen++;
+        prefixes_offset = size;
+        LIST_FOREACH(prefix, p, ra->prefixes)
+                size += sizeof(p->opt);
 
-        /* MAC address is optional, either because the link does not use L2
-           addresses or load sharing is desired. See RFC 4861, Section 4.2 */
-        if (memcmp(&mac_zero, &ra->mac_addr, sizeof(mac_zero))) {
-                opt_mac.slladdr = ra->mac_addr;
-                iov[msg.msg_iovlen].iov_base = &opt_mac;
-                iov[msg.msg_iovlen].iov_len = sizeof(opt_mac);
-                msg.msg_iovlen++;
-        }
+        if (ra->rdnss)
+                size += ra->rdnss->length * 8;
+        if (ra->dnssl)
+                size += ra->dnssl->length * 8;
+
+        packet = malloc(size);
+        if (!packet)
+                return -ENOMEM;
+
+        q = mempcpy(packet, &adv, sizeof(adv));
+        if (with_mac)
+                q = mempcpy(q, &opt_mac, sizeof(opt_mac));
+        if (ra->mtu)
+                q = mempcpy(q, &opt_mtu, sizeof(opt_mtu));
+
+        LIST_FOREACH(prefix, p, ra->prefixes)
+                q = mempcpy(q, &p->opt, sizeof(p->opt));
+
+        if (ra->rdnss)
+                q = mempcpy(q, ra->rdnss, ra->rdnss->length * 8);
+        if (ra->dnssl)
+                q = mempcpy(q, ra->dnssl, ra->dnssl->length * 8);
+
+        assert((size_t) (q - packet) == size);
+
+        free(ra->packet);
+        ra->packet = packet;
+        ra->packet_size = size;
+        ra->packet_prefixes_offset = prefixes_offset;
+
+        return 0;
+}
+
+static int radv_packet_update(sd_radv *ra, uint32_t router_lifetime, usec_t time_now) {
+        struct nd_router_advert *adv;
+        sd_radv_prefix *p;
+        size_t offset;
+        int r;
+
+        assert(ra);
 
-        if (ra->mtu) {
-                opt_mtu.nd_opt_mtu_mtu = htobe32(ra->mtu);
-                iov[msg.msg_iovlen].iov_base = &opt_mtu;
-                iov[msg.msg_iovlen].iov_len = sizeof(opt_mtu);
-                msg.msg_iovlen++;
+        if (!ra->packet) {
+                r = radv_packet_build(ra);
+                if (r < 0)
+                        return r;
         }
 
+        adv = (struct nd_router_advert*) ra->packet;
+        adv->nd_ra_router_lifetime = htobe16(router_lifetime);
+
+        offset = ra->packet_prefixes_offset;
         LIST_FOREACH(prefix, p, ra->prefixes) {
                 if (p->valid_until) {
+                        typeof(p->opt) *opt = (typeof(p->opt)*) (ra->packet + offset);
 
                         if (time_now > p->valid_until)
-                                p->opt.valid_lifetime = 0;
+                                opt->valid_lifetime = 0;
                         else
-                                p->opt.valid_lifetime = htobe32((p->valid_until - time_now) / USEC_PER_SEC);
+                                opt->valid_lifetime = htobe32((p->valid_until - time_now) / USEC_PER_SEC);
 
                         if (time_now > p->preferred_until)
-                                p->opt.preferred_lifetime = 0;
+                                opt->preferred_lifetime = 0;
                         else
-                                p->opt.preferred_lifetime = htobe32((p->preferred_until - time_now) / USEC_PER_SEC);
+                                opt->preferred_lifetime = htobe32((p->preferred_until - time_now) / USEC_PER_SEC);
                 }
-                iov[msg.msg_iovlen].iov_base = &p->opt;
-                iov[msg.msg_iovlen].iov_len = sizeof(p->opt);
-                msg.msg_iovlen++;
-        }
 
-        if (ra->rdnss) {
-                iov[msg.msg_iovlen].iov_base = ra->rdnss;
-                iov[msg.msg_iovlen].iov_len = ra->rdnss->length * 8;
-                msg.msg_iovlen++;
+                offset += sizeof(p->opt);
         }
 
-        if (ra->dnssl) {
-                iov[msg.msg_iovlen].iov_base = ra->dnssl;
-                iov[msg.msg_iovlen].iov_len = ra->dnssl->length * 8;
-                msg.msg_iovlen++;
-        }
+        return 0;
+}
+
+static int radv_packet_send(sd_radv *ra, const struct in6_addr *dst) {
+        struct sockaddr_in6 dst_addr = {
+                .sin6_family = AF_INET6,
+                .sin6_addr = IN6ADDR_ALL_NODES_MULTICAST_INIT,
+                .sin6_scope_id = ra->ifindex,
+        };
+        struct iovec iov = IOVEC_MAKE(ra->packet, ra->packet_size);
+        struct msghdr msg = {
+                .msg_name = &dst_addr,
+                .msg_namelen = sizeof(dst_addr),
+                .msg_iov = &iov,
+                .msg_iovlen = 1,
+        };
 
-        if (sendmsg(ra->fd, &msg, 0) < 0)
+        assert(ra);
+        assert(ra->packet);
+
+        if (dst && !in_addr_is_null(AF_INET6, (union in_addr_union*) dst))
+                dst_addr.sin6_addr = *dst;
+
+        if (sendmsg(ra->muxed ? ra->mux->fd : ra->fd, &msg, 0) < 0)
                 return -errno;
 
         return 0;
 }
 
+static int radv_send(sd_radv *ra, const struct in6_addr *dst,
+                     const uint32_t router_lifetime) {
+        usec_t time_now;
+        int r;
+
+        r = sd_event_now(ra->event, clock_boottime_or_monotonic(), &time_now);
+        if (r < 0)
+                return r;
+
+        r = radv_packet_update(ra, router_lifetime, time_now);
+        if (r < 0)
+                return r;
+
+        return radv_packet_send(ra, dst);
+}
+
+static int radv_solicited(sd_radv *ra, const struct in6_addr *src) {
+        _cleanup_free_ char *addr = NULL;
+        int r;
+
+        assert(ra);
+        assert(src);
+
+        (void) in_addr_to_string(AF_INET6, (const union in_addr_union*) src, &addr);
+
+        r = radv_send(ra, src, ra->lifetime);
+        if (r < 0)
+                log_radv_warning_errno(r, "Unable to send solicited Router Advertisment to %s: %m", addr);
+        else
+                log_radv("Sent solicited Router Advertisement to %s", addr);
+
+        return 0;
+}
+
 static int radv_recv(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
         sd_radv *ra = userdata;
         _cleanup_free_ char *addr = NULL;
@@ -284,15 +393,21 @@ static int radv_recv(sd_event_source *s, int fd, uint32_t revents, void *userdat
                 return 0;
         }
 
-        (void) in_addr_to_string(AF_INET6, (union in_addr_union*) &src, &addr);
+        return radv_solicited(ra, &src);
+}
 
-        r = radv_send(ra, &src, ra->lifetime);
-        if (r < 0)
-                log_radv_warning_errno(r, "Unable to send solicited Router Advertisment to %s: %m", addr);
-        else
-                log_radv("Sent solicited Router Advertisement to %s", addr);
+static int radv_mux_recv(const void *packet, size_t size, const struct in6_addr *src,
+                         const triple_timestamp *timestamp, void *userdata) {
+        sd_radv *ra = userdata;
 
-        return 0;
+        assert(packet);
+        assert(src);
+        assert(ra);
+
+        if (size < sizeof(struct nd_router_solicit))
+                return log_radv("Too short packet received");
+
+        return radv_solicited(ra, src);
 }
 
 static usec_t radv_compute_timeout(usec_t min, usec_t max) {
@@ -306,6 +421,7 @@ static int radv_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
         sd_radv *ra = userdata;
         usec_t min_timeout = SD_RADV_DEFAULT_MIN_TIMEOUT_USEC;
         usec_t max_timeout = SD_RADV_DEFAULT_MAX_TIMEOUT_USEC;
+        usec_t accuracy = SD_RADV_TIMEOUT_ACCURACY_USEC;
         usec_t time_now, timeout;
         char time_string[FORMAT_TIMESPAN_MAX];
 
@@ -319,7 +435,14 @@ static int radv_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
         if (r < 0)
                 goto fail;
 
-        r = radv_send(ra, NULL, ra->lifetime);
+        r = radv_packet_update(ra, ra->lifetime, time_now);
+        if (r >= 0) {
+                if (ra->muxed)
+                        /* Goes out together with those of the other links due in this iteration */
+                        r = icmp6_mux_queue(ra->mux, ra->ifindex, NULL, ra->packet, ra->packet_size);
+                else
+                        r = radv_packet_send(ra, NULL);
+        }
         if (r < 0)
                 log_radv_warning_errno(r, "Unable to send Router Advertisement: %m");
 
@@ -327,6 +450,7 @@ static int radv_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
         if (ra->ra_sent < SD_RADV_MAX_INITIAL_RTR_ADVERTISEMENTS) {
                 max_timeout = SD_RADV_MAX_INITIAL_RTR_ADVERT_INTERVAL_USEC;
                 min_timeout = SD_RADV_MAX_INITIAL_RTR_ADVERT_INTERVAL_USEC / 3;
+                accuracy = SD_RADV_INITIAL_TIMEOUT_ACCURACY_USEC;
         }
 
         timeout = radv_compute_timeout(min_timeout, max_timeout);
@@ -337,7 +461,7 @@ static int radv_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
 
         r = sd_event_add_time(ra->event, &ra->timeout_event_source,
                               clock_boottime_or_monotonic(),
-                              time_now + timeout, MSEC_PER_SEC,
+                              time_now + timeout, accuracy,
                               radv_timeout, ra);
         if (r < 0)
                 goto fail;
@@ -405,21 +529,34 @@ _public_ int sd_radv_start(sd_radv *ra) {
         (void) sd_event_source_set_description(ra->timeout_event_source,
                                                "radv-timeout");
 
-        r = icmp6_bind_router_advertisement(ra->ifindex);
-        if (r < 0)
-                goto fail;
+        if (ra->mux) {
+                r = icmp6_mux_add(ra->mux, ND_ROUTER_SOLICIT, ra->ifindex, radv_mux_recv, ra);
+                if (r >= 0)
+                        ra->muxed = true;
+                else if (r == -ENOBUFS)
+                        /* Out of option memory for multicast memberships on the shared socket */
+                        log_radv_errno(r, "Failed to join all-routers group on shared socket, using a dedicated one: %m");
+                else
+                        goto fail;
+        }
 
-        ra->fd = r;
+        if (!ra->muxed) {
+                r = icmp6_bind_router_advertisement(ra->ifindex);
+                if (r < 0)
+                        goto fail;
 
-        r = sd_event_add_io(ra->event, &ra->recv_event_source, ra->fd, EPOLLIN, radv_recv, ra);
-        if (r < 0)
-                goto fail;
+                ra->fd = r;
 
-        r = sd_event_source_set_priority(ra->recv_event_source, ra->event_priority);
-        if (r < 0)
-                goto fail;
+                r = sd_event_add_io(ra->event, &ra->recv_event_source, ra->fd, EPOLLIN, radv_recv, ra);
+                if (r < 0)
+                        goto fail;
 
-        (void) sd_event_source_set_description(ra->recv_event_source, "radv-receive-message");
+                r = sd_event_source_set_priority(ra->recv_event_source, ra->event_priority);
+                if (r < 0)
+                        goto fail;
+
+                (void) sd_event_source_set_description(ra->recv_event_source, "radv-receive-message");
+        }
 
         ra->state = SD_RADV_STATE_ADVERTISING;
 
@@ -456,6 +593,20 @@ _public_ int sd_radv_set_mac(sd_radv *ra, const struct ether_addr *mac_addr) {
         else
                 zero(ra->mac_addr);
 
+        radv_packet_invalidate(ra);
+
+        return 0;
+}
+
+_public_ int sd_radv_set_mux(sd_radv *ra, sd_icmp6_mux *mux) {
+        assert_return(ra, -EINVAL);
+
+        if (ra->state != SD_RADV_STATE_IDLE)
+                return -EBUSY;
+
+        sd_icmp6_mux_unref(ra->mux);
+        ra->mux = sd_icmp6_mux_ref(mux);
+
         return 0;
 }
 
@@ -464,6 +615,7 @@ _public_ int sd_radv_set_mtu(sd_radv *ra, uint32_t mtu) {
         assert_return(mtu >= 1280, -EINVAL);
 
         ra->mtu = mtu;
+        radv_packet_invalidate(ra);
 
         return 0;
 }
@@ -475,6 +627,7 @@ _public_ int sd_radv_set_hop_limit(sd_radv *ra, uint8_t hop_limit) {
                 return -EBUSY;
 
         ra->hop_limit = hop_limit;
+        radv_packet_invalidate(ra);
 
         return 0;
 }
@@ -503,6 +656,7 @@ _public_ int sd_radv_set_managed_information(sd_radv *ra, int managed) {
                 return -EBUSY;
 
         SET_FLAG(ra->flags, ND_RA_FLAG_MANAGED, managed);
+        radv_packet_invalidate(ra);
 
         return 0;
 }
@@ -514,6 +668,7 @@ _public_ int sd_radv_set_other_information(sd_radv *ra, int other) {
                 return -EBUSY;
 
         SET_FLAG(ra->flags, ND_RA_FLAG_OTHER, other);
+        radv_packet_invalidate(ra);
 
         return 0;
 }
@@ -528,6 +683,7 @@ _public_ int sd_radv_set_preference(sd_radv *ra, unsigned preference) {
                              SD_NDISC_PREFERENCE_HIGH), -EINVAL);
 
         ra->flags = (ra->flags & ~(0x3 << 3)) | (preference << 3);
+        radv_packet_invalidate(ra);
 
         return r;
 }
@@ -578,6 +734,7 @@ _public_ int sd_radv_add_prefix(sd_radv *ra, sd_radv_prefix *p, bool dynamic) {
         LIST_APPEND(prefix, ra->prefixes, p);
 
         ra->n_prefixes++;
+        radv_prefixes_changed(ra);
 
         (void) in_addr_to_string(AF_INET6, (union in_addr_union*) &p->opt.in6_addr, &addr_p);
 
@@ -636,6 +793,7 @@ _public_ sd_radv_prefix *sd_radv_remove_prefix(sd_radv *ra,
 
                 LIST_REMOVE(prefix, ra->prefixes, cur);
                 ra->n_prefixes--;
+                radv_prefixes_changed(ra);
 
                 break;
         }
@@ -651,6 +809,8 @@ _public_ int sd_radv_set_rdnss(sd_radv *ra, uint32_t lifetime,
         assert_return(ra, -EINVAL);
         assert_return(n_dns < 128, -EINVAL);
 
+        radv_packet_invalidate(ra);
+
         if (!dns || n_dns == 0) {
                 ra->rdnss = mfree(ra->rdnss);
                 ra->n_rdnss = 0;
@@ -688,6 +848,8 @@ _public_ int sd_radv_set_dnssl(sd_radv *ra, uint32_t lifetime,
 
         assert_return(ra, -EINVAL);
 
+        radv_packet_invalidate(ra);
+
         if (!search_list || *search_list == NULL) {
                 ra->dnssl = mfree(ra->dnssl);
 
@@ -0,0 +1,287 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <linux/veth.h>
+#include <net/if.h>
+#include <netinet/icmp6.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "sd-event.h"
+#include "sd-ndisc.h"
+#include "sd-netlink.h"
+#include "sd-radv.h"
+
+#include "alloc-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "icmp6-mux.h"
+#include "log.h"
+#include "macro.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "util.h"
+
+#define N_LINKS 64U
+
+static int advertisers[N_LINKS], listeners[N_LINKS];
+static sd_radv *radvs[N_LINKS];
+static sd_ndisc *ndiscs[N_LINKS];
+static unsigned n_routers, n_links_done, received[N_LINKS];
+static unsigned n_queued_received;
+
+static void create_veth(sd_netlink *rtnl, const char *name, const char *peer) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_NEWLINK, 0) >= 0);
+        assert_se(sd_netlink_message_append_string(m, IFLA_IFNAME, name) >= 0);
+        assert_se(sd_netlink_message_open_container(m, IFLA_LINKINFO) >= 0);
+        assert_se(sd_netlink_message_open_container_union(m, IFLA_INFO_DATA, "veth") >= 0);
+        assert_se(sd_netlink_message_open_container(m, VETH_INFO_PEER) >= 0);
+        assert_se(sd_netlink_message_append_string(m, IFLA_IFNAME, peer) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, NULL) >= 0);
+}
+
+static int link_up(sd_netlink *rtnl, const char *name) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        int ifindex;
+
+        ifindex = (int) if_nametoindex(name);
+        assert_se(ifindex > 0);
+
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_SETLINK, ifindex) >= 0);
+        assert_se(sd_rtnl_message_link_set_flags(m, IFF_UP, IFF_UP) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, NULL) >= 0);
+
+        return ifindex;
+}
+
+static unsigned count_link_local_addresses(void) {
+        _cleanup_free_ char *s = NULL;
+        const char *p;
+        unsigned n = 0;
+
+        assert_se(read_full_file("/proc/net/if_inet6", &s, NULL) >= 0);
+
+        for (p = s; (p = strstr(p, "\nfe80")); p++)
+                n++;
+        if (startswith(s, "fe80"))
+                n++;
+
+        return n;
+}
+
+static unsigned count_fds(void) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        unsigned n = 0;
+
+        d = opendir("/proc/self/fd");
+        assert_se(d);
+
+        FOREACH_DIRENT(de, d, assert_se(false))
+                n++;
+
+        return n;
+}
+
+static usec_t cpu_usage(void) {
+        struct rusage ru;
+
+        assert_se(getrusage(RUSAGE_SELF, &ru) >= 0);
+
+        return timeval_load(&ru.ru_utime) + timeval_load(&ru.ru_stime);
+}
+
+static void ndisc_handler(sd_ndisc *nd, sd_ndisc_event event, sd_ndisc_router *rt, void *userdata) {
+        unsigned i = PTR_TO_UINT(userdata);
+
+        assert_se(nd == ndiscs[i]);
+
+        if (event != SD_NDISC_EVENT_ROUTER)
+                return;
+
+        n_routers++;
+
+        if (received[i]++ == 0 && ++n_links_done == N_LINKS)
+                assert_se(sd_event_exit(sd_ndisc_get_event(nd), 0) >= 0);
+}
+
+static unsigned run(bool shared) {
+        _cleanup_(sd_icmp6_mux_unrefp) sd_icmp6_mux *mux = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        unsigned i, n_fds;
+        usec_t cpu;
+
+        n_routers = n_links_done = 0;
+        zero(received);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_add_time(e, NULL, CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + 30 * USEC_PER_SEC, 0, NULL, INT_TO_PTR(-ETIMEDOUT)) >= 0);
+
+        if (shared) {
+                assert_se(sd_icmp6_mux_new(&mux) >= 0);
+                assert_se(sd_icmp6_mux_attach_event(mux, e, 0) >= 0);
+        }
+
+        n_fds = count_fds();
+
+        for (i = 0; i < N_LINKS; i++) {
+                assert_se(sd_radv_new(radvs + i) >= 0);
+                assert_se(sd_radv_set_ifindex(radvs[i], advertisers[i]) >= 0);
+                assert_se(sd_radv_attach_event(radvs[i], e, 0) >= 0);
+                assert_se(sd_radv_set_mux(radvs[i], mux) >= 0);
+
+                assert_se(sd_ndisc_new(ndiscs + i) >= 0);
+                assert_se(sd_ndisc_set_ifindex(ndiscs[i], listeners[i]) >= 0);
+                assert_se(sd_ndisc_set_callback(ndiscs[i], ndisc_handler, UINT_TO_PTR(i)) >= 0);
+                assert_se(sd_ndisc_attach_event(ndiscs[i], e, 0) >= 0);
+                assert_se(sd_ndisc_set_mux(ndiscs[i], mux) >= 0);
+        }
+
+        cpu = cpu_usage();
+
+        for (i = 0; i < N_LINKS; i++) {
+                assert_se(sd_radv_start(radvs[i]) >= 0);
+                assert_se(sd_ndisc_start(ndiscs[i]) == 1);
+                assert_se(sd_ndisc_set_mux(ndiscs[i], NULL) == -EBUSY);
+        }
+
+        n_fds = count_fds() - n_fds;
+
+        assert_se(sd_event_loop(e) == 0);
+        assert_se(n_links_done == N_LINKS);
+
+        cpu = cpu_usage() - cpu;
+
+        log_info("%s: %u links, %u new fds, %u router advertisements received, %.1f µs CPU per advertisement",
+                 shared ? "shared socket" : "per-link sockets",
+                 N_LINKS, n_fds, n_routers, (double) cpu / n_routers);
+
+        for (i = 0; i < N_LINKS; i++) {
+                assert_se(sd_ndisc_stop(ndiscs[i]) == 1);
+                assert_se(sd_radv_stop(radvs[i]) >= 0);
+
+                ndiscs[i] = sd_ndisc_unref(ndiscs[i]);
+                radvs[i] = sd_radv_unref(radvs[i]);
+        }
+
+        return n_fds;
+}
+
+static void setup_links(void) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        unsigned i;
+
+        /* Make link-local addresses usable right away */
+        assert_se(write_string_file("/proc/sys/net/ipv6/conf/default/accept_dad", "0", 0) >= 0);
+
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+
+        for (i = 0; i < N_LINKS; i++) {
+                char a[IFNAMSIZ], b[IFNAMSIZ];
+
+                xsprintf(a, "icmp6-a%u", i);
+                xsprintf(b, "icmp6-b%u", i);
+                create_veth(rtnl, a, b);
+
+                advertisers[i] = link_up(rtnl, a);
+                listeners[i] = link_up(rtnl, b);
+        }
+
+        for (i = 0; count_link_local_addresses() < 2 * N_LINKS; i++) {
+                assert_se(i < 500);
+                usleep(10 * USEC_PER_MSEC);
+        }
+}
+
+static void test_mux(void) {
+        /* Both include the timer fds the event loop allocates on first use */
+        assert_se(run(false) == run(true) + 2 * N_LINKS - 1);
+}
+
+static int queue_handler(const void *packet, size_t size, const struct in6_addr *src,
+                         const triple_timestamp *timestamp, void *userdata) {
+        sd_event *e = userdata;
+
+        assert_se(size == sizeof(struct nd_router_advert));
+        assert_se(((const struct nd_router_advert*) packet)->nd_ra_type == ND_ROUTER_ADVERT);
+
+        if (++n_queued_received == N_LINKS - 1)
+                assert_se(sd_event_exit(e, 0) >= 0);
+
+        return 0;
+}
+
+static void test_queue(void) {
+        static const struct nd_router_advert ra = {
+                .nd_ra_type = ND_ROUTER_ADVERT,
+        };
+        _cleanup_(sd_icmp6_mux_unrefp) sd_icmp6_mux *mux = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        unsigned i;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_add_time(e, NULL, CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + 30 * USEC_PER_SEC, 0, NULL, INT_TO_PTR(-ETIMEDOUT)) >= 0);
+
+        assert_se(sd_icmp6_mux_new(&mux) >= 0);
+        assert_se(sd_icmp6_mux_attach_event(mux, e, 0) >= 0);
+
+        for (i = 0; i < N_LINKS; i++)
+                assert_se(icmp6_mux_add(mux, ND_ROUTER_ADVERT, listeners[i], queue_handler, e) >= 0);
+
+        for (i = 0; i < N_LINKS; i++)
+                assert_se(icmp6_mux_queue(mux, advertisers[i], NULL, &ra, sizeof(ra)) >= 0);
+
+        /* Messages of a link stopped before the queue was flushed are dropped */
+        icmp6_mux_dequeue(mux, advertisers[0]);
+        assert_se(mux->n_send_queue == N_LINKS - 1);
+
+        assert_se(sd_event_loop(e) == 0);
+        assert_se(n_queued_received == N_LINKS - 1);
+        assert_se(mux->n_send_queue == 0);
+
+        for (i = 0; i < N_LINKS; i++)
+                icmp6_mux_remove(mux, ND_ROUTER_ADVERT, listeners[i]);
+
+        assert_se(mux->fd < 0);
+}
+
+int main(int argc, char *argv[]) {
+        /* Debug logging would dominate the CPU time measured */
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (getuid() != 0 || unshare(CLONE_NEWNET) < 0) {
+                log_notice("Not privileged to create a network namespace, skipping tests.");
+                return EXIT_TEST_SKIP;
+        }
+
+        setup_links();
+
+        test_mux();
+        test_queue();
+
+        return 0;
+}
@@ -0,0 +1,199 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <linux/veth.h>
+#include <net/if.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "sd-event.h"
+#include "sd-ipv4acd.h"
+#include "sd-netlink.h"
+
+#include "alloc-util.h"
+#include "dirent-util.h"
+#include "fd-util.h"
+#include "log.h"
+#include "macro.h"
+#include "stdio-util.h"
+#include "util.h"
+
+#define N_LINKS 64U
+
+static int ifindexes[2 * N_LINKS];
+static sd_ipv4acd *acds[2 * N_LINKS];
+static unsigned n_conflicts, conflicts[N_LINKS];
+static sd_event *loop;
+
+static void create_veth(sd_netlink *rtnl, const char *name, const char *peer) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_NEWLINK, 0) >= 0);
+        assert_se(sd_netlink_message_append_string(m, IFLA_IFNAME, name) >= 0);
+        assert_se(sd_netlink_message_open_container(m, IFLA_LINKINFO) >= 0);
+        assert_se(sd_netlink_message_open_container_union(m, IFLA_INFO_DATA, "veth") >= 0);
+        assert_se(sd_netlink_message_open_container(m, VETH_INFO_PEER) >= 0);
+        assert_se(sd_netlink_message_append_string(m, IFLA_IFNAME, peer) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, NULL) >= 0);
+}
+
+static int link_up(sd_netlink *rtnl, const char *name) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        int ifindex;
+
+        ifindex = (int) if_nametoindex(name);
+        assert_se(ifindex > 0);
+
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_SETLINK, ifindex) >= 0);
+        assert_se(sd_rtnl_message_link_set_flags(m, IFF_UP, IFF_UP) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, NULL) >= 0);
+
+        return ifindex;
+}
+
+static unsigned count_fds(void) {
+        _cleanup_closedir_ DIR *d = NULL;
+        struct dirent *de;
+        unsigned n = 0;
+
+        d = opendir("/proc/self/fd");
+        assert_se(d);
+
+        FOREACH_DIRENT(de, d, assert_se(false))
+                n++;
+
+        return n;
+}
+
+static void acd_handler(sd_ipv4acd *acd, int event, void *userdata) {
+        unsigned i = PTR_TO_UINT(userdata);
+
+        assert_se(acd == acds[i]);
+
+        if (event != SD_IPV4ACD_EVENT_CONFLICT)
+                return;
+
+        /* Whichever end receives the probe of the other first gives up on the address and stops probing,
+         * hence the other end might not notice. Only pairs probing for the same address run into each
+         * other. */
+        if (conflicts[i / 2]++ == 0 && ++n_conflicts == N_LINKS / 2)
+                assert_se(sd_event_exit(loop, 0) >= 0);
+}
+
+static unsigned run(bool shared) {
+        _cleanup_(sd_ipv4acd_mux_unrefp) sd_ipv4acd_mux *mux = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        unsigned i, n_fds;
+
+        n_conflicts = 0;
+        zero(conflicts);
+
+        assert_se(sd_event_new(&e) >= 0);
+        loop = e;
+        assert_se(sd_event_add_time(e, NULL, CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + 30 * USEC_PER_SEC, 0, NULL, INT_TO_PTR(-ETIMEDOUT)) >= 0);
+
+        if (shared) {
+                assert_se(sd_ipv4acd_mux_new(&mux) >= 0);
+                assert_se(sd_ipv4acd_mux_attach_event(mux, e, 0) >= 0);
+        }
+
+        n_fds = count_fds();
+
+        for (i = 0; i < 2 * N_LINKS; i++) {
+                /* The ends of even pairs probe for the same address, those of odd pairs for different ones */
+                unsigned pair = i / 2;
+                struct in_addr address = {
+                        .s_addr = htobe32(0xa9fe0000U | (pair + 1) << 8 | (pair % 2 ? i % 2 + 1 : 1)),
+                };
+                struct ether_addr mac = {
+                        .ether_addr_octet = { 0x02, 0x00, 0x00, 0x00, i >> 8, i & 0xff },
+                };
+
+                assert_se(sd_ipv4acd_new(acds + i) >= 0);
+                assert_se(sd_ipv4acd_set_ifindex(acds[i], ifindexes[i]) >= 0);
+                assert_se(sd_ipv4acd_set_mac(acds[i], &mac) >= 0);
+                assert_se(sd_ipv4acd_set_address(acds[i], &address) >= 0);
+                assert_se(sd_ipv4acd_set_callback(acds[i], acd_handler, UINT_TO_PTR(i)) >= 0);
+                assert_se(sd_ipv4acd_attach_event(acds[i], e, 0) >= 0);
+                assert_se(sd_ipv4acd_set_mux(acds[i], mux) >= 0);
+        }
+
+        for (i = 0; i < 2 * N_LINKS; i++) {
+                assert_se(sd_ipv4acd_start(acds[i]) >= 0);
+                assert_se(sd_ipv4acd_set_mux(acds[i], NULL) == -EBUSY);
+        }
+
+        n_fds = count_fds() - n_fds;
+
+        assert_se(sd_event_loop(e) == 0);
+
+        log_info("%s: %u links, %u new fds, conflicts detected on %u pairs",
+                 shared ? "shared socket" : "per-link sockets", 2 * N_LINKS, n_fds, n_conflicts);
+
+        for (i = 0; i < 2 * N_LINKS; i++) {
+                assert_se((conflicts[i / 2] > 0) == (i / 2 % 2 == 0));
+
+                assert_se(sd_ipv4acd_stop(acds[i]) >= 0);
+                acds[i] = sd_ipv4acd_unref(acds[i]);
+        }
+
+        return n_fds;
+}
+
+static void setup_links(void) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        unsigned i;
+
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+
+        for (i = 0; i < N_LINKS; i++) {
+                char a[IFNAMSIZ], b[IFNAMSIZ];
+
+                xsprintf(a, "acd-a%u", i);
+                xsprintf(b, "acd-b%u", i);
+                create_veth(rtnl, a, b);
+
+                ifindexes[2 * i] = link_up(rtnl, a);
+                ifindexes[2 * i + 1] = link_up(rtnl, b);
+        }
+}
+
+static void test_mux(void) {
+        /* Both include the timer fd the event loop allocates on first use */
+        assert_se(run(false) == run(true) + 2 * N_LINKS - 1);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_INFO);
+        log_parse_environment();
+        log_open();
+
+        if (getuid() != 0 || unshare(CLONE_NEWNET) < 0) {
+                log_notice("Not privileged to create a network namespace, skipping tests.");
+                return EXIT_TEST_SKIP;
+        }
+
+        setup_links();
+
+        test_mux();
+
+        return 0;
+}
@@ -0,0 +1,251 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <linux/if_packet.h>
+#include <linux/veth.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "sd-event.h"
+#include "sd-lldp.h"
+#include "sd-netlink.h"
+
+#include "fd-util.h"
+#include "lldp-internal.h"
+#include "log.h"
+#include "macro.h"
+#include "socket-util.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "util.h"
+
+#define N_PORTS 64U
+
+static sd_lldp *lldps[N_PORTS];
+static unsigned n_added, added[N_PORTS];
+
+static void create_veth(sd_netlink *rtnl, const char *name, const char *peer) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_NEWLINK, 0) >= 0);
+        assert_se(sd_netlink_message_append_string(m, IFLA_IFNAME, name) >= 0);
+        assert_se(sd_netlink_message_open_container(m, IFLA_LINKINFO) >= 0);
+        assert_se(sd_netlink_message_open_container_union(m, IFLA_INFO_DATA, "veth") >= 0);
+        assert_se(sd_netlink_message_open_container(m, VETH_INFO_PEER) >= 0);
+        assert_se(sd_netlink_message_append_string(m, IFLA_IFNAME, peer) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, NULL) >= 0);
+}
+
+static int link_up(sd_netlink *rtnl, const char *name) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        int ifindex;
+
+        ifindex = (int) if_nametoindex(name);
+        assert_se(ifindex > 0);
+
+        assert_se(sd_rtnl_message_new_link(rtnl, &m, RTM_SETLINK, ifindex) >= 0);
+        assert_se(sd_rtnl_message_link_set_flags(m, IFF_UP, IFF_UP) >= 0);
+        assert_se(sd_netlink_call(rtnl, m, 0, NULL) >= 0);
+
+        return ifindex;
+}
+
+static void send_lldp(int ifindex, unsigned port) {
+        static const uint8_t header[] = {
+                0x01, 0x80, 0xc2, 0x00, 0x00, 0x0e,     /* Destination MAC */
+                0x02, 0x00, 0x00, 0x00, 0x00, 0x01,     /* Source MAC */
+                0x88, 0xcc,                             /* Ethertype */
+                0x02, 0x07, 0x04,                       /* Chassis: MAC */
+                0x02, 0x00, 0x00, 0x00, 0x00, 0x01,
+        };
+        union sockaddr_union sa = {
+                .ll.sll_family = AF_PACKET,
+                .ll.sll_ifindex = ifindex,
+        };
+        _cleanup_close_ int fd = -1;
+        uint8_t frame[64];
+        char id[16];
+        size_t l, k;
+
+        /* Port: interface name, identifying the sending end, TTL 120 s, end of LLDPDU */
+        xsprintf(id, "port-%u", port);
+        k = strlen(id);
+
+        memcpy(frame, header, sizeof(header));
+        l = sizeof(header);
+        frame[l++] = 0x04;
+        frame[l++] = 1 + k;
+        frame[l++] = 0x05;
+        memcpy(frame + l, id, k);
+        l += k;
+        frame[l++] = 0x06;
+        frame[l++] = 0x02;
+        frame[l++] = 0x00;
+        frame[l++] = 0x78;
+        frame[l++] = 0x00;
+        frame[l++] = 0x00;
+
+        fd = socket(AF_PACKET, SOCK_RAW|SOCK_CLOEXEC, 0);
+        assert_se(fd >= 0);
+        assert_se(bind(fd, &sa.sa, sizeof(sa.ll)) >= 0);
+        assert_se(send(fd, frame, l, 0) == (ssize_t) l);
+}
+
+static void lldp_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n, void *userdata) {
+        unsigned port = PTR_TO_UINT(userdata);
+        char id[16];
+        const char *s;
+
+        assert_se(lldp == lldps[port]);
+
+        if (event != SD_LLDP_EVENT_ADDED)
+                return;
+
+        /* Make sure the frame was routed to the instance of the interface it was received on */
+        xsprintf(id, "port-%u", port);
+        assert_se(sd_lldp_neighbor_get_port_id_as_string(n, &s) >= 0);
+        assert_se(streq(s, id));
+
+        added[port]++;
+        if (++n_added == N_PORTS)
+                assert_se(sd_event_exit(sd_lldp_get_event(lldp), 0) >= 0);
+}
+
+static void test_receiver(void) {
+        _cleanup_(sd_lldp_receiver_unrefp) sd_lldp_receiver *receiver = NULL;
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        int senders[N_PORTS];
+        unsigned i;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+
+        assert_se(sd_lldp_receiver_new(&receiver) >= 0);
+        assert_se(sd_lldp_receiver_attach_event(receiver, e, 0) >= 0);
+
+        for (i = 0; i < N_PORTS; i++) {
+                char a[IFNAMSIZ], b[IFNAMSIZ];
+
+                xsprintf(a, "lldp-a%u", i);
+                xsprintf(b, "lldp-b%u", i);
+                create_veth(rtnl, a, b);
+
+                senders[i] = link_up(rtnl, a);
+
+                assert_se(sd_lldp_new(lldps + i) >= 0);
+                assert_se(sd_lldp_set_ifindex(lldps[i], link_up(rtnl, b)) >= 0);
+                assert_se(sd_lldp_set_callback(lldps[i], lldp_handler, UINT_TO_PTR(i)) >= 0);
+                assert_se(sd_lldp_attach_event(lldps[i], e, 0) >= 0);
+                assert_se(sd_lldp_set_receiver(lldps[i], receiver) >= 0);
+                assert_se(sd_lldp_start(lldps[i]) == 1);
+                assert_se(sd_lldp_set_receiver(lldps[i], NULL) == -EBUSY);
+        }
+
+        for (i = 0; i < N_PORTS; i++)
+                send_lldp(senders[i], i);
+
+        assert_se(sd_event_add_time(e, NULL, CLOCK_MONOTONIC, now(CLOCK_MONOTONIC) + 10 * USEC_PER_SEC, 0, NULL, INT_TO_PTR(-ETIMEDOUT)) >= 0);
+        assert_se(sd_event_loop(e) == 0);
+        assert_se(n_added == N_PORTS);
+
+        for (i = 0; i < N_PORTS; i++) {
+                assert_se(added[i] == 1);
+                assert_se(sd_lldp_stop(lldps[i]) == 1);
+                lldps[i] = sd_lldp_unref(lldps[i]);
+        }
+}
+
+static int stale_pair[2] = { -1, -1 };
+
+static void restart_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n, void *userdata) {
+        bool *restarted = userdata;
+
+        if (*restarted)
+                return;
+
+        /* Stopping the only sd_lldp object closes the socket of the receiver, and starting it again opens
+         * a new one. Make sure the number of the old one is taken by something else in between, with data
+         * that must not be read by the receiver. */
+        assert_se(sd_lldp_stop(lldp) == 1);
+        assert_se(socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, stale_pair) >= 0);
+        assert_se(send(stale_pair[1], "x", 1, 0) == 1);
+        assert_se(sd_lldp_start(lldp) == 1);
+
+        *restarted = true;
+}
+
+static void test_receiver_restart(void) {
+        _cleanup_(sd_lldp_receiver_unrefp) sd_lldp_receiver *receiver = NULL;
+        _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_(sd_lldp_unrefp) sd_lldp *lldp = NULL;
+        bool restarted = false;
+        int sender;
+        unsigned i;
+        char c;
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_netlink_open(&rtnl) >= 0);
+
+        assert_se(sd_lldp_receiver_new(&receiver) >= 0);
+        assert_se(sd_lldp_receiver_attach_event(receiver, e, 0) >= 0);
+
+        create_veth(rtnl, "lldp-ra", "lldp-rb");
+        sender = link_up(rtnl, "lldp-ra");
+
+        assert_se(sd_lldp_new(&lldp) >= 0);
+        assert_se(sd_lldp_set_ifindex(lldp, link_up(rtnl, "lldp-rb")) >= 0);
+        assert_se(sd_lldp_set_callback(lldp, restart_handler, &restarted) >= 0);
+        assert_se(sd_lldp_attach_event(lldp, e, 0) >= 0);
+        assert_se(sd_lldp_set_receiver(lldp, receiver) >= 0);
+        assert_se(sd_lldp_start(lldp) == 1);
+
+        /* More than one batch, so that the receiver goes on reading after the callbacks ran */
+        for (i = 0; i < 2 * LLDP_RECEIVER_BATCH; i++)
+                send_lldp(sender, 0);
+
+        while (!restarted)
+                assert_se(sd_event_run(e, 10 * USEC_PER_SEC) > 0);
+
+        assert_se(recv(stale_pair[0], &c, 1, MSG_DONTWAIT) == 1);
+
+        assert_se(sd_lldp_stop(lldp) == 1);
+        safe_close_pair(stale_pair);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        if (getuid() != 0 || unshare(CLONE_NEWNET) < 0) {
+                log_notice("Not privileged to create a network namespace, skipping tests.");
+                return EXIT_TEST_SKIP;
+        }
+
+        test_receiver();
+        test_receiver_restart();
+
+        return 0;
+}
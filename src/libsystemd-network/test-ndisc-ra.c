@@ -242,7 +242,7 @@ int icmp6_bind_router_advertisement(int index) {
         return test_fd[1];
 }
 
-int icmp6_send_router_solicitation(int s, const struct ether_addr *ether_addr) {
+int icmp6_send_router_solicitation(int s, int ifindex, const struct ether_addr *ether_addr) {
 
         return 0;
 }
@@ -239,7 +239,7 @@ static int send_ra(uint8_t flags) {
         return 0;
 }
 
-int icmp6_send_router_solicitation(int s, const struct ether_addr *ether_addr) {
+int icmp6_send_router_solicitation(int s, int ifindex, const struct ether_addr *ether_addr) {
         if (!send_ra_function)
                 return 0;
 
@@ -19,6 +19,7 @@
 ***/
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/timerfd.h>
 #include <sys/wait.h>
 
@@ -27,6 +28,7 @@
 #include "sd-id128.h"
 
 #include "alloc-util.h"
+#include "event-util.h"
 #include "fd-util.h"
 #include "hashmap.h"
 #include "list.h"
@@ -38,11 +40,18 @@
 #include "signal-util.h"
 #include "string-table.h"
 #include "string-util.h"
+#include "strv.h"
 #include "time-util.h"
 #include "util.h"
 
 #define DEFAULT_ACCURACY_USEC (250 * USEC_PER_MSEC)
 
+/* Bounds for the number of epoll events we collect per iteration. The buffer starts out small, grows while
+ * epoll_wait() keeps filling it completely, and shrinks again when it stays mostly unused for a while. */
+#define EVENT_QUEUE_MIN 16U
+#define EVENT_QUEUE_MAX_DEFAULT 4096U
+#define EVENT_QUEUE_SHRINK_ITERATIONS 256U
+
 typedef enum EventSourceType
 {
     SOURCE_IO,
@@ -118,6 +127,8 @@ struct sd_event_source
 
     LIST_FIELDS(sd_event_source, sources);
 
+    sd_event_source_stats stats;
+
     union
     {
         struct
@@ -198,6 +209,17 @@ struct signal_data
     sd_event_source *current;
 };
 
+/* A work item handed to the event loop by sd_event_post_work(). Items are pushed onto a lock-free
+ * singly linked stack by any number of threads, and taken off it as a whole by the loop thread. */
+typedef struct EventWork EventWork;
+
+struct EventWork
+{
+    EventWork *next;
+    sd_event_work_handler_t callback;
+    void *userdata;
+};
+
 struct sd_event
 {
     unsigned n_ref;
@@ -239,6 +261,7 @@ struct sd_event
     bool need_process_child : 1;
     bool watchdog : 1;
     bool profile_delays : 1;
+    bool profile_sources : 1;
 
     int exit_code;
 
@@ -249,6 +272,24 @@ struct sd_event
 
     unsigned n_sources;
 
+    uint64_t n_timer_wakeups, n_timer_wakeups_saved;
+
+    struct epoll_event *event_queue;
+    unsigned event_queue_allocated;
+    unsigned event_queue_size;
+    unsigned event_queue_max;
+    unsigned event_queue_peak;
+    unsigned event_queue_iterations;
+
+    /* Cross-thread work queue, see sd_event_enable_work_queue(). The eventfd is set up once from the
+     * loop thread and only read afterwards, the list head and the wakeup failure flag are the only
+     * fields written by other threads. */
+    int work_fd;
+    sd_event_source *work_source;
+    EventWork *volatile work_queue;
+    volatile bool work_wakeup_failed;
+    int work_wakeup_error;
+
     LIST_HEAD(sd_event_source, sources);
 
     usec_t last_run, last_log;
@@ -415,12 +456,19 @@ static void free_clock_data(struct clock_data *d)
     prioq_free(d->latest);
 }
 
+static void event_run_work(sd_event *e, bool drain);
+static void event_free_work(sd_event *e);
+
 static void event_free(sd_event *e)
 {
     sd_event_source *s;
 
     assert(e);
 
+    /* sd_event_unref() ran the work queue before getting here. Items posted concurrently with dropping
+     * the last reference are a bug of the caller, and cannot be run anymore as the loop is going away. */
+    event_free_work(e);
+
     while ((s = e->sources))
     {
         assert(s->floating);
@@ -451,6 +499,7 @@ static void event_free(sd_event *e)
 
     hashmap_free(e->child_sources);
     set_free(e->post_sources);
+    free(e->event_queue);
     free(e);
 }
 
@@ -466,11 +515,13 @@ _public_ int sd_event_new(sd_event **ret)
         return -ENOMEM;
 
     e->n_ref = 1;
-    e->watchdog_fd = e->epoll_fd = e->realtime.fd = e->boottime.fd = e->monotonic.fd = e->realtime_alarm.fd = e->boottime_alarm.fd = -1;
+    e->work_fd = e->watchdog_fd = e->epoll_fd = e->realtime.fd = e->boottime.fd = e->monotonic.fd = e->realtime_alarm.fd = e->boottime_alarm.fd = -1;
     e->realtime.next = e->boottime.next = e->monotonic.next = e->realtime_alarm.next = e->boottime_alarm.next = USEC_INFINITY;
     e->realtime.wakeup = e->boottime.wakeup = e->monotonic.wakeup = e->realtime_alarm.wakeup = e->boottime_alarm.wakeup = WAKEUP_CLOCK_DATA;
     e->original_pid = getpid_cached();
     e->perturb = USEC_INFINITY;
+    e->event_queue_size = EVENT_QUEUE_MIN;
+    e->event_queue_max = EVENT_QUEUE_MAX_DEFAULT;
 
     r = prioq_ensure_allocated(&e->pending, pending_prioq_compare);
     if (r < 0)
@@ -490,6 +541,12 @@ _public_ int sd_event_new(sd_event **ret)
         e->profile_delays = true;
     }
 
+    if (secure_getenv("SD_EVENT_PROFILE_SOURCES"))
+    {
+        log_debug("Event source profiling enabled. Dispatch counts and run times will be collected per event source.");
+        e->profile_sources = true;
+    }
+
     *ret = e;
     return 0;
 
@@ -517,6 +574,13 @@ _public_ sd_event *sd_event_unref(sd_event *e)
         return NULL;
 
     assert(e->n_ref >= 1);
+
+    /* Run whatever other threads managed to queue before the last reference is dropped, so that no work
+     * item (and whatever its userdata owns) is lost silently. This happens while we still hold that
+     * reference, hence the callbacks get a fully functional loop, and may take references of their own. */
+    if (e->n_ref == 1 && e->work_source)
+        event_run_work(e, true);
+
     e->n_ref--;
 
     if (e->n_ref <= 0)
@@ -937,7 +1001,7 @@ static void source_disconnect(sd_event_source *s)
 
     event = s->event;
 
-    s->type = _SOURCE_EVENT_SOURCE_TYPE_INVALID;
+    /* The type is kept, source_free() still needs it to close the fd of IO sources that own it */
     s->event = NULL;
     LIST_REMOVE(sources, event->sources, s);
     event->n_sources--;
@@ -1999,6 +2063,16 @@ _public_ int sd_event_source_get_child_pid(sd_event_source *s, pid_t *pid)
     return 0;
 }
 
+_public_ int sd_event_source_get_stats(sd_event_source *s, sd_event_source_stats *ret)
+{
+    assert_return(s, -EINVAL);
+    assert_return(ret, -EINVAL);
+    assert_return(!event_pid_changed(s->event), -ECHILD);
+
+    *ret = s->stats;
+    return 0;
+}
+
 _public_ int sd_event_source_set_prepare(sd_event_source *s, sd_event_handler_t callback)
 {
     int r;
@@ -2139,50 +2213,30 @@ static usec_t sleep_between(sd_event *e, usec_t a, usec_t b)
     return b;
 }
 
-static int event_arm_timer(
-    sd_event *e,
-    struct clock_data *d)
+static int clock_data_arm(struct clock_data *d, usec_t t)
 {
-
     struct itimerspec its = {};
-    sd_event_source *a, *b;
-    usec_t t;
     int r;
 
-    assert(e);
     assert(d);
 
-    if (!d->needs_rearm)
+    if (d->next == t)
         return 0;
-    else
-        d->needs_rearm = false;
 
-    a = prioq_peek(d->earliest);
-    if (!a || a->enabled == SD_EVENT_OFF || a->time.next == USEC_INFINITY)
+    if (t == USEC_INFINITY)
     {
-
         if (d->fd < 0)
             return 0;
 
-        if (d->next == USEC_INFINITY)
-            return 0;
-
         /* disarm */
         r = timerfd_settime(d->fd, TFD_TIMER_ABSTIME, &its, NULL);
         if (r < 0)
-            return r;
+            return -errno;
 
         d->next = USEC_INFINITY;
         return 0;
     }
 
-    b = prioq_peek(d->latest);
-    assert_se(b && b->enabled != SD_EVENT_OFF);
-
-    t = sleep_between(e, a->time.next, time_event_source_latest(b));
-    if (d->next == t)
-        return 0;
-
     assert_se(d->fd >= 0);
 
     if (t == 0)
@@ -2202,6 +2256,177 @@ static int event_arm_timer(
     return 0;
 }
 
+static bool clock_data_get_window(struct clock_data *d, usec_t *ret_earliest, usec_t *ret_latest)
+{
+    sd_event_source *a, *b;
+
+    assert(d);
+    assert(ret_earliest);
+    assert(ret_latest);
+
+    a = prioq_peek(d->earliest);
+    if (!a || a->enabled == SD_EVENT_OFF || a->time.next == USEC_INFINITY)
+        return false;
+
+    b = prioq_peek(d->latest);
+    assert_se(b && b->enabled != SD_EVENT_OFF);
+
+    *ret_earliest = a->time.next;
+    *ret_latest = time_event_source_latest(b);
+    return true;
+}
+
+static int event_arm_timers(sd_event *e)
+{
+    static const EventSourceType types[] = {
+        SOURCE_TIME_REALTIME,
+        SOURCE_TIME_BOOTTIME,
+        SOURCE_TIME_MONOTONIC,
+        SOURCE_TIME_REALTIME_ALARM,
+        SOURCE_TIME_BOOTTIME_ALARM,
+    };
+
+    struct
+    {
+        struct clock_data *d;
+        clockid_t clock;
+        usec_t earliest, latest;
+        int64_t delta;
+        bool coalesce;
+        unsigned group;
+    } w[ELEMENTSOF(types)], tmp;
+
+    struct
+    {
+        usec_t earliest, latest, target;
+        unsigned n;
+        bool coalesce;
+    } g[ELEMENTSOF(types)];
+
+    triple_timestamp ts = {};
+    bool rearm = false;
+    unsigned i, j, n = 0, n_groups = 0;
+    int r;
+
+    assert(e);
+
+    for (i = 0; i < ELEMENTSOF(types); i++)
+        if (event_get_clock_data(e, types[i])->needs_rearm)
+            rearm = true;
+
+    if (!rearm)
+        return 0;
+
+    /* Each clock has a window, spanning from the earliest time its first timer may elapse to the latest
+     * time its most urgent timer must have been dispatched. Overlapping windows are grouped, and all
+     * clocks of a group are armed to the very same point in time within the intersection of their
+     * windows, so that they are all returned by a single epoll_wait(). Since the clocks use different
+     * bases, the windows are compared after translating them to CLOCK_MONOTONIC. */
+
+    for (i = 0; i < ELEMENTSOF(types); i++)
+    {
+        struct clock_data *d;
+        usec_t earliest, latest;
+
+        d = event_get_clock_data(e, types[i]);
+        d->needs_rearm = false;
+
+        if (!clock_data_get_window(d, &earliest, &latest))
+        {
+            r = clock_data_arm(d, USEC_INFINITY);
+            if (r < 0)
+                return r;
+
+            continue;
+        }
+
+        w[n].d = d;
+        w[n].clock = event_source_type_to_clock(types[i]);
+        w[n].earliest = earliest;
+        w[n].latest = latest;
+        w[n].delta = 0;
+        w[n].coalesce = false;
+        n++;
+    }
+
+    if (n > 1)
+    {
+        triple_timestamp_get(&ts);
+
+        for (i = 0; i < n; i++)
+        {
+            usec_t base;
+
+            base = triple_timestamp_by_clock(&ts, w[i].clock);
+            if (base == USEC_INFINITY)
+                continue;
+
+            w[i].delta = (int64_t)base - (int64_t)ts.monotonic;
+            w[i].coalesce = true;
+        }
+
+        /* Order the windows by the time they close */
+        for (i = 1; i < n; i++)
+            for (j = i; j > 0 && usec_sub_signed(w[j].latest, w[j].delta) < usec_sub_signed(w[j - 1].latest, w[j - 1].delta); j--)
+            {
+                tmp = w[j];
+                w[j] = w[j - 1];
+                w[j - 1] = tmp;
+            }
+    }
+
+    /* Since the windows are ordered by the time they close, the first window of a group closes first,
+     * and any later window that opens before that overlaps with all of the group. */
+    for (i = 0; i < n; i++)
+    {
+        usec_t earliest, latest;
+
+        earliest = usec_sub_signed(w[i].earliest, w[i].delta);
+        latest = usec_sub_signed(w[i].latest, w[i].delta);
+
+        for (j = 0; j < n_groups; j++)
+            if (w[i].coalesce && g[j].coalesce && earliest <= g[j].latest)
+                break;
+
+        if (j == n_groups)
+        {
+            g[j].earliest = earliest;
+            g[j].latest = latest;
+            g[j].target = USEC_INFINITY;
+            g[j].n = 0;
+            g[j].coalesce = w[i].coalesce;
+            n_groups++;
+        }
+        else
+            g[j].earliest = MAX(g[j].earliest, earliest);
+
+        w[i].group = j;
+        g[j].n++;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        usec_t t;
+
+        if (g[w[i].group].n == 1)
+            /* Nothing to coalesce with, stick to the clock's own base when picking the time */
+            t = sleep_between(e, w[i].earliest, w[i].latest);
+        else
+        {
+            if (g[w[i].group].target == USEC_INFINITY)
+                g[w[i].group].target = sleep_between(e, g[w[i].group].earliest, g[w[i].group].latest);
+
+            t = usec_sub_signed(g[w[i].group].target, -w[i].delta);
+        }
+
+        r = clock_data_arm(w[i].d, t);
+        if (r < 0)
+            return r;
+    }
+
+    return 0;
+}
+
 static int process_io(sd_event *e, sd_event_source *s, uint32_t revents)
 {
     assert(e);
@@ -2257,11 +2482,16 @@ static int process_timer(
 {
 
     sd_event_source *s;
+    usec_t last = USEC_INFINITY;
+    unsigned k = 0;
     int r;
 
     assert(e);
     assert(d);
 
+    /* Returns the number of distinct deadlines among the time sources that became pending. They are
+     * dequeued in order of their deadline, hence comparing with the previous one is enough. */
+
     for (;;)
     {
         s = prioq_peek(d->earliest);
@@ -2278,9 +2508,13 @@ static int process_timer(
         prioq_reshuffle(d->earliest, s, &s->time.earliest_index);
         prioq_reshuffle(d->latest, s, &s->time.latest_index);
         d->needs_rearm = true;
+
+        if (s->time.next != last)
+            k++;
+        last = s->time.next;
     }
 
-    return 0;
+    return (int)k;
 }
 
 static int process_child(sd_event *e)
@@ -2415,9 +2649,26 @@ static int process_signal(sd_event *e, struct signal_data *d, uint32_t events)
     }
 }
 
+static void source_account_dispatch(sd_event_source *s, EventSourceType type, usec_t run, usec_t late)
+{
+    assert(s);
+
+    s->stats.n_dispatch++;
+    s->stats.run_usec += run;
+    s->stats.run_max_usec = MAX(s->stats.run_max_usec, run);
+
+    if (EVENT_SOURCE_IS_TIME(type))
+    {
+        s->stats.late_usec += late;
+        s->stats.late_max_usec = MAX(s->stats.late_max_usec, late);
+    }
+}
+
 static int source_dispatch(sd_event_source *s)
 {
     EventSourceType saved_type;
+    usec_t begin = 0, late = 0;
+    bool profile;
     int r = 0;
 
     assert(s);
@@ -2460,6 +2711,17 @@ static int source_dispatch(sd_event_source *s)
             return r;
     }
 
+    /* Take the timestamps before invoking the callback, as it might move the time source around or even
+     * disconnect it from the event loop. */
+    profile = s->event->profile_sources;
+    if (profile)
+    {
+        if (EVENT_SOURCE_IS_TIME(s->type))
+            late = usec_sub_unsigned(now(event_source_type_to_clock(s->type)), s->time.next);
+
+        begin = now(CLOCK_MONOTONIC);
+    }
+
     s->dispatching = true;
 
     switch (s->type)
@@ -2516,6 +2778,9 @@ static int source_dispatch(sd_event_source *s)
 
     s->dispatching = false;
 
+    if (profile)
+        source_account_dispatch(s, saved_type, usec_sub_unsigned(now(CLOCK_MONOTONIC), begin), late);
+
     if (r < 0)
         log_debug_errno(r, "Event source %s (type %s) returned error, disabling: %m",
                         strna(s->description), event_source_type_to_string(saved_type));
@@ -2576,7 +2841,12 @@ static int dispatch_exit(sd_event *e)
     p = prioq_peek(e->exit);
     if (!p || p->enabled == SD_EVENT_OFF)
     {
+        /* Drain the work queue one last time while the loop is still fully functional */
+        sd_event_ref(e);
+        e->state = SD_EVENT_EXITING;
+        event_run_work(e, true);
         e->state = SD_EVENT_FINISHED;
+        sd_event_unref(e);
         return 0;
     }
 
@@ -2673,25 +2943,20 @@ _public_ int sd_event_prepare(sd_event *e)
     if (r < 0)
         return r;
 
-    r = event_arm_timer(e, &e->realtime);
-    if (r < 0)
-        return r;
-
-    r = event_arm_timer(e, &e->boottime);
-    if (r < 0)
-        return r;
-
-    r = event_arm_timer(e, &e->monotonic);
+    r = event_arm_timers(e);
     if (r < 0)
         return r;
 
-    r = event_arm_timer(e, &e->realtime_alarm);
-    if (r < 0)
-        return r;
+    /* A producer could not signal the eventfd, pick up the queued work items without waiting for it */
+    if (e->work_wakeup_failed && e->work_source)
+    {
+        e->work_wakeup_failed = false;
+        __sync_synchronize();
 
-    r = event_arm_timer(e, &e->boottime_alarm);
-    if (r < 0)
-        return r;
+        r = source_set_pending(e->work_source, true);
+        if (r < 0)
+            return r;
+    }
 
     if (event_next_pending(e) || e->need_process_child)
         goto pending;
@@ -2709,10 +2974,58 @@ pending:
     return r;
 }
 
+static int event_ensure_event_queue(sd_event *e)
+{
+    struct epoll_event *q;
+
+    assert(e);
+
+    if (e->event_queue_allocated == e->event_queue_size)
+        return 0;
+
+    q = realloc_multiply(e->event_queue, sizeof(struct epoll_event), e->event_queue_size);
+    if (!q)
+        return -ENOMEM;
+
+    e->event_queue = q;
+    e->event_queue_allocated = e->event_queue_size;
+
+    return 0;
+}
+
+static void event_adjust_event_queue(sd_event *e, unsigned m)
+{
+    assert(e);
+
+    /* If epoll_wait() filled the buffer completely, more events are likely ready. They stay queued in the
+     * kernel, which hands out the ones we did not collect first next time, so nothing starves; but let's
+     * collect more per iteration from now on. */
+    if (m >= e->event_queue_size && e->event_queue_size < e->event_queue_max)
+    {
+        e->event_queue_size = MIN(e->event_queue_size * 2, e->event_queue_max);
+        e->event_queue_peak = 0;
+        e->event_queue_iterations = 0;
+        return;
+    }
+
+    e->event_queue_peak = MAX(e->event_queue_peak, m);
+
+    if (++e->event_queue_iterations < EVENT_QUEUE_SHRINK_ITERATIONS)
+        return;
+
+    /* Give memory back if the buffer stayed mostly unused for a while */
+    if (e->event_queue_size > EVENT_QUEUE_MIN && e->event_queue_peak * 4 <= e->event_queue_size)
+        e->event_queue_size = MAX(e->event_queue_size / 2, EVENT_QUEUE_MIN);
+
+    e->event_queue_peak = 0;
+    e->event_queue_iterations = 0;
+}
+
 _public_ int sd_event_wait(sd_event *e, uint64_t timeout)
 {
     struct epoll_event *ev_queue;
-    unsigned ev_queue_max;
+    bool timer_wakeup = false;
+    unsigned n_timers;
     int r, m, i;
 
     assert_return(e, -EINVAL);
@@ -2728,8 +3041,12 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout)
     }
 
     // NOTE(ywen): Figure out the needed event buffer length.
-    ev_queue_max = MAX(e->n_sources, 1u);
-    ev_queue = newa(struct epoll_event, ev_queue_max);
+    /* The buffer is kept across iterations, and only reallocated when the desired length changed */
+    r = event_ensure_event_queue(e);
+    if (r < 0)
+        goto finish;
+
+    ev_queue = e->event_queue;
 
     // NOTE(ywen): Wait for events on the epoll instance `e->epoll_fd` which was
     // created in `sd_event_new`.
@@ -2740,7 +3057,7 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout)
         // NOTE(ywen): The buffer in which the triggered events are put.
         ev_queue,
         // NOTE(ywen): The maximum number of events to return.
-        ev_queue_max,
+        e->event_queue_allocated,
         // NOTE(ywen): And the timeout of the waiting.
         timeout == (uint64_t)-1 ? -1 : (int)((timeout + USEC_PER_MSEC - 1) / USEC_PER_MSEC));
     if (m < 0)
@@ -2757,6 +3074,8 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout)
 
     triple_timestamp_get(&e->timestamp);
 
+    event_adjust_event_queue(e, m);
+
     // NOTE(ywen): Now we go through all the triggered events one by one.
     for (i = 0; i < m; i++)
     {
@@ -2777,6 +3096,7 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout)
             {
                 struct clock_data *d = ev_queue[i].data.ptr;
                 r = flush_timer(e, d->fd, ev_queue[i].events, &d->next);
+                timer_wakeup = true;
                 break;
             }
 
@@ -2799,22 +3119,36 @@ _public_ int sd_event_wait(sd_event *e, uint64_t timeout)
     r = process_timer(e, e->timestamp.realtime, &e->realtime);
     if (r < 0)
         goto finish;
+    n_timers = r;
 
     r = process_timer(e, e->timestamp.boottime, &e->boottime);
     if (r < 0)
         goto finish;
+    n_timers += r;
 
     r = process_timer(e, e->timestamp.monotonic, &e->monotonic);
     if (r < 0)
         goto finish;
+    n_timers += r;
 
     r = process_timer(e, e->timestamp.realtime, &e->realtime_alarm);
     if (r < 0)
         goto finish;
+    n_timers += r;
 
     r = process_timer(e, e->timestamp.boottime, &e->boottime_alarm);
     if (r < 0)
         goto finish;
+    n_timers += r;
+
+    /* Only count iterations that a timerfd woke up, and of the deadlines that elapsed in them every one
+     * beyond the first would have needed a wakeup of its own, had it not been deferred into the window
+     * of another. Time sources sharing a deadline elapse together anyway and are not counted. */
+    if (timer_wakeup && n_timers > 0)
+    {
+        e->n_timer_wakeups++;
+        e->n_timer_wakeups_saved += n_timers - 1;
+    }
 
     if (e->need_process_child)
     {
@@ -3151,3 +3485,328 @@ _public_ int sd_event_get_iteration(sd_event *e, uint64_t *ret)
     *ret = e->iteration;
     return 0;
 }
+
+_public_ int sd_event_set_profile(sd_event *e, int b)
+{
+    assert_return(e, -EINVAL);
+    assert_return(e = event_resolve(e), -ENOPKG);
+    assert_return(!event_pid_changed(e), -ECHILD);
+
+    e->profile_sources = !!b;
+    return e->profile_sources;
+}
+
+_public_ int sd_event_get_profile(sd_event *e)
+{
+    assert_return(e, -EINVAL);
+    assert_return(e = event_resolve(e), -ENOPKG);
+    assert_return(!event_pid_changed(e), -ECHILD);
+
+    return e->profile_sources;
+}
+
+_public_ int sd_event_get_stats(sd_event *e, char ***ret_keys, sd_event_source_stats **ret_stats)
+{
+    _cleanup_hashmap_free_ Hashmap *index = NULL;
+    _cleanup_free_ sd_event_source_stats *stats = NULL;
+    _cleanup_strv_free_ char **keys = NULL;
+    size_t n = 0, n_allocated = 0, keys_allocated = 0;
+    sd_event_source *s;
+    int r;
+
+    assert_return(e, -EINVAL);
+    assert_return(e = event_resolve(e), -ENOPKG);
+    assert_return(ret_keys, -EINVAL);
+    assert_return(ret_stats, -EINVAL);
+    assert_return(!event_pid_changed(e), -ECHILD);
+
+    /* Sums up the accounting data of all event sources attached to the loop, keyed by their
+     * description. Sources without a description are accounted under the name of their type. */
+
+    index = hashmap_new(&string_hash_ops);
+    if (!index)
+        return -ENOMEM;
+
+    LIST_FOREACH(sources, s, e->sources)
+    {
+        sd_event_source_stats *t;
+        const char *key;
+        unsigned i;
+
+        key = s->description ?: event_source_type_to_string(s->type);
+
+        i = PTR_TO_UINT(hashmap_get(index, key));
+        if (i == 0)
+        {
+            if (!GREEDY_REALLOC0(stats, n_allocated, n + 1))
+                return -ENOMEM;
+
+            /* Keep the array NULL terminated at all times */
+            if (!GREEDY_REALLOC0(keys, keys_allocated, n + 2))
+                return -ENOMEM;
+
+            keys[n] = strdup(key);
+            if (!keys[n])
+                return -ENOMEM;
+
+            r = hashmap_put(index, keys[n], UINT_TO_PTR(n + 1));
+            if (r < 0)
+                return r;
+
+            i = ++n;
+        }
+
+        t = stats + i - 1;
+        t->n_dispatch += s->stats.n_dispatch;
+        t->run_usec += s->stats.run_usec;
+        t->run_max_usec = MAX(t->run_max_usec, s->stats.run_max_usec);
+        t->late_usec += s->stats.late_usec;
+        t->late_max_usec = MAX(t->late_max_usec, s->stats.late_max_usec);
+    }
+
+    *ret_keys = keys;
+    *ret_stats = stats;
+    keys = NULL;
+    stats = NULL;
+
+    return (int)n;
+}
+
+_public_ int sd_event_get_timer_wakeups(sd_event *e, uint64_t *ret_wakeups, uint64_t *ret_saved)
+{
+    assert_return(e, -EINVAL);
+    assert_return(e = event_resolve(e), -ENOPKG);
+    assert_return(!event_pid_changed(e), -ECHILD);
+
+    if (ret_wakeups)
+        *ret_wakeups = e->n_timer_wakeups;
+    if (ret_saved)
+        *ret_saved = e->n_timer_wakeups_saved;
+
+    return 0;
+}
+
+_public_ int sd_event_set_max_events(sd_event *e, unsigned max)
+{
+    assert_return(e, -EINVAL);
+    assert_return(e = event_resolve(e), -ENOPKG);
+    assert_return(!event_pid_changed(e), -ECHILD);
+
+    if (max == 0)
+        max = EVENT_QUEUE_MAX_DEFAULT;
+
+    e->event_queue_max = MAX(max, EVENT_QUEUE_MIN);
+    e->event_queue_size = MIN(e->event_queue_size, e->event_queue_max);
+
+    return 0;
+}
+
+_public_ int sd_event_get_max_events(sd_event *e, unsigned *ret)
+{
+    assert_return(e, -EINVAL);
+    assert_return(e = event_resolve(e), -ENOPKG);
+    assert_return(ret, -EINVAL);
+    assert_return(!event_pid_changed(e), -ECHILD);
+
+    *ret = e->event_queue_max;
+    return 0;
+}
+
+static EventWork *event_take_work(sd_event *e)
+{
+    EventWork *w, *fifo = NULL;
+
+    assert(e);
+
+    /* Detach the complete list at once. Producers push to the front, hence reverse it to get the
+     * items back in the order they were posted in. */
+    w = __sync_lock_test_and_set(&e->work_queue, NULL);
+    __sync_synchronize();
+
+    while (w)
+    {
+        EventWork *next = w->next;
+
+        w->next = fifo;
+        fifo = w;
+        w = next;
+    }
+
+    return fifo;
+}
+
+static void event_run_work(sd_event *e, bool drain)
+{
+    EventWork *w;
+
+    assert(e);
+
+    /* Normally we only process one batch per iteration, so that busy producers cannot starve the rest
+     * of the loop: items posted meanwhile trigger another wakeup. When draining, keep going until the
+     * queue is empty. */
+    do
+    {
+        w = event_take_work(e);
+        if (!w)
+            break;
+
+        while (w)
+        {
+            EventWork *next = w->next;
+            int r;
+
+            r = w->callback(e, w->userdata);
+            if (r < 0)
+                log_debug_errno(r, "Work item callback failed, ignoring: %m");
+
+            free(w);
+            w = next;
+        }
+    } while (drain);
+}
+
+static void event_free_work(sd_event *e)
+{
+    EventWork *w;
+
+    assert(e);
+
+    w = event_take_work(e);
+    while (w)
+    {
+        EventWork *next = w->next;
+
+        free(w);
+        w = next;
+    }
+}
+
+static int work_queue_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata)
+{
+    sd_event *e = userdata;
+    uint64_t x;
+
+    assert(e);
+
+    /* Reset the counter before looking at the queue. A producer that finds the list empty after we
+     * detached it will write the eventfd again, so nothing can be missed. */
+    if (read(fd, &x, sizeof(x)) < 0 && errno != EAGAIN)
+        return -errno;
+
+    event_run_work(e, false);
+    return 0;
+}
+
+_public_ int sd_event_enable_work_queue(sd_event *e, int64_t priority)
+{
+    _cleanup_close_ int fd = -1;
+    int r;
+
+    assert_return(e, -EINVAL);
+    assert_return(e = event_resolve(e), -ENOPKG);
+    assert_return(e->state != SD_EVENT_FINISHED, -ESTALE);
+    assert_return(!event_pid_changed(e), -ECHILD);
+
+    if (e->work_source)
+        return sd_event_source_set_priority(e->work_source, priority);
+
+    fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd < 0)
+        return -errno;
+
+    r = sd_event_add_io(e, &e->work_source, fd, EPOLLIN, work_queue_handler, e);
+    if (r < 0)
+        return r;
+
+    r = sd_event_source_set_priority(e->work_source, priority);
+    if (r < 0)
+    {
+        e->work_source = sd_event_source_unref(e->work_source);
+        return r;
+    }
+
+    (void)sd_event_source_set_description(e->work_source, "work-queue");
+    (void)sd_event_source_set_io_fd_own(e->work_source, true);
+
+    /* The source is owned by the loop itself and goes away together with it, hence turn it into a
+     * floating one and drop the reference it took on us. */
+    e->work_source->floating = true;
+    sd_event_unref(e);
+
+    e->work_fd = fd;
+    fd = -1;
+
+    return 0;
+}
+
+static int event_work_wakeup(sd_event *e)
+{
+    static const uint64_t one = 1;
+
+    assert(e);
+
+    if (e->work_wakeup_error < 0)
+        return e->work_wakeup_error;
+
+    if (write(e->work_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        return -errno;
+
+    return 0;
+}
+
+void event_work_queue_inject_wakeup_error(sd_event *e, int error)
+{
+    assert(e);
+    assert(error <= 0);
+
+    e->work_wakeup_error = error;
+}
+
+_public_ int sd_event_post_work(sd_event *e, sd_event_work_handler_t callback, void *userdata)
+{
+    EventWork *w, *head;
+    int r;
+
+    /* This is the only call of this API that may be invoked from threads other than the one running
+     * the event loop. Hence no event_resolve() here, the default event is a per-thread concept. */
+
+    assert_return(e, -EINVAL);
+    assert_return(e != SD_EVENT_DEFAULT, -EINVAL);
+    assert_return(callback, -EINVAL);
+    assert_return(!event_pid_changed(e), -ECHILD);
+
+    if (e->work_fd < 0)
+        return -ENXIO;
+
+    w = new(EventWork, 1);
+    if (!w)
+        return -ENOMEM;
+
+    w->callback = callback;
+    w->userdata = userdata;
+
+    do
+    {
+        head = e->work_queue;
+        w->next = head;
+    } while (!__sync_bool_compare_and_swap(&e->work_queue, head, w));
+
+    /* Only the producer turning the queue non-empty needs to wake up the loop. Everybody else piggy
+     * backs on that wakeup, which keeps the number of syscalls low under load. If that wakeup could not
+     * be sent, every later producer tries again, and the loop picks up the items on its next iteration
+     * anyway. The item is queued at this point, hence this is not a failure of this call: the caller
+     * must not release the userdata. */
+    if (!head || e->work_wakeup_failed)
+    {
+        r = event_work_wakeup(e);
+        if (r < 0)
+        {
+            log_debug_errno(r, "Failed to wake up event loop for queued work item, ignoring: %m");
+            e->work_wakeup_failed = true;
+        }
+        else
+            e->work_wakeup_failed = false;
+    }
+
+    return 0;
+}
@@ -18,14 +18,18 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <pthread.h>
 #include <sys/wait.h>
 
 #include "sd-event.h"
 
+#include "event-util.h"
 #include "fd-util.h"
 #include "log.h"
 #include "macro.h"
 #include "signal-util.h"
+#include "string-util.h"
+#include "strv.h"
 #include "util.h"
 #include "process-util.h"
 
@@ -355,6 +359,471 @@ static void test_rtqueue(void) {
         sd_event_unref(e);
 }
 
+static int stats_io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        char c;
+
+        assert_se(read(fd, &c, 1) == 1);
+        return 0;
+}
+
+static int stats_time_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        return 0;
+}
+
+static void test_stats(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        sd_event_source *x = NULL, *y = NULL, *z = NULL;
+        _cleanup_free_ sd_event_source_stats *stats = NULL;
+        _cleanup_strv_free_ char **keys = NULL;
+        sd_event_source_stats st;
+        static const char ch = 'x';
+        int a[2] = { -1, -1 }, b[2] = { -1, -1 };
+        unsigned i;
+        int n;
+
+        assert_se(pipe(a) >= 0);
+        assert_se(pipe(b) >= 0);
+
+        assert_se(sd_event_new(&e) >= 0);
+        assert_se(sd_event_set_profile(e, true) == 1);
+        assert_se(sd_event_get_profile(e) == 1);
+
+        /* Two sources with the same description are accounted together */
+        assert_se(sd_event_add_io(e, &x, a[0], EPOLLIN, stats_io_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_description(x, "test-io") >= 0);
+        assert_se(sd_event_add_io(e, &y, b[0], EPOLLIN, stats_io_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_description(y, "test-io") >= 0);
+        assert_se(sd_event_add_time(e, &z, CLOCK_MONOTONIC, 0, 0, stats_time_handler, NULL) >= 0);
+
+        for (i = 0; i < 3; i++) {
+                assert_se(write(a[1], &ch, 1) == 1);
+                assert_se(sd_event_run(e, (uint64_t) -1) >= 1);
+        }
+        assert_se(write(b[1], &ch, 1) == 1);
+        assert_se(sd_event_run(e, (uint64_t) -1) >= 1);
+        while (sd_event_run(e, 0) > 0)
+                ;
+
+        assert_se(sd_event_source_get_stats(x, &st) >= 0);
+        assert_se(st.n_dispatch == 3);
+        assert_se(st.run_max_usec <= st.run_usec);
+        assert_se(st.late_usec == 0);
+
+        assert_se(sd_event_source_get_stats(z, &st) >= 0);
+        assert_se(st.n_dispatch == 1);
+        assert_se(st.late_max_usec > 0);
+
+        n = sd_event_get_stats(e, &keys, &stats);
+        assert_se(n == 2);
+        assert_se(strv_length(keys) == 2);
+
+        for (i = 0; i < (unsigned) n; i++) {
+                log_info("%s: %" PRIu64 " dispatches, %" PRIu64 "us total, %" PRIu64 "us max, %" PRIu64 "us late",
+                         keys[i], stats[i].n_dispatch, stats[i].run_usec, stats[i].run_max_usec, stats[i].late_max_usec);
+
+                if (streq(keys[i], "test-io"))
+                        assert_se(stats[i].n_dispatch == 4);
+                else if (streq(keys[i], "monotonic"))
+                        assert_se(stats[i].n_dispatch == 1);
+                else
+                        assert_not_reached("Unexpected key");
+        }
+
+        /* Nothing is accounted once profiling is turned off again */
+        assert_se(sd_event_set_profile(e, false) == 0);
+        assert_se(write(a[1], &ch, 1) == 1);
+        assert_se(sd_event_run(e, (uint64_t) -1) >= 1);
+        assert_se(sd_event_source_get_stats(x, &st) >= 0);
+        assert_se(st.n_dispatch == 3);
+
+        sd_event_source_unref(x);
+        sd_event_source_unref(y);
+        sd_event_source_unref(z);
+
+        safe_close_pair(a);
+        safe_close_pair(b);
+}
+
+#define N_COALESCE_TIMERS 2000U
+
+static unsigned n_coalesced = 0;
+
+static int coalesce_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        sd_event *e = sd_event_source_get_event(s);
+        clockid_t clock;
+        uint64_t n;
+
+        /* Coalescing may delay timers, but must never make them elapse early */
+        assert_se(sd_event_source_get_time_clock(s, &clock) >= 0);
+        assert_se(sd_event_now(e, clock, &n) >= 0);
+        assert_se(n >= usec);
+
+        if (++n_coalesced == N_COALESCE_TIMERS)
+                assert_se(sd_event_exit(e, 0) >= 0);
+
+        return 0;
+}
+
+static void test_timer_coalescing(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        uint64_t base_monotonic, base_boottime, wakeups, saved;
+        unsigned i;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        base_monotonic = now(CLOCK_MONOTONIC);
+        base_boottime = clock_boottime_supported() ? now(CLOCK_BOOTTIME) : base_monotonic;
+
+        /* Spread a couple of thousand timers over 200ms, with 50ms of slack each, alternating between two
+         * clocks, and check that they elapse in far fewer wakeups than there are timers. */
+        for (i = 0; i < N_COALESCE_TIMERS; i++) {
+                usec_t offset = (i * 97 % 200) * USEC_PER_MSEC;
+
+                if (i % 2 == 0 || !clock_boottime_supported())
+                        assert_se(sd_event_add_time(e, NULL, CLOCK_MONOTONIC, base_monotonic + offset,
+                                                    50 * USEC_PER_MSEC, coalesce_handler, NULL) >= 0);
+                else
+                        assert_se(sd_event_add_time(e, NULL, CLOCK_BOOTTIME, base_boottime + offset,
+                                                    50 * USEC_PER_MSEC, coalesce_handler, NULL) >= 0);
+        }
+
+        assert_se(sd_event_loop(e) >= 0);
+        assert_se(n_coalesced == N_COALESCE_TIMERS);
+
+        assert_se(sd_event_get_timer_wakeups(e, &wakeups, &saved) >= 0);
+        log_info("%u timers elapsed in %" PRIu64 " wakeups, %" PRIu64 " wakeups saved", N_COALESCE_TIMERS, wakeups, saved);
+
+        /* Timers sharing a deadline elapse together without any coalescing and are not counted as saved,
+         * so at most one wakeup per distinct deadline is accounted for. */
+        assert_se(wakeups > 0);
+        assert_se(wakeups + saved <= 200);
+}
+
+static unsigned n_clock_timers = 0;
+
+static int clock_timer_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        if (++n_clock_timers == 3)
+                assert_se(sd_event_exit(sd_event_source_get_event(s), 0) >= 0);
+
+        return 0;
+}
+
+static void test_timer_coalescing_clocks(void) {
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        uint64_t wakeups, saved;
+        usec_t m, r, b;
+
+        if (!clock_boottime_supported()) {
+                log_info("CLOCK_BOOTTIME not supported, skipping %s", __func__);
+                return;
+        }
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* One timer on each clock, with windows that share 100ms. The clocks are read up front, so that
+         * being scheduled away between adding the timers cannot shrink that overlap. Arming each clock for
+         * its own window, the monotonic one would often wake up at a point aligned within its window before
+         * the others may elapse, and they would need wakeups of their own. */
+        m = now(CLOCK_MONOTONIC);
+        r = now(CLOCK_REALTIME);
+        b = now(CLOCK_BOOTTIME);
+
+        assert_se(sd_event_add_time(e, NULL, CLOCK_MONOTONIC, m + 100 * USEC_PER_MSEC,
+                                    300 * USEC_PER_MSEC, clock_timer_handler, NULL) >= 0);
+        assert_se(sd_event_add_time(e, NULL, CLOCK_REALTIME, r + 300 * USEC_PER_MSEC,
+                                    300 * USEC_PER_MSEC, clock_timer_handler, NULL) >= 0);
+        assert_se(sd_event_add_time(e, NULL, CLOCK_BOOTTIME, b + 300 * USEC_PER_MSEC,
+                                    300 * USEC_PER_MSEC, clock_timer_handler, NULL) >= 0);
+
+        assert_se(sd_event_loop(e) >= 0);
+        assert_se(n_clock_timers == 3);
+
+        assert_se(sd_event_get_timer_wakeups(e, &wakeups, &saved) >= 0);
+        log_info("3 timers on different clocks elapsed in %" PRIu64 " wakeups, %" PRIu64 " wakeups saved", wakeups, saved);
+
+        /* Normally all three elapse in a single wakeup. Leave room for one more, so that a heavily loaded
+         * host cannot make this fail. */
+        assert_se(wakeups <= 2);
+        assert_se(saved >= 1);
+}
+
+#define N_STRESS_SOURCES 20000U
+#define N_STRESS_PIPES 128U
+#define STRESS_STACK_SIZE (512U * 1024U)
+#define STRESS_STACK_PATTERN 0x5a
+
+static unsigned n_stress_io = 0;
+
+static int stress_io_handler(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        char c;
+
+        assert_se(read(fd, &c, 1) == 1);
+        n_stress_io++;
+
+        return 0;
+}
+
+static void *stress_thread(void *p) {
+        sd_event *e = NULL;
+        int pipes[N_STRESS_PIPES][2];
+        static const char ch = 'x';
+        unsigned i, max_events;
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        /* Lots of sources that never fire. The epoll buffer must not scale with them. */
+        for (i = 0; i < N_STRESS_SOURCES; i++)
+                assert_se(sd_event_add_time(e, NULL, CLOCK_MONOTONIC, USEC_INFINITY, 0, stats_time_handler, NULL) >= 0);
+
+        /* And more ready fds than fit into the capped buffer, all of which need to be dispatched */
+        assert_se(sd_event_set_max_events(e, 32) >= 0);
+        assert_se(sd_event_get_max_events(e, &max_events) >= 0);
+        assert_se(max_events == 32);
+
+        for (i = 0; i < N_STRESS_PIPES; i++) {
+                assert_se(pipe2(pipes[i], O_CLOEXEC|O_NONBLOCK) >= 0);
+                assert_se(sd_event_add_io(e, NULL, pipes[i][0], EPOLLIN, stress_io_handler, NULL) >= 0);
+                assert_se(write(pipes[i][1], &ch, 1) == 1);
+        }
+
+        for (i = 0; i < N_STRESS_PIPES * 2 && n_stress_io < N_STRESS_PIPES; i++)
+                assert_se(sd_event_run(e, 0) >= 0);
+
+        assert_se(n_stress_io == N_STRESS_PIPES);
+
+        sd_event_unref(e);
+
+        for (i = 0; i < N_STRESS_PIPES; i++)
+                safe_close_pair(pipes[i]);
+
+        return NULL;
+}
+
+static void test_event_queue_stress(void) {
+        pthread_attr_t attr;
+        uint8_t *stack;
+        size_t used;
+        pthread_t t;
+
+        /* Run the loop on a stack we own and prefill, so that we can tell afterwards how deep it went */
+        assert_se(posix_memalign((void**) &stack, page_size(), STRESS_STACK_SIZE) == 0);
+        memset(stack, STRESS_STACK_PATTERN, STRESS_STACK_SIZE);
+
+        assert_se(pthread_attr_init(&attr) == 0);
+        assert_se(pthread_attr_setstack(&attr, stack, STRESS_STACK_SIZE) == 0);
+        assert_se(pthread_create(&t, &attr, stress_thread, NULL) == 0);
+        assert_se(pthread_join(t, NULL) == 0);
+        assert_se(pthread_attr_destroy(&attr) == 0);
+
+        for (used = STRESS_STACK_SIZE; used > 0; used--)
+                if (stack[STRESS_STACK_SIZE - used] != STRESS_STACK_PATTERN)
+                        break;
+
+        log_info("Event loop with %u sources used %zu bytes of stack", N_STRESS_SOURCES + N_STRESS_PIPES, used);
+        assert_se(used < 64U * 1024U);
+
+        free(stack);
+}
+
+#define N_WORK_THREADS 4U
+#define N_WORK_ITEMS 20000U
+
+static sd_event *work_event;
+static unsigned work_seen[N_WORK_THREADS + 1];
+static unsigned n_work, n_work_expected;
+
+static int work_handler(sd_event *e, void *userdata) {
+        unsigned v = PTR_TO_UINT(userdata), t, seq;
+
+        assert_se(e == work_event);
+
+        /* Thread index in the upper bits, sequence number in the lower ones */
+        t = v >> 24;
+        seq = v & 0xFFFFFFU;
+
+        assert_se(t <= N_WORK_THREADS);
+        assert_se(seq == work_seen[t]);
+        work_seen[t]++;
+
+        if (++n_work == n_work_expected && sd_event_get_state(e) != SD_EVENT_EXITING)
+                assert_se(sd_event_exit(e, 0) >= 0);
+
+        return 0;
+}
+
+static unsigned n_work_use_loop;
+
+static int work_defer_handler(sd_event_source *s, void *userdata) {
+        return 0;
+}
+
+static int work_use_loop_handler(sd_event *e, void *userdata) {
+        sd_event_source *s = NULL;
+
+        assert_se(e == work_event);
+
+        sd_event_unref(sd_event_ref(e));
+
+        assert_se(sd_event_add_defer(e, &s, work_defer_handler, NULL) >= 0);
+        assert_se(sd_event_source_set_enabled(s, SD_EVENT_ONESHOT) >= 0);
+        sd_event_source_unref(s);
+
+        n_work_use_loop++;
+        return 0;
+}
+
+static void *work_thread(void *p) {
+        unsigned t = PTR_TO_UINT(p), i;
+
+        for (i = 0; i < N_WORK_ITEMS; i++)
+                assert_se(sd_event_post_work(work_event, work_handler, UINT_TO_PTR((t << 24) | i)) >= 0);
+
+        return NULL;
+}
+
+static void work_reset(unsigned expected) {
+        zero(work_seen);
+        n_work = 0;
+        n_work_expected = expected;
+}
+
+static void test_work_queue_ordering(void) {
+        pthread_t threads[N_WORK_THREADS];
+        unsigned i;
+
+        assert_se(sd_event_new(&work_event) >= 0);
+
+        assert_se(sd_event_post_work(work_event, work_handler, NULL) == -ENXIO);
+        assert_se(sd_event_enable_work_queue(work_event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+        assert_se(sd_event_enable_work_queue(work_event, SD_EVENT_PRIORITY_IDLE) >= 0);
+
+        work_reset(N_WORK_THREADS * N_WORK_ITEMS + 100);
+
+        /* Items posted from the loop thread itself are processed in order, too */
+        for (i = 0; i < 100; i++)
+                assert_se(sd_event_post_work(work_event, work_handler, UINT_TO_PTR((N_WORK_THREADS << 24) | i)) >= 0);
+
+        for (i = 0; i < N_WORK_THREADS; i++)
+                assert_se(pthread_create(threads + i, NULL, work_thread, UINT_TO_PTR(i)) == 0);
+
+        assert_se(sd_event_loop(work_event) >= 0);
+
+        for (i = 0; i < N_WORK_THREADS; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        assert_se(n_work == n_work_expected);
+        for (i = 0; i < N_WORK_THREADS; i++)
+                assert_se(work_seen[i] == N_WORK_ITEMS);
+        assert_se(work_seen[N_WORK_THREADS] == 100);
+
+        work_event = sd_event_unref(work_event);
+}
+
+static void test_work_queue_drain(void) {
+        pthread_t threads[N_WORK_THREADS];
+        unsigned i;
+
+        assert_se(sd_event_new(&work_event) >= 0);
+        assert_se(sd_event_enable_work_queue(work_event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        /* Everything queued before the loop exits is still dispatched, even if the exit request
+         * was made before the loop got to look at the queue. */
+        work_reset(UINT_MAX);
+
+        for (i = 0; i < N_WORK_THREADS; i++)
+                assert_se(pthread_create(threads + i, NULL, work_thread, UINT_TO_PTR(i)) == 0);
+        for (i = 0; i < N_WORK_THREADS; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        assert_se(sd_event_exit(work_event, 0) >= 0);
+        assert_se(sd_event_loop(work_event) >= 0);
+        assert_se(n_work == N_WORK_THREADS * N_WORK_ITEMS);
+
+        /* And whatever is left over when the last reference goes away is run on destruction */
+        for (i = 0; i < 10; i++)
+                assert_se(sd_event_post_work(work_event, work_handler, UINT_TO_PTR((N_WORK_THREADS << 24) | i)) >= 0);
+
+        work_event = sd_event_unref(work_event);
+        assert_se(work_seen[N_WORK_THREADS] == 10);
+}
+
+static void test_work_queue_unref(void) {
+        assert_se(sd_event_new(&work_event) >= 0);
+        assert_se(sd_event_enable_work_queue(work_event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        /* The items run on destruction may use the loop as usual, including taking references of their own */
+        n_work_use_loop = 0;
+        assert_se(sd_event_post_work(work_event, work_use_loop_handler, NULL) >= 0);
+        assert_se(sd_event_post_work(work_event, work_use_loop_handler, NULL) >= 0);
+
+        work_event = sd_event_unref(work_event);
+        assert_se(n_work_use_loop == 2);
+}
+
+static void test_work_queue_wakeup_failure(void) {
+        assert_se(sd_event_new(&work_event) >= 0);
+        assert_se(sd_event_enable_work_queue(work_event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        event_work_queue_inject_wakeup_error(work_event, -EIO);
+
+        work_reset(UINT_MAX);
+
+        /* The items are queued even though the loop could not be woken up, hence the posting
+         * succeeds, and the loop still runs them in order on its next iteration */
+        assert_se(sd_event_post_work(work_event, work_handler, UINT_TO_PTR((N_WORK_THREADS << 24) | 0)) == 0);
+        assert_se(sd_event_post_work(work_event, work_handler, UINT_TO_PTR((N_WORK_THREADS << 24) | 1)) == 0);
+        assert_se(work_seen[N_WORK_THREADS] == 0);
+
+        assert_se(sd_event_run(work_event, 0) > 0);
+        assert_se(work_seen[N_WORK_THREADS] == 2);
+
+        assert_se(sd_event_post_work(work_event, work_handler, UINT_TO_PTR((N_WORK_THREADS << 24) | 2)) == 0);
+        assert_se(sd_event_run(work_event, 0) > 0);
+        assert_se(work_seen[N_WORK_THREADS] == 3);
+
+        /* Once wakeups work again, the eventfd signals the loop like before */
+        event_work_queue_inject_wakeup_error(work_event, 0);
+        assert_se(sd_event_post_work(work_event, work_handler, UINT_TO_PTR((N_WORK_THREADS << 24) | 3)) == 0);
+        assert_se(sd_event_prepare(work_event) == 0);
+        assert_se(sd_event_wait(work_event, 0) > 0);
+        assert_se(sd_event_dispatch(work_event) > 0);
+        assert_se(work_seen[N_WORK_THREADS] == 4);
+
+        work_event = sd_event_unref(work_event);
+}
+
+static void test_work_queue_throughput(void) {
+        pthread_t threads[N_WORK_THREADS];
+        char buf[FORMAT_TIMESPAN_MAX];
+        uint64_t iterations;
+        usec_t ts;
+        unsigned i;
+
+        assert_se(sd_event_new(&work_event) >= 0);
+        assert_se(sd_event_enable_work_queue(work_event, SD_EVENT_PRIORITY_NORMAL) >= 0);
+
+        work_reset(N_WORK_THREADS * N_WORK_ITEMS);
+
+        ts = now(CLOCK_MONOTONIC);
+
+        for (i = 0; i < N_WORK_THREADS; i++)
+                assert_se(pthread_create(threads + i, NULL, work_thread, UINT_TO_PTR(i)) == 0);
+
+        assert_se(sd_event_loop(work_event) >= 0);
+
+        for (i = 0; i < N_WORK_THREADS; i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        ts = now(CLOCK_MONOTONIC) - ts;
+
+        assert_se(n_work == n_work_expected);
+        assert_se(sd_event_get_iteration(work_event, &iterations) >= 0);
+        log_info("Dispatched %u work items from %u threads in %s (%" PRIu64 " loop iterations)",
+                 n_work, N_WORK_THREADS, format_timespan(buf, sizeof(buf), ts, 0), iterations);
+
+        work_event = sd_event_unref(work_event);
+}
+
 int main(int argc, char *argv[]) {
 
         log_set_max_level(LOG_DEBUG);
@@ -363,6 +832,15 @@ int main(int argc, char *argv[]) {
         test_basic();
         test_sd_event_now();
         test_rtqueue();
+        test_stats();
+        test_timer_coalescing();
+        test_timer_coalescing_clocks();
+        test_event_queue_stress();
+        test_work_queue_ordering();
+        test_work_queue_drain();
+        test_work_queue_unref();
+        test_work_queue_wakeup_failure();
+        test_work_queue_throughput();
 
         return 0;
 }
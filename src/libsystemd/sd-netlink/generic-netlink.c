@@ -3,6 +3,7 @@
 #include "sd-netlink.h"
 #include "netlink-internal.h"
 #include "alloc-util.h"
+#include "hashmap.h"
 
 typedef struct {
         const char* name;
@@ -80,6 +81,16 @@ int sd_genl_message_new(sd_netlink *nl, sd_genl_family family, uint8_t cmd, sd_n
 static int lookup_id(sd_netlink *nl, sd_genl_family family, uint16_t *id) {
         int r;
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *req = NULL, *reply = NULL;
+        uint16_t u;
+        void *v;
+
+        /* The id of a family doesn't change as long as the family is registered, so save the round trip
+         * to the kernel for every message after the first one */
+        v = hashmap_get(nl->genl_family_to_nlmsg_type, INT_TO_PTR(family));
+        if (v) {
+                *id = PTR_TO_UINT(v);
+                return 0;
+        }
 
         r = sd_genl_message_new(nl, SD_GENL_ID_CTRL, CTRL_CMD_GETFAMILY, &req);
         if (r < 0)
@@ -93,5 +104,43 @@ static int lookup_id(sd_netlink *nl, sd_genl_family family, uint16_t *id) {
         if (r < 0)
                 return r;
 
-        return sd_netlink_message_read_u16(reply, CTRL_ATTR_FAMILY_ID, id);
+        r = sd_netlink_message_read_u16(reply, CTRL_ATTR_FAMILY_ID, &u);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_allocated(&nl->genl_family_to_nlmsg_type, NULL);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_allocated(&nl->nlmsg_type_to_genl_family, NULL);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(nl->genl_family_to_nlmsg_type, INT_TO_PTR(family), UINT_TO_PTR(u));
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(nl->nlmsg_type_to_genl_family, UINT_TO_PTR(u), INT_TO_PTR(family));
+        if (r < 0) {
+                hashmap_remove(nl->genl_family_to_nlmsg_type, INT_TO_PTR(family));
+                return r;
+        }
+
+        *id = u;
+
+        return 0;
+}
+
+int genl_get_type(sd_netlink *nl, uint16_t type, const NLType **ret) {
+        void *family;
+
+        assert(nl);
+        assert(ret);
+
+        /* Only families messages were sent to before are known, which is all replies can belong to */
+        family = hashmap_get(nl->nlmsg_type_to_genl_family, UINT_TO_PTR(type));
+        if (!family)
+                return -EOPNOTSUPP;
+
+        return type_system_get_type(&genl_family_message_type_system, ret, PTR_TO_INT(family));
 }
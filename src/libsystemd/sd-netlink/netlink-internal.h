@@ -67,6 +67,17 @@ struct sd_netlink {
         Hashmap *broadcast_group_refs;
         bool broadcast_group_dont_leave:1; /* until we can rely on 4.2 */
 
+        /* The ids the kernel assigned to generic netlink families, in both directions */
+        Hashmap *genl_family_to_nlmsg_type;
+        Hashmap *nlmsg_type_to_genl_family;
+
+        /* Connected to a replay driver through an AF_UNIX socket pair instead of to the kernel, see
+         * netlink_open_fake() */
+        bool fake:1;
+
+        /* Every datagram read is appended here, see rtnl_set_recording() */
+        int record_fd;
+
         sd_netlink_message **rqueue;
         unsigned rqueue_size;
         size_t rqueue_allocated;
@@ -106,6 +117,8 @@ struct netlink_container {
         size_t offset; /* offset from hdr to the start of the container */
         struct netlink_attribute *attributes;
         unsigned short n_attributes; /* number of attributes in container */
+        size_t array_next; /* offset from hdr to the next element of an entered array, 0 if no array */
+        size_t array_end; /* offset from hdr to the end of an entered array */
 };
 
 struct sd_netlink_message {
@@ -126,8 +139,13 @@ struct sd_netlink_message {
 
 int message_new(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t type);
 int message_new_empty(sd_netlink *rtnl, sd_netlink_message **ret);
+int message_get_type(sd_netlink *nl, uint16_t type, const NLType **ret);
+int message_parse(sd_netlink_message *m, const NLType *nl_type);
+
+int genl_get_type(sd_netlink *nl, uint16_t type, const NLType **ret);
 
 int netlink_open_family(sd_netlink **ret, int family);
+int netlink_open_fake(sd_netlink **ret, int protocol, int fd);
 
 int socket_open(int family);
 int socket_bind(sd_netlink *nl);
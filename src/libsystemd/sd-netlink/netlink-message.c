@@ -63,6 +63,19 @@ int message_new_empty(sd_netlink *rtnl, sd_netlink_message **ret) {
         return 0;
 }
 
+int message_get_type(sd_netlink *nl, uint16_t type, const NLType **ret) {
+        int r;
+
+        assert(nl);
+        assert(ret);
+
+        r = type_system_get_type(type_system_get_root(nl->protocol), ret, type);
+        if (r == -EOPNOTSUPP && nl->protocol == NETLINK_GENERIC)
+                return genl_get_type(nl, type, ret);
+
+        return r;
+}
+
 int message_new(sd_netlink *rtnl, sd_netlink_message **ret, uint16_t type) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
         const NLType *nl_type;
@@ -108,7 +121,8 @@ int sd_netlink_message_request_dump(sd_netlink_message *m, int dump) {
         assert_return(m, -EINVAL);
         assert_return(m->hdr, -EINVAL);
 
-        assert_return(IN_SET(m->hdr->nlmsg_type, RTM_GETLINK, RTM_GETADDR, RTM_GETROUTE, RTM_GETNEIGH, RTM_GETRULE, RTM_GETADDRLABEL), -EINVAL);
+        assert_return(m->protocol == NETLINK_GENERIC ||
+                      IN_SET(m->hdr->nlmsg_type, RTM_GETLINK, RTM_GETADDR, RTM_GETROUTE, RTM_GETNEIGH, RTM_GETRULE, RTM_GETADDRLABEL), -EINVAL);
 
         SET_FLAG(m->hdr->nlmsg_flags, NLM_F_DUMP, dump);
 
@@ -570,8 +584,10 @@ static int netlink_message_read_internal(sd_netlink_message *m, unsigned short t
         assert_return(data, -EINVAL);
 
         assert(m->n_containers < RTNL_CONTAINER_DEPTH);
-        assert(m->containers[m->n_containers].attributes);
-        assert(type < m->containers[m->n_containers].n_attributes);
+
+        /* arrays have no attributes of their own, only elements */
+        if (type >= m->containers[m->n_containers].n_attributes)
+                return -ENODATA;
 
         attribute = &m->containers[m->n_containers].attributes[type];
 
@@ -588,6 +604,22 @@ static int netlink_message_read_internal(sd_netlink_message *m, unsigned short t
         return RTA_PAYLOAD(rta);
 }
 
+int sd_netlink_message_read(sd_netlink_message *m, unsigned short type, size_t size, void *data) {
+        void *attr_data;
+        int r;
+
+        assert_return(m, -EINVAL);
+
+        r = netlink_message_read_internal(m, type, &attr_data, NULL);
+        if (r < 0)
+                return r;
+
+        if (data)
+                memcpy(data, attr_data, MIN(size, (size_t) r));
+
+        return r;
+}
+
 int sd_netlink_message_read_string(sd_netlink_message *m, unsigned short type, const char **data) {
         int r;
         void *attr_data;
@@ -906,13 +938,86 @@ int sd_netlink_message_enter_container(sd_netlink_message *m, unsigned short typ
         return 0;
 }
 
+int sd_netlink_message_enter_array(sd_netlink_message *m, unsigned short type_id) {
+        const NLTypeSystem *type_system;
+        struct netlink_container *array;
+        void *container;
+        int r;
+
+        assert_return(m, -EINVAL);
+        assert_return(m->n_containers < RTNL_CONTAINER_DEPTH - 1, -EINVAL);
+
+        r = type_system_get_type_system(m->containers[m->n_containers].type_system,
+                                        &type_system,
+                                        type_id);
+        if (r < 0)
+                return r;
+
+        r = netlink_message_read_internal(m, type_id, &container, NULL);
+        if (r < 0)
+                return r;
+
+        /* the elements are entered one after the other with sd_netlink_message_enter_array_element(),
+           as they usually all come with the same type, rather than with their index */
+        m->n_containers++;
+
+        array = &m->containers[m->n_containers];
+        array->type_system = type_system;
+        array->array_next = (uint8_t *) container - (uint8_t *) m->hdr;
+        array->array_end = array->array_next + r;
+
+        return 0;
+}
+
+int sd_netlink_message_enter_array_element(sd_netlink_message *m) {
+        struct netlink_container *array;
+        struct rtattr *rta;
+        unsigned int rt_len;
+        int r;
+
+        assert_return(m, -EINVAL);
+        assert_return(m->n_containers < RTNL_CONTAINER_DEPTH - 1, -EINVAL);
+
+        array = &m->containers[m->n_containers];
+
+        assert_return(array->array_next > 0, -EINVAL);
+
+        rta = (struct rtattr*)((uint8_t *) m->hdr + array->array_next);
+        rt_len = array->array_end - array->array_next;
+
+        if (!RTA_OK(rta, rt_len))
+                /* all elements visited */
+                return 0;
+
+        array->array_next += MIN((size_t) RTA_ALIGN(rta->rta_len), (size_t) rt_len);
+
+        m->n_containers++;
+
+        r = netlink_container_parse(m,
+                                    &m->containers[m->n_containers],
+                                    type_system_get_count(array->type_system),
+                                    RTA_DATA(rta),
+                                    RTA_PAYLOAD(rta));
+        if (r < 0) {
+                m->n_containers--;
+                return r;
+        }
+
+        m->containers[m->n_containers].type_system = array->type_system;
+
+        return 1;
+}
+
 int sd_netlink_message_exit_container(sd_netlink_message *m) {
         assert_return(m, -EINVAL);
         assert_return(m->sealed, -EINVAL);
         assert_return(m->n_containers > 0, -EINVAL);
 
         m->containers[m->n_containers].attributes = mfree(m->containers[m->n_containers].attributes);
+        m->containers[m->n_containers].n_attributes = 0;
         m->containers[m->n_containers].type_system = NULL;
+        m->containers[m->n_containers].array_next = 0;
+        m->containers[m->n_containers].array_end = 0;
 
         m->n_containers--;
 
@@ -947,11 +1052,37 @@ int sd_netlink_message_get_errno(sd_netlink_message *m) {
         return err->error;
 }
 
+int message_parse(sd_netlink_message *m, const NLType *nl_type) {
+        uint16_t type;
+        size_t size;
+
+        assert(m);
+        assert(m->hdr);
+        assert(nl_type);
+
+        type = type_get_type(nl_type);
+        size = type_get_size(nl_type);
+
+        if (type == NETLINK_TYPE_NESTED) {
+                const NLTypeSystem *type_system;
+
+                type_get_type_system(nl_type, &type_system);
+
+                m->containers[0].type_system = type_system;
+
+                return netlink_container_parse(m,
+                                               &m->containers[0],
+                                               type_system_get_count(type_system),
+                                               (struct rtattr*)((uint8_t*)NLMSG_DATA(m->hdr) + NLMSG_ALIGN(size)),
+                                               NLMSG_PAYLOAD(m->hdr, size));
+        }
+
+        return 0;
+}
+
 int sd_netlink_message_rewind(sd_netlink_message *m) {
         const NLType *nl_type;
         const NLTypeSystem *type_system_root;
-        uint16_t type;
-        size_t size;
         unsigned i;
         int r;
 
@@ -963,8 +1094,12 @@ int sd_netlink_message_rewind(sd_netlink_message *m) {
 
         type_system_root = type_system_get_root(m->protocol);
 
-        for (i = 1; i <= m->n_containers; i++)
+        for (i = 1; i <= m->n_containers; i++) {
                 m->containers[i].attributes = mfree(m->containers[i].attributes);
+                m->containers[i].n_attributes = 0;
+                m->containers[i].array_next = 0;
+                m->containers[i].array_end = 0;
+        }
 
         m->n_containers = 0;
 
@@ -978,26 +1113,7 @@ int sd_netlink_message_rewind(sd_netlink_message *m) {
         if (r < 0)
                 return r;
 
-        type = type_get_type(nl_type);
-        size = type_get_size(nl_type);
-
-        if (type == NETLINK_TYPE_NESTED) {
-                const NLTypeSystem *type_system;
-
-                type_get_type_system(nl_type, &type_system);
-
-                m->containers[0].type_system = type_system;
-
-                r = netlink_container_parse(m,
-                                            &m->containers[m->n_containers],
-                                            type_system_get_count(type_system),
-                                            (struct rtattr*)((uint8_t*)NLMSG_DATA(m->hdr) + NLMSG_ALIGN(size)),
-                                            NLMSG_PAYLOAD(m->hdr, size));
-                if (r < 0)
-                        return r;
-        }
-
-        return 0;
+        return message_parse(m, nl_type);
 }
 
 void rtnl_message_seal(sd_netlink_message *m) {
@@ -25,7 +25,9 @@
 #include "sd-netlink.h"
 
 #include "alloc-util.h"
+#include "fd-util.h"
 #include "format-util.h"
+#include "io-util.h"
 #include "missing.h"
 #include "netlink-internal.h"
 #include "netlink-types.h"
@@ -154,6 +156,9 @@ static int broadcast_group_join(sd_netlink *nl, unsigned group) {
         assert(nl->fd >= 0);
         assert(group > 0);
 
+        if (nl->fake)
+                return 0;
+
         r = setsockopt(nl->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP, &group, sizeof(group));
         if (r < 0)
                 return -errno;
@@ -197,7 +202,7 @@ static int broadcast_group_leave(sd_netlink *nl, unsigned group) {
         assert(nl->fd >= 0);
         assert(group > 0);
 
-        if (nl->broadcast_group_dont_leave)
+        if (nl->broadcast_group_dont_leave || nl->fake)
                 return 0;
 
         r = setsockopt(nl->fd, SOL_NETLINK, NETLINK_DROP_MEMBERSHIP, &group, sizeof(group));
@@ -248,17 +253,24 @@ int socket_write_message(sd_netlink *nl, sd_netlink_message *m) {
         assert(m);
         assert(m->hdr);
 
-        k = sendto(nl->fd, m->hdr, m->hdr->nlmsg_len,
-                        0, &addr.sa, sizeof(addr));
+        if (nl->fake)
+                k = send(nl->fd, m->hdr, m->hdr->nlmsg_len, 0);
+        else
+                k = sendto(nl->fd, m->hdr, m->hdr->nlmsg_len,
+                                0, &addr.sa, sizeof(addr));
         if (k < 0)
                 return -errno;
 
         return k;
 }
 
-static int socket_recv_message(int fd, struct iovec *iov, uint32_t *_group, bool peek) {
-        union sockaddr_union sender;
+static int socket_recv_message(sd_netlink *nl, struct iovec *iov, uint32_t *_group, bool peek) {
+        union sockaddr_union sender = {};
         uint8_t cmsg_buffer[CMSG_SPACE(sizeof(struct nl_pktinfo))];
+        uint32_t group = 0;
+        struct iovec fake_iov[2] = {
+                IOVEC_INIT(&group, sizeof(group)),
+        };
         struct msghdr msg = {
                 .msg_iov = iov,
                 .msg_iovlen = 1,
@@ -268,13 +280,20 @@ static int socket_recv_message(int fd, struct iovec *iov, uint32_t *_group, bool
                 .msg_controllen = sizeof(cmsg_buffer),
         };
         struct cmsghdr *cmsg;
-        uint32_t group = 0;
         ssize_t n;
 
-        assert(fd >= 0);
+        assert(nl);
+        assert(nl->fd >= 0);
         assert(iov);
 
-        n = recvmsg(fd, &msg, MSG_TRUNC | (peek ? MSG_PEEK : 0));
+        if (nl->fake) {
+                /* The replay driver passes the multicast group in front of the messages */
+                fake_iov[1] = *iov;
+                msg.msg_iov = fake_iov;
+                msg.msg_iovlen = ELEMENTSOF(fake_iov);
+        }
+
+        n = recvmsg(nl->fd, &msg, MSG_TRUNC | (peek ? MSG_PEEK : 0));
         if (n < 0) {
                 /* no data */
                 if (errno == ENOBUFS)
@@ -291,7 +310,7 @@ static int socket_recv_message(int fd, struct iovec *iov, uint32_t *_group, bool
 
                 if (peek) {
                         /* drop the message */
-                        n = recvmsg(fd, &msg, 0);
+                        n = recvmsg(nl->fd, &msg, 0);
                         if (n < 0)
                                 return IN_SET(errno, EAGAIN, EINTR) ? 0 : -errno;
                 }
@@ -310,12 +329,46 @@ static int socket_recv_message(int fd, struct iovec *iov, uint32_t *_group, bool
                 }
         }
 
+        if (nl->fake) {
+                if ((size_t) n < sizeof(group)) {
+                        log_debug("rtnl: ignoring datagram without multicast group");
+
+                        if (peek)
+                                /* drop the message */
+                                (void) recvmsg(nl->fd, &msg, 0);
+
+                        return 0;
+                }
+
+                n -= sizeof(group);
+        }
+
         if (_group)
                 *_group = group;
 
         return (int) n;
 }
 
+static void socket_record_message(sd_netlink *nl, size_t len, uint32_t group) {
+        RtnlRecord record = {
+                .timestamp = htole64(now(CLOCK_MONOTONIC)),
+                .group = htole32(group),
+                .size = htole32(len),
+        };
+        struct iovec iov[] = {
+                IOVEC_INIT(&record, sizeof(record)),
+                IOVEC_INIT(nl->rbuffer, len),
+        };
+
+        assert(nl);
+        assert(nl->record_fd >= 0);
+
+        if (writev(nl->record_fd, iov, ELEMENTSOF(iov)) < 0) {
+                log_debug_errno(errno, "sd-netlink: failed to record message, stopping: %m");
+                nl->record_fd = safe_close(nl->record_fd);
+        }
+}
+
 /* On success, the number of bytes received is returned and *ret points to the received message
  * which has a valid header and the correct size.
  * If nothing useful was received 0 is returned.
@@ -330,16 +383,13 @@ int socket_read_message(sd_netlink *rtnl) {
         size_t len;
         int r;
         unsigned i = 0;
-        const NLTypeSystem *type_system_root;
 
         assert(rtnl);
         assert(rtnl->rbuffer);
         assert(rtnl->rbuffer_allocated >= sizeof(struct nlmsghdr));
 
-        type_system_root = type_system_get_root(rtnl->protocol);
-
         /* read nothing, just get the pending message size */
-        r = socket_recv_message(rtnl->fd, &iov, NULL, true);
+        r = socket_recv_message(rtnl, &iov, NULL, true);
         if (r <= 0)
                 return r;
         else
@@ -355,7 +405,7 @@ int socket_read_message(sd_netlink *rtnl) {
         iov.iov_len = rtnl->rbuffer_allocated;
 
         /* read the pending message */
-        r = socket_recv_message(rtnl->fd, &iov, &group, false);
+        r = socket_recv_message(rtnl, &iov, &group, false);
         if (r <= 0)
                 return r;
         else
@@ -365,6 +415,9 @@ int socket_read_message(sd_netlink *rtnl) {
                 /* message did not fit in read buffer */
                 return -EIO;
 
+        if (rtnl->record_fd >= 0)
+                socket_record_message(rtnl, len, group);
+
         if (NLMSG_OK(rtnl->rbuffer, len) && rtnl->rbuffer->nlmsg_flags & NLM_F_MULTI) {
                 multi_part = true;
 
@@ -399,7 +452,7 @@ int socket_read_message(sd_netlink *rtnl) {
                 }
 
                 /* check that we support this message type */
-                r = type_system_get_type(type_system_root, &nl_type, new_msg->nlmsg_type);
+                r = message_get_type(rtnl, new_msg->nlmsg_type, &nl_type);
                 if (r < 0) {
                         if (r == -EOPNOTSUPP)
                                 log_debug("sd-netlink: ignored message with unknown type: %i",
@@ -425,7 +478,9 @@ int socket_read_message(sd_netlink *rtnl) {
                         return -ENOMEM;
 
                 /* seal and parse the top-level message */
-                r = sd_netlink_message_rewind(m);
+                rtnl_message_seal(m);
+
+                r = message_parse(m, nl_type);
                 if (r < 0)
                         return r;
 
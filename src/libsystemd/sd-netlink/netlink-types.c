@@ -685,7 +685,7 @@ static const NLType genl_wireguard_peer_types[] = {
         [WGPEER_A_PUBLIC_KEY] = { .size = WG_KEY_LEN  },
         [WGPEER_A_FLAGS] = { .type = NETLINK_TYPE_U32 },
         [WGPEER_A_PRESHARED_KEY] = { .size = WG_KEY_LEN },
-        [WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL] = { .type = NETLINK_TYPE_U32 },
+        [WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL] = { .type = NETLINK_TYPE_U16 },
         [WGPEER_A_ENDPOINT] = { /* either size of sockaddr_in or sockaddr_in6 depending on address family */ },
         [WGPEER_A_ALLOWEDIPS] = { .type = NETLINK_TYPE_NESTED, .type_system = &genl_wireguard_allowedip_type_system },
 };
@@ -695,7 +695,7 @@ static const NLTypeSystem genl_wireguard_peer_type_system = {
         .types = genl_wireguard_peer_types,
 };
 
-static const NLType genl_wireguard_set_device_types[] = {
+static const NLType genl_wireguard_device_types[] = {
         [WGDEVICE_A_IFINDEX] = { .type = NETLINK_TYPE_U32 },
         [WGDEVICE_A_IFNAME] = { .type = NETLINK_TYPE_STRING },
         [WGDEVICE_A_FLAGS] = { .type = NETLINK_TYPE_U32 },
@@ -705,13 +705,14 @@ static const NLType genl_wireguard_set_device_types[] = {
         [WGDEVICE_A_PEERS] = { .type = NETLINK_TYPE_NESTED, .type_system = &genl_wireguard_peer_type_system },
 };
 
-static const NLTypeSystem genl_wireguard_set_device_type_system = {
-        .count = ELEMENTSOF(genl_wireguard_set_device_types),
-        .types = genl_wireguard_set_device_types,
+static const NLTypeSystem genl_wireguard_device_type_system = {
+        .count = ELEMENTSOF(genl_wireguard_device_types),
+        .types = genl_wireguard_device_types,
 };
 
 static const NLType genl_wireguard_cmds[] = {
-        [WG_CMD_SET_DEVICE] = { .type = NETLINK_TYPE_NESTED, .type_system = &genl_wireguard_set_device_type_system },
+        [WG_CMD_GET_DEVICE] = { .type = NETLINK_TYPE_NESTED, .type_system = &genl_wireguard_device_type_system },
+        [WG_CMD_SET_DEVICE] = { .type = NETLINK_TYPE_NESTED, .type_system = &genl_wireguard_device_type_system },
 };
 
 static const NLTypeSystem genl_wireguard_type_system = {
@@ -748,7 +749,21 @@ const NLTypeSystem genl_family_type_system_root = {
         .types = genl_families,
 };
 
+/* Messages of families other than the controller are received with the id the kernel assigned to the
+ * family as type, see genl_get_type(). All commands of a family share its attributes. */
+static const NLType genl_family_messages[] = {
+        [SD_GENL_ID_CTRL]   = { .type = NETLINK_TYPE_NESTED, .type_system = &genl_get_family_type_system, .size = sizeof(struct genlmsghdr) },
+        [SD_GENL_WIREGUARD] = { .type = NETLINK_TYPE_NESTED, .type_system = &genl_wireguard_device_type_system, .size = sizeof(struct genlmsghdr) },
+};
+
+const NLTypeSystem genl_family_message_type_system = {
+        .count = ELEMENTSOF(genl_family_messages),
+        .types = genl_family_messages,
+};
+
 static const NLType genl_types[] = {
+        [NLMSG_DONE]   = { .type = NETLINK_TYPE_NESTED, .type_system = &empty_type_system, .size = 0 },
+        [NLMSG_ERROR]  = { .type = NETLINK_TYPE_NESTED, .type_system = &empty_type_system, .size = sizeof(struct nlmsgerr) },
         [GENL_ID_CTRL] = { .type = NETLINK_TYPE_NESTED, .type_system = &genl_get_family_type_system, .size = sizeof(struct genlmsghdr) },
 };
 
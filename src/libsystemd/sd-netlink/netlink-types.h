@@ -57,6 +57,7 @@ struct NLTypeSystemUnion {
 extern const NLTypeSystem rtnl_type_system_root;
 extern const NLTypeSystem genl_type_system_root;
 extern const NLTypeSystem genl_family_type_system_root;
+extern const NLTypeSystem genl_family_message_type_system;
 
 uint16_t type_get_type(const NLType *type);
 size_t type_get_size(const NLType *type);
@@ -22,8 +22,21 @@
 
 #include "sd-netlink.h"
 
+#include "sparse-endian.h"
 #include "util.h"
 
+/* A recording of the traffic received by an rtnl connection is a sequence of these headers, each followed
+ * by the datagram it describes, as it was read from the socket. The header is stored in little endian,
+ * the datagram in the byte order of the host that recorded it, like the kernel sent it. */
+typedef struct RtnlRecord {
+        le64_t timestamp; /* CLOCK_MONOTONIC */
+        le32_t group;     /* multicast group, 0 for replies to our own requests */
+        le32_t size;
+} RtnlRecord;
+
+int rtnl_set_recording(sd_netlink *rtnl, int fd);
+int rtnl_open_fake(sd_netlink **ret, int fd);
+
 int rtnl_message_new_synthetic_error(sd_netlink *rtnl, int error, uint32_t serial, sd_netlink_message **ret);
 uint32_t rtnl_message_get_serial(sd_netlink_message *m);
 void rtnl_message_seal(sd_netlink_message *m);
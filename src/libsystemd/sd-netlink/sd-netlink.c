@@ -46,6 +46,7 @@ static int sd_netlink_new(sd_netlink **ret)
 
     rtnl->n_ref = REFCNT_INIT;
     rtnl->fd = -1;
+    rtnl->record_fd = -1;
     rtnl->sockaddr.nl.nl_family = AF_NETLINK;
     rtnl->original_pid = getpid_cached();
     rtnl->protocol = -1;
@@ -144,6 +145,47 @@ int sd_netlink_open_fd(sd_netlink **ret, int fd)
     return 0;
 }
 
+/* Wraps one end of an AF_UNIX SOCK_DGRAM socket pair. Whatever is written to the other end must be
+ * prefixed with the 32bit multicast group the kernel would have sent it to, 0 for replies. */
+int netlink_open_fake(sd_netlink **ret, int protocol, int fd)
+{
+    _cleanup_(sd_netlink_unrefp) sd_netlink *rtnl = NULL;
+    int r;
+
+    assert_return(ret, -EINVAL);
+    assert_return(fd >= 0, -EBADF);
+
+    r = sd_netlink_new(&rtnl);
+    if (r < 0)
+        return r;
+
+    rtnl->fd = fd;
+    rtnl->protocol = protocol;
+    rtnl->fake = true;
+
+    *ret = rtnl;
+    rtnl = NULL;
+
+    return 0;
+}
+
+int rtnl_open_fake(sd_netlink **ret, int fd)
+{
+    return netlink_open_fake(ret, NETLINK_ROUTE, fd);
+}
+
+/* Takes possession of the fd, recording stops when writing to it fails */
+int rtnl_set_recording(sd_netlink *rtnl, int fd)
+{
+    assert_return(rtnl, -EINVAL);
+    assert_return(!rtnl_pid_changed(rtnl), -ECHILD);
+
+    safe_close(rtnl->record_fd);
+    rtnl->record_fd = fd;
+
+    return 0;
+}
+
 int netlink_open_family(sd_netlink **ret, int family)
 {
     _cleanup_close_ int fd = -1;
@@ -222,7 +264,11 @@ sd_netlink *sd_netlink_unref(sd_netlink *rtnl)
 
         hashmap_free(rtnl->broadcast_group_refs);
 
+        hashmap_free(rtnl->genl_family_to_nlmsg_type);
+        hashmap_free(rtnl->nlmsg_type_to_genl_family);
+
         safe_close(rtnl->fd);
+        safe_close(rtnl->record_fd);
         free(rtnl);
     }
 
@@ -18,18 +18,25 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <linux/genetlink.h>
 #include <net/if.h>
 #include <netinet/ether.h>
+#include <pthread.h>
 
 #include "sd-netlink.h"
 
 #include "ether-addr-util.h"
+#include "fd-util.h"
+#include "in-addr-util.h"
+#include "io-util.h"
 #include "macro.h"
 #include "missing.h"
+#include "netlink-internal.h"
 #include "netlink-util.h"
 #include "socket-util.h"
 #include "string-util.h"
 #include "util.h"
+#include "wireguard-netlink.h"
 
 static void test_message_link_bridge(sd_netlink *rtnl) {
         _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *message = NULL;
@@ -376,6 +383,286 @@ static void test_message(sd_netlink *rtnl) {
         assert_se(sd_netlink_message_get_errno(m) == -ETIMEDOUT);
 }
 
+#define FAKE_WIREGUARD_FAMILY_ID 0x42
+
+typedef struct FakeGenl {
+        int fd;
+        unsigned n_lookups;
+} FakeGenl;
+
+static void fake_genl_reply(int fd, const struct nlmsghdr *request, uint16_t type, uint16_t flags,
+                            const void *payload, size_t size) {
+        uint32_t group = 0;
+        struct nlmsghdr hdr = {
+                .nlmsg_len = NLMSG_LENGTH(size),
+                .nlmsg_type = type,
+                .nlmsg_flags = flags,
+                .nlmsg_seq = request->nlmsg_seq,
+                .nlmsg_pid = request->nlmsg_pid,
+        };
+        struct iovec iov[] = {
+                IOVEC_INIT(&group, sizeof(group)),
+                IOVEC_INIT(&hdr, NLMSG_HDRLEN),
+                IOVEC_INIT((void*) payload, size),
+        };
+        struct msghdr msg = {
+                .msg_iov = iov,
+                .msg_iovlen = ELEMENTSOF(iov),
+        };
+
+        assert_se(sendmsg(fd, &msg, 0) == (ssize_t) (sizeof(group) + NLMSG_LENGTH(size)));
+}
+
+/* Stands in for the kernel: resolves the wireguard family, and echoes requests to it back as replies, two
+ * of them for dumps, except that getting a device without dumping fails with ENODEV */
+static void *fake_genl_kernel(void *userdata) {
+        FakeGenl *k = userdata;
+
+        for (;;) {
+                union {
+                        struct nlmsghdr hdr;
+                        uint8_t buf[8192];
+                } request;
+                const struct genlmsghdr *genl;
+                size_t size;
+                ssize_t n;
+
+                n = recv(k->fd, &request, sizeof(request), 0);
+                if (n <= 0)
+                        /* an empty datagram asks us to stop */
+                        return NULL;
+
+                assert_se(NLMSG_OK(&request.hdr, (size_t) n));
+                genl = NLMSG_DATA(&request.hdr);
+                size = request.hdr.nlmsg_len - NLMSG_HDRLEN;
+
+                if (request.hdr.nlmsg_type == GENL_ID_CTRL) {
+                        struct {
+                                struct genlmsghdr genl;
+                                struct rtattr rta;
+                                uint16_t id;
+                                uint16_t padding;
+                        } reply = {
+                                .genl.cmd = CTRL_CMD_NEWFAMILY,
+                                .rta.rta_len = RTA_LENGTH(sizeof(uint16_t)),
+                                .rta.rta_type = CTRL_ATTR_FAMILY_ID,
+                                .id = FAKE_WIREGUARD_FAMILY_ID,
+                        };
+
+                        assert_se(genl->cmd == CTRL_CMD_GETFAMILY);
+                        k->n_lookups++;
+
+                        fake_genl_reply(k->fd, &request.hdr, GENL_ID_CTRL, 0, &reply, sizeof(reply));
+                        continue;
+                }
+
+                assert_se(request.hdr.nlmsg_type == FAKE_WIREGUARD_FAMILY_ID);
+
+                if ((request.hdr.nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP) {
+                        int32_t done = 0;
+
+                        fake_genl_reply(k->fd, &request.hdr, FAKE_WIREGUARD_FAMILY_ID, NLM_F_MULTI, genl, size);
+                        fake_genl_reply(k->fd, &request.hdr, FAKE_WIREGUARD_FAMILY_ID, NLM_F_MULTI, genl, size);
+                        fake_genl_reply(k->fd, &request.hdr, NLMSG_DONE, NLM_F_MULTI, &done, sizeof(done));
+                } else if (genl->cmd == WG_CMD_GET_DEVICE) {
+                        struct nlmsgerr err = {
+                                .error = -ENODEV,
+                                .msg = request.hdr,
+                        };
+
+                        fake_genl_reply(k->fd, &request.hdr, NLMSG_ERROR, 0, &err, sizeof(err));
+                } else
+                        fake_genl_reply(k->fd, &request.hdr, FAKE_WIREGUARD_FAMILY_ID, 0, genl, size);
+        }
+}
+
+static void test_genl_family_cache(sd_netlink *genl, FakeGenl *k) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        uint16_t type;
+
+        assert_se(sd_genl_message_new(genl, SD_GENL_WIREGUARD, WG_CMD_GET_DEVICE, &m) >= 0);
+        assert_se(k->n_lookups == 1);
+        assert_se(sd_netlink_message_get_type(m, &type) >= 0);
+        assert_se(type == FAKE_WIREGUARD_FAMILY_ID);
+
+        m = sd_netlink_message_unref(m);
+
+        /* The id is only looked up once */
+        assert_se(sd_genl_message_new(genl, SD_GENL_WIREGUARD, WG_CMD_SET_DEVICE, &m) >= 0);
+        assert_se(k->n_lookups == 1);
+        assert_se(sd_netlink_message_get_type(m, &type) >= 0);
+        assert_se(type == FAKE_WIREGUARD_FAMILY_ID);
+}
+
+static void test_genl_array(sd_netlink *genl) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL, *reply = NULL;
+        uint8_t key1[WG_KEY_LEN], key2[WG_KEY_LEN], key[WG_KEY_LEN], prefix[4];
+        union in_addr_union a1, a2;
+        struct in6_addr in6;
+        struct in_addr in;
+        const char *ifname;
+        uint16_t u16;
+        uint8_t u8;
+
+        memset(key1, 1, sizeof(key1));
+        memset(key2, 2, sizeof(key2));
+        assert_se(in_addr_from_string(AF_INET, "192.0.2.0", &a1) >= 0);
+        assert_se(in_addr_from_string(AF_INET6, "2001:db8::", &a2) >= 0);
+
+        assert_se(sd_genl_message_new(genl, SD_GENL_WIREGUARD, WG_CMD_SET_DEVICE, &m) >= 0);
+        assert_se(sd_netlink_message_append_string(m, WGDEVICE_A_IFNAME, "wg0") >= 0);
+        assert_se(sd_netlink_message_open_container(m, WGDEVICE_A_PEERS) >= 0);
+
+        assert_se(sd_netlink_message_open_array(m, 1) >= 0);
+        assert_se(sd_netlink_message_append_data(m, WGPEER_A_PUBLIC_KEY, key1, sizeof(key1)) >= 0);
+        assert_se(sd_netlink_message_append_u16(m, WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL, 25) >= 0);
+        assert_se(sd_netlink_message_open_container(m, WGPEER_A_ALLOWEDIPS) >= 0);
+        assert_se(sd_netlink_message_open_array(m, 1) >= 0);
+        assert_se(sd_netlink_message_append_u16(m, WGALLOWEDIP_A_FAMILY, AF_INET) >= 0);
+        assert_se(sd_netlink_message_append_in_addr(m, WGALLOWEDIP_A_IPADDR, &a1.in) >= 0);
+        assert_se(sd_netlink_message_append_u8(m, WGALLOWEDIP_A_CIDR_MASK, 24) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_message_open_array(m, 2) >= 0);
+        assert_se(sd_netlink_message_append_u16(m, WGALLOWEDIP_A_FAMILY, AF_INET6) >= 0);
+        assert_se(sd_netlink_message_append_in6_addr(m, WGALLOWEDIP_A_IPADDR, &a2.in6) >= 0);
+        assert_se(sd_netlink_message_append_u8(m, WGALLOWEDIP_A_CIDR_MASK, 32) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+
+        assert_se(sd_netlink_message_open_array(m, 2) >= 0);
+        assert_se(sd_netlink_message_append_data(m, WGPEER_A_PUBLIC_KEY, key2, sizeof(key2)) >= 0);
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+
+        assert_se(sd_netlink_message_close_container(m) >= 0);
+
+        /* The reply is typed by the id of the family, and has the request's attributes */
+        assert_se(sd_netlink_call(genl, m, 0, &reply) == 1);
+
+        assert_se(sd_netlink_message_read_string(reply, WGDEVICE_A_IFNAME, &ifname) >= 0);
+        assert_se(streq(ifname, "wg0"));
+        assert_se(sd_netlink_message_read(reply, WGDEVICE_A_PRIVATE_KEY, sizeof(key), key) == -ENODATA);
+
+        assert_se(sd_netlink_message_enter_array(reply, WGDEVICE_A_PEERS) >= 0);
+
+        assert_se(sd_netlink_message_enter_array_element(reply) == 1);
+        assert_se(sd_netlink_message_read(reply, WGPEER_A_PUBLIC_KEY, sizeof(key), key) == WG_KEY_LEN);
+        assert_se(memcmp(key, key1, WG_KEY_LEN) == 0);
+        /* A short buffer gets the start of the attribute, the return value is its full size */
+        assert_se(sd_netlink_message_read(reply, WGPEER_A_PUBLIC_KEY, sizeof(prefix), prefix) == WG_KEY_LEN);
+        assert_se(memcmp(prefix, key1, sizeof(prefix)) == 0);
+        assert_se(sd_netlink_message_read(reply, WGPEER_A_PUBLIC_KEY, 0, NULL) == WG_KEY_LEN);
+        assert_se(sd_netlink_message_read_u16(reply, WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL, &u16) >= 0);
+        assert_se(u16 == 25);
+
+        assert_se(sd_netlink_message_enter_array(reply, WGPEER_A_ALLOWEDIPS) >= 0);
+        assert_se(sd_netlink_message_enter_array_element(reply) == 1);
+        assert_se(sd_netlink_message_read_u16(reply, WGALLOWEDIP_A_FAMILY, &u16) >= 0);
+        assert_se(u16 == AF_INET);
+        assert_se(sd_netlink_message_read_in_addr(reply, WGALLOWEDIP_A_IPADDR, &in) >= 0);
+        assert_se(in.s_addr == a1.in.s_addr);
+        assert_se(sd_netlink_message_read_u8(reply, WGALLOWEDIP_A_CIDR_MASK, &u8) >= 0);
+        assert_se(u8 == 24);
+        assert_se(sd_netlink_message_exit_container(reply) >= 0);
+        assert_se(sd_netlink_message_enter_array_element(reply) == 1);
+        assert_se(sd_netlink_message_read_u16(reply, WGALLOWEDIP_A_FAMILY, &u16) >= 0);
+        assert_se(u16 == AF_INET6);
+        assert_se(sd_netlink_message_read_in6_addr(reply, WGALLOWEDIP_A_IPADDR, &in6) >= 0);
+        assert_se(IN6_ARE_ADDR_EQUAL(&in6, &a2.in6));
+        assert_se(sd_netlink_message_read_u8(reply, WGALLOWEDIP_A_CIDR_MASK, &u8) >= 0);
+        assert_se(u8 == 32);
+        assert_se(sd_netlink_message_exit_container(reply) >= 0);
+        assert_se(sd_netlink_message_enter_array_element(reply) == 0);
+        /* The array itself has no attributes */
+        assert_se(sd_netlink_message_read_u16(reply, WGALLOWEDIP_A_FAMILY, &u16) == -ENODATA);
+        assert_se(sd_netlink_message_exit_container(reply) >= 0);
+
+        assert_se(sd_netlink_message_exit_container(reply) >= 0);
+
+        assert_se(sd_netlink_message_enter_array_element(reply) == 1);
+        assert_se(sd_netlink_message_read(reply, WGPEER_A_PUBLIC_KEY, sizeof(key), key) == WG_KEY_LEN);
+        assert_se(memcmp(key, key2, WG_KEY_LEN) == 0);
+        assert_se(sd_netlink_message_enter_array(reply, WGPEER_A_ALLOWEDIPS) == -ENODATA);
+        assert_se(sd_netlink_message_exit_container(reply) >= 0);
+
+        assert_se(sd_netlink_message_enter_array_element(reply) == 0);
+        assert_se(sd_netlink_message_exit_container(reply) >= 0);
+
+        /* Back at the top level */
+        assert_se(sd_netlink_message_read_string(reply, WGDEVICE_A_IFNAME, &ifname) >= 0);
+        assert_se(streq(ifname, "wg0"));
+        assert_se(sd_netlink_message_exit_container(reply) == -EINVAL);
+
+        /* Arrays can be entered again after leaving them */
+        assert_se(sd_netlink_message_enter_array(reply, WGDEVICE_A_PEERS) >= 0);
+        assert_se(sd_netlink_message_enter_array_element(reply) == 1);
+        assert_se(sd_netlink_message_read(reply, WGPEER_A_PUBLIC_KEY, sizeof(key), key) == WG_KEY_LEN);
+        assert_se(memcmp(key, key1, WG_KEY_LEN) == 0);
+        assert_se(sd_netlink_message_exit_container(reply) >= 0);
+        assert_se(sd_netlink_message_exit_container(reply) >= 0);
+}
+
+static void test_genl_dump(sd_netlink *genl) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL, *reply = NULL;
+        sd_netlink_message *i;
+        const char *ifname;
+        unsigned n = 0;
+        uint16_t type;
+
+        assert_se(sd_genl_message_new(genl, SD_GENL_WIREGUARD, WG_CMD_GET_DEVICE, &m) >= 0);
+        assert_se(sd_netlink_message_request_dump(m, true) >= 0);
+        assert_se(sd_netlink_message_append_string(m, WGDEVICE_A_IFNAME, "wg0") >= 0);
+
+        /* The dump terminator completes the call */
+        assert_se(sd_netlink_call(genl, m, 0, &reply) == 1);
+
+        for (i = reply; i; i = sd_netlink_message_next(i)) {
+                assert_se(sd_netlink_message_get_type(i, &type) >= 0);
+                if (type == NLMSG_DONE)
+                        continue;
+
+                assert_se(type == FAKE_WIREGUARD_FAMILY_ID);
+                assert_se(sd_netlink_message_read_string(i, WGDEVICE_A_IFNAME, &ifname) >= 0);
+                assert_se(streq(ifname, "wg0"));
+                n++;
+        }
+
+        assert_se(n == 2);
+}
+
+static void test_genl_error(sd_netlink *genl) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+
+        assert_se(sd_genl_message_new(genl, SD_GENL_WIREGUARD, WG_CMD_GET_DEVICE, &m) >= 0);
+        assert_se(sd_netlink_message_append_string(m, WGDEVICE_A_IFNAME, "wg0") >= 0);
+
+        assert_se(sd_netlink_call(genl, m, 0, NULL) == -ENODEV);
+}
+
+static void test_genl(void) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *genl = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        FakeGenl k = {};
+        pthread_t t;
+
+        assert_se(socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        assert_se(netlink_open_fake(&genl, NETLINK_GENERIC, pair[0]) >= 0);
+
+        k.fd = pair[1];
+        assert_se(pthread_create(&t, NULL, fake_genl_kernel, &k) == 0);
+
+        test_genl_family_cache(genl, &k);
+        test_genl_array(genl);
+        test_genl_dump(genl);
+        test_genl_error(genl);
+
+        assert_se(send(pair[0], NULL, 0, 0) == 0);
+        assert_se(pthread_join(t, NULL) == 0);
+
+        /* the netlink object owns its end of the socket pair */
+        pair[0] = -1;
+}
+
 int main(void) {
         sd_netlink *rtnl;
         sd_netlink_message *m;
@@ -397,6 +684,8 @@ int main(void) {
 
         test_container(rtnl);
 
+        test_genl();
+
         if_loopback = (int) if_nametoindex("lo");
         assert_se(if_loopback > 0);
 
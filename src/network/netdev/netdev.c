@@ -107,6 +107,9 @@ static const char *const netdev_kind_table[_NETDEV_KIND_MAX] = {
     [NETDEV_KIND_WIREGUARD] = "wireguard",
 };
 
+/* Maximum number of RTM_NEWLINK requests for netdevs without an underlying link we keep in flight */
+#define NETDEV_CREATE_WINDOW 64U
+
 DEFINE_STRING_TABLE_LOOKUP(netdev_kind, NetDevKind);
 DEFINE_CONFIG_PARSE_ENUM(config_parse_netdev_kind, netdev_kind, NetDevKind, "Failed to parse netdev kind");
 
@@ -138,6 +141,9 @@ static void netdev_cancel_callbacks(NetDev *netdev)
         }
 }
 
+static void netdev_create_dequeue(NetDev *netdev);
+static void netdev_create_dispatch(Manager *m);
+
 static void netdev_free(NetDev *netdev)
 {
         if (!netdev)
@@ -145,6 +151,9 @@ static void netdev_free(NetDev *netdev)
 
         netdev_cancel_callbacks(netdev);
 
+        if (netdev->manager)
+                netdev_create_dequeue(netdev);
+
         if (netdev->ifname && netdev->manager)
                 hashmap_remove(netdev->manager->netdevs, netdev->ifname);
 
@@ -291,6 +300,22 @@ static int netdev_enter_ready(NetDev *netdev)
 
         log_netdev_info(netdev, "netdev ready");
 
+        if (netdev->create_usec > 0 && netdev->manager)
+        {
+                NetDevCreateStats *stats = netdev->manager->netdev_create_stats + netdev->kind;
+                char buf[FORMAT_TIMESPAN_MAX];
+                usec_t t;
+
+                t = usec_sub_unsigned(now(CLOCK_MONOTONIC), netdev->create_usec);
+                netdev->create_usec = 0;
+
+                stats->n_created++;
+                stats->total_usec += t;
+                stats->max_usec = MAX(stats->max_usec, t);
+
+                log_netdev_debug(netdev, "Creation took %s", format_timespan(buf, sizeof(buf), t, 1));
+        }
+
         LIST_FOREACH_SAFE(callbacks, callback, callback_next, netdev->callbacks)
         {
                 /* enslave the links that were attempted to be enslaved before the
@@ -317,6 +342,11 @@ static int netdev_create_handler(sd_netlink *rtnl, sd_netlink_message *m, void *
         int r;
 
         assert(netdev->state != _NETDEV_STATE_INVALID);
+        assert(netdev->manager);
+        assert(netdev->manager->n_netdev_creating > 0);
+
+        netdev->manager->n_netdev_creating--;
+        netdev_create_dispatch(netdev->manager);
 
         r = sd_netlink_message_get_errno(m);
         if (r == -EEXIST)
@@ -530,6 +560,141 @@ int netdev_get_mac(const char *ifname, struct ether_addr **ret)
         return 0;
 }
 
+static int netdev_create_message(NetDev *netdev, Link *link, sd_netlink_message **ret)
+{
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        int r;
+
+        assert(netdev);
+        assert(ret);
+
+        r = sd_rtnl_message_new_link(netdev->manager->rtnl, &m, RTM_NEWLINK, 0);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not allocate RTM_NEWLINK message: %m");
+
+        r = sd_netlink_message_append_string(m, IFLA_IFNAME, netdev->ifname);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not append IFLA_IFNAME, attribute: %m");
+
+        if (netdev->mac)
+        {
+                r = sd_netlink_message_append_ether_addr(m, IFLA_ADDRESS, netdev->mac);
+                if (r < 0)
+                        return log_netdev_error_errno(netdev, r, "Could not append IFLA_ADDRESS attribute: %m");
+        }
+
+        if (netdev->mtu)
+        {
+                r = sd_netlink_message_append_u32(m, IFLA_MTU, netdev->mtu);
+                if (r < 0)
+                        return log_netdev_error_errno(netdev, r, "Could not append IFLA_MTU attribute: %m");
+        }
+
+        if (link)
+        {
+                r = sd_netlink_message_append_u32(m, IFLA_LINK, link->ifindex);
+                if (r < 0)
+                        return log_netdev_error_errno(netdev, r, "Could not append IFLA_LINK attribute: %m");
+        }
+
+        r = sd_netlink_message_open_container(m, IFLA_LINKINFO);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not append IFLA_LINKINFO attribute: %m");
+
+        r = sd_netlink_message_open_container_union(m, IFLA_INFO_DATA, netdev_kind_to_string(netdev->kind));
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not append IFLA_INFO_DATA attribute: %m");
+
+        if (NETDEV_VTABLE(netdev)->fill_message_create)
+        {
+                r = NETDEV_VTABLE(netdev)->fill_message_create(netdev, link, m);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_netlink_message_close_container(m);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not append IFLA_INFO_DATA attribute: %m");
+
+        r = sd_netlink_message_close_container(m);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not append IFLA_LINKINFO attribute: %m");
+
+        *ret = m;
+        m = NULL;
+
+        return 0;
+}
+
+static void netdev_create_dequeue(NetDev *netdev)
+{
+        Manager *m;
+
+        assert(netdev);
+        assert(netdev->manager);
+
+        if (!netdev->create_queued)
+                return;
+
+        m = netdev->manager;
+
+        if (m->netdev_create_queue_tail == netdev)
+                m->netdev_create_queue_tail = netdev->create_queue_prev;
+
+        LIST_REMOVE(create_queue, m->netdev_create_queue, netdev);
+        netdev->create_queued = false;
+}
+
+static int netdev_create_send(NetDev *netdev)
+{
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        int r;
+
+        assert(netdev);
+        assert(netdev->manager);
+
+        r = netdev_create_message(netdev, NULL, &m);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_call_async(netdev->manager->rtnl, m, netdev_create_handler, netdev, 0, NULL);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not send rtnetlink message: %m");
+
+        netdev_ref(netdev);
+
+        netdev->manager->n_netdev_creating++;
+        netdev->create_usec = now(CLOCK_MONOTONIC);
+
+        log_netdev_debug(netdev, "Creating");
+
+        return 0;
+}
+
+static void netdev_create_dispatch(Manager *m)
+{
+        NetDev *netdev;
+        int r;
+
+        assert(m);
+
+        /* Keep up to NETDEV_CREATE_WINDOW requests in flight. Each reply makes room for the next queued
+         * netdev, so that a large number of netdevs is created pipelined, without flooding the rtnl socket
+         * and the kernel with thousands of requests at once. */
+        while (m->n_netdev_creating < NETDEV_CREATE_WINDOW && (netdev = m->netdev_create_queue))
+        {
+                netdev_create_dequeue(netdev);
+
+                /* the netdev might have been dropped while it was waiting for its turn */
+                if (netdev->state != NETDEV_STATE_CREATING)
+                        continue;
+
+                r = netdev_create_send(netdev);
+                if (r < 0)
+                        netdev_enter_failed(netdev);
+        }
+}
+
 static int netdev_create(NetDev *netdev, Link *link,
                          sd_netlink_message_handler_t callback)
 {
@@ -549,82 +714,41 @@ static int netdev_create(NetDev *netdev, Link *link,
 
                 log_netdev_debug(netdev, "Created");
         }
-        else
+        else if (link)
         {
                 _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
 
-                r = sd_rtnl_message_new_link(netdev->manager->rtnl, &m, RTM_NEWLINK, 0);
-                if (r < 0)
-                        return log_netdev_error_errno(netdev, r, "Could not allocate RTM_NEWLINK message: %m");
-
-                r = sd_netlink_message_append_string(m, IFLA_IFNAME, netdev->ifname);
+                /* stacked netdevs are created when their underlying link shows up, hence they are never
+                 * queued behind other netdevs */
+                r = netdev_create_message(netdev, link, &m);
                 if (r < 0)
-                        return log_netdev_error_errno(netdev, r, "Could not append IFLA_IFNAME, attribute: %m");
-
-                if (netdev->mac)
-                {
-                        r = sd_netlink_message_append_ether_addr(m, IFLA_ADDRESS, netdev->mac);
-                        if (r < 0)
-                                return log_netdev_error_errno(netdev, r, "Could not append IFLA_ADDRESS attribute: %m");
-                }
-
-                if (netdev->mtu)
-                {
-                        r = sd_netlink_message_append_u32(m, IFLA_MTU, netdev->mtu);
-                        if (r < 0)
-                                return log_netdev_error_errno(netdev, r, "Could not append IFLA_MTU attribute: %m");
-                }
-
-                if (link)
-                {
-                        r = sd_netlink_message_append_u32(m, IFLA_LINK, link->ifindex);
-                        if (r < 0)
-                                return log_netdev_error_errno(netdev, r, "Could not append IFLA_LINK attribute: %m");
-                }
-
-                r = sd_netlink_message_open_container(m, IFLA_LINKINFO);
-                if (r < 0)
-                        return log_netdev_error_errno(netdev, r, "Could not append IFLA_LINKINFO attribute: %m");
+                        return r;
 
-                r = sd_netlink_message_open_container_union(m, IFLA_INFO_DATA, netdev_kind_to_string(netdev->kind));
+                r = sd_netlink_call_async(netdev->manager->rtnl, m, callback, link, 0, NULL);
                 if (r < 0)
-                        return log_netdev_error_errno(netdev, r, "Could not append IFLA_INFO_DATA attribute: %m");
+                        return log_netdev_error_errno(netdev, r, "Could not send rtnetlink message: %m");
 
-                if (NETDEV_VTABLE(netdev)->fill_message_create)
-                {
-                        r = NETDEV_VTABLE(netdev)->fill_message_create(netdev, link, m);
-                        if (r < 0)
-                                return r;
-                }
-
-                r = sd_netlink_message_close_container(m);
-                if (r < 0)
-                        return log_netdev_error_errno(netdev, r, "Could not append IFLA_INFO_DATA attribute: %m");
+                link_ref(link);
 
-                r = sd_netlink_message_close_container(m);
-                if (r < 0)
-                        return log_netdev_error_errno(netdev, r, "Could not append IFLA_LINKINFO attribute: %m");
+                netdev->state = NETDEV_STATE_CREATING;
+                netdev->create_usec = now(CLOCK_MONOTONIC);
 
-                if (link)
-                {
-                        r = sd_netlink_call_async(netdev->manager->rtnl, m, callback, link, 0, NULL);
-                        if (r < 0)
-                                return log_netdev_error_errno(netdev, r, "Could not send rtnetlink message: %m");
+                log_netdev_debug(netdev, "Creating");
+        }
+        else
+        {
+                Manager *m = netdev->manager;
 
-                        link_ref(link);
-                }
-                else
-                {
-                        r = sd_netlink_call_async(netdev->manager->rtnl, m, netdev_create_handler, netdev, 0, NULL);
-                        if (r < 0)
-                                return log_netdev_error_errno(netdev, r, "Could not send rtnetlink message: %m");
+                netdev->state = NETDEV_STATE_CREATING;
 
-                        netdev_ref(netdev);
-                }
+                if (netdev->create_queued)
+                        return 0;
 
-                netdev->state = NETDEV_STATE_CREATING;
+                LIST_INSERT_AFTER(create_queue, m->netdev_create_queue, m->netdev_create_queue_tail, netdev);
+                m->netdev_create_queue_tail = netdev;
+                netdev->create_queued = true;
 
-                log_netdev_debug(netdev, "Creating");
+                netdev_create_dispatch(m);
         }
 
         return 0;
@@ -661,12 +785,81 @@ int netdev_join(NetDev *netdev, Link *link, sd_netlink_message_handler_t callbac
         return 0;
 }
 
+/* Returns 0 for netdevs other netdevs get enslaved to, 1 for other netdevs that are created right away, and
+ * -1 for netdevs that are created only once their underlying link shows up. */
+static int netdev_create_rank(NetDev *netdev)
+{
+        bool independent = false;
+
+        assert(netdev);
+
+        switch (NETDEV_VTABLE(netdev)->create_type)
+        {
+        case NETDEV_CREATE_MASTER:
+                return 0;
+        case NETDEV_CREATE_INDEPENDENT:
+                return 1;
+        default:
+                break;
+        }
+
+        switch (netdev->kind)
+        {
+        case NETDEV_KIND_IPIP:
+                independent = IPIP(netdev)->independent;
+                break;
+        case NETDEV_KIND_GRE:
+                independent = GRE(netdev)->independent;
+                break;
+        case NETDEV_KIND_GRETAP:
+                independent = GRETAP(netdev)->independent;
+                break;
+        case NETDEV_KIND_IP6GRE:
+                independent = IP6GRE(netdev)->independent;
+                break;
+        case NETDEV_KIND_IP6GRETAP:
+                independent = IP6GRETAP(netdev)->independent;
+                break;
+        case NETDEV_KIND_SIT:
+                independent = SIT(netdev)->independent;
+                break;
+        case NETDEV_KIND_VTI:
+                independent = VTI(netdev)->independent;
+                break;
+        case NETDEV_KIND_VTI6:
+                independent = VTI6(netdev)->independent;
+                break;
+        case NETDEV_KIND_IP6TNL:
+                independent = IP6TNL(netdev)->independent;
+                break;
+        default:
+                break;
+        }
+
+        return independent ? 1 : -1;
+}
+
+static int netdev_compare_create_rank(const void *a, const void *b)
+{
+        NetDev *x = *(NetDev **)a, *y = *(NetDev **)b;
+        int rx, ry;
+
+        rx = netdev_create_rank(x);
+        ry = netdev_create_rank(y);
+
+        if (rx < ry)
+                return -1;
+        if (rx > ry)
+                return 1;
+
+        return strcmp(x->ifname, y->ifname);
+}
+
 static int netdev_load_one(Manager *manager, const char *filename)
 {
         _cleanup_netdev_unref_ NetDev *netdev_raw = NULL, *netdev = NULL;
         _cleanup_fclose_ FILE *file = NULL;
         const char *dropin_dirname;
-        bool independent = false;
         int r;
 
         assert(manager);
@@ -773,59 +966,6 @@ static int netdev_load_one(Manager *manager, const char *filename)
 
         log_netdev_debug(netdev, "loaded %s", netdev_kind_to_string(netdev->kind));
 
-        switch (NETDEV_VTABLE(netdev)->create_type)
-        {
-        case NETDEV_CREATE_MASTER:
-        case NETDEV_CREATE_INDEPENDENT:
-                r = netdev_create(netdev, NULL, NULL);
-                if (r < 0)
-                        return r;
-
-                break;
-        default:
-                break;
-        }
-
-        switch (netdev->kind)
-        {
-        case NETDEV_KIND_IPIP:
-                independent = IPIP(netdev)->independent;
-                break;
-        case NETDEV_KIND_GRE:
-                independent = GRE(netdev)->independent;
-                break;
-        case NETDEV_KIND_GRETAP:
-                independent = GRETAP(netdev)->independent;
-                break;
-        case NETDEV_KIND_IP6GRE:
-                independent = IP6GRE(netdev)->independent;
-                break;
-        case NETDEV_KIND_IP6GRETAP:
-                independent = IP6GRETAP(netdev)->independent;
-                break;
-        case NETDEV_KIND_SIT:
-                independent = SIT(netdev)->independent;
-                break;
-        case NETDEV_KIND_VTI:
-                independent = VTI(netdev)->independent;
-                break;
-        case NETDEV_KIND_VTI6:
-                independent = VTI6(netdev)->independent;
-                break;
-        case NETDEV_KIND_IP6TNL:
-                independent = IP6TNL(netdev)->independent;
-                break;
-        default:
-                break;
-        }
-
-        if (independent)
-        {
-                r = netdev_create(netdev, NULL, NULL);
-                if (r < 0)
-                        return r;
-        }
-
         netdev = NULL;
 
         return 0;
@@ -834,7 +974,10 @@ static int netdev_load_one(Manager *manager, const char *filename)
 int netdev_load(Manager *manager)
 {
         _cleanup_strv_free_ char **files = NULL;
+        _cleanup_free_ NetDev **planned = NULL;
+        size_t n_planned = 0, j;
         NetDev *netdev;
+        Iterator i;
         char **f;
         int r;
 
@@ -854,5 +997,51 @@ int netdev_load(Manager *manager)
                         return r;
         }
 
+        /* Now that all netdevs are known, plan their creation: masters go first, so that links waiting to be
+         * enslaved can proceed as early as possible, followed by all other netdevs that do not depend on an
+         * underlying link. The requests are then pipelined, see netdev_create_dispatch(). */
+        planned = new(NetDev *, hashmap_size(manager->netdevs));
+        if (!planned)
+                return log_oom();
+
+        HASHMAP_FOREACH(netdev, manager->netdevs, i)
+                if (netdev_create_rank(netdev) >= 0)
+                        planned[n_planned++] = netdev;
+
+        qsort_safe(planned, n_planned, sizeof(NetDev *), netdev_compare_create_rank);
+
+        for (j = 0; j < n_planned; j++)
+        {
+                r = netdev_create(planned[j], NULL, NULL);
+                if (r < 0)
+                        return r;
+        }
+
+        log_debug("Planned creation of %zu netdevs, %u requests in flight", n_planned, manager->n_netdev_creating);
+
         return 0;
 }
+
+void netdev_log_create_stats(Manager *m)
+{
+        NetDevKind k;
+
+        assert(m);
+
+        for (k = 0; k < _NETDEV_KIND_MAX; k++)
+        {
+                const NetDevCreateStats *stats = m->netdev_create_stats + k;
+                char avg[FORMAT_TIMESPAN_MAX], max[FORMAT_TIMESPAN_MAX];
+
+                if (stats->n_created == 0)
+                        continue;
+
+                log_info("NetDev kind %s: created %u, average creation latency %s (max %s)",
+                         netdev_kind_to_string(k), stats->n_created,
+                         format_timespan(avg, sizeof(avg), stats->total_usec / stats->n_created, 1),
+                         format_timespan(max, sizeof(max), stats->max_usec, 1));
+        }
+
+        if (m->n_netdev_creating > 0 || m->netdev_create_queue)
+                log_info("NetDev creation in progress: %u requests in flight", m->n_netdev_creating);
+}
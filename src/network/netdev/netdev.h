@@ -86,6 +86,14 @@ typedef enum NetDevCreateType {
 typedef struct Manager Manager;
 typedef struct Condition Condition;
 
+/* Creation latency of netdevs of one kind, measured from sending the request until the kernel
+ * reported the new link */
+typedef struct NetDevCreateStats {
+        unsigned n_created;
+        usec_t total_usec;
+        usec_t max_usec;
+} NetDevCreateStats;
+
 typedef struct NetDev {
         Manager *manager;
 
@@ -107,7 +115,11 @@ typedef struct NetDev {
         size_t mtu;
         int ifindex;
 
+        usec_t create_usec;
+        bool create_queued;
+
         LIST_HEAD(netdev_join_callback, callbacks);
+        LIST_FIELDS(struct NetDev, create_queue);
 } NetDev;
 
 typedef struct NetDevVTable {
@@ -163,6 +175,7 @@ extern const NetDevVTable * const netdev_vtable[_NETDEV_KIND_MAX];
 #define NETDEV(n) (&(n)->meta)
 
 int netdev_load(Manager *manager);
+void netdev_log_create_stats(Manager *m);
 void netdev_drop(NetDev *netdev);
 
 NetDev *netdev_unref(NetDev *netdev);
@@ -26,7 +26,9 @@
 #include "fd-util.h"
 #include "strv.h"
 #include "hexdecoct.h"
+#include "siphash24.h"
 #include "string-util.h"
+#include "util.h"
 #include "wireguard.h"
 #include "networkd-link.h"
 #include "networkd-util.h"
@@ -35,6 +37,25 @@
 
 static void resolve_endpoints(NetDev *netdev);
 
+typedef enum WireguardSetFlags {
+        WIREGUARD_SET_DEVICE          = 1 << 0, /* private key, listen port and firewall mark */
+        WIREGUARD_SET_REPLACE_PEERS   = 1 << 1, /* drop all peers not passed along */
+        WIREGUARD_SET_ENDPOINTS_ONLY  = 1 << 2, /* leave everything but the endpoints of the peers alone */
+} WireguardSetFlags;
+
+static void wireguard_public_key_hash_func(const void *p, struct siphash *state) {
+        siphash24_compress(p, WG_KEY_LEN, state);
+}
+
+static int wireguard_public_key_compare_func(const void *a, const void *b) {
+        return memcmp(a, b, WG_KEY_LEN);
+}
+
+static const struct hash_ops wireguard_public_key_hash_ops = {
+        .hash = wireguard_public_key_hash_func,
+        .compare = wireguard_public_key_compare_func
+};
+
 static WireguardPeer *wireguard_peer_new(Wireguard *w, unsigned section) {
         WireguardPeer *peer;
 
@@ -54,23 +75,162 @@ static WireguardPeer *wireguard_peer_new(Wireguard *w, unsigned section) {
         return peer;
 }
 
-static int set_wireguard_interface(NetDev *netdev) {
+static WireguardPeer *wireguard_peer_free(WireguardPeer *peer) {
+        WireguardIPmask *mask;
+
+        if (!peer)
+                return NULL;
+
+        while ((mask = peer->ipmasks)) {
+                LIST_REMOVE(ipmasks, peer->ipmasks, mask);
+                free(mask);
+        }
+
+        return mfree(peer);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(WireguardPeer*, wireguard_peer_free);
+
+static int wireguard_append_ipmask(sd_netlink_message *message, WireguardIPmask *mask, uint16_t index) {
+        int r;
+
+        r = sd_netlink_message_open_array(message, index);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_u16(message, WGALLOWEDIP_A_FAMILY, mask->family);
+        if (r < 0)
+                goto cancel;
+
+        if (mask->family == AF_INET) {
+                r = sd_netlink_message_append_in_addr(message, WGALLOWEDIP_A_IPADDR, &mask->ip.in);
+                if (r < 0)
+                        goto cancel;
+        } else if (mask->family == AF_INET6) {
+                r = sd_netlink_message_append_in6_addr(message, WGALLOWEDIP_A_IPADDR, &mask->ip.in6);
+                if (r < 0)
+                        goto cancel;
+        }
+
+        r = sd_netlink_message_append_u8(message, WGALLOWEDIP_A_CIDR_MASK, mask->cidr);
+        if (r < 0)
+                goto cancel;
+
+        return sd_netlink_message_close_container(message);
+
+cancel:
+        (void) sd_netlink_message_cancel_array(message);
+        return r;
+}
+
+/* Appends the peer to the message, or if its allowed IPs did not all fit into the previous message, the ones
+ * starting with *mask_start. Returns 1 if the peer is complete, 0 if the message filled up before, with
+ * *mask_start set to where to continue in the next one, and -ENOBUFS if the peer did not fit at all. */
+static int wireguard_append_peer(sd_netlink_message *message, WireguardPeer *peer, uint16_t index,
+                                 WireguardIPmask **mask_start, WireguardSetFlags flags) {
+        WireguardIPmask *mask;
+        uint16_t j = 0;
         int r;
-        unsigned int i, j;
-        WireguardPeer *peer, *peer_start;
-        WireguardIPmask *mask, *mask_start = NULL;
-        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *message = NULL;
+
+        r = sd_netlink_message_open_array(message, index);
+        if (r < 0)
+                return r;
+
+        r = sd_netlink_message_append_data(message, WGPEER_A_PUBLIC_KEY, &peer->public_key, sizeof(peer->public_key));
+        if (r < 0)
+                goto cancel;
+
+        if (!*mask_start) {
+                r = sd_netlink_message_append_u32(message, WGPEER_A_FLAGS,
+                                                  flags & WIREGUARD_SET_ENDPOINTS_ONLY ? 0 : peer->flags);
+                if (r < 0)
+                        goto cancel;
+
+                if (!(flags & WIREGUARD_SET_ENDPOINTS_ONLY) && !(peer->flags & WGPEER_F_REMOVE_ME)) {
+                        r = sd_netlink_message_append_data(message, WGPEER_A_PRESHARED_KEY, &peer->preshared_key, WG_KEY_LEN);
+                        if (r < 0)
+                                goto cancel;
+
+                        r = sd_netlink_message_append_u16(message, WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL, peer->persistent_keepalive_interval);
+                        if (r < 0)
+                                goto cancel;
+                }
+
+                if (!(peer->flags & WGPEER_F_REMOVE_ME)) {
+                        if (peer->endpoint.sa.sa_family == AF_INET) {
+                                r = sd_netlink_message_append_data(message, WGPEER_A_ENDPOINT, &peer->endpoint.in, sizeof(peer->endpoint.in));
+                                if (r < 0)
+                                        goto cancel;
+                        } else if (peer->endpoint.sa.sa_family == AF_INET6) {
+                                r = sd_netlink_message_append_data(message, WGPEER_A_ENDPOINT, &peer->endpoint.in6, sizeof(peer->endpoint.in6));
+                                if (r < 0)
+                                        goto cancel;
+                        }
+                }
+        }
+
+        mask = NULL;
+
+        if (!(flags & WIREGUARD_SET_ENDPOINTS_ONLY) && !(peer->flags & WGPEER_F_REMOVE_ME) && peer->ipmasks) {
+                r = sd_netlink_message_open_container(message, WGPEER_A_ALLOWEDIPS);
+                if (r < 0)
+                        goto cancel;
+
+                LIST_FOREACH(ipmasks, mask, *mask_start ?: peer->ipmasks) {
+                        r = wireguard_append_ipmask(message, mask, ++j);
+                        if (r == -ENOBUFS)
+                                break;
+                        if (r < 0)
+                                return r;
+                }
+
+                r = sd_netlink_message_close_container(message);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_netlink_message_close_container(message);
+        if (r < 0)
+                return r;
+
+        *mask_start = mask;
+
+        return !mask;
+
+cancel:
+        (void) sd_netlink_message_cancel_array(message);
+        return r;
+}
+
+static int wireguard_set_handler(sd_netlink *genl, sd_netlink_message *m, void *userdata) {
+        _cleanup_netdev_unref_ NetDev *netdev = userdata;
+        int r;
+
+        assert(netdev);
+
+        if (netdev->state == NETDEV_STATE_LINGER)
+                return 1;
+
+        r = sd_netlink_message_get_errno(m);
+        if (r < 0)
+                log_netdev_warning_errno(netdev, r, "Could not set wireguard device: %m");
+
+        return 1;
+}
+
+static int set_wireguard_interface(NetDev *netdev, WireguardPeer **peers, size_t n_peers, WireguardSetFlags flags) {
+        WireguardIPmask *mask_start = NULL;
+        size_t i = 0;
         Wireguard *w;
-        uint32_t serial;
+        int r;
 
         assert(netdev);
         w = WIREGUARD(netdev);
         assert(w);
 
-        peer_start = w->peers;
-
         do {
-                message = sd_netlink_message_unref(message);
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *message = NULL;
+                uint16_t j = 0;
 
                 r = sd_genl_message_new(netdev->manager->genl, SD_GENL_WIREGUARD, WG_CMD_SET_DEVICE, &message);
                 if (r < 0)
@@ -80,7 +240,7 @@ static int set_wireguard_interface(NetDev *netdev) {
                 if (r < 0)
                         return log_netdev_error_errno(netdev, r, "Could not append wireguard interface name: %m");
 
-                if (peer_start == w->peers) {
+                if (flags & WIREGUARD_SET_DEVICE) {
                         r = sd_netlink_message_append_data(message, WGDEVICE_A_PRIVATE_KEY, &w->private_key, WG_KEY_LEN);
                         if (r < 0)
                                 return log_netdev_error_errno(netdev, r, "Could not append wireguard private key: %m");
@@ -92,117 +252,435 @@ static int set_wireguard_interface(NetDev *netdev) {
                         r = sd_netlink_message_append_u32(message, WGDEVICE_A_FWMARK, w->fwmark);
                         if (r < 0)
                                 return log_netdev_error_errno(netdev, r, "Could not append wireguard fwmark: %m");
+                }
 
-                        r = sd_netlink_message_append_u32(message, WGDEVICE_A_FLAGS, w->flags);
+                /* The kernel only looks at the flags of the first message */
+                if (flags & WIREGUARD_SET_REPLACE_PEERS) {
+                        r = sd_netlink_message_append_u32(message, WGDEVICE_A_FLAGS, WGDEVICE_F_REPLACE_PEERS);
                         if (r < 0)
                                 return log_netdev_error_errno(netdev, r, "Could not append wireguard flags: %m");
                 }
 
-                r = sd_netlink_message_open_container(message, WGDEVICE_A_PEERS);
-                if (r < 0)
-                        return log_netdev_error_errno(netdev, r, "Could not append wireguard peer attributes: %m");
-
-                i = 0;
+                flags &= ~(WIREGUARD_SET_DEVICE|WIREGUARD_SET_REPLACE_PEERS);
 
-                LIST_FOREACH(peers, peer, peer_start) {
-                        r = sd_netlink_message_open_array(message, ++i);
+                if (i < n_peers) {
+                        r = sd_netlink_message_open_container(message, WGDEVICE_A_PEERS);
                         if (r < 0)
-                                break;
+                                return log_netdev_error_errno(netdev, r, "Could not append wireguard peer attributes: %m");
 
-                        r = sd_netlink_message_append_data(message, WGPEER_A_PUBLIC_KEY, &peer->public_key, sizeof(peer->public_key));
-                        if (r < 0)
-                                break;
-
-                        if (!mask_start) {
-                                r = sd_netlink_message_append_data(message, WGPEER_A_PRESHARED_KEY, &peer->preshared_key, WG_KEY_LEN);
-                                if (r < 0)
+                        for (; i < n_peers; i++) {
+                                r = wireguard_append_peer(message, peers[i], ++j, &mask_start, flags);
+                                if (r == -ENOBUFS && j > 1)
                                         break;
-
-                                r = sd_netlink_message_append_u32(message, WGPEER_A_FLAGS, peer->flags);
                                 if (r < 0)
+                                        return log_netdev_error_errno(netdev, r, "Could not add wireguard peer: %m");
+                                if (r == 0)
                                         break;
+                        }
 
-                                r = sd_netlink_message_append_u32(message, WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL, peer->persistent_keepalive_interval);
-                                if (r < 0)
-                                        break;
+                        r = sd_netlink_message_close_container(message);
+                        if (r < 0)
+                                return log_netdev_error_errno(netdev, r, "Could not close wireguard container: %m");
+                }
 
-                                if (peer->endpoint.sa.sa_family == AF_INET) {
-                                        r = sd_netlink_message_append_data(message, WGPEER_A_ENDPOINT, &peer->endpoint.in, sizeof(peer->endpoint.in));
-                                        if (r < 0)
-                                                break;
-                                } else if (peer->endpoint.sa.sa_family == AF_INET6) {
-                                        r = sd_netlink_message_append_data(message, WGPEER_A_ENDPOINT, &peer->endpoint.in6, sizeof(peer->endpoint.in6));
-                                        if (r < 0)
-                                                break;
-                                }
-
-                                mask_start = peer->ipmasks;
-                        }
+                r = sd_netlink_call_async(netdev->manager->genl, message, wireguard_set_handler, netdev, 0, NULL);
+                if (r < 0)
+                        return log_netdev_error_errno(netdev, r, "Could not set wireguard device: %m");
 
-                        r = sd_netlink_message_open_container(message, WGPEER_A_ALLOWEDIPS);
-                        if (r < 0) {
-                                mask_start = NULL;
-                                break;
-                        }
-                        j = 0;
-                        LIST_FOREACH(ipmasks, mask, mask_start) {
-                                r = sd_netlink_message_open_array(message, ++j);
-                                if (r < 0)
-                                        break;
+                netdev_ref(netdev);
+        } while (i < n_peers);
 
-                                r = sd_netlink_message_append_u16(message, WGALLOWEDIP_A_FAMILY, mask->family);
-                                if (r < 0)
-                                        break;
+        return 0;
+}
 
-                                if (mask->family == AF_INET) {
-                                        r = sd_netlink_message_append_in_addr(message, WGALLOWEDIP_A_IPADDR, &mask->ip.in);
-                                        if (r < 0)
-                                                break;
-                                } else if (mask->family == AF_INET6) {
-                                        r = sd_netlink_message_append_in6_addr(message, WGALLOWEDIP_A_IPADDR, &mask->ip.in6);
-                                        if (r < 0)
-                                                break;
-                                }
-
-                                r = sd_netlink_message_append_u8(message, WGALLOWEDIP_A_CIDR_MASK, mask->cidr);
-                                if (r < 0)
-                                        break;
+/* Collects the peers of the configuration, skipping the sections repeating the public key of a later one,
+ * which is the one that is applied */
+static int wireguard_collect_peers(Wireguard *w, bool endpoints_only, WireguardPeer ***ret, size_t *ret_n) {
+        _cleanup_free_ WireguardPeer **peers = NULL;
+        size_t n = 0, allocated = 0;
+        WireguardPeer *peer;
 
-                                r = sd_netlink_message_close_container(message);
-                                if (r < 0)
-                                        return log_netdev_error_errno(netdev, r, "Could not add wireguard allowed ip: %m");
-                        }
-                        mask_start = mask;
-                        if (mask_start) {
-                                r = sd_netlink_message_cancel_array(message);
-                                if (r < 0)
-                                        return log_netdev_error_errno(netdev, r, "Could not cancel wireguard allowed ip message attribute: %m");
-                        }
-                        r = sd_netlink_message_close_container(message);
+        LIST_FOREACH(peers, peer, w->peers) {
+                if (hashmap_get(w->peers_by_public_key, peer->public_key) != peer)
+                        continue;
+
+                if (endpoints_only) {
+                        if (!peer->update_endpoint)
+                                continue;
+
+                        peer->update_endpoint = false;
+                }
+
+                if (!GREEDY_REALLOC(peers, allocated, n + 1))
+                        return -ENOMEM;
+
+                peers[n++] = peer;
+        }
+
+        *ret = peers;
+        *ret_n = n;
+        peers = NULL;
+
+        return 0;
+}
+
+static int wireguard_replace(NetDev *netdev) {
+        _cleanup_free_ WireguardPeer **peers = NULL;
+        size_t n_peers;
+        Wireguard *w;
+        int r;
+
+        assert(netdev);
+        w = WIREGUARD(netdev);
+        assert(w);
+
+        r = wireguard_collect_peers(w, false, &peers, &n_peers);
+        if (r < 0)
+                return log_oom();
+
+        return set_wireguard_interface(netdev, peers, n_peers, WIREGUARD_SET_DEVICE|WIREGUARD_SET_REPLACE_PEERS);
+}
+
+static int wireguard_ipmask_compare_func(const void *a, const void *b) {
+        const WireguardIPmask *x = a, *y = b;
+
+        if (x->family != y->family)
+                return x->family < y->family ? -1 : 1;
+
+        if (x->cidr != y->cidr)
+                return x->cidr < y->cidr ? -1 : 1;
+
+        return memcmp(&x->ip, &y->ip, FAMILY_ADDRESS_SIZE(x->family));
+}
+
+static int wireguard_ipmasks_to_array(WireguardIPmask *head, size_t n, WireguardIPmask **ret) {
+        _cleanup_free_ WireguardIPmask *masks = NULL;
+        WireguardIPmask *mask;
+        size_t i = 0;
+
+        masks = new(WireguardIPmask, n);
+        if (!masks)
+                return -ENOMEM;
+
+        /* The kernel strips the host part of allowed IPs, and does not keep them in order */
+        LIST_FOREACH(ipmasks, mask, head) {
+                masks[i] = *mask;
+                (void) in_addr_mask(mask->family, &masks[i].ip, mask->cidr);
+                i++;
+        }
+
+        qsort_safe(masks, n, sizeof(WireguardIPmask), wireguard_ipmask_compare_func);
+
+        *ret = masks;
+        masks = NULL;
+
+        return 0;
+}
+
+static int wireguard_ipmasks_equal(WireguardIPmask *a, WireguardIPmask *b) {
+        _cleanup_free_ WireguardIPmask *x = NULL, *y = NULL;
+        WireguardIPmask *mask;
+        size_t n = 0, m = 0, i;
+        int r;
+
+        LIST_FOREACH(ipmasks, mask, a)
+                n++;
+        LIST_FOREACH(ipmasks, mask, b)
+                m++;
+
+        if (n != m)
+                return false;
+
+        r = wireguard_ipmasks_to_array(a, n, &x);
+        if (r < 0)
+                return r;
+
+        r = wireguard_ipmasks_to_array(b, m, &y);
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < n; i++)
+                if (wireguard_ipmask_compare_func(x + i, y + i) != 0)
+                        return false;
+
+        return true;
+}
+
+static bool wireguard_endpoint_equal(const union sockaddr_union *a, const union sockaddr_union *b) {
+        if (a->sa.sa_family != b->sa.sa_family)
+                return false;
+
+        if (a->sa.sa_family == AF_INET)
+                return a->in.sin_port == b->in.sin_port &&
+                       a->in.sin_addr.s_addr == b->in.sin_addr.s_addr;
+
+        if (a->sa.sa_family == AF_INET6)
+                return a->in6.sin6_port == b->in6.sin6_port &&
+                       a->in6.sin6_scope_id == b->in6.sin6_scope_id &&
+                       IN6_ARE_ADDR_EQUAL(&a->in6.sin6_addr, &b->in6.sin6_addr);
+
+        return true;
+}
+
+static int wireguard_peer_equal(WireguardPeer *peer, WireguardPeer *current) {
+        if (memcmp(peer->preshared_key, current->preshared_key, WG_KEY_LEN) != 0)
+                return false;
+
+        if (peer->persistent_keepalive_interval != current->persistent_keepalive_interval)
+                return false;
+
+        /* Unless configured, the endpoint is learnt from the peer */
+        if (peer->endpoint.sa.sa_family != AF_UNSPEC &&
+            !wireguard_endpoint_equal(&peer->endpoint, &current->endpoint))
+                return false;
+
+        return wireguard_ipmasks_equal(peer->ipmasks, current->ipmasks);
+}
+
+static int wireguard_read_peer(sd_netlink_message *m, Hashmap *current) {
+        _cleanup_(wireguard_peer_freep) WireguardPeer *new_peer = NULL;
+        uint8_t public_key[WG_KEY_LEN];
+        WireguardPeer *peer;
+        int r;
+
+        r = sd_netlink_message_read(m, WGPEER_A_PUBLIC_KEY, sizeof(public_key), public_key);
+        if (r < 0)
+                return r;
+        if (r != WG_KEY_LEN)
+                return -EBADMSG;
+
+        /* The allowed IPs of a peer are continued in the next message if they do not fit into one. Only the
+         * first part carries the other attributes, but the parts of a dump are chained newest first, hence
+         * read whatever is there from each part. */
+        peer = hashmap_get(current, public_key);
+        if (!peer) {
+                new_peer = new0(WireguardPeer, 1);
+                if (!new_peer)
+                        return -ENOMEM;
+
+                memcpy(new_peer->public_key, public_key, WG_KEY_LEN);
+
+                r = hashmap_put(current, new_peer->public_key, new_peer);
+                if (r < 0)
+                        return r;
+
+                peer = new_peer;
+                new_peer = NULL;
+        }
+
+        (void) sd_netlink_message_read(m, WGPEER_A_PRESHARED_KEY, WG_KEY_LEN, peer->preshared_key);
+        (void) sd_netlink_message_read(m, WGPEER_A_ENDPOINT, sizeof(peer->endpoint), &peer->endpoint);
+        (void) sd_netlink_message_read_u16(m, WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL, &peer->persistent_keepalive_interval);
+
+        r = sd_netlink_message_enter_array(m, WGPEER_A_ALLOWEDIPS);
+        if (r == -ENODATA)
+                return 0;
+        if (r < 0)
+                return r;
+
+        while ((r = sd_netlink_message_enter_array_element(m)) > 0) {
+                _cleanup_free_ WireguardIPmask *mask = NULL;
+
+                mask = new0(WireguardIPmask, 1);
+                if (!mask)
+                        return -ENOMEM;
+
+                r = sd_netlink_message_read_u16(m, WGALLOWEDIP_A_FAMILY, &mask->family);
+                if (r < 0)
+                        return r;
+
+                if (mask->family == AF_INET)
+                        r = sd_netlink_message_read_in_addr(m, WGALLOWEDIP_A_IPADDR, &mask->ip.in);
+                else if (mask->family == AF_INET6)
+                        r = sd_netlink_message_read_in6_addr(m, WGALLOWEDIP_A_IPADDR, &mask->ip.in6);
+                else
+                        r = -EAFNOSUPPORT;
+                if (r < 0)
+                        return r;
+
+                r = sd_netlink_message_read_u8(m, WGALLOWEDIP_A_CIDR_MASK, &mask->cidr);
+                if (r < 0)
+                        return r;
+
+                LIST_PREPEND(ipmasks, peer->ipmasks, mask);
+                mask = NULL;
+
+                r = sd_netlink_message_exit_container(m);
+                if (r < 0)
+                        return r;
+        }
+        if (r < 0)
+                return r;
+
+        return sd_netlink_message_exit_container(m);
+}
+
+/* Brings the device in line with the configuration, based on what the kernel reported it to be configured
+ * with. Only the peers that were added, changed or removed are passed to the kernel, so that the sessions
+ * of all others are left alone, and huge numbers of peers are not sent over and over again. */
+static int wireguard_update(NetDev *netdev, sd_netlink_message *m) {
+        _cleanup_hashmap_free_ Hashmap *current = NULL;
+        _cleanup_free_ WireguardPeer **peers = NULL;
+        uint8_t private_key[WG_KEY_LEN] = {};
+        size_t n_peers = 0, n_changed = 0, allocated = 0;
+        WireguardSetFlags flags = 0;
+        WireguardPeer *peer;
+        uint16_t port = 0;
+        uint32_t fwmark = 0;
+        Wireguard *w;
+        Iterator i;
+        int r;
+
+        assert(netdev);
+        w = WIREGUARD(netdev);
+        assert(w);
+
+        current = hashmap_new(&wireguard_public_key_hash_ops);
+        if (!current)
+                return -ENOMEM;
+
+        for (; m; m = sd_netlink_message_next(m)) {
+                uint16_t type;
+
+                r = sd_netlink_message_get_type(m, &type);
+                if (r < 0)
+                        goto finish;
+
+                if (type == NLMSG_DONE)
+                        continue;
+
+                /* Only one message of the dump describes the device itself */
+                (void) sd_netlink_message_read(m, WGDEVICE_A_PRIVATE_KEY, sizeof(private_key), private_key);
+                (void) sd_netlink_message_read_u16(m, WGDEVICE_A_LISTEN_PORT, &port);
+                (void) sd_netlink_message_read_u32(m, WGDEVICE_A_FWMARK, &fwmark);
+
+                r = sd_netlink_message_enter_array(m, WGDEVICE_A_PEERS);
+                if (r == -ENODATA)
+                        continue;
+                if (r < 0)
+                        goto finish;
+
+                while ((r = sd_netlink_message_enter_array_element(m)) > 0) {
+                        r = wireguard_read_peer(m, current);
                         if (r < 0)
-                                return log_netdev_error_errno(netdev, r, "Could not add wireguard allowed ip: %m");
+                                goto finish;
 
-                        r = sd_netlink_message_close_container(message);
+                        r = sd_netlink_message_exit_container(m);
                         if (r < 0)
-                                return log_netdev_error_errno(netdev, r, "Could not add wireguard peer: %m");
+                                goto finish;
                 }
+                if (r < 0)
+                        goto finish;
 
-                peer_start = peer;
-                if (peer_start && !mask_start) {
-                        r = sd_netlink_message_cancel_array(message);
+                r = sd_netlink_message_exit_container(m);
+                if (r < 0)
+                        goto finish;
+        }
+
+        if (memcmp(private_key, w->private_key, WG_KEY_LEN) != 0 ||
+            (w->port != 0 && w->port != port) ||
+            w->fwmark != fwmark)
+                flags |= WIREGUARD_SET_DEVICE;
+
+        LIST_FOREACH(peers, peer, w->peers) {
+                WireguardPeer *c;
+
+                if (hashmap_get(w->peers_by_public_key, peer->public_key) != peer)
+                        continue;
+
+                c = hashmap_get(current, peer->public_key);
+                if (c) {
+                        r = wireguard_peer_equal(peer, c);
                         if (r < 0)
-                                return log_netdev_error_errno(netdev, r, "Could not cancel wireguard peers: %m");
+                                goto finish;
+                        if (r > 0)
+                                continue;
                 }
 
-                r = sd_netlink_message_close_container(message);
-                if (r < 0)
-                        return log_netdev_error_errno(netdev, r, "Could not close wireguard container: %m");
+                if (!GREEDY_REALLOC(peers, allocated, n_peers + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
 
-                r = sd_netlink_send(netdev->manager->genl, message, &serial);
-                if (r < 0)
-                        return log_netdev_error_errno(netdev, r, "Could not set wireguard device: %m");
+                peers[n_peers++] = peer;
+        }
+
+        n_changed = n_peers;
+
+        HASHMAP_FOREACH(peer, current, i) {
+                if (hashmap_contains(w->peers_by_public_key, peer->public_key))
+                        continue;
 
-        } while (peer || mask_start);
+                peer->flags = WGPEER_F_REMOVE_ME;
+
+                if (!GREEDY_REALLOC(peers, allocated, n_peers + 1)) {
+                        r = -ENOMEM;
+                        goto finish;
+                }
+
+                peers[n_peers++] = peer;
+        }
+
+        log_netdev_debug(netdev, "%zu of %u configured peers to add or update, %zu to remove%s",
+                         n_changed, hashmap_size(w->peers_by_public_key), n_peers - n_changed,
+                         flags & WIREGUARD_SET_DEVICE ? ", device settings changed" : "");
+
+        r = 0;
+        if (flags != 0 || n_peers > 0)
+                r = set_wireguard_interface(netdev, peers, n_peers, flags);
+
+finish:
+        while ((peer = hashmap_steal_first(current)))
+                wireguard_peer_free(peer);
+
+        return r;
+}
+
+static int wireguard_get_handler(sd_netlink *genl, sd_netlink_message *m, void *userdata) {
+        _cleanup_netdev_unref_ NetDev *netdev = userdata;
+        int r;
+
+        assert(netdev);
+
+        if (netdev->state == NETDEV_STATE_LINGER)
+                return 1;
+
+        r = sd_netlink_message_get_errno(m);
+        if (r >= 0) {
+                r = wireguard_update(netdev, m);
+                if (r >= 0)
+                        return 1;
+        }
+
+        log_netdev_warning_errno(netdev, r, "Could not get wireguard device, replacing its configuration: %m");
+        (void) wireguard_replace(netdev);
+
+        return 1;
+}
+
+static int get_wireguard_interface(NetDev *netdev) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *message = NULL;
+        int r;
+
+        assert(netdev);
+
+        r = sd_genl_message_new(netdev->manager->genl, SD_GENL_WIREGUARD, WG_CMD_GET_DEVICE, &message);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Failed to allocate generic netlink message: %m");
+
+        r = sd_netlink_message_request_dump(message, true);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not set dump flag: %m");
+
+        r = sd_netlink_message_append_string(message, WGDEVICE_A_IFNAME, netdev->ifname);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not append wireguard interface name: %m");
+
+        r = sd_netlink_call_async(netdev->manager->genl, message, wireguard_get_handler, netdev, 0, NULL);
+        if (r < 0)
+                return log_netdev_error_errno(netdev, r, "Could not get wireguard device: %m");
+
+        netdev_ref(netdev);
 
         return 0;
 }
@@ -251,6 +729,8 @@ static int wireguard_resolve_handler(sd_resolve_query *q,
         NetDev *netdev;
         Wireguard *w;
         _cleanup_(wireguard_endpoint_freep) WireguardEndpoint *e;
+        _cleanup_free_ WireguardPeer **peers = NULL;
+        size_t n_peers;
         int r;
 
         assert(userdata);
@@ -268,9 +748,10 @@ static int wireguard_resolve_handler(sd_resolve_query *q,
                 LIST_PREPEND(endpoints, w->failed_endpoints, e);
                 e = NULL;
         } else if ((ai->ai_family == AF_INET && ai->ai_addrlen == sizeof(struct sockaddr_in)) ||
-                        (ai->ai_family == AF_INET6 && ai->ai_addrlen == sizeof(struct sockaddr_in6)))
+                        (ai->ai_family == AF_INET6 && ai->ai_addrlen == sizeof(struct sockaddr_in6))) {
                 memcpy(&e->peer->endpoint, ai->ai_addr, ai->ai_addrlen);
-        else
+                e->peer->update_endpoint = true;
+        } else
                 log_netdev_error(netdev, "Neither IPv4 nor IPv6 address found for peer endpoint: %s:%s", e->host, e->port);
 
         if (w->unresolved_endpoints) {
@@ -278,7 +759,13 @@ static int wireguard_resolve_handler(sd_resolve_query *q,
                 return 0;
         }
 
-        set_wireguard_interface(netdev);
+        /* Pass all endpoints resolved in this round in one go */
+        r = wireguard_collect_peers(w, true, &peers, &n_peers);
+        if (r < 0)
+                log_oom();
+        else if (n_peers > 0)
+                (void) set_wireguard_interface(netdev, peers, n_peers, WIREGUARD_SET_ENDPOINTS_ONLY);
+
         if (w->failed_endpoints) {
                 w->n_retries++;
                 r = sd_event_add_time(netdev->manager->event,
@@ -336,7 +823,9 @@ static int netdev_wireguard_post_create(NetDev *netdev, Link *link, sd_netlink_m
         w = WIREGUARD(netdev);
         assert(w);
 
-        set_wireguard_interface(netdev);
+        /* Find out what the device is configured with already, which is everything if it is left over
+         * from before networkd was restarted */
+        get_wireguard_interface(netdev);
         resolve_endpoints(netdev);
         return 0;
 }
@@ -679,35 +1168,47 @@ int config_parse_wireguard_keepalive(const char *unit,
         return 0;
 }
 
-static void wireguard_init(NetDev *netdev) {
+static int wireguard_verify(NetDev *netdev, const char *filename) {
         Wireguard *w;
+        WireguardPeer *peer;
+        int r;
 
         assert(netdev);
-
         w = WIREGUARD(netdev);
-
         assert(w);
 
-        w->flags = WGDEVICE_F_REPLACE_PEERS;
+        w->peers_by_public_key = hashmap_new(&wireguard_public_key_hash_ops);
+        if (!w->peers_by_public_key)
+                return log_oom();
+
+        /* Sections are prepended to the list, so the last one of several with the same key comes first */
+        LIST_FOREACH(peers, peer, w->peers) {
+                r = hashmap_put(w->peers_by_public_key, peer->public_key, peer);
+                if (r == -EEXIST) {
+                        log_netdev_warning(netdev, "%s: Public key of peer specified more than once, ignoring all but the last [WireGuardPeer] section with it.", filename);
+                        continue;
+                }
+                if (r < 0)
+                        return log_oom();
+        }
+
+        return 0;
 }
 
 static void wireguard_done(NetDev *netdev) {
         Wireguard *w;
         WireguardPeer *peer;
-        WireguardIPmask *mask;
 
         assert(netdev);
         w = WIREGUARD(netdev);
         assert(!w->unresolved_endpoints);
         w->resolve_retry_event_source = sd_event_source_unref(w->resolve_retry_event_source);
 
+        w->peers_by_public_key = hashmap_free(w->peers_by_public_key);
+
         while ((peer = w->peers)) {
                 LIST_REMOVE(peers, w->peers, peer);
-                while ((mask = peer->ipmasks)) {
-                        LIST_REMOVE(ipmasks, peer->ipmasks, mask);
-                        free(mask);
-                }
-                free(peer);
+                wireguard_peer_free(peer);
         }
 }
 
@@ -715,7 +1216,7 @@ const NetDevVTable wireguard_vtable = {
         .object_size = sizeof(Wireguard),
         .sections = "Match\0NetDev\0WireGuard\0WireGuardPeer\0",
         .post_create = netdev_wireguard_post_create,
-        .init = wireguard_init,
         .done = wireguard_done,
+        .config_verify = wireguard_verify,
         .create_type = NETDEV_CREATE_INDEPENDENT,
 };
@@ -21,6 +21,7 @@
 
 typedef struct Wireguard Wireguard;
 
+#include "hashmap.h"
 #include "netdev.h"
 #include "sd-resolve.h"
 #include "wireguard-netlink.h"
@@ -48,6 +49,9 @@ typedef struct WireguardPeer {
 
         uint16_t persistent_keepalive_interval;
 
+        /* resolved, but not yet passed to the kernel */
+        bool update_endpoint;
+
         LIST_HEAD(WireguardIPmask, ipmasks);
         LIST_FIELDS(struct WireguardPeer, peers);
 } WireguardPeer;
@@ -67,7 +71,6 @@ struct Wireguard {
         unsigned last_peer_section;
 
         char interface[IFNAMSIZ];
-        uint32_t flags;
 
         uint8_t public_key[WG_KEY_LEN];
         uint8_t private_key[WG_KEY_LEN];
@@ -76,6 +79,7 @@ struct Wireguard {
         uint16_t port;
 
         LIST_HEAD(WireguardPeer, peers);
+        Hashmap *peers_by_public_key;
         size_t allocation_size;
         sd_event_source *resolve_retry_event_source;
 
@@ -121,6 +121,7 @@ void address_free(Address *address) {
         if (address->link) {
                 set_remove(address->link->addresses, address);
                 set_remove(address->link->addresses_foreign, address);
+                link_bump_generation(address->link);
 
                 if (in_addr_equal(AF_INET6, &address->in_addr, (const union in_addr_union *) &address->link->ipv6ll_address))
                         memzero(&address->link->ipv6ll_address, sizeof(struct in6_addr));
@@ -284,6 +285,7 @@ static int address_add_internal(Link *link, Set **addresses,
                 return r;
 
         address->link = link;
+        link_bump_generation(link);
 
         if (ret)
                 *ret = address;
@@ -373,6 +375,7 @@ int address_update(
         address->scope = scope;
         address->cinfo = *cinfo;
 
+        link_bump_generation(address->link);
         link_update_operstate(address->link);
 
         if (!ready && address_is_ready(address)) {
@@ -30,48 +30,21 @@
 #include "networkd-link.h"
 #include "networkd-manager.h"
 #include "siphash24.h"
+#include "set.h"
 #include "string-util.h"
 #include "radv-internal.h"
 
 static int dhcp6_lease_address_acquired(sd_dhcp6_client *client, Link *link);
 
-static bool dhcp6_verify_link(Link *link) {
-        if (!link->network) {
-                log_link_info(link, "Link is not managed by us");
-                return false;
-        }
-
-        if (!IN_SET(link->network->router_prefix_delegation,
-                            RADV_PREFIX_DELEGATION_DHCP6,
-                            RADV_PREFIX_DELEGATION_BOTH)) {
-                log_link_debug(link, "Link does not request DHCPv6 prefix delegation");
-                return false;
-        }
-
-        return true;
-}
-
 static bool dhcp6_enable_prefix_delegation(Link *dhcp6_link) {
         Manager *manager;
-        Link *l;
-        Iterator i;
 
         assert(dhcp6_link);
 
         manager = dhcp6_link->manager;
         assert(manager);
 
-        HASHMAP_FOREACH(l, manager->links, i) {
-                if (l == dhcp6_link)
-                        continue;
-
-                if (!dhcp6_verify_link(l))
-                        continue;
-
-                return true;
-        }
-
-        return false;
+        return set_size(manager->dhcp6_pd_links) > (size_t) set_contains(manager->dhcp6_pd_links, dhcp6_link);
 }
 
 static int dhcp6_lease_information_acquired(sd_dhcp6_client *client,
@@ -103,42 +76,113 @@ static int dhcp6_pd_prefix_assign(Link *link, struct in6_addr *prefix,
         if (r < 0)
                 return r;
 
-        r = sd_radv_stop(radv);
-        if (r < 0)
-                return r;
-
+        /* Updates the lifetimes of a prefix already advertised in place */
         r = sd_radv_add_prefix(radv, p, true);
         if (r < 0 && r != -EEXIST)
                 return r;
 
-        r = manager_dhcp6_prefix_add(link->manager, &p->opt.in6_addr, link);
-        if (r < 0)
-                return r;
+        if (manager_dhcp6_prefix_get(link->manager, prefix) != link) {
+                r = manager_dhcp6_prefix_add(link->manager, &p->opt.in6_addr, link);
+                if (r < 0)
+                        return r;
+        }
 
+        /* Does nothing if the engine is running already, it picks up the change by itself */
         return sd_radv_start(radv);
 }
 
-static Network *dhcp6_reset_pd_prefix_network(Link *link) {
+static int dhcp6_pd_route_handler(sd_netlink *rtnl, sd_netlink_message *m, void *userdata) {
+        _cleanup_link_unref_ Link *link = userdata;
+        int r;
+
         assert(link);
-        assert(link->manager);
-        assert(link->manager->networks);
 
-        return link->manager->networks;
+        r = sd_netlink_message_get_errno(m);
+        if (r < 0 && r != -EEXIST)
+                log_link_debug_errno(link, r, "Could not set unreachable route for DHCPv6 delegated prefix: %m");
+
+        return 1;
 }
 
-static int dhcp6_pd_prefix_distribute(Link *dhcp6_link, Iterator *i,
+static int dhcp6_pd_prefix_unreachable(Link *dhcp6_link, const union in_addr_union *prefix, uint8_t prefix_len) {
+        Route *route;
+        int r;
+
+        /* Subnets of the delegated prefix not assigned to any link must not be routed back upstream. The
+         * more specific routes of the assigned ones take precedence. */
+        r = route_add(dhcp6_link, AF_INET6, prefix, prefix_len, 0, 0, 0, &route);
+        if (r < 0)
+                return r;
+
+        route->type = RTN_UNREACHABLE;
+
+        return route_configure(route, dhcp6_link, dhcp6_pd_route_handler);
+}
+
+/* Updates the lifetimes of the subnets of a delegated prefix the links got with previous leases */
+static int dhcp6_pd_prefix_renew(Link *dhcp6_link, Set **assigned,
+                                 struct in6_addr *pd_prefix,
+                                 uint8_t pd_prefix_len,
+                                 uint32_t lifetime_preferred,
+                                 uint32_t lifetime_valid) {
+        Manager *manager = dhcp6_link->manager;
+        struct in6_addr *addr;
+        Link *link;
+        Iterator i;
+        int r;
+
+        assert(manager);
+        assert(assigned);
+
+        HASHMAP_FOREACH_KEY(link, addr, manager->dhcp6_prefixes, i) {
+                _cleanup_free_ char *buf = NULL;
+
+                if (link == dhcp6_link || !set_contains(manager->dhcp6_pd_links, link))
+                        continue;
+
+                if (set_contains(*assigned, link))
+                        continue;
+
+                if (in_addr_prefix_covers(AF_INET6, (union in_addr_union*) pd_prefix, pd_prefix_len,
+                                          (union in_addr_union*) addr) <= 0)
+                        continue;
+
+                r = set_ensure_allocated(assigned, NULL);
+                if (r < 0)
+                        return r;
+
+                r = set_put(*assigned, link);
+                if (r < 0)
+                        return r;
+
+                (void) in_addr_to_string(AF_INET6, (union in_addr_union*) addr, &buf);
+
+                r = dhcp6_pd_prefix_assign(link, addr, 64, lifetime_preferred, lifetime_valid);
+                if (r < 0)
+                        log_link_error_errno(link, r, "Unable to update prefix %s/64 for link: %m", strnull(buf));
+                else
+                        log_link_debug(link, "Updated prefix %s/64", strnull(buf));
+        }
+
+        return 0;
+}
+
+/* Hands out the subnets of a delegated prefix no link holds yet to links without one */
+static int dhcp6_pd_prefix_distribute(Link *dhcp6_link, Set **assigned,
                                       struct in6_addr *pd_prefix,
                                       uint8_t pd_prefix_len,
                                       uint32_t lifetime_preferred,
                                       uint32_t lifetime_valid) {
-        Link *link;
         Manager *manager = dhcp6_link->manager;
-        union in_addr_union prefix;
-        uint8_t n_prefixes, n_used = 0;
+        union in_addr_union prefix, first;
         _cleanup_free_ char *buf = NULL;
+        unsigned n_used = 0;
+        Link *link;
+        Iterator i;
         int r;
 
         assert(manager);
+        assert(assigned);
         assert(pd_prefix_len <= 64);
 
         prefix.in6 = *pd_prefix;
@@ -147,96 +191,88 @@ static int dhcp6_pd_prefix_distribute(Link *dhcp6_link, Iterator *i,
         if (r < 0)
                 return r;
 
-        n_prefixes = 1 << (64 - pd_prefix_len);
+        first = prefix;
 
         (void) in_addr_to_string(AF_INET6, &prefix, &buf);
-        log_link_debug(dhcp6_link, "Assigning up to %u prefixes from %s/%u",
-                       n_prefixes, strnull(buf), pd_prefix_len);
+        log_link_debug(dhcp6_link, "Assigning prefixes from %s/%u", strnull(buf), pd_prefix_len);
 
-        while (hashmap_iterate(manager->links, i, (void **)&link, NULL)) {
-                Link *assigned_link;
-
-                if (n_used == n_prefixes) {
-                        log_link_debug(dhcp6_link, "Assigned %u/%u prefixes from %s/%u",
-                                       n_used, n_prefixes, strnull(buf), pd_prefix_len);
+        if (pd_prefix_len < 64) {
+                r = dhcp6_pd_prefix_unreachable(dhcp6_link, &first, pd_prefix_len);
+                if (r < 0)
+                        log_link_warning_errno(dhcp6_link, r, "Could not set unreachable route for %s/%u: %m",
+                                               strnull(buf), pd_prefix_len);
+        }
 
-                        return -EAGAIN;
-                }
+        SET_FOREACH(link, manager->dhcp6_pd_links, i) {
+                _cleanup_free_ char *assigned_buf = NULL;
 
-                if (link == dhcp6_link)
+                if (link == dhcp6_link || set_contains(*assigned, link))
                         continue;
 
-                if (!dhcp6_verify_link(link))
-                        continue;
+                /* Skip the subnets held by other links. Those are never handed out again before their
+                 * link goes away, hence the search never needs to start over. */
+                while (manager_dhcp6_prefix_get(manager, &prefix.in6)) {
+                        r = in_addr_prefix_next(AF_INET6, &prefix, 64);
+                        if (r <= 0 || in_addr_prefix_covers(AF_INET6, &first, pd_prefix_len, &prefix) <= 0) {
+                                log_link_debug(dhcp6_link, "No more prefixes left in %s/%u after assigning %u",
+                                               strnull(buf), pd_prefix_len, n_used);
+                                return -EAGAIN;
+                        }
+                }
 
-                assigned_link = manager_dhcp6_prefix_get(manager, &prefix.in6);
-                if (assigned_link != NULL && assigned_link != link)
-                        continue;
+                (void) in_addr_to_string(AF_INET6, &prefix, &assigned_buf);
 
-                r = dhcp6_pd_prefix_assign(link, &prefix.in6, 64,
-                                           lifetime_preferred, lifetime_valid);
+                r = dhcp6_pd_prefix_assign(link, &prefix.in6, 64, lifetime_preferred, lifetime_valid);
                 if (r < 0) {
-                        log_link_error_errno(link, r, "Unable to %s prefix %s/%u for link: %m",
-                                             assigned_link ? "update": "assign",
-                                             strnull(buf), pd_prefix_len);
-
-                        if (assigned_link == NULL)
-                                continue;
-
-                } else
-                        log_link_debug(link, "Assigned prefix %u/%u %s/64 to link",
-                                       n_used + 1, n_prefixes, strnull(buf));
-
-                n_used++;
+                        log_link_error_errno(link, r, "Unable to assign prefix %s/64 for link: %m",
+                                             strnull(assigned_buf));
+                        continue;
+                }
 
-                r = in_addr_prefix_next(AF_INET6, &prefix, pd_prefix_len);
-                if (r < 0 && n_used < n_prefixes)
+                r = set_ensure_allocated(assigned, NULL);
+                if (r < 0)
                         return r;
-        }
-
-        if (n_used < n_prefixes) {
-                Route *route;
-                int n = n_used;
 
-                r = route_new(&route);
+                r = set_put(*assigned, link);
                 if (r < 0)
                         return r;
 
-                while (n < n_prefixes) {
-                        route_update(route, &prefix, pd_prefix_len, NULL, NULL,
-                                     0, 0, RTN_UNREACHABLE);
-
-                        r = route_configure(route, link, NULL);
-                        if (r < 0) {
-                                route_free(route);
-                                return r;
-                        }
-
-                        r = in_addr_prefix_next(AF_INET6, &prefix, pd_prefix_len);
-                        if (r < 0)
-                                return r;
-                }
+                log_link_debug(link, "Assigned prefix %s/64 to link", strnull(assigned_buf));
+                n_used++;
         }
 
         return n_used;
 }
 
 static int dhcp6_lease_pd_prefix_acquired(sd_dhcp6_client *client, Link *link) {
+        _cleanup_set_free_ Set *assigned = NULL;
         int r;
         sd_dhcp6_lease *lease;
         struct in6_addr pd_prefix;
         uint8_t pd_prefix_len;
         uint32_t lifetime_preferred, lifetime_valid;
-        _cleanup_free_ char *buf = NULL;
-        Iterator i = ITERATOR_FIRST;
 
         r = sd_dhcp6_client_get_lease(client, &lease);
         if (r < 0)
                 return r;
 
-        (void) in_addr_to_string(AF_INET6, (union in_addr_union*) &pd_prefix, &buf);
+        /* First let the links keep the subnets they got from earlier leases, so that renewals don't
+         * renumber anything, then hand out subnets to the links that don't have one yet */
+        sd_dhcp6_lease_reset_pd_prefix_iter(lease);
+
+        while (sd_dhcp6_lease_get_pd(lease, &pd_prefix, &pd_prefix_len,
+                                     &lifetime_preferred,
+                                     &lifetime_valid) >= 0) {
+
+                if (pd_prefix_len > 64)
+                        continue;
+
+                r = dhcp6_pd_prefix_renew(link, &assigned, &pd_prefix, pd_prefix_len,
+                                          lifetime_preferred, lifetime_valid);
+                if (r < 0)
+                        return r;
+        }
 
-        dhcp6_reset_pd_prefix_network(link);
         sd_dhcp6_lease_reset_pd_prefix_iter(lease);
 
         while (sd_dhcp6_lease_get_pd(lease, &pd_prefix, &pd_prefix_len,
@@ -244,20 +280,20 @@ static int dhcp6_lease_pd_prefix_acquired(sd_dhcp6_client *client, Link *link) {
                                      &lifetime_valid) >= 0) {
 
                 if (pd_prefix_len > 64) {
+                        _cleanup_free_ char *buf = NULL;
+
+                        (void) in_addr_to_string(AF_INET6, (union in_addr_union*) &pd_prefix, &buf);
                         log_link_debug(link, "PD Prefix length > 64, ignoring prefix %s/%u",
                                        strnull(buf), pd_prefix_len);
                         continue;
                 }
 
-                r = dhcp6_pd_prefix_distribute(link, &i, &pd_prefix,
+                r = dhcp6_pd_prefix_distribute(link, &assigned, &pd_prefix,
                                                pd_prefix_len,
                                                lifetime_preferred,
                                                lifetime_valid);
                 if (r < 0 && r != -EAGAIN)
                         return r;
-
-                if (r >= 0)
-                        i = ITERATOR_FIRST;
         }
 
         return 0;
@@ -249,5 +249,9 @@ int ipv4ll_configure(Link *link) {
         if (r < 0)
                 return r;
 
+        r = sd_ipv4ll_set_mux(link->ipv4ll, link->manager->ipv4acd_mux);
+        if (r < 0)
+                return r;
+
         return 0;
 }
@@ -22,8 +22,10 @@
 #include "bus-util.h"
 #include "networkd-link.h"
 #include "networkd-manager.h"
+#include "networkd-ndisc.h"
 #include "parse-util.h"
 #include "strv.h"
+#include "time-util.h"
 
 static BUS_DEFINE_PROPERTY_GET_ENUM(property_get_operational_state, link_operstate, LinkOperationalState);
 static BUS_DEFINE_PROPERTY_GET_ENUM(property_get_administrative_state, link_state, LinkState);
@@ -117,9 +119,10 @@ int link_object_find(sd_bus *bus, const char *path, const char *interface, void
         return 1;
 }
 
+/* Only records the properties, they are sent in one merged signal by link_flush_changed() */
 int link_send_changed(Link *link, const char *property, ...) {
-        _cleanup_free_ char *p = NULL;
         char **l;
+        int r;
 
         assert(link);
         assert(link->manager);
@@ -129,6 +132,36 @@ int link_send_changed(Link *link, const char *property, ...) {
 
         l = strv_from_stdarg_alloca(property);
 
+        r = strv_extend_strv(&link->changed_properties, l, true);
+        if (r < 0)
+                return r;
+
+        r = set_ensure_allocated(&link->manager->changed_links, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_put(link->manager->changed_links, link);
+        if (r < 0)
+                return r;
+        if (r > 0)
+                link_ref(link);
+
+        return manager_schedule_send_changed(link->manager);
+}
+
+int link_flush_changed(Link *link) {
+        _cleanup_strv_free_ char **l = NULL;
+        _cleanup_free_ char *p = NULL;
+
+        assert(link);
+        assert(link->manager);
+
+        l = link->changed_properties;
+        link->changed_properties = NULL;
+
+        if (strv_isempty(l) || !link->manager->bus)
+                return 0;
+
         p = link_bus_path(link);
         if (!p)
                 return -ENOMEM;
@@ -139,3 +172,250 @@ int link_send_changed(Link *link, const char *property, ...) {
                         "org.freedesktop.network1.Link",
                         l);
 }
+
+static int append_in_addr(sd_bus_message *reply, int family, const union in_addr_union *a) {
+        return sd_bus_message_append_array(reply, 'y', a, FAMILY_ADDRESS_SIZE(family));
+}
+
+static int append_dns(sd_bus_message *reply, int family, const void *a) {
+        int r;
+
+        r = sd_bus_message_open_container(reply, 'r', "iay");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "i", family);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append_array(reply, 'y', a, FAMILY_ADDRESS_SIZE(family));
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int link_append_addresses(Link *link, sd_bus_message *reply) {
+        Set *sets[] = { link->addresses, link->addresses_foreign };
+        Address *a;
+        Iterator i;
+        unsigned j;
+        int r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(iayu)");
+        if (r < 0)
+                return r;
+
+        for (j = 0; j < ELEMENTSOF(sets); j++)
+                SET_FOREACH(a, sets[j], i) {
+                        r = sd_bus_message_open_container(reply, 'r', "iayu");
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_append(reply, "i", a->family);
+                        if (r < 0)
+                                return r;
+
+                        r = append_in_addr(reply, a->family, &a->in_addr);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_append(reply, "u", (uint32_t) a->prefixlen);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_close_container(reply);
+                        if (r < 0)
+                                return r;
+                }
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int link_append_routes(Link *link, sd_bus_message *reply) {
+        Set *sets[] = { link->routes, link->routes_foreign };
+        Route *route;
+        Iterator i;
+        unsigned j;
+        int r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(iayuayuu)");
+        if (r < 0)
+                return r;
+
+        for (j = 0; j < ELEMENTSOF(sets); j++)
+                SET_FOREACH(route, sets[j], i) {
+                        r = sd_bus_message_open_container(reply, 'r', "iayuayuu");
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_append(reply, "i", route->family);
+                        if (r < 0)
+                                return r;
+
+                        r = append_in_addr(reply, route->family, &route->dst);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_append(reply, "u", (uint32_t) route->dst_prefixlen);
+                        if (r < 0)
+                                return r;
+
+                        r = append_in_addr(reply, route->family, &route->gw);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_append(reply, "uu", route->table, route->priority);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_close_container(reply);
+                        if (r < 0)
+                                return r;
+                }
+
+        return sd_bus_message_close_container(reply);
+}
+
+/* Same servers, in the same order, as link_save() writes to DNS= */
+static int link_append_dns(Link *link, sd_bus_message *reply) {
+        int r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(iay)");
+        if (r < 0)
+                return r;
+
+        if (link->network) {
+                sd_dhcp6_lease *dhcp6_lease = NULL;
+                unsigned j;
+
+                for (j = 0; j < link->network->n_dns; j++) {
+                        r = append_dns(reply, link->network->dns[j].family, &link->network->dns[j].address);
+                        if (r < 0)
+                                return r;
+                }
+
+                if (link->network->dhcp_use_dns && link->dhcp_lease) {
+                        const struct in_addr *addresses;
+                        int n;
+
+                        n = sd_dhcp_lease_get_dns(link->dhcp_lease, &addresses);
+                        for (j = 0; n > 0 && j < (unsigned) n; j++) {
+                                r = append_dns(reply, AF_INET, addresses + j);
+                                if (r < 0)
+                                        return r;
+                        }
+                }
+
+                if (link->network->dhcp_use_dns && link->dhcp6_client &&
+                    sd_dhcp6_client_get_lease(link->dhcp6_client, &dhcp6_lease) >= 0) {
+                        struct in6_addr *addresses;
+                        int n;
+
+                        n = sd_dhcp6_lease_get_dns(dhcp6_lease, &addresses);
+                        for (j = 0; n > 0 && j < (unsigned) n; j++) {
+                                r = append_dns(reply, AF_INET6, addresses + j);
+                                if (r < 0)
+                                        return r;
+                        }
+                }
+
+                if (link->network->dhcp_use_dns && link->ndisc_rdnss) {
+                        usec_t time_now;
+                        NDiscRDNSS *dd;
+                        Iterator i;
+
+                        /* Leave vacuuming to link_save(), this is only a query, but don't report expired
+                         * entries either */
+                        time_now = now(clock_boottime_or_monotonic());
+
+                        SET_FOREACH(dd, link->ndisc_rdnss, i) {
+                                if (dd->valid_until < time_now)
+                                        continue;
+
+                                r = append_dns(reply, AF_INET6, &dd->address);
+                                if (r < 0)
+                                        return r;
+                        }
+                }
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int link_append_dhcp_lease(Link *link, sd_bus_message *reply) {
+        struct in_addr address, server = {};
+        uint32_t lifetime = 0;
+        int r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(ayayu)");
+        if (r < 0)
+                return r;
+
+        if (link->dhcp_lease && sd_dhcp_lease_get_address(link->dhcp_lease, &address) >= 0) {
+                (void) sd_dhcp_lease_get_server_identifier(link->dhcp_lease, &server);
+                (void) sd_dhcp_lease_get_lifetime(link->dhcp_lease, &lifetime);
+
+                r = sd_bus_message_open_container(reply, 'r', "ayayu");
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append_array(reply, 'y', &address, sizeof(address));
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append_array(reply, 'y', &server, sizeof(server));
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_append(reply, "u", lifetime);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_close_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        return sd_bus_message_close_container(reply);
+}
+
+/* Appends one LINK_DESCRIPTION_SIGNATURE record, everything the state file and the properties of the link
+ * object expose, so that clients don't need one round trip per link and property */
+int link_append_description(Link *link, sd_bus_message *reply) {
+        int r;
+
+        assert(link);
+        assert(reply);
+
+        r = sd_bus_message_open_container(reply, 'r', LINK_DESCRIPTION_FIELDS);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "issst",
+                                  link->ifindex,
+                                  link->ifname,
+                                  link_state_to_string(link->state),
+                                  link_operstate_to_string(link->operstate),
+                                  link->generation);
+        if (r < 0)
+                return r;
+
+        r = link_append_addresses(link, reply);
+        if (r < 0)
+                return r;
+
+        r = link_append_routes(link, reply);
+        if (r < 0)
+                return r;
+
+        r = link_append_dns(link, reply);
+        if (r < 0)
+                return r;
+
+        r = link_append_dhcp_lease(link, reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
@@ -40,9 +40,9 @@
 #include "socket-util.h"
 #include "stdio-util.h"
 #include "string-table.h"
+#include "strv.h"
 #include "udev-util.h"
 #include "util.h"
-#include "virt.h"
 
 static bool link_dhcp6_enabled(Link *link)
 {
@@ -491,6 +491,7 @@ static int link_new(Manager *manager, sd_netlink_message *message, Link **ret)
     link->rtnl_extended_attrs = true;
     link->ifindex = ifindex;
     link->iftype = iftype;
+    link_bump_generation(link);
     link->ifname = strdup(ifname);
     if (!link->ifname)
         return -ENOMEM;
@@ -515,6 +516,9 @@ static int link_new(Manager *manager, sd_netlink_message *message, Link **ret)
     if (asprintf(&link->lldp_file, "/run/systemd/netif/lldp/%d", link->ifindex) < 0)
         return -ENOMEM;
 
+    /* We know no neighbors yet, drop whatever a previous instance left behind */
+    (void)unlink(link->lldp_file);
+
     r = hashmap_ensure_allocated(&manager->links, NULL);
     if (r < 0)
         return r;
@@ -569,8 +573,13 @@ static void link_free(Link *link)
     sd_lldp_unref(link->lldp);
     free(link->lldp_file);
 
+    strv_free(link->changed_properties);
+
     ndisc_flush(link);
 
+    if (link->manager)
+        manager_dhcp6_pd_link_remove(link->manager, link);
+
     sd_ipv4ll_unref(link->ipv4ll);
     sd_dhcp6_client_unref(link->dhcp6_client);
     sd_ndisc_unref(link->ndisc);
@@ -645,7 +654,7 @@ int link_get(Manager *m, int ifindex, Link **ret)
     return 0;
 }
 
-static void link_set_state(Link *link, LinkState state)
+void link_set_state(Link *link, LinkState state)
 {
     assert(link);
 
@@ -654,6 +663,9 @@ static void link_set_state(Link *link, LinkState state)
 
     link->state = state;
 
+    /* Not every transition marks the link dirty, DescribeLinks() needs to see all of them */
+    link_bump_generation(link);
+
     link_send_changed(link, "AdministrativeState", NULL);
 }
 
@@ -1621,7 +1633,7 @@ static int link_bond_set(Link *link)
     return r;
 }
 
-static int link_lldp_save(Link *link)
+int link_lldp_save(Link *link)
 {
     _cleanup_free_ char *temp_path = NULL;
     _cleanup_fclose_ FILE *f = NULL;
@@ -1706,7 +1718,11 @@ static void lldp_handler(sd_lldp *lldp, sd_lldp_event event, sd_lldp_neighbor *n
 
     assert(link);
 
-    (void)link_lldp_save(link);
+    /* A refresh means the neighbor re-sent an identical LLDPDU, only its expiry time changed, which is not
+     * part of the serialized data. Anything else is written out together with other pending state changes
+     * at the end of the event loop iteration. */
+    if (event != SD_LLDP_EVENT_REFRESHED)
+        link_lldp_dirty(link);
 
     if (link_lldp_emit_enabled(link) && event == SD_LLDP_EVENT_ADDED)
     {
@@ -2318,6 +2334,8 @@ void link_drop(Link *link)
 
     link_free_carrier_maps(link);
 
+    manager_dhcp6_pd_link_remove(link->manager, link);
+
     log_link_debug(link, "Link removed");
 
     (void)unlink(link->state_file);
@@ -2775,7 +2793,12 @@ static int link_update_lldp(Link *link)
     {
         r = sd_lldp_stop(link->lldp);
         if (r > 0)
+        {
             log_link_debug(link, "Stopped LLDP.");
+
+            /* Stopping flushes all neighbors without notifying us, hence drop them from disk, too */
+            link_lldp_dirty(link);
+        }
     }
 
     return r;
@@ -2899,6 +2922,15 @@ static int link_configure(Link *link)
         r = radv_configure(link);
         if (r < 0)
             return r;
+
+        if (IN_SET(link->network->router_prefix_delegation,
+                   RADV_PREFIX_DELEGATION_DHCP6,
+                   RADV_PREFIX_DELEGATION_BOTH))
+        {
+            r = manager_dhcp6_pd_link_add(link->manager, link);
+            if (r < 0)
+                return r;
+        }
     }
 
     if (link_lldp_rx_enabled(link))
@@ -2924,6 +2956,10 @@ static int link_configure(Link *link)
         if (r < 0)
             return r;
 
+        r = sd_lldp_set_receiver(link->lldp, link->manager->lldp_receiver);
+        if (r < 0)
+            return r;
+
         r = sd_lldp_set_callback(link->lldp, lldp_handler, link);
         if (r < 0)
             return r;
@@ -3288,9 +3324,9 @@ int link_add(Manager *m, sd_netlink_message *message, Link **ret)
     if (r < 0)
         return r;
 
-    if (detect_container() <= 0)
+    if (m->udev)
     {
-        /* not in a container, udev will be around */
+        /* not in a container (nor replaying recorded traffic), udev will be around */
         sprintf(ifindex_str, "n%d", link->ifindex);
         device = udev_device_new_from_device_id(m->udev, ifindex_str);
         if (!device)
@@ -3692,8 +3728,6 @@ int link_save(Link *link)
         return 0;
     }
 
-    link_lldp_save(link);
-
     admin_state = link_state_to_string(link->state);
     assert(admin_state);
 
@@ -4027,6 +4061,8 @@ void link_dirty(Link *link)
     /* mark manager dirty as link is dirty */
     manager_dirty(link->manager);
 
+    link_bump_generation(link);
+
     r = set_ensure_allocated(&link->manager->dirty_links, NULL);
     if (r < 0)
         /* allocation errors are ignored */
@@ -4050,6 +4086,49 @@ void link_clean(Link *link)
     link_unref(link);
 }
 
+/* The link state, addresses, routes or DNS servers changed since the last DescribeLinks() call */
+void link_bump_generation(Link *link)
+{
+    assert(link);
+
+    if (!link->manager)
+        return;
+
+    link->generation = ++link->manager->link_generation;
+}
+
+/* The serialized LLDP neighbors in /run are no longer up-to-date. Unlike link_dirty() this leaves the
+ * link and manager state files alone. */
+void link_lldp_dirty(Link *link)
+{
+    int r;
+
+    assert(link);
+    assert(link->manager);
+
+    r = set_ensure_allocated(&link->manager->dirty_lldp_links, NULL);
+    if (r < 0)
+        /* allocation errors are ignored */
+        return;
+
+    r = set_put(link->manager->dirty_lldp_links, link);
+    if (r <= 0)
+        /* don't take another ref if the link was already dirty */
+        return;
+
+    link_ref(link);
+}
+
+/* The serialized LLDP neighbors in /run are up-to-date */
+void link_lldp_clean(Link *link)
+{
+    assert(link);
+    assert(link->manager);
+
+    set_remove(link->manager->dirty_lldp_links, link);
+    link_unref(link);
+}
+
 static const char *const link_state_table[_LINK_STATE_MAX] = {
     [LINK_STATE_PENDING] = "pending",
     [LINK_STATE_ENSLAVING] = "configuring",
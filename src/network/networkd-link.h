@@ -86,6 +86,12 @@ typedef struct Link {
         LinkState state;
         LinkOperationalState operstate;
 
+        /* Properties of the link object whose PropertiesChanged signal is still pending */
+        char **changed_properties;
+
+        /* Value of the manager's generation counter when the link state exposed by DescribeLinks() last changed */
+        uint64_t generation;
+
         unsigned address_messages;
         unsigned address_label_messages;
         unsigned route_messages;
@@ -154,6 +160,7 @@ int link_down(Link *link);
 int link_address_remove_handler(sd_netlink *rtnl, sd_netlink_message *m, void *userdata);
 int link_route_remove_handler(sd_netlink *rtnl, sd_netlink_message *m, void *userdata);
 
+void link_set_state(Link *link, LinkState state);
 void link_enter_failed(Link *link);
 int link_initialized(Link *link, struct udev_device *device);
 
@@ -164,8 +171,13 @@ int link_update(Link *link, sd_netlink_message *message);
 
 void link_dirty(Link *link);
 void link_clean(Link *link);
+void link_bump_generation(Link *link);
 int link_save(Link *link);
 
+void link_lldp_dirty(Link *link);
+void link_lldp_clean(Link *link);
+int link_lldp_save(Link *link);
+
 int link_carrier_reset(Link *link);
 bool link_has_carrier(Link *link);
 
@@ -187,9 +199,16 @@ LinkOperationalState link_operstate_from_string(const char *s) _pure_;
 
 extern const sd_bus_vtable link_vtable[];
 
+/* ifindex, name, administrative state, operational state, generation, addresses, routes, DNS servers,
+ * DHCPv4 lease (address, server, lifetime) */
+#define LINK_DESCRIPTION_FIELDS "issst" "a(iayu)" "a(iayuayuu)" "a(iay)" "a(ayayu)"
+#define LINK_DESCRIPTION_SIGNATURE "(" LINK_DESCRIPTION_FIELDS ")"
+
 int link_node_enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error);
 int link_object_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error);
 int link_send_changed(Link *link, const char *property, ...) _sentinel_;
+int link_flush_changed(Link *link);
+int link_append_description(Link *link, sd_bus_message *reply);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(Link*, link_unref);
 #define _cleanup_link_unref_ _cleanup_(link_unrefp)
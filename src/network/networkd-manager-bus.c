@@ -21,19 +21,216 @@
 #include "alloc-util.h"
 #include "bus-util.h"
 #include "networkd-manager.h"
+#include "strv.h"
 
 static BUS_DEFINE_PROPERTY_GET_ENUM(property_get_operational_state, link_operstate, LinkOperationalState);
 
+static int method_get_event_source_statistics(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_free_ sd_event_source_stats *stats = NULL;
+        _cleanup_strv_free_ char **keys = NULL;
+        Manager *m = userdata;
+        int n, i, r;
+
+        assert(message);
+        assert(m);
+
+        n = sd_event_get_stats(m->event, &keys, &stats);
+        if (n < 0)
+                return n;
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sttttt)");
+        if (r < 0)
+                return r;
+
+        for (i = 0; i < n; i++) {
+                r = sd_bus_message_append(reply, "(sttttt)",
+                                          keys[i],
+                                          stats[i].n_dispatch,
+                                          stats[i].run_usec,
+                                          stats[i].run_max_usec,
+                                          stats[i].late_usec,
+                                          stats[i].late_max_usec);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
+static int method_describe_links(sd_bus_message *message, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        Manager *m = userdata;
+        uint64_t since;
+        Link *link;
+        Iterator i;
+        int r;
+
+        assert(message);
+        assert(m);
+
+        /* Only links that changed after the passed generation are described, 0 describes all of them.
+         * The indexes of all current links are always returned, to let clients notice removed ones. */
+        r = sd_bus_message_read(message, "t", &since);
+        if (r < 0)
+                return r;
+
+        if (since > m->link_generation)
+                return sd_bus_error_setf(error, SD_BUS_ERROR_INVALID_ARGS, "Generation %" PRIu64 " is in the future.", since);
+
+        r = sd_bus_message_new_method_return(message, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "t", m->link_generation);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', LINK_DESCRIPTION_SIGNATURE);
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(link, m->links, i) {
+                if (link->state == LINK_STATE_LINGER || link->generation <= since)
+                        continue;
+
+                r = link_append_description(link, reply);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "i");
+        if (r < 0)
+                return r;
+
+        HASHMAP_FOREACH(link, m->links, i) {
+                if (link->state == LINK_STATE_LINGER)
+                        continue;
+
+                r = sd_bus_message_append(reply, "i", link->ifindex);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(NULL, reply, NULL);
+}
+
 const sd_bus_vtable manager_vtable[] = {
         SD_BUS_VTABLE_START(0),
 
         SD_BUS_PROPERTY("OperationalState", "s", property_get_operational_state, offsetof(Manager, operational_state), SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
 
+        SD_BUS_METHOD("GetEventSourceStatistics", NULL, "a(sttttt)", method_get_event_source_statistics, SD_BUS_VTABLE_UNPRIVILEGED),
+        SD_BUS_METHOD("DescribeLinks", "t", "ta" LINK_DESCRIPTION_SIGNATURE "ai", method_describe_links, SD_BUS_VTABLE_UNPRIVILEGED),
+
         SD_BUS_VTABLE_END
 };
 
+static int manager_send_changed_handler(sd_event_source *s, void *userdata) {
+        _cleanup_strv_free_ char **l = NULL;
+        Manager *m = userdata;
+        Link *link;
+        int r;
+
+        assert(m);
+
+        while ((link = set_steal_first(m->changed_links))) {
+                r = link_flush_changed(link);
+                if (r < 0)
+                        log_link_warning_errno(link, r, "Could not emit changed properties: %m");
+
+                link_unref(link);
+        }
+
+        l = m->changed_properties;
+        m->changed_properties = NULL;
+
+        if (strv_isempty(l) || !m->bus)
+                return 0;
+
+        r = sd_bus_emit_properties_changed_strv(
+                        m->bus,
+                        "/org/freedesktop/network1",
+                        "org.freedesktop.network1.Manager",
+                        l);
+        if (r < 0)
+                log_warning_errno(r, "Could not emit changed properties: %m");
+
+        return 0;
+}
+
+static int manager_send_changed_time_handler(sd_event_source *s, uint64_t usec, void *userdata) {
+        return manager_send_changed_handler(s, userdata);
+}
+
+int manager_schedule_send_changed(Manager *m) {
+        usec_t usec = 0;
+        int r, enabled;
+
+        assert(m);
+
+        if (m->send_changed_delay_usec > 0)
+                usec = usec_add(now(CLOCK_MONOTONIC), m->send_changed_delay_usec);
+
+        if (m->send_changed_event_source) {
+                r = sd_event_source_get_enabled(m->send_changed_event_source, &enabled);
+                if (r < 0)
+                        return r;
+
+                /* Already pending, the signals will go out with the ones queued before */
+                if (enabled != SD_EVENT_OFF)
+                        return 0;
+
+                if (usec > 0) {
+                        r = sd_event_source_set_time(m->send_changed_event_source, usec);
+                        if (r < 0)
+                                return r;
+                }
+
+                return sd_event_source_set_enabled(m->send_changed_event_source, SD_EVENT_ONESHOT);
+        }
+
+        /* Whether signals are delayed at all is decided here, once: the configuration is loaded before
+         * links are enumerated and the first signal is queued */
+        if (usec > 0)
+                r = sd_event_add_time(m->event, &m->send_changed_event_source, CLOCK_MONOTONIC, usec, 0,
+                                      manager_send_changed_time_handler, m);
+        else
+                r = sd_event_add_defer(m->event, &m->send_changed_event_source,
+                                       manager_send_changed_handler, m);
+        if (r < 0)
+                return r;
+
+        /* Let everything else pending in this iteration run first, so that it can add to the signals */
+        r = sd_event_source_set_priority(m->send_changed_event_source, SD_EVENT_PRIORITY_IDLE);
+        if (r < 0)
+                return r;
+
+        (void) sd_event_source_set_description(m->send_changed_event_source, "networkd-send-changed");
+
+        return sd_event_source_set_enabled(m->send_changed_event_source, SD_EVENT_ONESHOT);
+}
+
+/* Only records the properties, they are sent in one merged signal by manager_send_changed_handler() */
 int manager_send_changed(Manager *manager, const char *property, ...) {
         char **l;
+        int r;
 
         assert(manager);
 
@@ -42,9 +239,9 @@ int manager_send_changed(Manager *manager, const char *property, ...) {
 
         l = strv_from_stdarg_alloca(property);
 
-        return sd_bus_emit_properties_changed_strv(
-                        manager->bus,
-                        "/org/freedesktop/network1",
-                        "org.freedesktop.network1.Manager",
-                        l);
+        r = strv_extend_strv(&manager->changed_properties, l, true);
+        if (r < 0)
+                return r;
+
+        return manager_schedule_send_changed(manager);
 }
@@ -18,6 +18,7 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
  ***/
 
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <linux/if.h>
 #include <linux/fib_rules.h>
@@ -40,6 +41,7 @@
 #include "ordered-set.h"
 #include "path-util.h"
 #include "set.h"
+#include "strv.h"
 #include "udev-util.h"
 #include "virt.h"
 
@@ -1056,6 +1058,7 @@ static int manager_connect_genl(Manager *m)
 
 static int manager_connect_rtnl(Manager *m)
 {
+        const char *e;
         int fd, r;
 
         assert(m);
@@ -1068,6 +1071,27 @@ static int manager_connect_rtnl(Manager *m)
         if (r < 0)
                 return r;
 
+        /* Capture the traffic for test-network-replay */
+        e = secure_getenv("SYSTEMD_NETWORK_RTNL_RECORD");
+        if (e)
+        {
+                fd = open(e, O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC|O_NOCTTY, 0600);
+                if (fd < 0)
+                        log_warning_errno(errno, "Failed to open %s, not recording rtnl traffic: %m", e);
+                else
+                        (void) rtnl_set_recording(m->rtnl, fd);
+        }
+
+        return manager_setup_rtnl(m);
+}
+
+int manager_setup_rtnl(Manager *m)
+{
+        int r;
+
+        assert(m);
+        assert(m->rtnl);
+
         r = sd_netlink_inc_rcvbuf(m->rtnl, RCVBUF_SIZE);
         if (r < 0)
                 return r;
@@ -1399,6 +1423,13 @@ static int manager_dirty_handler(sd_event_source *s, void *userdata)
                         link_clean(link);
         }
 
+        SET_FOREACH(link, m->dirty_lldp_links, i)
+        {
+                r = link_lldp_save(link);
+                if (r >= 0)
+                        link_lldp_clean(link);
+        }
+
         return 1;
 }
 
@@ -1442,6 +1473,7 @@ static int dhcp6_route_add_callback(sd_netlink *nl, sd_netlink_message *m,
 
 int manager_dhcp6_prefix_add(Manager *m, struct in6_addr *addr, Link *link)
 {
+        _cleanup_free_ struct in6_addr *a = NULL;
         int r;
         Route *route;
 
@@ -1458,7 +1490,17 @@ int manager_dhcp6_prefix_add(Manager *m, struct in6_addr *addr, Link *link)
         if (r < 0)
                 return r;
 
-        return hashmap_put(m->dhcp6_prefixes, addr, link);
+        /* The prefix stays with the link across lease renewals, hence keep our own copy of the key */
+        a = newdup(struct in6_addr, addr, 1);
+        if (!a)
+                return -ENOMEM;
+
+        r = hashmap_put(m->dhcp6_prefixes, a, link);
+        if (r <= 0)
+                return r;
+
+        a = NULL;
+        return 0;
 }
 
 static int dhcp6_route_remove_callback(sd_netlink *nl, sd_netlink_message *m,
@@ -1492,6 +1534,7 @@ static int dhcp6_route_remove_callback(sd_netlink *nl, sd_netlink_message *m,
 
 int manager_dhcp6_prefix_remove(Manager *m, struct in6_addr *addr)
 {
+        _cleanup_free_ struct in6_addr *a = NULL;
         Link *l;
         int r;
         Route *route;
@@ -1500,12 +1543,12 @@ int manager_dhcp6_prefix_remove(Manager *m, struct in6_addr *addr)
         assert_return(m->dhcp6_prefixes, -ENODATA);
         assert_return(addr, -EINVAL);
 
-        l = hashmap_remove(m->dhcp6_prefixes, addr);
+        l = hashmap_remove2(m->dhcp6_prefixes, addr, (void **)&a);
         if (!l)
                 return -EINVAL;
 
-        (void)sd_radv_remove_prefix(l->radv, addr, 64);
-        r = route_get(l, AF_INET6, (union in_addr_union *)addr, 64,
+        sd_radv_prefix_unref(sd_radv_remove_prefix(l->radv, a, 64));
+        r = route_get(l, AF_INET6, (union in_addr_union *)a, 64,
                       0, 0, 0, &route);
         if (r >= 0)
                 (void)route_remove(route, l, dhcp6_route_remove_callback);
@@ -1513,6 +1556,48 @@ int manager_dhcp6_prefix_remove(Manager *m, struct in6_addr *addr)
         return 0;
 }
 
+int manager_dhcp6_pd_link_add(Manager *m, Link *link)
+{
+        int r;
+
+        assert_return(m, -EINVAL);
+        assert_return(link, -EINVAL);
+
+        r = set_ensure_allocated(&m->dhcp6_pd_links, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_put(m->dhcp6_pd_links, link);
+        if (r < 0)
+                return r;
+
+        return 0;
+}
+
+void manager_dhcp6_pd_link_remove(Manager *m, Link *link)
+{
+        struct in6_addr *addr;
+        Iterator i;
+        Link *l;
+
+        assert(m);
+        assert(link);
+
+        if (!set_remove(m->dhcp6_pd_links, link))
+                return;
+
+        /* The link is going away, and its routes and Router Advertisements with it. Only make its
+         * subnets available to the other links. */
+        HASHMAP_FOREACH_KEY(l, addr, m->dhcp6_prefixes, i)
+        {
+                if (l != link)
+                        continue;
+
+                hashmap_remove(m->dhcp6_prefixes, addr);
+                free(addr);
+        }
+}
+
 int manager_dhcp6_prefix_remove_all(Manager *m, Link *link)
 {
         Iterator i;
@@ -1546,7 +1631,7 @@ static int dhcp6_prefixes_compare_func(const void *_a, const void *_b)
 {
         const struct in6_addr *a = _a, *b = _b;
 
-        return memcmp(&a, &b, sizeof(*a));
+        return memcmp(a, b, sizeof(*a));
 }
 
 static const struct hash_ops dhcp6_prefixes_hash_ops = {
@@ -1585,6 +1670,33 @@ int manager_new(Manager **ret, sd_event *event)
         if (r < 0)
                 return r;
 
+        /* All links receive LLDP frames through a single packet socket */
+        r = sd_lldp_receiver_new(&m->lldp_receiver);
+        if (r < 0)
+                return r;
+
+        r = sd_lldp_receiver_attach_event(m->lldp_receiver, m->event, 0);
+        if (r < 0)
+                return r;
+
+        /* Likewise, Router Solicitations and Advertisements go through a single ICMPv6 socket */
+        r = sd_icmp6_mux_new(&m->icmp6_mux);
+        if (r < 0)
+                return r;
+
+        r = sd_icmp6_mux_attach_event(m->icmp6_mux, m->event, 0);
+        if (r < 0)
+                return r;
+
+        /* And IPv4 link-local address conflict detection through a single ARP socket */
+        r = sd_ipv4acd_mux_new(&m->ipv4acd_mux);
+        if (r < 0)
+                return r;
+
+        r = sd_ipv4acd_mux_attach_event(m->ipv4acd_mux, m->event, 0);
+        if (r < 0)
+                return r;
+
         m->netdevs = hashmap_new(&string_hash_ops);
         if (!m->netdevs)
                 return -ENOMEM;
@@ -1623,6 +1735,7 @@ void manager_free(Manager *m)
         NetDev *netdev;
         Link *link;
         AddressPool *pool;
+        struct in6_addr *addr;
 
         if (!m)
                 return;
@@ -1632,9 +1745,20 @@ void manager_free(Manager *m)
         while ((network = m->networks))
                 network_free(network);
 
-        while ((link = hashmap_first(m->dhcp6_prefixes)))
+        while ((addr = hashmap_steal_first_key(m->dhcp6_prefixes)))
+                free(addr);
+        m->dhcp6_prefixes = hashmap_free(m->dhcp6_prefixes);
+        m->dhcp6_pd_links = set_free(m->dhcp6_pd_links);
+
+        while ((link = set_first(m->dirty_lldp_links)))
+                link_lldp_clean(link);
+        set_free(m->dirty_lldp_links);
+
+        while ((link = set_steal_first(m->changed_links)))
                 link_unref(link);
-        hashmap_free(m->dhcp6_prefixes);
+        set_free(m->changed_links);
+        strv_free(m->changed_properties);
+        sd_event_source_unref(m->send_changed_event_source);
 
         while ((link = hashmap_first(m->links)))
                 link_unref(link);
@@ -1654,6 +1778,10 @@ void manager_free(Manager *m)
 
         set_free_with_destructor(m->rules_saved, routing_policy_rule_free);
 
+        sd_lldp_receiver_unref(m->lldp_receiver);
+        sd_icmp6_mux_unref(m->icmp6_mux);
+        sd_ipv4acd_mux_unref(m->ipv4acd_mux);
+
         sd_netlink_unref(m->rtnl);
         sd_event_unref(m->event);
 
@@ -1934,6 +2062,41 @@ Link *manager_find_uplink(Manager *m, Link *exclude)
         return NULL;
 }
 
+int manager_log_event_stats(Manager *m)
+{
+        _cleanup_free_ sd_event_source_stats *stats = NULL;
+        _cleanup_strv_free_ char **keys = NULL;
+        uint64_t wakeups, saved;
+        int n, i;
+
+        assert(m);
+
+        if (sd_event_get_timer_wakeups(m->event, &wakeups, &saved) >= 0)
+                log_info("Timer wakeups: %" PRIu64 ", saved by coalescing: %" PRIu64, wakeups, saved);
+
+        if (sd_event_get_profile(m->event) <= 0)
+                log_info("Event source profiling is disabled, set SD_EVENT_PROFILE_SOURCES=1 to enable it.");
+
+        n = sd_event_get_stats(m->event, &keys, &stats);
+        if (n < 0)
+                return log_warning_errno(n, "Failed to get event source statistics: %m");
+
+        for (i = 0; i < n; i++)
+        {
+                char run[FORMAT_TIMESPAN_MAX], run_max[FORMAT_TIMESPAN_MAX], late_max[FORMAT_TIMESPAN_MAX];
+
+                log_info("Event source %s: dispatched %" PRIu64 " times, ran for %s (max %s), late by at most %s",
+                         keys[i], stats[i].n_dispatch,
+                         format_timespan(run, sizeof(run), stats[i].run_usec, 1),
+                         format_timespan(run_max, sizeof(run_max), stats[i].run_max_usec, 1),
+                         format_timespan(late_max, sizeof(late_max), stats[i].late_max_usec, 1));
+        }
+
+        netdev_log_create_stats(m);
+
+        return 0;
+}
+
 void manager_dirty(Manager *manager)
 {
         assert(manager);
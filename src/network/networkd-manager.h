@@ -51,19 +51,39 @@ struct Manager {
         struct udev *udev;
         struct udev_monitor *udev_monitor;
         sd_event_source *udev_event_source;
+        sd_lldp_receiver *lldp_receiver;
+        sd_icmp6_mux *icmp6_mux;
+        sd_ipv4acd_mux *ipv4acd_mux;
 
         bool enumerating:1;
         bool dirty:1;
 
         Set *dirty_links;
+        Set *dirty_lldp_links;
+
+        /* PropertiesChanged signals are merged per object and sent once per event loop iteration, or
+         * after the configured delay */
+        Set *changed_links;
+        char **changed_properties;
+        sd_event_source *send_changed_event_source;
+        usec_t send_changed_delay_usec;
 
         char *state_file;
         LinkOperationalState operational_state;
 
         Hashmap *links;
+        /* Bumped whenever anything exposed by DescribeLinks() changes on any link */
+        uint64_t link_generation;
         Hashmap *netdevs;
         Hashmap *networks_by_name;
+        LIST_HEAD(NetDev, netdev_create_queue);
+        NetDev *netdev_create_queue_tail;
+        unsigned n_netdev_creating;
+        NetDevCreateStats netdev_create_stats[_NETDEV_KIND_MAX];
+        /* Delegated /64 → Link, kept across lease renewals */
         Hashmap *dhcp6_prefixes;
+        /* Links sub-delegating prefixes acquired via DHCPv6 in their Router Advertisements */
+        Set *dhcp6_pd_links;
         LIST_HEAD(Network, networks);
         LIST_HEAD(AddressPool, address_pools);
 
@@ -96,6 +116,7 @@ int manager_start(Manager *m);
 int manager_load_config(Manager *m);
 bool manager_should_reload(Manager *m);
 
+int manager_setup_rtnl(Manager *m);
 int manager_rtnl_enumerate_links(Manager *m);
 int manager_rtnl_enumerate_addresses(Manager *m);
 int manager_rtnl_enumerate_routes(Manager *m);
@@ -106,8 +127,11 @@ int manager_rtnl_process_route(sd_netlink *nl, sd_netlink_message *message, void
 int manager_rtnl_process_rule(sd_netlink *nl, sd_netlink_message *message, void *userdata);
 
 int manager_send_changed(Manager *m, const char *property, ...) _sentinel_;
+int manager_schedule_send_changed(Manager *m);
 void manager_dirty(Manager *m);
 
+int manager_log_event_stats(Manager *m);
+
 int manager_address_pool_acquire(Manager *m, int family, unsigned prefixlen, union in_addr_union *found);
 
 Link* manager_find_uplink(Manager *m, Link *exclude);
@@ -119,6 +143,8 @@ Link *manager_dhcp6_prefix_get(Manager *m, struct in6_addr *addr);
 int manager_dhcp6_prefix_add(Manager *m, struct in6_addr *addr, Link *link);
 int manager_dhcp6_prefix_remove(Manager *m, struct in6_addr *addr);
 int manager_dhcp6_prefix_remove_all(Manager *m, Link *link);
+int manager_dhcp6_pd_link_add(Manager *m, Link *link);
+void manager_dhcp6_pd_link_remove(Manager *m, Link *link);
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(Manager*, manager_free);
 #define _cleanup_manager_free_ _cleanup_(manager_freep)
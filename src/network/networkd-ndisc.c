@@ -23,6 +23,7 @@
 
 #include "sd-ndisc.h"
 
+#include "networkd-manager.h"
 #include "networkd-ndisc.h"
 #include "networkd-route.h"
 
@@ -703,6 +704,10 @@ int ndisc_configure(Link *link) {
         if (r < 0)
                 return r;
 
+        r = sd_ndisc_set_mux(link->ndisc, link->manager->icmp6_mux);
+        if (r < 0)
+                return r;
+
         r = sd_ndisc_set_callback(link->ndisc, ndisc_handler, link);
         if (r < 0)
                 return r;
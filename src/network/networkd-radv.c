@@ -478,6 +478,10 @@ int radv_configure(Link *link) {
         if (r < 0)
                 return r;
 
+        r = sd_radv_set_mux(link->radv, link->manager->icmp6_mux);
+        if (r < 0)
+                return r;
+
         r = sd_radv_set_managed_information(link->radv, link->network->router_managed);
         if (r < 0)
                 return r;
@@ -152,6 +152,7 @@ void route_free(Route *route) {
         if (route->link) {
                 set_remove(route->link->routes, route);
                 set_remove(route->link->routes_foreign, route);
+                link_bump_generation(route->link);
         }
 
         sd_event_source_unref(route->expire);
@@ -305,6 +306,7 @@ static int route_add_internal(
                 return r;
 
         route->link = link;
+        link_bump_generation(link);
 
         if (ret)
                 *ret = route;
@@ -390,6 +392,9 @@ void route_update(Route *route,
         route->scope = scope;
         route->protocol = protocol;
         route->type = type;
+
+        if (route->link)
+                link_bump_generation(route->link);
 }
 
 int route_remove(Route *route, Link *link,
@@ -27,6 +27,17 @@
 #include "signal-util.h"
 #include "user-util.h"
 
+static int on_sigusr2(sd_event_source *s, const struct signalfd_siginfo *si, void *userdata)
+{
+    Manager *m = userdata;
+
+    assert(m);
+
+    (void)manager_log_event_stats(m);
+
+    return 0;
+}
+
 // NOTE(ywen): Add this new main so I can find the main function quickly (as
 // there are many other main functions in this repo).
 int systemd_networkd_main(int argc, char *argv[])
@@ -93,7 +104,7 @@ int systemd_networkd_main(int argc, char *argv[])
     if (r < 0)
         log_warning_errno(r, "Could not create runtime directory 'lldp': %m");
 
-    assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGTERM, SIGINT, -1) >= 0);
+    assert_se(sigprocmask_many(SIG_BLOCK, NULL, SIGTERM, SIGINT, SIGUSR2, -1) >= 0);
 
     r = sd_event_default(&event);
     if (r < 0)
@@ -110,6 +121,14 @@ int systemd_networkd_main(int argc, char *argv[])
         goto out;
     }
 
+    /* Dump the per event source accounting on SIGUSR2 */
+    r = sd_event_add_signal(event, NULL, SIGUSR2, on_sigusr2, m);
+    if (r < 0)
+    {
+        log_error_errno(r, "Could not install SIGUSR2 handler: %m");
+        goto out;
+    }
+
     r = manager_connect_bus(m);
     if (r < 0)
     {
@@ -0,0 +1,319 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Feeds rtnl traffic recorded by systemd-networkd (run it with $SYSTEMD_NETWORK_RTNL_RECORD set to a file
+ * name) into a Manager, without touching the kernel and hence without privileges. The Manager talks to a
+ * fake kernel over an AF_UNIX socket pair, which acknowledges all requests without acting on them. Every
+ * notification, and every message of the dumps networkd requested while recording, is replayed as a
+ * notification of its own, and the time until the Manager is idle again is accounted to its type.
+ *
+ * Without arguments, test/test-network-replay/startup.rtnl is replayed, and the links and addresses the
+ * Manager ends up with are checked. It was recorded in a new network namespace, which had lo and a bridge
+ * br0 with 192.0.2.1/24, while a veth pair ve0/ve1 was created, ve0 was added to br0, 198.51.100.1/24 was
+ * added to ve1, and the pair was removed again. */
+
+#include <linux/rtnetlink.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "in-addr-util.h"
+#include "io-util.h"
+#include "log.h"
+#include "netlink-util.h"
+#include "networkd-manager.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "udev-util.h"
+
+static const char* const message_type_table[] = {
+        [RTM_NEWLINK]  = "RTM_NEWLINK",
+        [RTM_DELLINK]  = "RTM_DELLINK",
+        [RTM_NEWADDR]  = "RTM_NEWADDR",
+        [RTM_DELADDR]  = "RTM_DELADDR",
+        [RTM_NEWROUTE] = "RTM_NEWROUTE",
+        [RTM_DELROUTE] = "RTM_DELROUTE",
+        [RTM_NEWRULE]  = "RTM_NEWRULE",
+        [RTM_DELRULE]  = "RTM_DELRULE",
+};
+
+static ReplayStats stats[ELEMENTSOF(message_type_table)];
+static unsigned n_requests;
+
+static bool message_type_is_get(uint16_t type) {
+        /* Each family of rtnl messages comes as RTM_NEWxxx, RTM_DELxxx, RTM_GETxxx (and RTM_SETxxx) */
+        return type >= RTM_BASE && (type - RTM_BASE) % 4 == 2;
+}
+
+static void kernel_reply(int fd, const struct nlmsghdr *request, uint16_t type, uint16_t flags,
+                         const void *payload, size_t size) {
+        uint32_t group = 0;
+        struct nlmsghdr hdr = {
+                .nlmsg_len = NLMSG_LENGTH(size),
+                .nlmsg_type = type,
+                .nlmsg_flags = flags,
+                .nlmsg_seq = request->nlmsg_seq,
+                .nlmsg_pid = request->nlmsg_pid,
+        };
+        struct iovec iov[] = {
+                IOVEC_INIT(&group, sizeof(group)),
+                IOVEC_INIT(&hdr, NLMSG_HDRLEN),
+                IOVEC_INIT((void*) payload, size),
+        };
+        struct msghdr msg = {
+                .msg_iov = iov,
+                .msg_iovlen = ELEMENTSOF(iov),
+        };
+
+        assert_se(sendmsg(fd, &msg, 0) == (ssize_t) (sizeof(group) + NLMSG_LENGTH(size)));
+}
+
+static int on_kernel_request(sd_event_source *s, int fd, uint32_t revents, void *userdata) {
+        static uint8_t buf[64 * 1024];
+        struct nlmsghdr *hdr;
+        ssize_t n;
+
+        for (;;) {
+                size_t len;
+
+                n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+                if (n < 0) {
+                        assert_se(IN_SET(errno, EAGAIN, EINTR));
+                        return 0;
+                }
+
+                len = (size_t) n;
+                for (hdr = (struct nlmsghdr*) buf; NLMSG_OK(hdr, len); hdr = NLMSG_NEXT(hdr, len)) {
+                        n_requests++;
+
+                        if ((hdr->nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP) {
+                                int32_t done = 0;
+
+                                kernel_reply(fd, hdr, NLMSG_DONE, NLM_F_MULTI, &done, sizeof(done));
+                        } else {
+                                /* No state is kept, so there is nothing to answer queries with */
+                                struct nlmsgerr err = {
+                                        .error = message_type_is_get(hdr->nlmsg_type) ? -EOPNOTSUPP : 0,
+                                        .msg = *hdr,
+                                };
+
+                                kernel_reply(fd, hdr, NLMSG_ERROR, 0, &err, sizeof(err));
+                        }
+                }
+        }
+}
+
+static int read_record(FILE *f, usec_t *timestamp, uint32_t *group, void **buf, size_t *size, size_t *allocated) {
+        RtnlRecord record;
+
+        if (fread(&record, sizeof(record), 1, f) != 1)
+                return ferror(f) ? -EIO : 0;
+
+        *timestamp = le64toh(record.timestamp);
+        *group = le32toh(record.group);
+        *size = le32toh(record.size);
+
+        if (!greedy_realloc(buf, allocated, *size, 1))
+                return -ENOMEM;
+
+        if (*size > 0 && fread(*buf, *size, 1, f) != 1)
+                return ferror(f) ? -EIO : 0;
+
+        return 1;
+}
+
+static void replay_message(sd_event *e, int fd, uint32_t group, struct nlmsghdr *hdr) {
+        struct iovec iov[] = {
+                IOVEC_INIT(&group, sizeof(group)),
+                IOVEC_INIT(hdr, hdr->nlmsg_len),
+        };
+        struct msghdr msg = {
+                .msg_iov = iov,
+                .msg_iovlen = ELEMENTSOF(iov),
+        };
+        usec_t t;
+        int r;
+
+        /* Turn replies to the requests networkd made while recording into notifications */
+        hdr->nlmsg_seq = 0;
+        hdr->nlmsg_pid = 0;
+        hdr->nlmsg_flags &= ~NLM_F_MULTI;
+
+        t = now(CLOCK_MONOTONIC);
+
+        assert_se(sendmsg(fd, &msg, 0) == (ssize_t) (sizeof(group) + hdr->nlmsg_len));
+
+        while ((r = sd_event_run(e, 0)) > 0)
+                ;
+        assert_se(r >= 0);
+
+        replay_stats_add(stats + hdr->nlmsg_type, now(CLOCK_MONOTONIC) - t);
+}
+
+static int replay_file(sd_event *e, int fd, const char *path, bool realtime) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ void *buf = NULL;
+        size_t allocated = 0, size;
+        usec_t first = USEC_INFINITY, start, timestamp;
+        uint32_t group;
+        int r;
+
+        f = fopen(path, "re");
+        if (!f)
+                return log_error_errno(errno, "Failed to open %s: %m", path);
+
+        start = now(CLOCK_MONOTONIC);
+
+        while ((r = read_record(f, &timestamp, &group, &buf, &size, &allocated)) > 0) {
+                struct nlmsghdr *hdr;
+                size_t len = size;
+
+                if (realtime) {
+                        usec_t n;
+
+                        if (first == USEC_INFINITY)
+                                first = timestamp;
+
+                        n = now(CLOCK_MONOTONIC);
+                        if (start + timestamp - first > n)
+                                (void) usleep(start + timestamp - first - n);
+                }
+
+                /* The kernel sends notifications one by one, but dumps come in batches */
+                for (hdr = buf; NLMSG_OK(hdr, len); hdr = NLMSG_NEXT(hdr, len)) {
+                        if (hdr->nlmsg_type >= ELEMENTSOF(message_type_table) ||
+                            !message_type_table[hdr->nlmsg_type])
+                                continue;
+
+                        replay_message(e, fd, group ?: RTNLGRP_LINK, hdr);
+                }
+        }
+        if (r < 0)
+                return log_error_errno(r, "Failed to read %s: %m", path);
+
+        return 0;
+}
+
+static void check_address(Link *link, int family, const char *address, unsigned char prefixlen) {
+        union in_addr_union u;
+
+        assert_se(in_addr_from_string(family, address, &u) >= 0);
+        assert_se(address_get(link, family, &u, prefixlen, NULL) >= 0);
+}
+
+static void check_startup(Manager *m, unsigned n_messages) {
+        Link *link;
+
+        /* 2 links, 3 addresses and 7 routes were dumped, and then 16 notifications about the veth pair and
+         * br0 followed */
+        assert_se(n_messages == 25);
+
+        assert_se(link_get(m, 1, &link) >= 0);
+        assert_se(streq(link->ifname, "lo"));
+        check_address(link, AF_INET, "127.0.0.1", 8);
+        check_address(link, AF_INET6, "::1", 128);
+
+        assert_se(link_get(m, 2, &link) >= 0);
+        assert_se(streq(link->ifname, "br0"));
+        check_address(link, AF_INET, "192.0.2.1", 24);
+
+        /* ve1 and ve0 */
+        assert_se(link_get(m, 3, &link) == -ENODEV);
+        assert_se(link_get(m, 4, &link) == -ENODEV);
+}
+
+static usec_t cpu_usage(void) {
+        struct rusage ru;
+
+        assert_se(getrusage(RUSAGE_SELF, &ru) >= 0);
+
+        return timeval_load(&ru.ru_utime) + timeval_load(&ru.ru_stime);
+}
+
+static unsigned print_stats(usec_t wall, usec_t cpu) {
+        struct rusage ru;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        unsigned n;
+
+        assert_se(getrusage(RUSAGE_SELF, &ru) >= 0);
+
+        n = replay_stats_print("MESSAGE", message_type_table, stats, ELEMENTSOF(stats));
+
+        printf("\n%u messages replayed, %u requests answered in %s, CPU %s, peak RSS %li KiB\n",
+               n, n_requests,
+               format_timespan(a, sizeof(a), wall, 1),
+               format_timespan(b, sizeof(b), cpu, 1),
+               ru.ru_maxrss);
+
+        return n;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_manager_free_ Manager *m = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        const char *recording;
+        usec_t start, cpu;
+        unsigned n;
+
+        /* networkd complains loudly about not being able to write its state files, and formatting those
+         * messages would distort the measurements */
+        test_setup_logging(LOG_CRIT);
+
+        if (argc > 3 || (argc == 3 && !streq(argv[2], "--realtime"))) {
+                log_error("Usage: %s [RECORDING [--realtime]]", program_invocation_short_name);
+                return EXIT_FAILURE;
+        }
+
+        recording = argc >= 2 ? argv[1] : get_testdata_dir("/test-network-replay/startup.rtnl");
+
+        assert_se(sd_event_default(&e) >= 0);
+        assert_se(manager_new(&m, e) >= 0);
+
+        /* Take the place of the kernel, and of udev: links are considered initialized right away, like in
+         * containers */
+        m->udev_event_source = sd_event_source_unref(m->udev_event_source);
+        m->udev_monitor = udev_monitor_unref(m->udev_monitor);
+        m->udev = udev_unref(m->udev);
+
+        m->rtnl = sd_netlink_unref(m->rtnl);
+        assert_se(socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, pair) >= 0);
+        assert_se(rtnl_open_fake(&m->rtnl, pair[0]) >= 0);
+        pair[0] = -1;
+        assert_se(manager_setup_rtnl(m) >= 0);
+
+        assert_se(sd_event_add_io(e, NULL, pair[1], EPOLLIN, on_kernel_request, NULL) >= 0);
+
+        start = now(CLOCK_MONOTONIC);
+        cpu = cpu_usage();
+
+        if (replay_file(e, pair[1], recording, argc == 3) < 0)
+                return EXIT_FAILURE;
+
+        n = print_stats(now(CLOCK_MONOTONIC) - start, cpu_usage() - cpu);
+
+        if (argc == 1)
+                check_startup(m, n);
+
+        return EXIT_SUCCESS;
+}
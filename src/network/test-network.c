@@ -19,13 +19,20 @@
 ***/
 
 #include <sys/param.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+#include "sd-id128.h"
 
 #include "alloc-util.h"
 #include "dhcp-lease-internal.h"
+#include "fd-util.h"
 #include "hostname-util.h"
 #include "network-internal.h"
 #include "networkd-manager.h"
 #include "string-util.h"
+#include "strv.h"
+#include "time-util.h"
 #include "udev-util.h"
 
 static void test_deserialize_in_addr(void) {
@@ -145,6 +152,173 @@ static void test_network_get(Manager *manager, struct udev_device *loopback) {
         assert_se(!network);
 }
 
+static void test_link_generation(Manager *manager) {
+        Link *link;
+        uint64_t generation;
+
+        assert_se(link_get(manager, 1, &link) >= 0);
+        generation = link->generation;
+
+        /* Transitions like these do not mark the link dirty, but must still be visible to DescribeLinks() */
+        link_set_state(link, LINK_STATE_SETTING_ADDRESSES);
+        assert_se(link->generation > generation);
+        assert_se(link->generation == manager->link_generation);
+
+        generation = link->generation;
+        link_set_state(link, LINK_STATE_SETTING_ROUTES);
+        assert_se(link->generation > generation);
+
+        /* Setting the same state again is not a change */
+        generation = link->generation;
+        link_set_state(link, LINK_STATE_SETTING_ROUTES);
+        assert_se(link->generation == generation);
+}
+
+typedef struct ChangedSignals {
+        unsigned n_manager;
+        unsigned n_link;
+        char **manager_properties;
+        char **link_properties;
+} ChangedSignals;
+
+static int on_properties_changed(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        ChangedSignals *c = userdata;
+        const char *interface, *path;
+        char ***properties;
+        int r;
+
+        if (!sd_bus_message_is_signal(m, "org.freedesktop.DBus.Properties", "PropertiesChanged"))
+                return 0;
+
+        path = sd_bus_message_get_path(m);
+        if (streq(path, "/org/freedesktop/network1")) {
+                c->n_manager++;
+                properties = &c->manager_properties;
+        } else {
+                assert_se(streq(path, "/org/freedesktop/network1/link/_31"));
+                c->n_link++;
+                properties = &c->link_properties;
+        }
+
+        assert_se(sd_bus_message_read(m, "s", &interface) >= 0);
+        assert_se(sd_bus_message_enter_container(m, 'a', "{sv}") >= 0);
+
+        while ((r = sd_bus_message_enter_container(m, 'e', "sv")) > 0) {
+                const char *name;
+
+                assert_se(sd_bus_message_read(m, "s", &name) >= 0);
+                assert_se(sd_bus_message_skip(m, "v") >= 0);
+                assert_se(sd_bus_message_exit_container(m) >= 0);
+
+                assert_se(strv_extend(properties, name) >= 0);
+        }
+        assert_se(r == 0);
+
+        assert_se(sd_bus_message_exit_container(m) >= 0);
+
+        return 0;
+}
+
+static void changed_signals_wait(sd_event *event, ChangedSignals *c, unsigned n) {
+        unsigned i;
+
+        for (i = 0; c->n_manager + c->n_link < n; i++) {
+                assert_se(i < 100);
+                assert_se(sd_event_run(event, 100 * USEC_PER_MSEC) >= 0);
+        }
+
+        /* Give the sending side the chance to emit more than it should have */
+        for (i = 0; i < 5; i++)
+                assert_se(sd_event_run(event, 0) >= 0);
+}
+
+static void changed_signals_reset(ChangedSignals *c) {
+        c->n_manager = c->n_link = 0;
+        c->manager_properties = strv_free(c->manager_properties);
+        c->link_properties = strv_free(c->link_properties);
+}
+
+static void test_send_changed(Manager *manager, sd_event *event) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *server = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        ChangedSignals c = {};
+        int fds[2] = { -1, -1 };
+        usec_t ts;
+        sd_id128_t id;
+        Link *link;
+
+        assert_se(link_get(manager, 1, &link) >= 0);
+
+        /* The Manager talks to the other end of a socket pair instead of the system bus */
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC|SOCK_NONBLOCK, 0, fds) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&server) >= 0);
+        assert_se(sd_bus_set_fd(server, fds[0], fds[0]) >= 0);
+        assert_se(sd_bus_set_server(server, true, id) >= 0);
+        assert_se(sd_bus_set_anonymous(server, true) >= 0);
+        assert_se(sd_bus_add_filter(server, NULL, on_properties_changed, &c) >= 0);
+        assert_se(sd_bus_start(server) >= 0);
+        assert_se(sd_bus_attach_event(server, event, 0) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_set_anonymous(bus, true) >= 0);
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/network1", "org.freedesktop.network1.Manager", manager_vtable, manager) >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, "/org/freedesktop/network1/link", "org.freedesktop.network1.Link", link_vtable, link_object_find, manager) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+        assert_se(sd_bus_attach_event(bus, event, 0) >= 0);
+
+        assert_se(!manager->bus);
+        manager->bus = sd_bus_ref(bus);
+
+        /* Changes queued within one iteration go out as one signal per object, with all the properties */
+        assert_se(manager_send_changed(manager, "OperationalState", NULL) >= 0);
+        assert_se(link_send_changed(link, "OperationalState", NULL) >= 0);
+        assert_se(link_send_changed(link, "AdministrativeState", "OperationalState", NULL) >= 0);
+        assert_se(manager_send_changed(manager, "OperationalState", NULL) >= 0);
+
+        changed_signals_wait(event, &c, 2);
+        assert_se(c.n_manager == 1);
+        assert_se(c.n_link == 1);
+        assert_se(strv_equal(c.manager_properties, STRV_MAKE("OperationalState")));
+        strv_sort(c.link_properties);
+        assert_se(strv_equal(c.link_properties, STRV_MAKE("AdministrativeState", "OperationalState")));
+        assert_se(set_isempty(manager->changed_links));
+
+        /* Later changes are signalled again */
+        changed_signals_reset(&c);
+        assert_se(link_send_changed(link, "AdministrativeState", NULL) >= 0);
+
+        changed_signals_wait(event, &c, 1);
+        assert_se(c.n_manager == 0);
+        assert_se(c.n_link == 1);
+        assert_se(strv_equal(c.link_properties, STRV_MAKE("AdministrativeState")));
+
+        /* With PropertiesChangedDelaySec= the changes are collected for that long. Whether to delay is
+         * decided when the event source is created, hence start over with a new one. */
+        changed_signals_reset(&c);
+        manager->send_changed_event_source = sd_event_source_unref(manager->send_changed_event_source);
+        manager->send_changed_delay_usec = 200 * USEC_PER_MSEC;
+
+        ts = now(CLOCK_MONOTONIC);
+        assert_se(link_send_changed(link, "OperationalState", NULL) >= 0);
+        assert_se(manager_send_changed(manager, "OperationalState", NULL) >= 0);
+
+        assert_se(sd_event_run(event, 0) >= 0);
+        assert_se(link_send_changed(link, "AdministrativeState", NULL) >= 0);
+
+        changed_signals_wait(event, &c, 2);
+        assert_se(now(CLOCK_MONOTONIC) >= ts + manager->send_changed_delay_usec);
+        assert_se(c.n_manager == 1);
+        assert_se(c.n_link == 1);
+        strv_sort(c.link_properties);
+        assert_se(strv_equal(c.link_properties, STRV_MAKE("AdministrativeState", "OperationalState")));
+
+        changed_signals_reset(&c);
+        manager->bus = sd_bus_unref(manager->bus);
+}
+
 static void test_address_equality(void) {
         _cleanup_address_free_ Address *a1 = NULL, *a2 = NULL;
 
@@ -265,4 +439,7 @@ int main(void) {
         test_network_get(manager, loopback);
 
         assert_se(manager_rtnl_enumerate_links(manager) >= 0);
+
+        test_link_generation(manager);
+        test_send_changed(manager, event);
 }
@@ -0,0 +1,646 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Sets up WireGuard netdevs against a fake kernel, which answers WG_CMD_GET_DEVICE with a synthetic dump
+ * and records the WG_CMD_SET_DEVICE requests networkd sends in response. Checks that only the peers that
+ * changed are passed, and that peers which do not fit into one message are continued in the next. */
+
+#include <linux/genetlink.h>
+#include <pthread.h>
+#include <sys/socket.h>
+
+#include "sd-event.h"
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "in-addr-util.h"
+#include "io-util.h"
+#include "log.h"
+#include "netdev/wireguard.h"
+#include "netlink-internal.h"
+#include "netlink-util.h"
+#include "networkd-manager.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "util.h"
+
+#define FAKE_WIREGUARD_FAMILY_ID 0x42
+
+#define MAX_MESSAGES 64
+
+typedef struct FakeKernel {
+        int fd;
+
+        /* what to answer WG_CMD_GET_DEVICE with, an error if dump_error is set */
+        struct nlmsghdr *dump[MAX_MESSAGES];
+        unsigned n_dump;
+        int dump_error;
+
+        /* the WG_CMD_SET_DEVICE requests received */
+        struct nlmsghdr *set[MAX_MESSAGES];
+        unsigned n_set;
+} FakeKernel;
+
+typedef struct PeerUpdate {
+        uint8_t public_key[WG_KEY_LEN];
+        unsigned n_messages;
+        bool has_flags;
+        uint32_t flags;
+        unsigned n_ipmasks;
+} PeerUpdate;
+
+static void kernel_reply(int fd, const struct nlmsghdr *request, uint16_t type, uint16_t flags,
+                         const void *payload, size_t size) {
+        uint32_t group = 0;
+        struct nlmsghdr hdr = {
+                .nlmsg_len = NLMSG_LENGTH(size),
+                .nlmsg_type = type,
+                .nlmsg_flags = flags,
+                .nlmsg_seq = request->nlmsg_seq,
+                .nlmsg_pid = request->nlmsg_pid,
+        };
+        struct iovec iov[] = {
+                IOVEC_INIT(&group, sizeof(group)),
+                IOVEC_INIT(&hdr, NLMSG_HDRLEN),
+                IOVEC_INIT((void*) payload, size),
+        };
+        struct msghdr msg = {
+                .msg_iov = iov,
+                .msg_iovlen = ELEMENTSOF(iov),
+        };
+
+        assert_se(sendmsg(fd, &msg, 0) == (ssize_t) (sizeof(group) + NLMSG_LENGTH(size)));
+}
+
+static void kernel_reply_error(int fd, const struct nlmsghdr *request, int error) {
+        struct nlmsgerr err = {
+                .error = error,
+                .msg = *request,
+        };
+
+        kernel_reply(fd, request, NLMSG_ERROR, 0, &err, sizeof(err));
+}
+
+static void *fake_kernel(void *userdata) {
+        FakeKernel *k = userdata;
+
+        for (;;) {
+                union {
+                        struct nlmsghdr hdr;
+                        uint8_t buf[16384];
+                } request;
+                const struct genlmsghdr *genl;
+                unsigned i;
+                ssize_t n;
+
+                n = recv(k->fd, &request, sizeof(request), 0);
+                if (n <= 0)
+                        /* an empty datagram asks us to stop */
+                        return NULL;
+
+                assert_se(NLMSG_OK(&request.hdr, (size_t) n));
+                genl = NLMSG_DATA(&request.hdr);
+
+                if (request.hdr.nlmsg_type == GENL_ID_CTRL) {
+                        struct {
+                                struct genlmsghdr genl;
+                                struct rtattr rta;
+                                uint16_t id;
+                                uint16_t padding;
+                        } reply = {
+                                .genl.cmd = CTRL_CMD_NEWFAMILY,
+                                .rta.rta_len = RTA_LENGTH(sizeof(uint16_t)),
+                                .rta.rta_type = CTRL_ATTR_FAMILY_ID,
+                                .id = FAKE_WIREGUARD_FAMILY_ID,
+                        };
+
+                        kernel_reply(k->fd, &request.hdr, GENL_ID_CTRL, 0, &reply, sizeof(reply));
+                        continue;
+                }
+
+                assert_se(request.hdr.nlmsg_type == FAKE_WIREGUARD_FAMILY_ID);
+
+                if (genl->cmd == WG_CMD_GET_DEVICE) {
+                        int32_t done = 0;
+
+                        assert_se((request.hdr.nlmsg_flags & NLM_F_DUMP) == NLM_F_DUMP);
+
+                        if (k->dump_error != 0) {
+                                kernel_reply_error(k->fd, &request.hdr, k->dump_error);
+                                continue;
+                        }
+
+                        for (i = 0; i < k->n_dump; i++)
+                                kernel_reply(k->fd, &request.hdr, FAKE_WIREGUARD_FAMILY_ID, NLM_F_MULTI,
+                                             NLMSG_DATA(k->dump[i]), k->dump[i]->nlmsg_len - NLMSG_HDRLEN);
+
+                        kernel_reply(k->fd, &request.hdr, NLMSG_DONE, NLM_F_MULTI, &done, sizeof(done));
+                        continue;
+                }
+
+                assert_se(genl->cmd == WG_CMD_SET_DEVICE);
+                assert_se(k->n_set < MAX_MESSAGES);
+
+                k->set[k->n_set] = memdup(&request.hdr, request.hdr.nlmsg_len);
+                assert_se(k->set[k->n_set]);
+                k->n_set++;
+
+                kernel_reply_error(k->fd, &request.hdr, 0);
+        }
+}
+
+static void fake_kernel_reset(FakeKernel *k) {
+        unsigned i;
+
+        for (i = 0; i < k->n_dump; i++)
+                free(k->dump[i]);
+        for (i = 0; i < k->n_set; i++)
+                free(k->set[i]);
+
+        k->n_dump = k->n_set = 0;
+        k->dump_error = 0;
+}
+
+static void key_set(uint8_t key[static WG_KEY_LEN], unsigned id) {
+        memset(key, 0, WG_KEY_LEN);
+        key[0] = id & 0xff;
+        key[1] = id >> 8;
+}
+
+static NetDev *netdev_wireguard_new(Manager *m) {
+        NetDev *netdev;
+        Wireguard *w;
+
+        netdev = malloc0(wireguard_vtable.object_size);
+        assert_se(netdev);
+
+        netdev->n_ref = 1;
+        netdev->manager = m;
+        netdev->kind = NETDEV_KIND_WIREGUARD;
+        netdev->state = NETDEV_STATE_READY;
+        netdev->ifname = strdup("wg-test");
+        assert_se(netdev->ifname);
+
+        w = WIREGUARD(netdev);
+        memset(w->private_key, 0xff, WG_KEY_LEN);
+        w->port = 51820;
+
+        return netdev;
+}
+
+static WireguardPeer *peer_add(Wireguard *w, unsigned id, uint16_t persistent_keepalive_interval) {
+        WireguardPeer *peer;
+
+        peer = new0(WireguardPeer, 1);
+        assert_se(peer);
+
+        key_set(peer->public_key, id);
+        peer->persistent_keepalive_interval = persistent_keepalive_interval;
+        peer->flags = WGPEER_F_REPLACE_ALLOWEDIPS;
+
+        LIST_PREPEND(peers, w->peers, peer);
+
+        return peer;
+}
+
+static void peer_add_ipmask(WireguardPeer *peer, const char *prefix) {
+        WireguardIPmask *mask;
+        int family;
+
+        mask = new0(WireguardIPmask, 1);
+        assert_se(mask);
+
+        assert_se(in_addr_prefix_from_string_auto(prefix, &family, &mask->ip, &mask->cidr) >= 0);
+        mask->family = family;
+
+        LIST_PREPEND(ipmasks, peer->ipmasks, mask);
+}
+
+/* Runs the netdev through what networkd does once the kernel created it, until all requests were answered */
+static void netdev_wireguard_setup(NetDev *netdev) {
+        unsigned i;
+
+        assert_se(wireguard_vtable.config_verify(netdev, "test") >= 0);
+        assert_se(wireguard_vtable.post_create(netdev, NULL, NULL) >= 0);
+
+        for (i = 0; netdev->n_ref > 1; i++) {
+                assert_se(i < 100);
+                assert_se(sd_event_run(netdev->manager->event, USEC_PER_SEC) >= 0);
+        }
+}
+
+static void netdev_wireguard_free(NetDev *netdev) {
+        /* The Manager is a stub, which netdev_free() must not look at */
+        netdev->manager = NULL;
+        netdev_unref(netdev);
+}
+
+typedef struct DumpPeer {
+        unsigned id;
+        bool continued; /* only the public key and more allowed IPs, the peer started in an earlier message */
+        uint16_t persistent_keepalive_interval;
+        const char *ipmasks[2];
+} DumpPeer;
+
+/* Adds a message to the dump the fake kernel answers with, only the first one describes the device */
+static void dump_add(FakeKernel *k, sd_netlink *genl, bool device, const DumpPeer *peers, size_t n_peers) {
+        _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+        size_t i;
+
+        assert_se(k->n_dump < MAX_MESSAGES);
+
+        assert_se(sd_genl_message_new(genl, SD_GENL_WIREGUARD, WG_CMD_GET_DEVICE, &m) >= 0);
+        assert_se(sd_netlink_message_append_string(m, WGDEVICE_A_IFNAME, "wg-test") >= 0);
+
+        if (device) {
+                uint8_t private_key[WG_KEY_LEN];
+
+                memset(private_key, 0xff, WG_KEY_LEN);
+                assert_se(sd_netlink_message_append_data(m, WGDEVICE_A_PRIVATE_KEY, private_key, WG_KEY_LEN) >= 0);
+                assert_se(sd_netlink_message_append_u16(m, WGDEVICE_A_LISTEN_PORT, 51820) >= 0);
+                assert_se(sd_netlink_message_append_u32(m, WGDEVICE_A_FWMARK, 0) >= 0);
+        }
+
+        if (n_peers > 0) {
+                assert_se(sd_netlink_message_open_container(m, WGDEVICE_A_PEERS) >= 0);
+
+                for (i = 0; i < n_peers; i++) {
+                        uint8_t public_key[WG_KEY_LEN];
+                        uint16_t j;
+
+                        key_set(public_key, peers[i].id);
+
+                        assert_se(sd_netlink_message_open_array(m, i + 1) >= 0);
+                        assert_se(sd_netlink_message_append_data(m, WGPEER_A_PUBLIC_KEY, public_key, WG_KEY_LEN) >= 0);
+                        if (!peers[i].continued)
+                                assert_se(sd_netlink_message_append_u16(m, WGPEER_A_PERSISTENT_KEEPALIVE_INTERVAL,
+                                                                        peers[i].persistent_keepalive_interval) >= 0);
+
+                        assert_se(sd_netlink_message_open_container(m, WGPEER_A_ALLOWEDIPS) >= 0);
+                        for (j = 0; j < ELEMENTSOF(peers[i].ipmasks) && peers[i].ipmasks[j]; j++) {
+                                union in_addr_union u;
+                                unsigned char prefixlen;
+                                int family;
+
+                                assert_se(in_addr_prefix_from_string_auto(peers[i].ipmasks[j], &family, &u, &prefixlen) >= 0);
+
+                                assert_se(sd_netlink_message_open_array(m, j + 1) >= 0);
+                                assert_se(sd_netlink_message_append_u16(m, WGALLOWEDIP_A_FAMILY, family) >= 0);
+                                if (family == AF_INET)
+                                        assert_se(sd_netlink_message_append_in_addr(m, WGALLOWEDIP_A_IPADDR, &u.in) >= 0);
+                                else
+                                        assert_se(sd_netlink_message_append_in6_addr(m, WGALLOWEDIP_A_IPADDR, &u.in6) >= 0);
+                                assert_se(sd_netlink_message_append_u8(m, WGALLOWEDIP_A_CIDR_MASK, prefixlen) >= 0);
+                                assert_se(sd_netlink_message_close_container(m) >= 0);
+                        }
+                        assert_se(sd_netlink_message_close_container(m) >= 0);
+
+                        assert_se(sd_netlink_message_close_container(m) >= 0);
+                }
+
+                assert_se(sd_netlink_message_close_container(m) >= 0);
+        }
+
+        k->dump[k->n_dump] = memdup(m->hdr, m->hdr->nlmsg_len);
+        assert_se(k->dump[k->n_dump]);
+        k->n_dump++;
+}
+
+typedef struct SetRequests {
+        unsigned n_messages;
+        unsigned n_device;      /* messages with the private key, port and firewall mark */
+        bool replace_peers;
+        PeerUpdate peers[256];
+        unsigned n_peers;
+} SetRequests;
+
+static PeerUpdate *set_requests_get_peer(SetRequests *s, const uint8_t public_key[static WG_KEY_LEN]) {
+        unsigned i;
+
+        for (i = 0; i < s->n_peers; i++)
+                if (memcmp(s->peers[i].public_key, public_key, WG_KEY_LEN) == 0)
+                        return s->peers + i;
+
+        assert_se(s->n_peers < ELEMENTSOF(s->peers));
+        memcpy(s->peers[s->n_peers].public_key, public_key, WG_KEY_LEN);
+
+        return s->peers + s->n_peers++;
+}
+
+static PeerUpdate *set_requests_find_peer(SetRequests *s, unsigned id) {
+        uint8_t public_key[WG_KEY_LEN];
+        unsigned i;
+
+        key_set(public_key, id);
+
+        for (i = 0; i < s->n_peers; i++)
+                if (memcmp(s->peers[i].public_key, public_key, WG_KEY_LEN) == 0)
+                        return s->peers + i;
+
+        return NULL;
+}
+
+/* Parses the requests the fake kernel received like sd-netlink does replies, and sums them up per peer */
+static void set_requests_parse(SetRequests *s, FakeKernel *k, sd_netlink *genl) {
+        unsigned i;
+
+        *s = (SetRequests) {};
+
+        for (i = 0; i < k->n_set; i++) {
+                _cleanup_(sd_netlink_message_unrefp) sd_netlink_message *m = NULL;
+                const NLType *nl_type;
+                const char *ifname;
+                uint32_t flags;
+                int r;
+
+                assert_se(k->set[i]->nlmsg_len <= page_size());
+
+                assert_se(message_new_empty(genl, &m) >= 0);
+                m->hdr = memdup(k->set[i], k->set[i]->nlmsg_len);
+                assert_se(m->hdr);
+                rtnl_message_seal(m);
+                assert_se(message_get_type(genl, m->hdr->nlmsg_type, &nl_type) >= 0);
+                assert_se(message_parse(m, nl_type) >= 0);
+
+                s->n_messages++;
+
+                assert_se(sd_netlink_message_read_string(m, WGDEVICE_A_IFNAME, &ifname) >= 0);
+                assert_se(streq(ifname, "wg-test"));
+
+                if (sd_netlink_message_read(m, WGDEVICE_A_PRIVATE_KEY, 0, NULL) >= 0)
+                        s->n_device++;
+
+                /* The kernel only looks at the flags of the first message */
+                if (sd_netlink_message_read_u32(m, WGDEVICE_A_FLAGS, &flags) >= 0) {
+                        assert_se(i == 0);
+                        s->replace_peers = flags & WGDEVICE_F_REPLACE_PEERS;
+                }
+
+                r = sd_netlink_message_enter_array(m, WGDEVICE_A_PEERS);
+                if (r == -ENODATA)
+                        continue;
+                assert_se(r >= 0);
+
+                while ((r = sd_netlink_message_enter_array_element(m)) > 0) {
+                        uint8_t public_key[WG_KEY_LEN];
+                        PeerUpdate *u;
+
+                        assert_se(sd_netlink_message_read(m, WGPEER_A_PUBLIC_KEY, WG_KEY_LEN, public_key) == WG_KEY_LEN);
+
+                        u = set_requests_get_peer(s, public_key);
+                        u->n_messages++;
+
+                        /* Peers continued from an earlier message only come with more allowed IPs */
+                        if (sd_netlink_message_read_u32(m, WGPEER_A_FLAGS, &flags) >= 0) {
+                                assert_se(!u->has_flags);
+                                u->has_flags = true;
+                                u->flags = flags;
+                        } else
+                                assert_se(u->n_messages > 1);
+
+                        if (sd_netlink_message_enter_array(m, WGPEER_A_ALLOWEDIPS) >= 0) {
+                                while ((r = sd_netlink_message_enter_array_element(m)) > 0) {
+                                        u->n_ipmasks++;
+                                        assert_se(sd_netlink_message_exit_container(m) >= 0);
+                                }
+                                assert_se(r == 0);
+                                assert_se(sd_netlink_message_exit_container(m) >= 0);
+                        }
+
+                        assert_se(sd_netlink_message_exit_container(m) >= 0);
+                }
+                assert_se(r == 0);
+
+                assert_se(sd_netlink_message_exit_container(m) >= 0);
+        }
+}
+
+static void test_update(Manager *m, FakeKernel *k) {
+        static const DumpPeer first[] = {
+                { .id = 1, .persistent_keepalive_interval = 25, .ipmasks = { "fd00::/64" } },
+                { .id = 2, .persistent_keepalive_interval = 0,  .ipmasks = { "10.0.2.0/24" } },
+                { .id = 3, .persistent_keepalive_interval = 0,  .ipmasks = { "10.0.3.0/24" } },
+        };
+        static const DumpPeer second[] = {
+                { .id = 1, .continued = true,                   .ipmasks = { "10.0.1.0/24" } },
+                { .id = 5, .persistent_keepalive_interval = 0,  .ipmasks = { "10.0.5.0/24" } },
+        };
+        SetRequests s;
+        NetDev *netdev;
+        WireguardPeer *peer;
+        PeerUpdate *u;
+        Wireguard *w;
+
+        netdev = netdev_wireguard_new(m);
+        w = WIREGUARD(netdev);
+
+        /* Unchanged: the kernel drops the host part, keeps the allowed IPs in no particular order, and
+         * continues them in the next message of the dump */
+        peer = peer_add(w, 1, 25);
+        peer_add_ipmask(peer, "10.0.1.5/24");
+        peer_add_ipmask(peer, "fd00::1/64");
+
+        /* Changed keepalive */
+        peer = peer_add(w, 2, 25);
+        peer_add_ipmask(peer, "10.0.2.0/24");
+
+        /* Added */
+        peer = peer_add(w, 4, 0);
+        peer_add_ipmask(peer, "10.0.4.0/24");
+
+        /* Added an allowed IP */
+        peer = peer_add(w, 5, 0);
+        peer_add_ipmask(peer, "10.0.5.0/24");
+        peer_add_ipmask(peer, "10.0.6.0/24");
+
+        /* Peer 3 is only known to the kernel, and is removed */
+        dump_add(k, m->genl, true, first, ELEMENTSOF(first));
+        dump_add(k, m->genl, false, second, ELEMENTSOF(second));
+
+        netdev_wireguard_setup(netdev);
+        set_requests_parse(&s, k, m->genl);
+
+        assert_se(s.n_messages == 1);
+        assert_se(s.n_device == 0);
+        assert_se(!s.replace_peers);
+        assert_se(s.n_peers == 4);
+
+        assert_se(!set_requests_find_peer(&s, 1));
+
+        assert_se(u = set_requests_find_peer(&s, 2));
+        assert_se(u->has_flags && u->flags == WGPEER_F_REPLACE_ALLOWEDIPS);
+        assert_se(u->n_ipmasks == 1);
+
+        assert_se(u = set_requests_find_peer(&s, 4));
+        assert_se(u->has_flags && u->flags == WGPEER_F_REPLACE_ALLOWEDIPS);
+        assert_se(u->n_ipmasks == 1);
+
+        assert_se(u = set_requests_find_peer(&s, 5));
+        assert_se(u->has_flags && u->flags == WGPEER_F_REPLACE_ALLOWEDIPS);
+        assert_se(u->n_ipmasks == 2);
+
+        assert_se(u = set_requests_find_peer(&s, 3));
+        assert_se(u->has_flags && u->flags == WGPEER_F_REMOVE_ME);
+        assert_se(u->n_ipmasks == 0);
+
+        netdev_wireguard_free(netdev);
+        fake_kernel_reset(k);
+
+        /* Nothing is sent when nothing changed */
+        netdev = netdev_wireguard_new(m);
+        w = WIREGUARD(netdev);
+
+        peer = peer_add(w, 1, 25);
+        peer_add_ipmask(peer, "10.0.1.0/24");
+        peer_add_ipmask(peer, "fd00::/64");
+
+        dump_add(k, m->genl, true, first, 1);
+        dump_add(k, m->genl, false, second, 1);
+
+        netdev_wireguard_setup(netdev);
+        assert_se(k->n_set == 0);
+
+        netdev_wireguard_free(netdev);
+        fake_kernel_reset(k);
+}
+
+static void test_batches(Manager *m, FakeKernel *k) {
+        SetRequests s;
+        NetDev *netdev;
+        WireguardPeer *peer;
+        PeerUpdate *u;
+        Wireguard *w;
+        unsigned i;
+
+        netdev = netdev_wireguard_new(m);
+        w = WIREGUARD(netdev);
+
+        /* More peers than fit into one message */
+        for (i = 1; i <= 150; i++) {
+                char prefix[sizeof("10.255.255.0/24")];
+
+                xsprintf(prefix, "10.%u.%u.0/24", i >> 8, i & 0xff);
+
+                peer = peer_add(w, i, 0);
+                peer_add_ipmask(peer, prefix);
+        }
+
+        /* A peer with more allowed IPs than fit into one message */
+        peer = peer_add(w, 1000, 0);
+        for (i = 0; i < 400; i++) {
+                char prefix[sizeof("fd00::ffff/128")];
+
+                xsprintf(prefix, "fd00::%x/128", i);
+                peer_add_ipmask(peer, prefix);
+        }
+
+        dump_add(k, m->genl, true, NULL, 0);
+
+        netdev_wireguard_setup(netdev);
+        set_requests_parse(&s, k, m->genl);
+
+        log_info("%u peers sent in %u messages", s.n_peers, s.n_messages);
+
+        assert_se(s.n_messages > 2);
+        assert_se(s.n_device == 0);
+        assert_se(!s.replace_peers);
+        assert_se(s.n_peers == 151);
+
+        for (i = 1; i <= 150; i++) {
+                assert_se(u = set_requests_find_peer(&s, i));
+                assert_se(u->n_messages == 1);
+                assert_se(u->has_flags && u->flags == WGPEER_F_REPLACE_ALLOWEDIPS);
+                assert_se(u->n_ipmasks == 1);
+        }
+
+        /* Only the first part replaces the allowed IPs, the others add to them */
+        assert_se(u = set_requests_find_peer(&s, 1000));
+        assert_se(u->n_messages > 2);
+        assert_se(u->has_flags && u->flags == WGPEER_F_REPLACE_ALLOWEDIPS);
+        assert_se(u->n_ipmasks == 400);
+
+        netdev_wireguard_free(netdev);
+        fake_kernel_reset(k);
+}
+
+static void test_dump_error(Manager *m, FakeKernel *k) {
+        SetRequests s;
+        NetDev *netdev;
+        WireguardPeer *peer;
+        Wireguard *w;
+
+        netdev = netdev_wireguard_new(m);
+        w = WIREGUARD(netdev);
+
+        peer = peer_add(w, 1, 0);
+        peer_add_ipmask(peer, "10.0.1.0/24");
+        peer = peer_add(w, 2, 0);
+        peer_add_ipmask(peer, "10.0.2.0/24");
+
+        /* Without knowing what the kernel has, everything is replaced */
+        k->dump_error = -EOPNOTSUPP;
+
+        netdev_wireguard_setup(netdev);
+        set_requests_parse(&s, k, m->genl);
+
+        assert_se(s.n_messages == 1);
+        assert_se(s.n_device == 1);
+        assert_se(s.replace_peers);
+        assert_se(s.n_peers == 2);
+        assert_se(set_requests_find_peer(&s, 1));
+        assert_se(set_requests_find_peer(&s, 2));
+
+        netdev_wireguard_free(netdev);
+        fake_kernel_reset(k);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_netlink_unrefp) sd_netlink *genl = NULL;
+        _cleanup_(sd_event_unrefp) sd_event *e = NULL;
+        _cleanup_close_ int kernel_fd = -1;
+        FakeKernel k = {};
+        Manager m = {};
+        int pair[2];
+        pthread_t t;
+
+        test_setup_logging(LOG_INFO);
+
+        assert_se(sd_event_new(&e) >= 0);
+
+        assert_se(socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0, pair) >= 0);
+        kernel_fd = pair[1];
+        assert_se(netlink_open_fake(&genl, NETLINK_GENERIC, pair[0]) >= 0);
+        assert_se(sd_netlink_attach_event(genl, e, 0) >= 0);
+
+        k.fd = kernel_fd;
+        assert_se(pthread_create(&t, NULL, fake_kernel, &k) == 0);
+
+        /* The wireguard code only needs these */
+        m.event = e;
+        m.genl = genl;
+
+        test_update(&m, &k);
+        test_batches(&m, &k);
+        test_dump_error(&m, &k);
+
+        assert_se(send(pair[0], NULL, 0, 0) == 0);
+        assert_se(pthread_join(t, NULL) == 0);
+
+        return EXIT_SUCCESS;
+}
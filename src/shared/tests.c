@@ -21,9 +21,12 @@
 #include <alloc-util.h>
 #include <fs-util.h>
 #include <libgen.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <util.h>
 
+#include "env-util.h"
+#include "log.h"
 #include "tests.h"
 #include "path-util.h"
 
@@ -72,3 +75,64 @@ const char* get_testdata_dir(const char *suffix) {
         strncpy(testdir + strlen(testdir), suffix, sizeof(testdir) - strlen(testdir) - 1);
         return testdir;
 }
+
+bool slow_tests_enabled(void) {
+        int r;
+
+        r = getenv_bool("SYSTEMD_SLOW_TESTS");
+        if (r >= 0)
+                return r;
+
+        if (r != -ENXIO)
+                log_warning_errno(r, "Cannot parse $SYSTEMD_SLOW_TESTS, ignoring: %m");
+
+        return SYSTEMD_SLOW_TESTS_DEFAULT;
+}
+
+void test_setup_logging(int level) {
+        log_set_max_level(level);
+        log_parse_environment();
+        log_open();
+}
+
+void replay_stats_add(ReplayStats *s, usec_t usec) {
+        assert(s);
+
+        s->n++;
+        s->total_usec += usec;
+        s->max_usec = MAX(s->max_usec, usec);
+}
+
+/* Prints one line for each kind that was replayed at least once, kinds without a name are skipped. Returns
+ * the number of messages or events in the printed lines. */
+unsigned replay_stats_print(const char *title, const char* const names[], const ReplayStats stats[], size_t n) {
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        size_t i, width;
+        unsigned total = 0;
+
+        assert(title);
+        assert(names || n == 0);
+        assert(stats || n == 0);
+
+        width = strlen(title);
+        for (i = 0; i < n; i++)
+                if (names[i] && stats[i].n > 0)
+                        width = MAX(width, strlen(names[i]));
+
+        printf("%-*s %9s %12s %12s\n", (int) width, title, "COUNT", "AVERAGE", "MAX");
+
+        for (i = 0; i < n; i++) {
+                if (!names[i] || stats[i].n == 0)
+                        continue;
+
+                printf("%-*s %9u %12s %12s\n",
+                       (int) width, names[i],
+                       stats[i].n,
+                       format_timespan(a, sizeof(a), stats[i].total_usec / stats[i].n, 1),
+                       format_timespan(b, sizeof(b), stats[i].max_usec, 1));
+
+                total += stats[i].n;
+        }
+
+        return total;
+}
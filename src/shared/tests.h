@@ -20,5 +20,23 @@
   along with systemd; If not, see <http://www.gnu.org/licenses/>.
 ***/
 
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "time-util.h"
+
 char* setup_fake_runtime_dir(void);
 const char* get_testdata_dir(const char *suffix);
+
+bool slow_tests_enabled(void);
+void test_setup_logging(int level);
+
+/* Latencies of the messages or events of one kind, as measured by the replay tests */
+typedef struct ReplayStats {
+        unsigned n;
+        usec_t total_usec;
+        usec_t max_usec;
+} ReplayStats;
+
+void replay_stats_add(ReplayStats *s, usec_t usec);
+unsigned replay_stats_print(const char *title, const char* const names[], const ReplayStats stats[], size_t n);
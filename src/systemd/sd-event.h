@@ -82,6 +82,18 @@ enum
     SD_EVENT_PRIORITY_IDLE = 100
 };
 
+/* Per event source dispatch accounting, collected while profiling is enabled on the event loop, see
+ * sd_event_set_profile(). All times are in µs. The lateness fields are only maintained for time event
+ * sources and record how long after the requested time the callback was actually invoked. */
+typedef struct sd_event_source_stats
+{
+    uint64_t n_dispatch;
+    uint64_t run_usec;
+    uint64_t run_max_usec;
+    uint64_t late_usec;
+    uint64_t late_max_usec;
+} sd_event_source_stats;
+
 typedef int (*sd_event_handler_t)(sd_event_source *s, void *userdata);
 typedef int (*sd_event_io_handler_t)(sd_event_source *s, int fd, uint32_t revents, void *userdata);
 typedef int (*sd_event_time_handler_t)(sd_event_source *s, uint64_t usec, void *userdata);
@@ -91,6 +103,7 @@ typedef int (*sd_event_child_handler_t)(sd_event_source *s, const siginfo_t *si,
 #else
 typedef void *sd_event_child_handler_t;
 #endif
+typedef int (*sd_event_work_handler_t)(sd_event *e, void *userdata);
 
 int sd_event_default(sd_event **e);
 
@@ -122,6 +135,14 @@ int sd_event_get_exit_code(sd_event *e, int *code);
 int sd_event_set_watchdog(sd_event *e, int b);
 int sd_event_get_watchdog(sd_event *e);
 int sd_event_get_iteration(sd_event *e, uint64_t *ret);
+int sd_event_set_profile(sd_event *e, int b);
+int sd_event_get_profile(sd_event *e);
+int sd_event_get_stats(sd_event *e, char ***ret_keys, sd_event_source_stats **ret_stats);
+int sd_event_get_timer_wakeups(sd_event *e, uint64_t *ret_wakeups, uint64_t *ret_saved);
+int sd_event_set_max_events(sd_event *e, unsigned max);
+int sd_event_get_max_events(sd_event *e, unsigned *ret);
+int sd_event_enable_work_queue(sd_event *e, int64_t priority);
+int sd_event_post_work(sd_event *e, sd_event_work_handler_t callback, void *userdata);
 
 sd_event_source *sd_event_source_ref(sd_event_source *s);
 sd_event_source *sd_event_source_unref(sd_event_source *s);
@@ -152,6 +173,7 @@ int sd_event_source_set_time_accuracy(sd_event_source *s, uint64_t usec);
 int sd_event_source_get_time_clock(sd_event_source *s, clockid_t *clock);
 int sd_event_source_get_signal(sd_event_source *s);
 int sd_event_source_get_child_pid(sd_event_source *s, pid_t *pid);
+int sd_event_source_get_stats(sd_event_source *s, sd_event_source_stats *ret);
 
 /* Define helpers so that __attribute__((cleanup(sd_event_unrefp))) and similar may be used. */
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_event, sd_event_unref);
@@ -38,6 +38,7 @@ enum {
 };
 
 typedef struct sd_ipv4acd sd_ipv4acd;
+typedef struct sd_ipv4acd_mux sd_ipv4acd_mux;
 typedef void (*sd_ipv4acd_callback_t)(sd_ipv4acd *acd, int event, void *userdata);
 
 int sd_ipv4acd_detach_event(sd_ipv4acd *acd);
@@ -47,6 +48,7 @@ int sd_ipv4acd_set_callback(sd_ipv4acd *acd, sd_ipv4acd_callback_t cb, void *use
 int sd_ipv4acd_set_mac(sd_ipv4acd *acd, const struct ether_addr *addr);
 int sd_ipv4acd_set_ifindex(sd_ipv4acd *acd, int interface_index);
 int sd_ipv4acd_set_address(sd_ipv4acd *acd, const struct in_addr *address);
+int sd_ipv4acd_set_mux(sd_ipv4acd *acd, sd_ipv4acd_mux *mux);
 int sd_ipv4acd_is_running(sd_ipv4acd *acd);
 int sd_ipv4acd_start(sd_ipv4acd *acd);
 int sd_ipv4acd_stop(sd_ipv4acd *acd);
@@ -54,7 +56,14 @@ sd_ipv4acd *sd_ipv4acd_ref(sd_ipv4acd *acd);
 sd_ipv4acd *sd_ipv4acd_unref(sd_ipv4acd *acd);
 int sd_ipv4acd_new(sd_ipv4acd **ret);
 
+int sd_ipv4acd_mux_new(sd_ipv4acd_mux **ret);
+sd_ipv4acd_mux *sd_ipv4acd_mux_ref(sd_ipv4acd_mux *mux);
+sd_ipv4acd_mux *sd_ipv4acd_mux_unref(sd_ipv4acd_mux *mux);
+int sd_ipv4acd_mux_attach_event(sd_ipv4acd_mux *mux, sd_event *event, int64_t priority);
+int sd_ipv4acd_mux_detach_event(sd_ipv4acd_mux *mux);
+
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_ipv4acd, sd_ipv4acd_unref);
+_SD_DEFINE_POINTER_CLEANUP_FUNC(sd_ipv4acd_mux, sd_ipv4acd_mux_unref);
 
 _SD_END_DECLARATIONS;
 
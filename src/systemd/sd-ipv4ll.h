@@ -25,6 +25,7 @@
 #include <netinet/in.h>
 
 #include "sd-event.h"
+#include "sd-ipv4acd.h"
 
 #include "_sd-common.h"
 
@@ -47,6 +48,7 @@ int sd_ipv4ll_set_mac(sd_ipv4ll *ll, const struct ether_addr *addr);
 int sd_ipv4ll_set_ifindex(sd_ipv4ll *ll, int interface_index);
 int sd_ipv4ll_set_address(sd_ipv4ll *ll, const struct in_addr *address);
 int sd_ipv4ll_set_address_seed(sd_ipv4ll *ll, uint64_t seed);
+int sd_ipv4ll_set_mux(sd_ipv4ll *ll, sd_ipv4acd_mux *mux);
 int sd_ipv4ll_is_running(sd_ipv4ll *ll);
 int sd_ipv4ll_restart(sd_ipv4ll *ll);
 int sd_ipv4ll_start(sd_ipv4ll *ll);
@@ -112,6 +112,7 @@ enum {
 
 typedef struct sd_lldp sd_lldp;
 typedef struct sd_lldp_neighbor sd_lldp_neighbor;
+typedef struct sd_lldp_receiver sd_lldp_receiver;
 
 typedef enum sd_lldp_event {
         SD_LLDP_EVENT_ADDED     = 'a',
@@ -136,6 +137,15 @@ sd_event *sd_lldp_get_event(sd_lldp *lldp);
 int sd_lldp_set_callback(sd_lldp *lldp, sd_lldp_callback_t cb, void *userdata);
 int sd_lldp_set_ifindex(sd_lldp *lldp, int ifindex);
 
+/* Optionally, receive frames through a socket shared by many sd_lldp objects, instead of one socket each */
+int sd_lldp_set_receiver(sd_lldp *lldp, sd_lldp_receiver *receiver);
+
+int sd_lldp_receiver_new(sd_lldp_receiver **ret);
+sd_lldp_receiver* sd_lldp_receiver_ref(sd_lldp_receiver *receiver);
+sd_lldp_receiver* sd_lldp_receiver_unref(sd_lldp_receiver *receiver);
+int sd_lldp_receiver_attach_event(sd_lldp_receiver *receiver, sd_event *event, int64_t priority);
+int sd_lldp_receiver_detach_event(sd_lldp_receiver *receiver);
+
 /* Controls how much and what to store in the neighbors database */
 int sd_lldp_set_neighbors_max(sd_lldp *lldp, uint64_t n);
 int sd_lldp_match_capabilities(sd_lldp *lldp, uint16_t mask);
@@ -177,6 +187,7 @@ int sd_lldp_neighbor_tlv_get_raw(sd_lldp_neighbor *n, const void **ret, size_t *
 
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_lldp, sd_lldp_unref);
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_lldp_neighbor, sd_lldp_neighbor_unref);
+_SD_DEFINE_POINTER_CLEANUP_FUNC(sd_lldp_receiver, sd_lldp_receiver_unref);
 
 _SD_END_DECLARATIONS;
 
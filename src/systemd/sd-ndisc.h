@@ -55,6 +55,7 @@ enum {
 
 typedef struct sd_ndisc sd_ndisc;
 typedef struct sd_ndisc_router sd_ndisc_router;
+typedef struct sd_icmp6_mux sd_icmp6_mux;
 
 typedef enum sd_ndisc_event {
         SD_NDISC_EVENT_TIMEOUT = 't',
@@ -78,6 +79,16 @@ int sd_ndisc_set_callback(sd_ndisc *nd, sd_ndisc_callback_t cb, void *userdata);
 int sd_ndisc_set_ifindex(sd_ndisc *nd, int interface_index);
 int sd_ndisc_set_mac(sd_ndisc *nd, const struct ether_addr *mac_addr);
 
+/* Optionally, exchange messages through an ICMPv6 socket shared by many sd_ndisc and sd_radv objects,
+ * instead of one socket each */
+int sd_ndisc_set_mux(sd_ndisc *nd, sd_icmp6_mux *mux);
+
+int sd_icmp6_mux_new(sd_icmp6_mux **ret);
+sd_icmp6_mux *sd_icmp6_mux_ref(sd_icmp6_mux *mux);
+sd_icmp6_mux *sd_icmp6_mux_unref(sd_icmp6_mux *mux);
+int sd_icmp6_mux_attach_event(sd_icmp6_mux *mux, sd_event *event, int64_t priority);
+int sd_icmp6_mux_detach_event(sd_icmp6_mux *mux);
+
 int sd_ndisc_get_mtu(sd_ndisc *nd, uint32_t *ret);
 int sd_ndisc_get_hop_limit(sd_ndisc *nd, uint8_t *ret);
 
@@ -125,6 +136,7 @@ int sd_ndisc_router_dnssl_get_lifetime(sd_ndisc_router *rt, uint32_t *ret);
 
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_ndisc, sd_ndisc_unref);
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_ndisc_router, sd_ndisc_router_unref);
+_SD_DEFINE_POINTER_CLEANUP_FUNC(sd_icmp6_mux, sd_icmp6_mux_unref);
 
 _SD_END_DECLARATIONS;
 
@@ -57,6 +57,7 @@ int sd_radv_stop(sd_radv *ra);
 
 int sd_radv_set_ifindex(sd_radv *ra, int interface_index);
 int sd_radv_set_mac(sd_radv *ra, const struct ether_addr *mac_addr);
+int sd_radv_set_mux(sd_radv *ra, sd_icmp6_mux *mux);
 int sd_radv_set_mtu(sd_radv *ra, uint32_t mtu);
 int sd_radv_set_hop_limit(sd_radv *ra, uint8_t hop_limit);
 int sd_radv_set_router_lifetime(sd_radv *ra, uint32_t router_lifetime);
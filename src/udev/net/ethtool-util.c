@@ -311,7 +311,7 @@ static int get_stringset(int fd, struct ifreq *ifr, int stringset_id, struct eth
         return 0;
 }
 
-static int find_feature_index(struct ethtool_gstrings *strings, const char *feature) {
+static int find_feature_index(const struct ethtool_gstrings *strings, const char *feature) {
         unsigned i;
 
         for (i = 0; i < strings->len; i++) {
@@ -322,27 +322,12 @@ static int find_feature_index(struct ethtool_gstrings *strings, const char *feat
         return -1;
 }
 
-int ethtool_set_features(int *fd, const char *ifname, NetDevFeature *features) {
-        _cleanup_free_ struct ethtool_gstrings *strings = NULL;
-        struct ethtool_sfeatures *sfeatures;
+/* Fills in the request for the configured features, and returns whether any of them differs from the current
+ * state. Without the current state, all configured features are set. */
+bool ethtool_features_request(const struct ethtool_gstrings *strings, const NetDevFeature *features,
+                              const struct ethtool_gfeatures *current, struct ethtool_sfeatures *sfeatures) {
+        bool need_update = !current;
         int block, bit, i, r;
-        struct ifreq ifr = {};
-
-        if (*fd < 0) {
-                r = ethtool_connect(fd);
-                if (r < 0)
-                        return log_warning_errno(r, "link_config: could not connect to ethtool: %m");
-        }
-
-        strscpy(ifr.ifr_name, IFNAMSIZ, ifname);
-
-        r = get_stringset(*fd, &ifr, ETH_SS_FEATURES, &strings);
-        if (r < 0)
-                return log_warning_errno(r, "link_config: could not get ethtool features for %s", ifname);
-
-        sfeatures = alloca0(sizeof(struct ethtool_gstrings) + DIV_ROUND_UP(strings->len, 32U) * sizeof(sfeatures->features[0]));
-        sfeatures->cmd = ETHTOOL_SFEATURES;
-        sfeatures->size = DIV_ROUND_UP(strings->len, 32U);
 
         for (i = 0; i < _NET_DEV_FEAT_MAX; i++) {
 
@@ -363,9 +348,57 @@ int ethtool_set_features(int *fd, const char *ifname, NetDevFeature *features) {
                                 sfeatures->features[block].requested |= 1 << bit;
                         else
                                 sfeatures->features[block].requested &= ~(1 << bit);
+
+                        if (current && !!(current->features[block].requested & (1 << bit)) != !!features[i])
+                                need_update = true;
                 }
         }
 
+        return need_update;
+}
+
+int ethtool_set_features(int *fd, const char *ifname, NetDevFeature *features) {
+        _cleanup_free_ struct ethtool_gstrings *strings = NULL;
+        struct ethtool_gfeatures *gfeatures;
+        struct ethtool_sfeatures *sfeatures;
+        struct ifreq ifr = {};
+        int i, r;
+
+        for (i = 0; i < _NET_DEV_FEAT_MAX; i++)
+                if (features[i] != -1)
+                        break;
+        if (i >= _NET_DEV_FEAT_MAX)
+                return 0;
+
+        if (*fd < 0) {
+                r = ethtool_connect(fd);
+                if (r < 0)
+                        return log_warning_errno(r, "link_config: could not connect to ethtool: %m");
+        }
+
+        strscpy(ifr.ifr_name, IFNAMSIZ, ifname);
+
+        r = get_stringset(*fd, &ifr, ETH_SS_FEATURES, &strings);
+        if (r < 0)
+                return log_warning_errno(r, "link_config: could not get ethtool features for %s", ifname);
+
+        gfeatures = alloca0(sizeof(struct ethtool_gfeatures) + DIV_ROUND_UP(strings->len, 32U) * sizeof(gfeatures->features[0]));
+        gfeatures->cmd = ETHTOOL_GFEATURES;
+        gfeatures->size = DIV_ROUND_UP(strings->len, 32U);
+
+        ifr.ifr_data = (void *) gfeatures;
+        if (ioctl(*fd, SIOCETHTOOL, &ifr) < 0) {
+                log_debug_errno(errno, "link_config: could not get ethtool features of %s, setting them all: %m", ifname);
+                gfeatures = NULL;
+        }
+
+        sfeatures = alloca0(sizeof(struct ethtool_sfeatures) + DIV_ROUND_UP(strings->len, 32U) * sizeof(sfeatures->features[0]));
+        sfeatures->cmd = ETHTOOL_SFEATURES;
+        sfeatures->size = DIV_ROUND_UP(strings->len, 32U);
+
+        if (!ethtool_features_request(strings, features, gfeatures, sfeatures))
+                return 0;
+
         ifr.ifr_data = (void *) sfeatures;
 
         r = ioctl(*fd, SIOCETHTOOL, &ifr);
@@ -375,6 +408,31 @@ int ethtool_set_features(int *fd, const char *ifname, NetDevFeature *features) {
         return 0;
 }
 
+/* Converts the reply to ETHTOOL_GLINKSETTINGS, where the link mode bitmaps follow the settings */
+struct ethtool_link_usettings *ethtool_link_usettings_new(const struct ethtool_link_settings *req, const uint32_t *link_mode_data) {
+        struct ethtool_link_usettings *u;
+        unsigned offset;
+
+        assert(req->link_mode_masks_nwords > 0);
+
+        u = new0(struct ethtool_link_usettings , 1);
+        if (!u)
+                return NULL;
+
+        u->base = *req;
+
+        offset = 0;
+        memcpy(u->link_modes.supported, &link_mode_data[offset], 4 * req->link_mode_masks_nwords);
+
+        offset += req->link_mode_masks_nwords;
+        memcpy(u->link_modes.advertising, &link_mode_data[offset], 4 * req->link_mode_masks_nwords);
+
+        offset += req->link_mode_masks_nwords;
+        memcpy(u->link_modes.lp_advertising, &link_mode_data[offset], 4 * req->link_mode_masks_nwords);
+
+        return u;
+}
+
 static int get_glinksettings(int fd, struct ifreq *ifr, struct ethtool_link_usettings **g) {
         struct ecmd {
                 struct ethtool_link_settings req;
@@ -383,7 +441,6 @@ static int get_glinksettings(int fd, struct ifreq *ifr, struct ethtool_link_uset
                 .req.cmd = ETHTOOL_GLINKSETTINGS,
         };
         struct ethtool_link_usettings *u;
-        unsigned offset;
         int r;
 
         /* The interaction user/kernel via the new API requires a small ETHTOOL_GLINKSETTINGS
@@ -414,21 +471,10 @@ static int get_glinksettings(int fd, struct ifreq *ifr, struct ethtool_link_uset
         if (ecmd.req.link_mode_masks_nwords <= 0 || ecmd.req.cmd != ETHTOOL_GLINKSETTINGS)
                 return -EOPNOTSUPP;
 
-        u = new0(struct ethtool_link_usettings , 1);
+        u = ethtool_link_usettings_new(&ecmd.req, ecmd.link_mode_data);
         if (!u)
                 return -ENOMEM;
 
-        ecmd.req = u->base;
-
-        offset = 0;
-        memcpy(u->link_modes.supported, &ecmd.link_mode_data[offset], 4 * ecmd.req.link_mode_masks_nwords);
-
-        offset += ecmd.req.link_mode_masks_nwords;
-        memcpy(u->link_modes.advertising, &ecmd.link_mode_data[offset], 4 * ecmd.req.link_mode_masks_nwords);
-
-        offset += ecmd.req.link_mode_masks_nwords;
-        memcpy(u->link_modes.lp_advertising, &ecmd.link_mode_data[offset], 4 * ecmd.req.link_mode_masks_nwords);
-
         *g = u;
 
         return 0;
@@ -531,6 +577,33 @@ static int set_sset(int fd, struct ifreq *ifr, const struct ethtool_link_usettin
         return 0;
 }
 
+/* Applies the configured values to the current settings, and returns whether any of them changed */
+bool ethtool_link_usettings_update(struct ethtool_link_usettings *u, const struct link_config *link) {
+        bool need_update = false;
+
+        if (link->speed && u->base.speed != DIV_ROUND_UP(link->speed, 1000000)) {
+                u->base.speed = DIV_ROUND_UP(link->speed, 1000000);
+                need_update = true;
+        }
+
+        if (link->duplex != _DUP_INVALID && u->base.duplex != link->duplex) {
+                u->base.duplex = link->duplex;
+                need_update = true;
+        }
+
+        if (link->port != _NET_DEV_PORT_INVALID && u->base.port != link->port) {
+                u->base.port = link->port;
+                need_update = true;
+        }
+
+        if (link->autonegotiation >= 0 && u->base.autoneg != link->autonegotiation) {
+                u->base.autoneg = link->autonegotiation;
+                need_update = true;
+        }
+
+        return need_update;
+}
+
 /* If autonegotiation is disabled, the speed and duplex represent the fixed link
  * mode and are writable if the driver supports multiple link modes. If it is
  * enabled then they are read-only. If the link  is up they represent the negotiated
@@ -543,6 +616,10 @@ int ethtool_set_glinksettings(int *fd, const char *ifname, struct link_config *l
         struct ifreq ifr = {};
         int r;
 
+        if (link->autonegotiation < 0 && link->speed == 0 &&
+            link->duplex == _DUP_INVALID && link->port == _NET_DEV_PORT_INVALID)
+                return 0;
+
         if (link->autonegotiation != 0) {
                 log_info("link_config: autonegotiation is unset or enabled, the speed and duplex are not writable.");
                 return 0;
@@ -563,16 +640,8 @@ int ethtool_set_glinksettings(int *fd, const char *ifname, struct link_config *l
                         return log_warning_errno(r, "link_config: Cannot get device settings for %s : %m", ifname);
         }
 
-        if (link->speed)
-                u->base.speed = DIV_ROUND_UP(link->speed, 1000000);
-
-        if (link->duplex != _DUP_INVALID)
-                u->base.duplex = link->duplex;
-
-        if (link->port != _NET_DEV_PORT_INVALID)
-                u->base.port = link->port;
-
-        u->base.autoneg = link->autonegotiation;
+        if (!ethtool_link_usettings_update(u, link))
+                return 0;
 
         if (u->base.cmd == ETHTOOL_GLINKSETTINGS)
                 r = set_slinksettings(*fd, &ifr, u);
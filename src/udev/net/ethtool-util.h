@@ -94,6 +94,11 @@ int ethtool_set_wol(int *fd, const char *ifname, WakeOnLan wol);
 int ethtool_set_features(int *fd, const char *ifname, NetDevFeature *features);
 int ethtool_set_glinksettings(int *fd, const char *ifname, struct link_config *link);
 
+bool ethtool_features_request(const struct ethtool_gstrings *strings, const NetDevFeature *features,
+                              const struct ethtool_gfeatures *current, struct ethtool_sfeatures *sfeatures);
+struct ethtool_link_usettings *ethtool_link_usettings_new(const struct ethtool_link_settings *req, const uint32_t *link_mode_data);
+bool ethtool_link_usettings_update(struct ethtool_link_usettings *u, const struct link_config *link);
+
 const char *duplex_to_string(Duplex d) _const_;
 Duplex duplex_from_string(const char *d) _pure_;
 
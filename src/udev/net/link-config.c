@@ -25,8 +25,11 @@
 #include "alloc-util.h"
 #include "conf-files.h"
 #include "conf-parser.h"
+#include "ether-addr-util.h"
 #include "ethtool-util.h"
 #include "fd-util.h"
+#include "glob-util.h"
+#include "hashmap.h"
 #include "libudev-private.h"
 #include "link-config.h"
 #include "log.h"
@@ -37,21 +40,41 @@
 #include "path-util.h"
 #include "proc-cmdline.h"
 #include "random-util.h"
+#include "siphash24.h"
 #include "stat-util.h"
 #include "string-table.h"
 #include "string-util.h"
 #include "strv.h"
 #include "util.h"
 
+/* Indexes into link_config_ctx.configs, in increasing order */
+typedef struct LinkConfigBucket {
+        unsigned *indexes;
+        size_t n_indexes;
+        size_t allocated;
+} LinkConfigBucket;
+
 struct link_config_ctx {
         LIST_HEAD(link_config, links);
 
+        /* The configs which apply to this system, in order of priority. Each one is in exactly one bucket:
+         * the one of its MACAddress=, else those of its Driver=, Type= or OriginalName= values if they are
+         * all plain names, else the one looked at for all devices. */
+        link_config **configs;
+        unsigned n_configs;
+        Hashmap *configs_by_mac;
+        Hashmap *configs_by_driver;
+        Hashmap *configs_by_type;
+        Hashmap *configs_by_name;
+        LinkConfigBucket configs_any;
+
         int ethtool_fd;
 
         bool enable_name_policy;
 
         sd_netlink *rtnl;
 
+        const char* const* link_dirs;
         usec_t link_dirs_ts_usec;
 };
 
@@ -64,6 +87,19 @@ static const char* const link_dirs[] = {
 #endif
         NULL};
 
+static void ether_addr_hash_func(const void *p, struct siphash *state) {
+        siphash24_compress(p, sizeof(struct ether_addr), state);
+}
+
+static int ether_addr_compare_func(const void *a, const void *b) {
+        return memcmp(a, b, sizeof(struct ether_addr));
+}
+
+static const struct hash_ops ether_addr_hash_ops = {
+        .hash = ether_addr_hash_func,
+        .compare = ether_addr_compare_func,
+};
+
 static void link_config_free(link_config *link) {
         if (!link)
                 return;
@@ -92,14 +128,44 @@ static void link_config_free(link_config *link) {
 
 DEFINE_TRIVIAL_CLEANUP_FUNC(link_config*, link_config_free);
 
+static void bucket_free(LinkConfigBucket *b) {
+        if (!b)
+                return;
+
+        free(b->indexes);
+        free(b);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(LinkConfigBucket*, bucket_free);
+
+static Hashmap *buckets_free(Hashmap *h) {
+        LinkConfigBucket *b;
+
+        while ((b = hashmap_steal_first(h)))
+                bucket_free(b);
+
+        return hashmap_free(h);
+}
+
 static void link_configs_free(link_config_ctx *ctx) {
         link_config *link, *link_next;
 
         if (!ctx)
                 return;
 
+        ctx->configs = mfree(ctx->configs);
+        ctx->n_configs = 0;
+        ctx->configs_by_mac = buckets_free(ctx->configs_by_mac);
+        ctx->configs_by_driver = buckets_free(ctx->configs_by_driver);
+        ctx->configs_by_type = buckets_free(ctx->configs_by_type);
+        ctx->configs_by_name = buckets_free(ctx->configs_by_name);
+        ctx->configs_any.indexes = mfree(ctx->configs_any.indexes);
+        ctx->configs_any.n_indexes = ctx->configs_any.allocated = 0;
+
         LIST_FOREACH_SAFE(links, link, link_next, ctx->links)
                 link_config_free(link);
+
+        ctx->links = NULL;
 }
 
 void link_config_ctx_free(link_config_ctx *ctx) {
@@ -135,6 +201,8 @@ int link_config_ctx_new(link_config_ctx **ret) {
 
         ctx->enable_name_policy = true;
 
+        ctx->link_dirs = link_dirs;
+
         *ret = ctx;
         ctx = NULL;
 
@@ -196,12 +264,153 @@ static int load_link(link_config_ctx *ctx, const char *filename) {
         return 0;
 }
 
+void link_config_ctx_set_dirs(link_config_ctx *ctx, const char* const* dirs) {
+        assert(ctx);
+
+        ctx->link_dirs = dirs ?: link_dirs;
+}
+
 static bool enable_name_policy(void) {
         bool b;
 
         return proc_cmdline_get_bool("net.ifnames", &b) <= 0 || b;
 }
 
+static int bucket_add(LinkConfigBucket *b, unsigned i) {
+        assert(b);
+
+        /* Configs are added in order, a config that lists the same name twice is added once */
+        if (b->n_indexes > 0 && b->indexes[b->n_indexes - 1] == i)
+                return 0;
+
+        if (!GREEDY_REALLOC(b->indexes, b->allocated, b->n_indexes + 1))
+                return -ENOMEM;
+
+        b->indexes[b->n_indexes++] = i;
+
+        return 0;
+}
+
+static int buckets_add(Hashmap **h, const struct hash_ops *hash_ops, const void *key, unsigned i) {
+        _cleanup_(bucket_freep) LinkConfigBucket *n = NULL;
+        LinkConfigBucket *b;
+        int r;
+
+        assert(h);
+        assert(key);
+
+        b = hashmap_get(*h, key);
+        if (b)
+                return bucket_add(b, i);
+
+        r = hashmap_ensure_allocated(h, hash_ops);
+        if (r < 0)
+                return r;
+
+        n = new0(LinkConfigBucket, 1);
+        if (!n)
+                return -ENOMEM;
+
+        r = bucket_add(n, i);
+        if (r < 0)
+                return r;
+
+        /* The key is owned by the config, which outlives the index */
+        r = hashmap_put(*h, key, n);
+        if (r < 0)
+                return r;
+
+        n = NULL;
+
+        return 0;
+}
+
+/* Whether a list of patterns only matches the values it lists */
+static bool patterns_are_names(char **patterns) {
+        char **p;
+
+        if (strv_isempty(patterns) || patterns[0][0] == '!')
+                return false;
+
+        STRV_FOREACH(p, patterns)
+                if (string_is_glob(*p))
+                        return false;
+
+        return true;
+}
+
+static int buckets_add_names(Hashmap **h, char **names, unsigned i) {
+        char **n;
+        int r;
+
+        STRV_FOREACH(n, names) {
+                r = buckets_add(h, &string_hash_ops, *n, i);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+/* The host, kernel and architecture cannot change while udevd runs, the hostname can */
+static bool link_config_applies_to_system(link_config *link) {
+        if (link->match_virt && condition_test(link->match_virt) <= 0)
+                return false;
+
+        if (link->match_kernel_cmdline && condition_test(link->match_kernel_cmdline) <= 0)
+                return false;
+
+        if (link->match_kernel_version && condition_test(link->match_kernel_version) <= 0)
+                return false;
+
+        if (link->match_arch && condition_test(link->match_arch) <= 0)
+                return false;
+
+        return true;
+}
+
+static int link_configs_index(link_config_ctx *ctx) {
+        link_config *link;
+        unsigned n = 0;
+        int r;
+
+        assert(ctx);
+
+        LIST_FOREACH(links, link, ctx->links)
+                n++;
+
+        ctx->configs = new(link_config*, n);
+        if (!ctx->configs)
+                return log_oom();
+
+        LIST_FOREACH(links, link, ctx->links) {
+                unsigned i;
+
+                if (!link_config_applies_to_system(link)) {
+                        log_debug("Config file %s does not apply to this system, ignoring", link->filename);
+                        continue;
+                }
+
+                i = ctx->n_configs++;
+                ctx->configs[i] = link;
+
+                if (link->match_mac)
+                        r = buckets_add(&ctx->configs_by_mac, &ether_addr_hash_ops, link->match_mac, i);
+                else if (patterns_are_names(link->match_driver))
+                        r = buckets_add_names(&ctx->configs_by_driver, link->match_driver, i);
+                else if (patterns_are_names(link->match_type))
+                        r = buckets_add_names(&ctx->configs_by_type, link->match_type, i);
+                else if (patterns_are_names(link->match_name))
+                        r = buckets_add_names(&ctx->configs_by_name, link->match_name, i);
+                else
+                        r = bucket_add(&ctx->configs_any, i);
+                if (r < 0)
+                        return log_oom();
+        }
+
+        return 0;
+}
+
 int link_config_load(link_config_ctx *ctx) {
         _cleanup_strv_free_ char **files;
         char **f;
@@ -215,9 +424,9 @@ int link_config_load(link_config_ctx *ctx) {
         }
 
         /* update timestamp */
-        paths_check_timestamp(link_dirs, &ctx->link_dirs_ts_usec, true);
+        paths_check_timestamp(ctx->link_dirs, &ctx->link_dirs_ts_usec, true);
 
-        r = conf_files_list_strv(&files, ".link", NULL, 0, link_dirs);
+        r = conf_files_list_strv(&files, ".link", NULL, 0, ctx->link_dirs);
         if (r < 0)
                 return log_error_errno(r, "failed to enumerate link files: %m");
 
@@ -227,36 +436,99 @@ int link_config_load(link_config_ctx *ctx) {
                         return r;
         }
 
-        return 0;
+        return link_configs_index(ctx);
 }
 
 bool link_config_should_reload(link_config_ctx *ctx) {
-        return paths_check_timestamp(link_dirs, &ctx->link_dirs_ts_usec, false);
+        return paths_check_timestamp(ctx->link_dirs, &ctx->link_dirs_ts_usec, false);
+}
+
+typedef struct LinkConfigCandidates {
+        const LinkConfigBucket *buckets[5];
+        size_t positions[5];
+        unsigned n_buckets;
+} LinkConfigCandidates;
+
+static void candidates_add(LinkConfigCandidates *c, const LinkConfigBucket *b) {
+        assert(c);
+        assert(c->n_buckets < ELEMENTSOF(c->buckets));
+
+        if (!b)
+                return;
+
+        c->buckets[c->n_buckets] = b;
+        c->positions[c->n_buckets] = 0;
+        c->n_buckets++;
+}
+
+/* Returns the configs of the buckets in order of priority, like a scan of all configs would */
+static link_config *candidates_next(link_config_ctx *ctx, LinkConfigCandidates *c) {
+        unsigned k, best = UINT_MAX, best_index = UINT_MAX;
+
+        for (k = 0; k < c->n_buckets; k++) {
+                const LinkConfigBucket *b = c->buckets[k];
+
+                if (c->positions[k] < b->n_indexes && b->indexes[c->positions[k]] < best_index) {
+                        best = k;
+                        best_index = b->indexes[c->positions[k]];
+                }
+        }
+
+        if (best == UINT_MAX)
+                return NULL;
+
+        c->positions[best]++;
+
+        return ctx->configs[best_index];
 }
 
 int link_config_get(link_config_ctx *ctx, struct udev_device *device,
                     link_config **ret) {
+        LinkConfigCandidates candidates = {};
+        struct ether_addr mac_buf, *mac = NULL;
+        const char *attr_value, *path, *parent_driver = NULL, *driver, *type, *name;
+        struct udev_device *parent;
         link_config *link;
 
         assert(ctx);
         assert(device);
         assert(ret);
 
-        LIST_FOREACH(links, link, ctx->links) {
-                const char* attr_value;
+        attr_value = udev_device_get_sysattr_value(device, "address");
+        if (attr_value) {
+                mac = ether_aton(attr_value);
+                if (mac) {
+                        mac_buf = *mac;
+                        mac = &mac_buf;
+                }
+        }
 
-                attr_value = udev_device_get_sysattr_value(device, "address");
+        path = udev_device_get_property_value(device, "ID_PATH");
+        parent = udev_device_get_parent(device);
+        if (parent)
+                parent_driver = udev_device_get_driver(parent);
+        driver = udev_device_get_property_value(device, "ID_NET_DRIVER");
+        type = udev_device_get_devtype(device);
+        name = udev_device_get_sysname(device);
 
+        /* A config can only match if it is in the bucket of one of the values of the device, or in the one
+         * looked at for all devices */
+        candidates_add(&candidates, &ctx->configs_any);
+        if (mac)
+                candidates_add(&candidates, hashmap_get(ctx->configs_by_mac, mac));
+        if (driver)
+                candidates_add(&candidates, hashmap_get(ctx->configs_by_driver, driver));
+        if (type)
+                candidates_add(&candidates, hashmap_get(ctx->configs_by_type, type));
+        if (name)
+                candidates_add(&candidates, hashmap_get(ctx->configs_by_name, name));
+
+        while ((link = candidates_next(ctx, &candidates))) {
+                /* The other conditions were tested when the configs were loaded */
                 if (net_match_config(link->match_mac, link->match_path, link->match_driver,
                                      link->match_type, link->match_name, link->match_host,
-                                     link->match_virt, link->match_kernel_cmdline,
-                                     link->match_kernel_version, link->match_arch,
-                                     attr_value ? ether_aton(attr_value) : NULL,
-                                     udev_device_get_property_value(device, "ID_PATH"),
-                                     udev_device_get_driver(udev_device_get_parent(device)),
-                                     udev_device_get_property_value(device, "ID_NET_DRIVER"),
-                                     udev_device_get_devtype(device),
-                                     udev_device_get_sysname(device))) {
+                                     NULL, NULL, NULL, NULL,
+                                     mac, path, parent_driver, driver, type, name)) {
                         if (link->match_name) {
                                 unsigned char name_assign_type = NET_NAME_UNKNOWN;
 
@@ -309,6 +581,35 @@ static bool mac_is_random(struct udev_device *device) {
         return type == NET_ADDR_RANDOM;
 }
 
+/* The current values are read from sysfs, the address was read already when the config was looked up */
+bool link_has_mac(struct udev_device *device, const struct ether_addr *mac) {
+        struct ether_addr *current;
+        const char *s;
+
+        s = udev_device_get_sysattr_value(device, "address");
+        if (!s)
+                return false;
+
+        current = ether_aton(s);
+
+        return current && ether_addr_equal(current, mac);
+}
+
+bool link_has_mtu(struct udev_device *device, size_t mtu) {
+        const char *s;
+        unsigned current;
+
+        s = udev_device_get_sysattr_value(device, "mtu");
+        if (!s)
+                return false;
+
+        return safe_atou(s, &current) >= 0 && current == mtu;
+}
+
+bool link_has_alias(struct udev_device *device, const char *alias) {
+        return streq_ptr(udev_device_get_sysattr_value(device, "ifalias"), alias);
+}
+
 static bool should_rename(struct udev_device *device, bool respect_predictable) {
         const char *s;
         unsigned type;
@@ -370,8 +671,9 @@ int link_config_apply(link_config_ctx *ctx, link_config *config,
         struct ether_addr generated_mac;
         struct ether_addr *mac = NULL;
         const char *new_name = NULL;
-        const char *old_name;
+        const char *old_name, *alias;
         unsigned speed;
+        size_t mtu;
         int r, ifindex;
 
         assert(ctx);
@@ -478,7 +780,19 @@ int link_config_apply(link_config_ctx *ctx, link_config *config,
                         mac = config->mac;
         }
 
-        r = rtnl_set_link_properties(&ctx->rtnl, ifindex, config->alias, mac, config->mtu);
+        /* Only what differs is set, and nothing at all if the link is configured already */
+        alias = config->alias;
+        if (alias && link_has_alias(device, alias))
+                alias = NULL;
+
+        if (mac && link_has_mac(device, mac))
+                mac = NULL;
+
+        mtu = config->mtu;
+        if (mtu > 0 && link_has_mtu(device, mtu))
+                mtu = 0;
+
+        r = rtnl_set_link_properties(&ctx->rtnl, ifindex, alias, mac, mtu);
         if (r < 0)
                 return log_warning_errno(r, "Could not set Alias, MACAddress or MTU on %s: %m", old_name);
 
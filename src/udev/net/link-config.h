@@ -81,6 +81,7 @@ struct link_config {
 
 int link_config_ctx_new(link_config_ctx **ret);
 void link_config_ctx_free(link_config_ctx *ctx);
+void link_config_ctx_set_dirs(link_config_ctx *ctx, const char* const* dirs);
 
 int link_config_load(link_config_ctx *ctx);
 bool link_config_should_reload(link_config_ctx *ctx);
@@ -90,6 +91,10 @@ int link_config_apply(link_config_ctx *ctx, struct link_config *config, struct u
 
 int link_get_driver(link_config_ctx *ctx, struct udev_device *device, char **ret);
 
+bool link_has_mac(struct udev_device *device, const struct ether_addr *mac);
+bool link_has_mtu(struct udev_device *device, size_t mtu);
+bool link_has_alias(struct udev_device *device, const char *alias);
+
 const char *name_policy_to_string(NamePolicy p) _const_;
 NamePolicy name_policy_from_string(const char *p) _pure_;
 
@@ -0,0 +1,227 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Checks that only the settings which differ from the current state of a device cause a write */
+
+#include "alloc-util.h"
+#include "ethtool-util.h"
+#include "link-config.h"
+#include "log.h"
+#include "macro.h"
+#include "string-util.h"
+#include "tests.h"
+
+#define N_STRINGS 40U
+#define N_BLOCKS DIV_ROUND_UP(N_STRINGS, 32U)
+
+/* the features we look up, where a driver might list them; UFO is not listed */
+#define GSO_INDEX 0
+#define GRO_INDEX 3
+#define LRO_INDEX 31
+#define TSO_INDEX 33
+#define TSO6_INDEX 39
+
+#define BIT(i) (UINT32_C(1) << ((i) % 32))
+
+static struct ethtool_gstrings *strings_new(void) {
+        struct ethtool_gstrings *strings;
+        unsigned i;
+
+        strings = malloc0(sizeof(struct ethtool_gstrings) + N_STRINGS * ETH_GSTRING_LEN);
+        assert_se(strings);
+
+        strings->cmd = ETHTOOL_GSTRINGS;
+        strings->string_set = ETH_SS_FEATURES;
+        strings->len = N_STRINGS;
+
+        for (i = 0; i < N_STRINGS; i++)
+                assert_se(snprintf((char *) &strings->data[i * ETH_GSTRING_LEN], ETH_GSTRING_LEN, "feature-%u", i) < ETH_GSTRING_LEN);
+
+        strcpy((char *) &strings->data[GSO_INDEX * ETH_GSTRING_LEN], "tx-generic-segmentation");
+        strcpy((char *) &strings->data[GRO_INDEX * ETH_GSTRING_LEN], "rx-gro");
+        strcpy((char *) &strings->data[LRO_INDEX * ETH_GSTRING_LEN], "rx-lro");
+        strcpy((char *) &strings->data[TSO_INDEX * ETH_GSTRING_LEN], "tx-tcp-segmentation");
+        strcpy((char *) &strings->data[TSO6_INDEX * ETH_GSTRING_LEN], "tx-tcp6-segmentation");
+
+        return strings;
+}
+
+static void features_unset(NetDevFeature *features) {
+        unsigned i;
+
+        for (i = 0; i < _NET_DEV_FEAT_MAX; i++)
+                features[i] = -1;
+}
+
+static void test_features_request(void) {
+        _cleanup_free_ struct ethtool_gstrings *strings = NULL;
+        struct ethtool_gfeatures *current;
+        struct ethtool_sfeatures *sfeatures;
+        NetDevFeature features[_NET_DEV_FEAT_MAX];
+
+        log_info("/* %s */", __func__);
+
+        strings = strings_new();
+        current = alloca0(sizeof(struct ethtool_gfeatures) + N_BLOCKS * sizeof(current->features[0]));
+        current->size = N_BLOCKS;
+        sfeatures = alloca0(sizeof(struct ethtool_sfeatures) + N_BLOCKS * sizeof(sfeatures->features[0]));
+        sfeatures->size = N_BLOCKS;
+
+        /* the device has GSO, GRO, LRO and TSO enabled, and TSO6 disabled */
+        current->features[0].requested = BIT(GSO_INDEX) | BIT(GRO_INDEX) | BIT(LRO_INDEX);
+        current->features[1].requested = BIT(TSO_INDEX);
+
+        /* nothing configured */
+        features_unset(features);
+        assert_se(!ethtool_features_request(strings, features, current, sfeatures));
+        assert_se(sfeatures->features[0].valid == 0 && sfeatures->features[1].valid == 0);
+
+        /* the current state, in both blocks */
+        features[NET_DEV_FEAT_GRO] = true;
+        features[NET_DEV_FEAT_TSO] = true;
+        features[NET_DEV_FEAT_TSO6] = false;
+        assert_se(!ethtool_features_request(strings, features, current, sfeatures));
+        assert_se(sfeatures->features[0].valid == BIT(GRO_INDEX));
+        assert_se(sfeatures->features[0].requested == BIT(GRO_INDEX));
+        assert_se(sfeatures->features[1].valid == (BIT(TSO_INDEX) | BIT(TSO6_INDEX)));
+        assert_se(sfeatures->features[1].requested == BIT(TSO_INDEX));
+
+        /* a feature the driver does not list is ignored */
+        features[NET_DEV_FEAT_UFO] = true;
+        assert_se(!ethtool_features_request(strings, features, current, sfeatures));
+
+        /* one which differs, and the others are requested too */
+        features[NET_DEV_FEAT_LRO] = false;
+        assert_se(ethtool_features_request(strings, features, current, sfeatures));
+        assert_se(sfeatures->features[0].valid == (BIT(GRO_INDEX) | BIT(LRO_INDEX)));
+        assert_se(sfeatures->features[0].requested == BIT(GRO_INDEX));
+        assert_se(sfeatures->features[1].valid == (BIT(TSO_INDEX) | BIT(TSO6_INDEX)));
+        assert_se(sfeatures->features[1].requested == BIT(TSO_INDEX));
+
+        /* in the second block */
+        features[NET_DEV_FEAT_LRO] = true;
+        features[NET_DEV_FEAT_TSO6] = true;
+        assert_se(ethtool_features_request(strings, features, current, sfeatures));
+        assert_se(sfeatures->features[1].requested == (BIT(TSO_INDEX) | BIT(TSO6_INDEX)));
+
+        /* without the current state */
+        features_unset(features);
+        features[NET_DEV_FEAT_GSO] = true;
+        assert_se(ethtool_features_request(strings, features, NULL, sfeatures));
+}
+
+static void test_link_usettings_new(void) {
+        _cleanup_free_ struct ethtool_link_usettings *u = NULL;
+        struct ethtool_link_settings req = {
+                .cmd = ETHTOOL_GLINKSETTINGS,
+                .speed = 1000,
+                .duplex = DUPLEX_FULL,
+                .port = PORT_TP,
+                .autoneg = AUTONEG_DISABLE,
+                .link_mode_masks_nwords = 2,
+        };
+        const uint32_t link_mode_data[] = { 1, 2, 3, 4, 5, 6 };
+
+        log_info("/* %s */", __func__);
+
+        /* the settings read are the ones of the device */
+        u = ethtool_link_usettings_new(&req, link_mode_data);
+        assert_se(u);
+        assert_se(u->base.cmd == ETHTOOL_GLINKSETTINGS);
+        assert_se(u->base.speed == 1000);
+        assert_se(u->base.duplex == DUPLEX_FULL);
+        assert_se(u->base.port == PORT_TP);
+        assert_se(u->base.autoneg == AUTONEG_DISABLE);
+        assert_se(u->base.link_mode_masks_nwords == 2);
+
+        assert_se(u->link_modes.supported[0] == 1 && u->link_modes.supported[1] == 2);
+        assert_se(u->link_modes.advertising[0] == 3 && u->link_modes.advertising[1] == 4);
+        assert_se(u->link_modes.lp_advertising[0] == 5 && u->link_modes.lp_advertising[1] == 6);
+        assert_se(u->link_modes.supported[2] == 0);
+}
+
+static void test_link_usettings_update(void) {
+        struct ethtool_link_usettings u = {
+                .base = {
+                        .cmd = ETHTOOL_GLINKSETTINGS,
+                        .speed = 1000,
+                        .duplex = DUPLEX_FULL,
+                        .port = PORT_TP,
+                        .autoneg = AUTONEG_DISABLE,
+                        .link_mode_masks_nwords = 1,
+                },
+        };
+        struct link_config link = {
+                .duplex = _DUP_INVALID,
+                .port = _NET_DEV_PORT_INVALID,
+                .autonegotiation = -1,
+        };
+
+        log_info("/* %s */", __func__);
+
+        /* nothing configured */
+        assert_se(!ethtool_link_usettings_update(&u, &link));
+
+        /* the current values; the speed is configured in bits per second */
+        link.speed = 1000 * 1000 * 1000;
+        link.duplex = DUP_FULL;
+        link.port = NET_DEV_PORT_TP;
+        link.autonegotiation = 0;
+        assert_se(!ethtool_link_usettings_update(&u, &link));
+
+        link.speed = 1000 * 1000 * 1000 - 1;
+        assert_se(!ethtool_link_usettings_update(&u, &link));
+
+        /* each of them differing */
+        link.speed = 100 * 1000 * 1000;
+        assert_se(ethtool_link_usettings_update(&u, &link));
+        assert_se(u.base.speed == 100);
+        assert_se(!ethtool_link_usettings_update(&u, &link));
+
+        link.duplex = DUP_HALF;
+        assert_se(ethtool_link_usettings_update(&u, &link));
+        assert_se(u.base.duplex == DUPLEX_HALF);
+        assert_se(!ethtool_link_usettings_update(&u, &link));
+
+        link.port = NET_DEV_PORT_FIBRE;
+        assert_se(ethtool_link_usettings_update(&u, &link));
+        assert_se(u.base.port == PORT_FIBRE);
+        assert_se(!ethtool_link_usettings_update(&u, &link));
+
+        u.base.autoneg = AUTONEG_ENABLE;
+        assert_se(ethtool_link_usettings_update(&u, &link));
+        assert_se(u.base.autoneg == AUTONEG_DISABLE);
+        assert_se(!ethtool_link_usettings_update(&u, &link));
+
+        /* the others are left as they are */
+        assert_se(u.base.speed == 100);
+        assert_se(u.base.duplex == DUPLEX_HALF);
+        assert_se(u.base.cmd == ETHTOOL_GLINKSETTINGS);
+        assert_se(u.base.link_mode_masks_nwords == 1);
+}
+
+int main(int argc, char *argv[]) {
+        log_parse_environment();
+        log_open();
+
+        test_features_request();
+        test_link_usettings_new();
+        test_link_usettings_update();
+
+        return 0;
+}
@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Writes many .link files, as a fleet that ships one per machine would, plus one that matches each network
+ * device of this system by its MAC address and a catch-all one, and reports how long looking up the config
+ * of each network device takes. Each device must get its own config, or the catch-all one. */
+
+#include <netinet/ether.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "ether-addr-util.h"
+#include "fileio.h"
+#include "link-config.h"
+#include "log.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "udev-util.h"
+#include "util.h"
+
+static unsigned arg_configs;
+static unsigned arg_rounds = 1000;
+
+static void write_link(const char *dir, const char *name, const char *match) {
+        _cleanup_free_ char *fn = NULL, *s = NULL;
+
+        fn = strjoin(dir, "/", name, ".link");
+        s = strjoin("[Match]\n", match, "\n[Link]\nNamePolicy=kernel\n");
+        assert_se(fn && s);
+
+        assert_se(write_string_file(fn, s, WRITE_STRING_FILE_CREATE) >= 0);
+}
+
+static unsigned write_links(const char *dir, struct udev_device **devices, unsigned n_devices) {
+        unsigned i, n = arg_configs;
+
+        /* Mostly configs matching on MAC addresses, some on drivers and some on paths */
+        for (i = 0; i < arg_configs; i++) {
+                _cleanup_free_ char *name = NULL, *match = NULL;
+
+                assert_se(asprintf(&name, "10-host-%06u", i) >= 0);
+
+                if (i % 8 == 0)
+                        assert_se(asprintf(&match, "Path=pci-0000:%02x:%02x.0", i / 256 % 256, i % 256) >= 0);
+                else if (i % 8 == 1)
+                        assert_se(asprintf(&match, "Driver=drv%u", i) >= 0);
+                else
+                        assert_se(asprintf(&match, "MACAddress=02:42:%02x:%02x:%02x:%02x",
+                                           i >> 24, (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff) >= 0);
+
+                write_link(dir, name, match);
+        }
+
+        for (i = 0; i < n_devices; i++) {
+                const char *address;
+                struct ether_addr *mac;
+
+                address = udev_device_get_sysattr_value(devices[i], "address");
+                mac = address ? ether_aton(address) : NULL;
+                if (!mac || ether_addr_is_null(mac))
+                        continue;
+
+                write_link(dir, strjoina("50-", udev_device_get_sysname(devices[i])), strjoina("MACAddress=", address));
+                n++;
+        }
+
+        write_link(dir, "99-default", "");
+
+        return n + 1;
+}
+
+static unsigned get_devices(struct udev *udev, struct udev_device ***ret) {
+        _cleanup_udev_enumerate_unref_ struct udev_enumerate *e = NULL;
+        struct udev_list_entry *entry;
+        struct udev_device **devices = NULL;
+        size_t allocated = 0;
+        unsigned n = 0;
+
+        e = udev_enumerate_new(udev);
+        assert_se(e);
+        assert_se(udev_enumerate_add_match_subsystem(e, "net") >= 0);
+        assert_se(udev_enumerate_scan_devices(e) >= 0);
+
+        udev_list_entry_foreach(entry, udev_enumerate_get_list_entry(e)) {
+                struct udev_device *d;
+
+                d = udev_device_new_from_syspath(udev, udev_list_entry_get_name(entry));
+                if (!d)
+                        continue;
+
+                assert_se(GREEDY_REALLOC(devices, allocated, n + 1));
+                devices[n++] = d;
+        }
+
+        *ret = devices;
+
+        return n;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_udev_unref_ struct udev *udev = NULL;
+        _cleanup_free_ struct udev_device **devices = NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX], c[FORMAT_TIMESPAN_MAX];
+        char t[] = "/tmp/link-config-XXXXXX";
+        const char *dirs[] = { t, NULL };
+        link_config_ctx *ctx;
+        unsigned i, k, n_devices, n_configs;
+        usec_t load, lookup;
+
+        test_setup_logging(LOG_INFO);
+
+        if (argc >= 2)
+                assert_se(safe_atou(argv[1], &arg_configs) >= 0);
+        else
+                arg_configs = slow_tests_enabled() ? 100000 : 5000;
+
+        if (argc >= 3)
+                assert_se(safe_atou(argv[2], &arg_rounds) >= 0 && arg_rounds > 0);
+
+        udev = udev_new();
+        assert_se(udev);
+
+        n_devices = get_devices(udev, &devices);
+        if (n_devices == 0)
+                return EXIT_TEST_SKIP;
+
+        assert_se(mkdtemp(t));
+        n_configs = write_links(t, devices, n_devices);
+
+        assert_se(link_config_ctx_new(&ctx) >= 0);
+        link_config_ctx_set_dirs(ctx, dirs);
+
+        /* Parsing the configs is not of interest here */
+        log_set_max_level(LOG_WARNING);
+
+        load = now(CLOCK_MONOTONIC);
+        assert_se(link_config_load(ctx) >= 0);
+        load = now(CLOCK_MONOTONIC) - load;
+
+        log_set_max_level(LOG_INFO);
+
+        lookup = now(CLOCK_MONOTONIC);
+
+        for (k = 0; k < arg_rounds; k++)
+                for (i = 0; i < n_devices; i++) {
+                        link_config *link;
+                        const char *expected;
+
+                        assert_se(link_config_get(ctx, devices[i], &link) >= 0);
+
+                        if (k > 0)
+                                continue;
+
+                        expected = strjoina(t, "/50-", udev_device_get_sysname(devices[i]), ".link");
+                        if (access(expected, F_OK) < 0)
+                                expected = strjoina(t, "/99-default.link");
+
+                        log_debug("%s: %s", udev_device_get_sysname(devices[i]), link->filename);
+                        assert_se(path_equal(link->filename, expected));
+                }
+
+        lookup = now(CLOCK_MONOTONIC) - lookup;
+
+        log_info("%u configs loaded in %s, %u lookups for %u devices in %s, %s per lookup",
+                 n_configs, format_timespan(a, sizeof(a), load, 1),
+                 arg_rounds * n_devices, n_devices, format_timespan(b, sizeof(b), lookup, 1),
+                 format_timespan(c, sizeof(c), lookup / (arg_rounds * n_devices), 1));
+
+        link_config_ctx_free(ctx);
+
+        for (i = 0; i < n_devices; i++)
+                udev_device_unref(devices[i]);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return 0;
+}
@@ -0,0 +1,233 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Checks that looking up the config of a network device in the buckets of its driver, type and name and in
+ * the catch-all one finds the same config as a scan of all configs in order of priority would. The devices
+ * are made up from uevent properties, hence the MAC address and the parent driver are never known.
+ *
+ * Also checks the comparison of the configured values with the current ones of the loopback device, which
+ * decides what is set when a config is applied. */
+
+#include <netinet/ether.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fileio.h"
+#include "libudev-private.h"
+#include "link-config.h"
+#include "log.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "path-util.h"
+#include "rm-rf.h"
+#include "string-util.h"
+#include "tests.h"
+#include "udev-util.h"
+
+/* Each config is in the bucket noted next to it */
+static const struct {
+        const char *name;
+        const char *match;
+} configs[] = {
+        { "10-driver",         "Driver=drv-a\nOriginalName=eth-*" },        /* driver drv-a */
+        { "20-type",           "Type=wlan" },                                /* type wlan */
+        { "30-name",           "OriginalName=eth-c" },                       /* name eth-c */
+        { "40-glob",           "OriginalName=glob*" },                       /* catch-all */
+        { "50-negated",        "Driver=!drv-a\nPath=neg-*" },                /* catch-all */
+        { "60-names",          "OriginalName=eth-a eth-b eth-a" },           /* names eth-a and eth-b */
+        { "70-driver-globs",   "Driver=drv-m drv-g*" },                      /* catch-all */
+        { "80-drivers",        "Driver=drv-x drv-y\nOriginalName=eth-*" },   /* drivers drv-x and drv-y */
+        { "99-default",        "" },                                         /* catch-all */
+};
+
+static const struct {
+        const char *name;
+        const char *driver;
+        const char *type;
+        const char *path;
+        const char *expected;
+} devices[] = {
+        /* one bucket */
+        { "eth-a",  NULL,    NULL,   NULL,    "60-names" },
+        { "eth-c",  NULL,    NULL,   NULL,    "30-name" },
+        { "eth-q",  "drv-y", NULL,   NULL,    "80-drivers" },
+        { "wl-q",   NULL,    "wlan", NULL,    "20-type" },
+        { "eth-q",  NULL,    NULL,   NULL,    "99-default" },
+
+        /* the first config wins, whichever bucket it is in */
+        { "eth-a",  "drv-a", NULL,   NULL,    "10-driver" },
+        { "eth-b",  "drv-y", NULL,   NULL,    "60-names" },
+        { "eth-c",  NULL,    "wlan", NULL,    "20-type" },
+        { "eth-q",  "drv-y", "wlan", NULL,    "20-type" },
+        { "glob-q", NULL,    "wlan", NULL,    "20-type" },
+        { "eth-a",  "drv-y", NULL,   "neg-q", "50-negated" },
+
+        /* a config of a bucket which does not match on all its conditions lets later ones match */
+        { "wl-q",   "drv-y", NULL,   NULL,    "99-default" },
+        { "glob-q", "drv-a", NULL,   NULL,    "40-glob" },
+
+        /* globs and negations are looked at for all devices */
+        { "glob-q", NULL,    NULL,   NULL,    "40-glob" },
+        { "eth-q",  "drv-q", NULL,   "neg-q", "50-negated" },
+        { "eth-q",  NULL,    NULL,   "neg-q", "50-negated" },
+        { "eth-q",  "drv-a", NULL,   "neg-q", "10-driver" },
+        { "wl-q",   "drv-a", NULL,   "neg-q", "99-default" },
+        { "eth-q",  "drv-m", NULL,   NULL,    "70-driver-globs" },
+        { "eth-q",  "drv-gq", NULL,  NULL,    "70-driver-globs" },
+};
+
+static void write_link(const char *dir, const char *name, const char *match) {
+        _cleanup_free_ char *fn = NULL, *s = NULL;
+
+        fn = strjoin(dir, "/", name, ".link");
+        s = strjoin("[Match]\n", match, "\n[Link]\nNamePolicy=kernel\n");
+        assert_se(fn && s);
+
+        assert_se(write_string_file(fn, s, WRITE_STRING_FILE_CREATE) >= 0);
+}
+
+/* A device as received from the kernel, which does not exist in sysfs */
+static struct udev_device *device_new(struct udev *udev, const char *name, const char *driver, const char *type, const char *path) {
+        _cleanup_free_ char *buf = NULL;
+        size_t size = 0, allocated = 0;
+        const char *properties[] = {
+                "ACTION=add",
+                "SEQNUM=1",
+                "SUBSYSTEM=net",
+                strjoina("DEVPATH=/devices/virtual/net/test-link-config/", name),
+                strjoina("INTERFACE=", name),
+                driver ? strjoina("ID_NET_DRIVER=", driver) : NULL,
+                type ? strjoina("DEVTYPE=", type) : NULL,
+                path ? strjoina("ID_PATH=", path) : NULL,
+        };
+        unsigned i;
+
+        for (i = 0; i < ELEMENTSOF(properties); i++) {
+                size_t l;
+
+                if (!properties[i])
+                        continue;
+
+                l = strlen(properties[i]) + 1;
+                assert_se(GREEDY_REALLOC(buf, allocated, size + l));
+                memcpy(buf + size, properties[i], l);
+                size += l;
+        }
+
+        return udev_device_new_from_nulstr(udev, buf, size);
+}
+
+static void test_link_config_get(struct udev *udev, link_config_ctx *ctx, const char *dir, bool with_default) {
+        unsigned i;
+
+        for (i = 0; i < ELEMENTSOF(devices); i++) {
+                _cleanup_udev_device_unref_ struct udev_device *device = NULL;
+                link_config *link;
+                int r;
+
+                device = device_new(udev, devices[i].name, devices[i].driver, devices[i].type, devices[i].path);
+                assert_se(device);
+                assert_se(streq(udev_device_get_sysname(device), devices[i].name));
+
+                r = link_config_get(ctx, device, &link);
+
+                log_debug("%s driver=%s type=%s path=%s: %s", devices[i].name,
+                          strnull(devices[i].driver), strnull(devices[i].type), strnull(devices[i].path),
+                          r < 0 ? "none" : link->filename);
+
+                if (!with_default && streq(devices[i].expected, "99-default")) {
+                        assert_se(r == -ENOENT);
+                        assert_se(!link);
+                        continue;
+                }
+
+                assert_se(r >= 0);
+                assert_se(path_equal(link->filename, strjoina(dir, "/", devices[i].expected, ".link")));
+        }
+}
+
+/* The current values are compared with the ones read from sysfs directly */
+static void test_link_has(struct udev *udev) {
+        _cleanup_udev_device_unref_ struct udev_device *device = NULL;
+        _cleanup_free_ char *address = NULL, *mtu = NULL, *alias = NULL;
+        struct ether_addr mac, *m;
+        unsigned current_mtu;
+
+        log_info("/* %s */", __func__);
+
+        device = udev_device_new_from_subsystem_sysname(udev, "net", "lo");
+        if (!device ||
+            read_one_line_file("/sys/class/net/lo/address", &address) < 0 ||
+            read_one_line_file("/sys/class/net/lo/mtu", &mtu) < 0) {
+                log_notice("Loopback device not found in sysfs, skipping.");
+                return;
+        }
+
+        m = ether_aton(address);
+        assert_se(m);
+        mac = *m;
+        assert_se(link_has_mac(device, &mac));
+        mac.ether_addr_octet[5] ^= 1;
+        assert_se(!link_has_mac(device, &mac));
+
+        assert_se(safe_atou(mtu, &current_mtu) >= 0);
+        assert_se(link_has_mtu(device, current_mtu));
+        assert_se(!link_has_mtu(device, current_mtu - 1));
+        assert_se(!link_has_mtu(device, current_mtu + 1));
+
+        if (read_one_line_file("/sys/class/net/lo/ifalias", &alias) >= 0)
+                assert_se(link_has_alias(device, alias));
+        assert_se(!link_has_alias(device, "test-link-config"));
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_udev_unref_ struct udev *udev = NULL;
+        char t[] = "/tmp/test-link-config-XXXXXX";
+        const char *dirs[] = { t, NULL };
+        link_config_ctx *ctx;
+        unsigned i;
+
+        log_parse_environment();
+        log_open();
+
+        udev = udev_new();
+        assert_se(udev);
+
+        assert_se(mkdtemp(t));
+        for (i = 0; i < ELEMENTSOF(configs); i++)
+                write_link(t, configs[i].name, configs[i].match);
+
+        assert_se(link_config_ctx_new(&ctx) >= 0);
+        link_config_ctx_set_dirs(ctx, dirs);
+
+        assert_se(link_config_load(ctx) >= 0);
+        test_link_config_get(udev, ctx, t, true);
+
+        /* without the catch-all config, and reloaded */
+        assert_se(unlink(strjoina(t, "/99-default.link")) >= 0);
+        assert_se(link_config_load(ctx) >= 0);
+        test_link_config_get(udev, ctx, t, false);
+
+        link_config_ctx_free(ctx);
+
+        test_link_has(udev);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return 0;
+}
@@ -0,0 +1,168 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Sends a worker statistics request over a control socket of its own to a forked daemon side, which
+ * answers as udevd does, or hangs up. */
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "fd-util.h"
+#include "log.h"
+#include "macro.h"
+#include "process-util.h"
+#include "rm-rf.h"
+#include "socket-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "udev.h"
+
+/* more than fits into the buffer of a control message */
+static char *reply_new(void) {
+        char *reply = NULL;
+        size_t size = 0, allocated = 0;
+        unsigned i;
+
+        for (i = 0; i < 256; i++) {
+                char line[LINE_MAX];
+                int l;
+
+                l = snprintf(line, sizeof(line), "WORKER%u_PID=%u\nWORKER%u_EVENTS=%u\n", i, 1000 + i, i, 7 * i);
+                assert_se(l > 0 && (size_t) l < sizeof(line));
+
+                assert_se(GREEDY_REALLOC(reply, allocated, size + l + 1));
+                memcpy(reply + size, line, l + 1);
+                size += l;
+        }
+
+        return reply;
+}
+
+/* the daemon side: accepts one connection and answers the request it reads, if told to */
+static void daemon_side(int fd, const char *reply) {
+        struct udev_ctrl *uctrl;
+        struct udev_ctrl_connection *conn;
+        struct udev_ctrl_msg *msg;
+
+        uctrl = udev_ctrl_new_from_fd(NULL, fd);
+        assert_se(uctrl);
+
+        conn = udev_ctrl_get_connection(uctrl);
+        assert_se(conn);
+
+        msg = udev_ctrl_receive_msg(conn);
+        assert_se(msg);
+        assert_se(udev_ctrl_get_worker_stats(msg) > 0);
+        assert_se(udev_ctrl_get_ping(msg) < 0);
+        assert_se(udev_ctrl_get_exit(msg) < 0);
+
+        if (reply)
+                assert_se(udev_ctrl_connection_send_reply(conn, reply) >= 0);
+
+        udev_ctrl_msg_unref(msg);
+        udev_ctrl_connection_unref(conn);
+        udev_ctrl_unref(uctrl);
+}
+
+static int request(const union sockaddr_union *sa, const char *reply, char **ret) {
+        _cleanup_close_ int listen_fd = -1;
+        struct udev_ctrl *uctrl;
+        siginfo_t si;
+        pid_t pid;
+        int fd, r;
+
+        listen_fd = socket(AF_LOCAL, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+        assert_se(listen_fd >= 0);
+        (void) unlink(sa->un.sun_path);
+        assert_se(bind(listen_fd, &sa->sa, SOCKADDR_UN_LEN(sa->un)) >= 0);
+        assert_se(listen(listen_fd, 1) >= 0);
+
+        pid = fork();
+        assert_se(pid >= 0);
+        if (pid == 0) {
+                daemon_side(listen_fd, reply);
+                _exit(EXIT_SUCCESS);
+        }
+
+        /* the socket is connected already, the request is sent on it rather than to /run/udev/control */
+        fd = socket(AF_LOCAL, SOCK_SEQPACKET|SOCK_CLOEXEC, 0);
+        assert_se(fd >= 0);
+        assert_se(connect(fd, &sa->sa, SOCKADDR_UN_LEN(sa->un)) >= 0);
+
+        uctrl = udev_ctrl_new_from_fd(NULL, fd);
+        assert_se(uctrl);
+
+        r = udev_ctrl_send_get_worker_stats(uctrl, 10, ret);
+        udev_ctrl_unref(uctrl);
+
+        assert_se(wait_for_terminate(pid, &si) >= 0);
+        assert_se(si.si_code == CLD_EXITED);
+        assert_se(si.si_status == EXIT_SUCCESS);
+
+        return r;
+}
+
+static void test_get_worker_stats(const union sockaddr_union *sa) {
+        _cleanup_free_ char *expected = NULL, *reply = NULL;
+
+        log_info("/* %s */", __func__);
+
+        expected = reply_new();
+        assert_se(strlen(expected) > 4096);
+
+        assert_se(request(sa, expected, &reply) >= 0);
+        assert_se(reply);
+        assert_se(streq(reply, expected));
+}
+
+static void test_get_worker_stats_unsupported(const union sockaddr_union *sa) {
+        char *reply = NULL;
+
+        log_info("/* %s */", __func__);
+
+        /* a daemon which does not know the request closes the connection without a reply */
+        assert_se(request(sa, NULL, &reply) == -EOPNOTSUPP);
+        assert_se(!reply);
+}
+
+int main(int argc, char *argv[]) {
+        char t[] = "/tmp/test-udev-ctrl-XXXXXX";
+        union sockaddr_union sa = {
+                .un.sun_family = AF_LOCAL,
+        };
+
+        log_parse_environment();
+        log_open();
+
+        /* the daemon side only accepts requests of root */
+        if (getuid() != 0) {
+                log_notice("Not running as root, skipping.");
+                return EXIT_TEST_SKIP;
+        }
+
+        assert_se(mkdtemp(t));
+        strscpy(sa.un.sun_path, sizeof(sa.un.sun_path), strjoina(t, "/control"));
+
+        test_get_worker_stats(&sa);
+        test_get_worker_stats_unsupported(&sa);
+
+        assert_se(rm_rf(t, REMOVE_ROOT|REMOVE_PHYSICAL) >= 0);
+
+        return 0;
+}
@@ -0,0 +1,434 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include <stdlib.h>
+
+#include "alloc-util.h"
+#include "log.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "tests.h"
+#include "udev.h"
+
+typedef struct TestEvent {
+        struct udev_queued_event queued;
+        unsigned id;
+        bool running;
+        bool done;
+} TestEvent;
+
+typedef struct TestQueue {
+        struct udev_event_queue queue;
+        TestEvent events[512];
+        unsigned n_events;
+} TestQueue;
+
+static TestEvent *test_queue_add(TestQueue *q, const char *devpath, const char *devpath_old,
+                                 dev_t devnum, bool is_block, int ifindex) {
+        TestEvent *e;
+
+        assert_se(q->n_events < ELEMENTSOF(q->events));
+
+        e = &q->events[q->n_events];
+        e->id = ++q->n_events;
+        e->queued.devpath = devpath;
+        e->queued.devpath_old = devpath_old;
+        e->queued.devnum = devnum;
+        e->queued.is_block = is_block;
+        e->queued.ifindex = ifindex;
+
+        assert_se(udev_event_queue_link(&q->queue, &e->queued) >= 0);
+
+        return e;
+}
+
+static void test_queue_start(TestEvent *e) {
+        assert_se(e->queued.is_ready);
+        assert_se(!e->running);
+
+        udev_event_queue_unmake_ready(&e->queued);
+        e->running = true;
+}
+
+static void test_queue_finish(TestEvent *e) {
+        assert_se(e->running);
+
+        udev_event_queue_unlink(&e->queued);
+        e->running = false;
+        e->done = true;
+}
+
+/* the ids of the events in the ready queue, in their order */
+static void assert_ready(TestQueue *q, const char *expected) {
+        _cleanup_free_ char *s = NULL;
+        struct udev_queued_event *i;
+
+        s = strdup("");
+        assert_se(s);
+
+        LIST_FOREACH(ready, i, q->queue.ready) {
+                TestEvent *e = container_of(i, TestEvent, queued);
+                char buf[DECIMAL_STR_MAX(unsigned) + 1];
+
+                xsprintf(buf, isempty(s) ? "%u" : " %u", e->id);
+                assert_se(strextend(&s, buf, NULL));
+        }
+
+        log_debug("ready: %s", s);
+        assert_se(streq(s, expected));
+}
+
+static void test_queue_done(TestQueue *q) {
+        unsigned i;
+
+        for (i = 0; i < q->n_events; i++)
+                assert_se(q->events[i].done);
+
+        assert_se(!q->queue.ready);
+        assert_se(hashmap_isempty(q->queue.devpaths));
+        assert_se(hashmap_isempty(q->queue.events_by_devnum));
+        assert_se(hashmap_isempty(q->queue.events_by_ifindex));
+
+        udev_event_queue_done(&q->queue);
+}
+
+static void test_parent_child(void) {
+        TestQueue q = {};
+        TestEvent *a, *abc, *ab, *abd, *x, *ab2;
+
+        log_info("/* %s */", __func__);
+
+        a = test_queue_add(&q, "/devices/a", NULL, 0, false, 0);
+        abc = test_queue_add(&q, "/devices/a/b/c", NULL, 0, false, 0);
+        x = test_queue_add(&q, "/devices/ab", NULL, 0, false, 0);
+        assert_ready(&q, "1 3");
+
+        test_queue_start(a);
+        test_queue_start(x);
+        assert_ready(&q, "");
+
+        /* a child queued after its parent started still waits for it */
+        ab = test_queue_add(&q, "/devices/a/b", NULL, 0, false, 0);
+        abd = test_queue_add(&q, "/devices/a/b/d", NULL, 0, false, 0);
+        assert_ready(&q, "");
+
+        test_queue_finish(x);
+        assert_ready(&q, "");
+
+        test_queue_finish(a);
+        assert_ready(&q, "2");
+
+        /* a parent queued after its child waits for it */
+        test_queue_start(abc);
+        test_queue_finish(abc);
+        assert_ready(&q, "4");
+
+        test_queue_start(ab);
+        ab2 = test_queue_add(&q, "/devices/a/b", NULL, 0, false, 0);
+        test_queue_finish(ab);
+        assert_ready(&q, "5");
+
+        test_queue_start(abd);
+        test_queue_finish(abd);
+        assert_ready(&q, "6");
+
+        test_queue_start(ab2);
+        test_queue_finish(ab2);
+        test_queue_done(&q);
+}
+
+static void test_parent_after_children(void) {
+        TestQueue q = {};
+        TestEvent *abc, *ab, *a, *abce, *a2;
+
+        log_info("/* %s */", __func__);
+
+        /* the parent only records the newest event of its child, which already waits for the grandchild */
+        abc = test_queue_add(&q, "/devices/a/b/c", NULL, 0, false, 0);
+        ab = test_queue_add(&q, "/devices/a/b", NULL, 0, false, 0);
+        a = test_queue_add(&q, "/devices/a", NULL, 0, false, 0);
+        assert_se(set_size(a->queued.blocked_by) == 1);
+        assert_se(set_contains(a->queued.blocked_by, &ab->queued));
+        assert_ready(&q, "1");
+
+        test_queue_start(abc);
+        test_queue_finish(abc);
+        assert_ready(&q, "2");
+
+        /* an event queued below the child after it is not covered by the child's event, and has to be
+         * found by walking further down */
+        abce = test_queue_add(&q, "/devices/a/b/c/e", NULL, 0, false, 0);
+        a2 = test_queue_add(&q, "/devices/a", NULL, 0, false, 0);
+        assert_se(set_size(a2->queued.blocked_by) == 3);
+        assert_se(set_contains(a2->queued.blocked_by, &abce->queued));
+
+        test_queue_start(ab);
+        test_queue_finish(ab);
+        assert_ready(&q, "3");
+
+        test_queue_start(a);
+        test_queue_finish(a);
+        assert_ready(&q, "4");
+
+        test_queue_start(abce);
+        test_queue_finish(abce);
+        assert_ready(&q, "5");
+
+        test_queue_start(a2);
+        test_queue_finish(a2);
+        test_queue_done(&q);
+}
+
+static void test_same_devpath(void) {
+        TestQueue q = {};
+        TestEvent *e1, *e2, *e3, *e4;
+
+        log_info("/* %s */", __func__);
+
+        e1 = test_queue_add(&q, "/devices/virtual/block/loop0", NULL, makedev(7, 0), true, 0);
+        e2 = test_queue_add(&q, "/devices/virtual/block/loop0", NULL, makedev(7, 0), true, 0);
+        /* the device was swapped in the meantime */
+        e3 = test_queue_add(&q, "/devices/virtual/block/loop0", NULL, makedev(7, 1), true, 0);
+        assert_ready(&q, "1 3");
+
+        e4 = test_queue_add(&q, "/devices/virtual/block/loop0", NULL, 0, false, 0);
+        assert_ready(&q, "1 3");
+
+        test_queue_start(e3);
+        test_queue_start(e1);
+        test_queue_finish(e1);
+        assert_ready(&q, "2");
+
+        test_queue_start(e2);
+        test_queue_finish(e2);
+        assert_ready(&q, "");
+
+        test_queue_finish(e3);
+        assert_ready(&q, "4");
+
+        test_queue_start(e4);
+        test_queue_finish(e4);
+        test_queue_done(&q);
+}
+
+static void test_devnum(void) {
+        TestQueue q = {};
+        TestEvent *e1, *e2, *e3, *e4;
+
+        log_info("/* %s */", __func__);
+
+        e1 = test_queue_add(&q, "/devices/virtual/block/dm-0", NULL, makedev(253, 0), true, 0);
+        /* a character device with the same numbers does not collide */
+        e2 = test_queue_add(&q, "/devices/virtual/misc/foo", NULL, makedev(253, 0), false, 0);
+        /* the same block device under another name does */
+        e3 = test_queue_add(&q, "/devices/virtual/block/dm-1", NULL, makedev(253, 0), true, 0);
+        e4 = test_queue_add(&q, "/devices/virtual/block/dm-2", NULL, makedev(253, 0), true, 0);
+        assert_ready(&q, "1 2");
+        assert_se(set_size(e4->queued.blocked_by) == 1);
+
+        test_queue_start(e1);
+        test_queue_start(e2);
+        test_queue_finish(e2);
+        test_queue_finish(e1);
+        assert_ready(&q, "3");
+
+        test_queue_start(e3);
+        test_queue_finish(e3);
+        assert_ready(&q, "4");
+
+        test_queue_start(e4);
+        test_queue_finish(e4);
+        test_queue_done(&q);
+}
+
+static void test_ifindex(void) {
+        TestQueue q = {};
+        TestEvent *e1, *e2, *e3, *e4;
+
+        log_info("/* %s */", __func__);
+
+        e1 = test_queue_add(&q, "/devices/virtual/net/eth0", NULL, 0, false, 2);
+        /* renamed */
+        e2 = test_queue_add(&q, "/devices/virtual/net/lan0", "/devices/virtual/net/eth0", 0, false, 2);
+        e3 = test_queue_add(&q, "/devices/virtual/net/eth1", NULL, 0, false, 3);
+        /* the old name is reused by another interface */
+        e4 = test_queue_add(&q, "/devices/virtual/net/eth0", NULL, 0, false, 4);
+        assert_ready(&q, "1 3 4");
+
+        test_queue_start(e4);
+        test_queue_start(e3);
+        test_queue_start(e1);
+        test_queue_finish(e1);
+        assert_ready(&q, "2");
+
+        test_queue_start(e2);
+        test_queue_finish(e2);
+        test_queue_finish(e3);
+        test_queue_finish(e4);
+        test_queue_done(&q);
+}
+
+/* the rules the daemon used to apply by comparing each queued event with all earlier ones */
+static bool events_related(const TestEvent *event, const TestEvent *earlier) {
+        const struct udev_queued_event *e = &event->queued, *l = &earlier->queued;
+        size_t common;
+
+        if (major(e->devnum) != 0 && e->devnum == l->devnum && e->is_block == l->is_block)
+                return true;
+
+        if (e->ifindex > 0 && e->ifindex == l->ifindex)
+                return true;
+
+        if (e->devpath_old && streq(e->devpath_old, l->devpath))
+                return true;
+
+        common = MIN(strlen(e->devpath), strlen(l->devpath));
+        if (memcmp(e->devpath, l->devpath, common) != 0)
+                return false;
+
+        if (e->devpath[common] == '\0' && l->devpath[common] == '\0') {
+                if (major(e->devnum) != 0 && (e->devnum != l->devnum || e->is_block != l->is_block))
+                        return false;
+                if (e->ifindex != 0 && e->ifindex != l->ifindex)
+                        return false;
+
+                return true;
+        }
+
+        return e->devpath[common] == '/' || l->devpath[common] == '/';
+}
+
+/* every queued event not waiting for an earlier related one must be ready, and no other */
+static void assert_ready_matches_rules(TestQueue *q) {
+        unsigned i, j;
+
+        for (i = 0; i < q->n_events; i++) {
+                TestEvent *e = &q->events[i];
+                bool busy = false;
+
+                if (e->done || e->running) {
+                        assert_se(!e->queued.is_ready);
+                        continue;
+                }
+
+                for (j = 0; j < i && !busy; j++)
+                        busy = !q->events[j].done && events_related(e, &q->events[j]);
+
+                assert_se(e->queued.is_ready == !busy);
+        }
+}
+
+static void test_random(void) {
+        static const char *const devpaths[] = {
+                "/devices/a",
+                "/devices/a/b",
+                "/devices/a/bc",
+                "/devices/a/b/c",
+                "/devices/a/b/c/d",
+                "/devices/a/b/e",
+                "/devices/f",
+                "/devices/f/g",
+        };
+        TestQueue q = {};
+        unsigned i, n_running = 0;
+
+        log_info("/* %s */", __func__);
+
+        srand(4711);
+
+        for (i = 0; i < 2000; i++) {
+                unsigned k = rand() % 8;
+
+                if (k < 3 && q.n_events < ELEMENTSOF(q.events)) {
+                        const char *devpath_old = NULL;
+                        dev_t devnum = 0;
+                        int ifindex = 0;
+
+                        if (rand() % 4 == 0)
+                                devnum = makedev(8, rand() % 3);
+                        if (rand() % 4 == 0)
+                                ifindex = 1 + rand() % 3;
+                        if (rand() % 8 == 0)
+                                devpath_old = devpaths[rand() % ELEMENTSOF(devpaths)];
+
+                        test_queue_add(&q, devpaths[rand() % ELEMENTSOF(devpaths)], devpath_old,
+                                       devnum, rand() % 2, ifindex);
+
+                } else if (k < 6 && q.queue.ready) {
+                        struct udev_queued_event *e;
+                        unsigned n = rand() % 3;
+
+                        /* mostly the oldest ready event, as the daemon does */
+                        for (e = q.queue.ready; n > 0 && e->ready_next; n--)
+                                e = e->ready_next;
+
+                        test_queue_start(container_of(e, TestEvent, queued));
+                        n_running++;
+
+                } else if (n_running > 0) {
+                        unsigned n = rand() % n_running, j;
+
+                        for (j = 0; j < q.n_events; j++)
+                                if (q.events[j].running && n-- == 0)
+                                        break;
+
+                        test_queue_finish(&q.events[j]);
+                        n_running--;
+                }
+
+                assert_ready_matches_rules(&q);
+        }
+
+        /* nothing is stuck */
+        for (;;) {
+                unsigned j;
+
+                while (q.queue.ready) {
+                        test_queue_start(container_of(q.queue.ready, TestEvent, queued));
+                        n_running++;
+                }
+
+                if (n_running == 0)
+                        break;
+
+                for (j = 0; j < q.n_events; j++)
+                        if (q.events[j].running) {
+                                test_queue_finish(&q.events[j]);
+                                n_running--;
+                        }
+
+                assert_ready_matches_rules(&q);
+        }
+
+        test_queue_done(&q);
+}
+
+int main(int argc, char *argv[]) {
+        log_set_max_level(LOG_DEBUG);
+        log_parse_environment();
+        log_open();
+
+        test_parent_child();
+        test_parent_after_children();
+        test_same_devpath();
+        test_devnum();
+        test_ifindex();
+        test_random();
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,240 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* Applies udev rules to uevents recorded with "udevadm monitor --kernel --property", and accounts the time
+ * spent to the action of each event.
+ *
+ * Without arguments, the rules and the recording in test/test-udev-rules-replay/ are used, and the rules
+ * which matched each event are checked.
+ *
+ * Given a recording, the rules installed on the system are used. Like "udevadm test", this does not execute
+ * RUN keys, but it does run the programs of PROGRAM and IMPORT{program} keys, and it writes the values of
+ * ATTR and SYSCTL assignments. Hence it refuses to do that as root. */
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include "alloc-util.h"
+#include "def.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "log.h"
+#include "string-util.h"
+#include "tests.h"
+#include "time-util.h"
+#include "udev.h"
+#include "udev-util.h"
+
+static const char* const action_table[] = {
+        "add",
+        "remove",
+        "change",
+        "move",
+        "online",
+        "offline",
+        "bind",
+        "unbind",
+        "other",
+};
+
+static ReplayStats stats[ELEMENTSOF(action_table)];
+
+/* The letters of the rules in test/test-udev-rules-replay/rules.d/ which match the events of the recording
+ * next to it, in order */
+static const char* const expected_table[] = {
+        "eh",
+        "acgh",
+        "bch",
+        "ch",
+        "dh",
+        "h",
+        "cfgh",
+        "ch",
+};
+
+static ReplayStats *action_stats(const char *action) {
+        unsigned i;
+
+        for (i = 0; i < ELEMENTSOF(action_table) - 1; i++)
+                if (streq_ptr(action, action_table[i]))
+                        break;
+
+        return stats + i;
+}
+
+static int replay_event(struct udev *udev, struct udev_rules *rules, char *buf, size_t size, const char *expected) {
+        _cleanup_udev_device_unref_ struct udev_device *dev = NULL;
+        _cleanup_udev_event_unref_ struct udev_event *event = NULL;
+        usec_t t;
+
+        dev = udev_device_new_from_nulstr(udev, buf, size);
+        if (!dev)
+                return log_error_errno(errno, "Failed to create device from recorded event: %m");
+
+        event = udev_event_new(dev);
+        if (!event)
+                return log_oom();
+
+        t = now(CLOCK_MONOTONIC);
+
+        udev_rules_apply_to_event(rules, event, 10 * USEC_PER_SEC, 5 * USEC_PER_SEC, NULL);
+
+        t = now(CLOCK_MONOTONIC) - t;
+
+        replay_stats_add(action_stats(udev_device_get_action(dev)), t);
+
+        if (expected && !streq_ptr(udev_device_get_property_value(dev, "REPLAY"), expected)) {
+                log_error("Rules \"%s\" matched %s %s, expected \"%s\".",
+                          strnull(udev_device_get_property_value(dev, "REPLAY")),
+                          udev_device_get_action(dev), udev_device_get_devpath(dev), expected);
+                return -EBADMSG;
+        }
+
+        return 0;
+}
+
+/* Returns the number of events replayed. If expected is non-NULL, each event is checked against the
+ * corresponding entry, and there must be exactly n_expected events. */
+static int replay_file(struct udev *udev, struct udev_rules *rules, const char *path,
+                       const char* const *expected, size_t n_expected) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *buf = NULL;
+        size_t size = 0, allocated = 0;
+        unsigned n = 0;
+        int r;
+
+        f = fopen(path, "re");
+        if (!f)
+                return log_error_errno(errno, "Failed to open %s: %m", path);
+
+        /* Events are separated by empty lines, and start with a header line followed by the properties */
+        for (;;) {
+                _cleanup_free_ char *line = NULL;
+                size_t len;
+                bool eof;
+
+                r = read_line(f, LONG_LINE_MAX, &line);
+                if (r < 0)
+                        return log_error_errno(r, "Failed to read %s: %m", path);
+
+                eof = r == 0;
+
+                if (eof || isempty(line)) {
+                        if (size > 0) {
+                                if (expected && n >= n_expected) {
+                                        log_error("%s contains more events than expected.", path);
+                                        return -EBADMSG;
+                                }
+
+                                r = replay_event(udev, rules, buf, size, expected ? expected[n] : NULL);
+                                if (r < 0)
+                                        return r;
+
+                                n++;
+                        }
+
+                        if (eof)
+                                break;
+
+                        size = 0;
+                        continue;
+                }
+
+                if (!strchr(line, '='))
+                        continue;
+
+                len = strlen(line) + 1;
+                if (!GREEDY_REALLOC(buf, allocated, size + len))
+                        return log_oom();
+
+                memcpy(buf + size, line, len);
+                size += len;
+        }
+
+        if (expected && n != n_expected) {
+                log_error("%s contains %u events, expected %zu.", path, n, n_expected);
+                return -EBADMSG;
+        }
+
+        return n;
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_udev_rules_unref_ struct udev_rules *rules = NULL;
+        _cleanup_udev_unref_ struct udev *udev = NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        const char *recording, *dirs[2] = {};
+        usec_t load, start;
+        int r;
+
+        /* the system rules log failures to access the recorded devices, which would distort the measurements */
+        test_setup_logging(argc == 2 ? LOG_CRIT : LOG_INFO);
+
+        if (argc > 2) {
+                log_error("Usage: %s [RECORDING]", program_invocation_short_name);
+                return EXIT_FAILURE;
+        }
+
+        if (argc == 2) {
+                if (getuid() == 0) {
+                        log_error("Refusing to apply the system rules to recorded events as root.");
+                        return EXIT_FAILURE;
+                }
+
+                recording = argv[1];
+        } else {
+                const char *d;
+
+                d = get_testdata_dir("/test-udev-rules-replay");
+                dirs[0] = strjoina(d, "/rules.d");
+                recording = strjoina(d, "/events.txt");
+        }
+
+        udev = udev_new();
+        if (!udev)
+                return EXIT_FAILURE;
+
+        load = now(CLOCK_MONOTONIC);
+
+        rules = udev_rules_new_from_dirs(udev, 1, dirs[0] ? dirs : NULL);
+        if (!rules)
+                return EXIT_FAILURE;
+
+        udev_builtin_init(udev);
+
+        start = now(CLOCK_MONOTONIC);
+        load = start - load;
+
+        r = replay_file(udev, rules, recording,
+                        argc == 2 ? NULL : expected_table, argc == 2 ? 0 : ELEMENTSOF(expected_table));
+
+        udev_builtin_exit(udev);
+
+        if (r < 0)
+                return EXIT_FAILURE;
+
+        start = now(CLOCK_MONOTONIC) - start;
+
+        assert_se(replay_stats_print("ACTION", action_table, stats, ELEMENTSOF(stats)) == (unsigned) r);
+
+        printf("\nrules loaded in %s, %i events replayed in %s\n",
+               format_timespan(a, sizeof(a), load, 1),
+               r, format_timespan(b, sizeof(b), start, 1));
+
+        return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+/***
+  This file is part of systemd.
+
+  systemd is free software; you can redistribute it and/or modify it
+  under the terms of the GNU Lesser General Public License as published by
+  the Free Software Foundation; either version 2.1 of the License, or
+  (at your option) any later version.
+
+  systemd is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with systemd; If not, see <http://www.gnu.org/licenses/>.
+***/
+
+#include "log.h"
+#include "macro.h"
+#include "tests.h"
+#include "udev.h"
+
+typedef struct TestWorker {
+        struct udev_pooled_worker pooled;
+        char name;
+} TestWorker;
+
+typedef struct TestPool {
+        struct udev_worker_pool pool;
+        TestWorker workers[4];
+} TestPool;
+
+static void test_pool_init(TestPool *p) {
+        unsigned i;
+
+        zero(*p);
+        for (i = 0; i < ELEMENTSOF(p->workers); i++)
+                p->workers[i].name = 'a' + i;
+}
+
+static void test_pool_done(TestPool *p) {
+        unsigned i;
+
+        for (i = 0; i < ELEMENTSOF(p->workers); i++)
+                udev_pooled_worker_done(&p->pool, &p->workers[i].pooled);
+
+        assert_se(!p->pool.idle);
+        assert_se(p->pool.n_idle == 0);
+}
+
+/* the worker handles an event, and is idle again */
+static void test_pool_handle(TestPool *p, char name, const char *devpath, const char *subsystem) {
+        TestWorker *w = &p->workers[name - 'a'];
+
+        udev_worker_pool_unmake_idle(&p->pool, &w->pooled);
+        udev_pooled_worker_remember(&w->pooled, devpath, subsystem);
+        udev_worker_pool_make_idle(&p->pool, &w->pooled);
+}
+
+/* the name of the worker an event is given to, or '-' if there is no idle one */
+static char test_pool_find(TestPool *p, const char *devpath, const char *subsystem) {
+        struct udev_pooled_worker *pooled;
+
+        pooled = udev_worker_pool_find_idle(&p->pool, devpath, subsystem);
+        return pooled ? container_of(pooled, TestWorker, pooled)->name : '-';
+}
+
+static char test_pool_lru(TestPool *p) {
+        struct udev_pooled_worker *pooled;
+
+        pooled = udev_worker_pool_least_recently_used(&p->pool);
+        return pooled ? container_of(pooled, TestWorker, pooled)->name : '-';
+}
+
+static void test_recently_used(void) {
+        TestPool p;
+
+        log_info("/* %s */", __func__);
+
+        test_pool_init(&p);
+
+        assert_se(test_pool_find(&p, "/devices/virtual/net/lo", "net") == '-');
+        assert_se(test_pool_lru(&p) == '-');
+
+        /* fresh workers know nothing, the last one made idle is used first */
+        udev_worker_pool_make_idle(&p.pool, &p.workers[0].pooled);
+        udev_worker_pool_make_idle(&p.pool, &p.workers[1].pooled);
+        udev_worker_pool_make_idle(&p.pool, &p.workers[2].pooled);
+        udev_worker_pool_make_idle(&p.pool, &p.workers[2].pooled);
+        assert_se(p.pool.n_idle == 3);
+        assert_se(test_pool_find(&p, "/devices/virtual/net/lo", "net") == 'c');
+        assert_se(test_pool_lru(&p) == 'a');
+
+        /* handling an event makes a worker the most recently used one */
+        test_pool_handle(&p, 'a', "/devices/virtual/net/lo", "net");
+        assert_se(test_pool_find(&p, "/devices/virtual/misc/tun", "misc") == 'a');
+        assert_se(test_pool_lru(&p) == 'b');
+
+        /* busy workers are not picked */
+        udev_worker_pool_unmake_idle(&p.pool, &p.workers[0].pooled);
+        udev_worker_pool_unmake_idle(&p.pool, &p.workers[0].pooled);
+        assert_se(p.pool.n_idle == 2);
+        assert_se(test_pool_find(&p, "/devices/virtual/net/eth0", "net") == 'c');
+
+        udev_worker_pool_unmake_idle(&p.pool, &p.workers[1].pooled);
+        udev_worker_pool_unmake_idle(&p.pool, &p.workers[2].pooled);
+        assert_se(test_pool_find(&p, "/devices/virtual/net/eth0", "net") == '-');
+
+        test_pool_done(&p);
+}
+
+static void test_affinity(void) {
+        TestPool p;
+
+        log_info("/* %s */", __func__);
+
+        test_pool_init(&p);
+
+        test_pool_handle(&p, 'a', "/devices/pci0000:00/0000:00:14.0/usb1/1-1", "usb");
+        test_pool_handle(&p, 'b', "/devices/pci0000:00/0000:00:14.0/usb1/1-1/1-1:1.0/host0", "scsi");
+        test_pool_handle(&p, 'c', "/devices/virtual/net/lo", "net");
+        test_pool_handle(&p, 'd', "/devices/virtual/block/loop0", "block");
+
+        /* a sibling, whichever the subsystem is, before more recently used workers */
+        assert_se(test_pool_find(&p, "/devices/pci0000:00/0000:00:14.0/usb1/1-2", "usb") == 'a');
+        assert_se(test_pool_find(&p, "/devices/pci0000:00/0000:00:14.0/usb1/1-2", NULL) == 'a');
+        assert_se(test_pool_find(&p, "/devices/virtual/net/eth0", "net") == 'c');
+        assert_se(test_pool_find(&p, "/devices/virtual/net/eth0", "foo") == 'c');
+
+        /* the device itself is not a sibling of its child, nor of its parent */
+        assert_se(test_pool_find(&p, "/devices/pci0000:00/0000:00:14.0/usb1/1-1/1-1:1.0", "usb") == 'a');
+        assert_se(test_pool_find(&p, "/devices/pci0000:00/0000:00:14.0/usb1/1-1/1-1:1.0", "foo") == 'd');
+        assert_se(test_pool_find(&p, "/devices/pci0000:00/0000:00:14.0/usb1", "foo") == 'd');
+
+        /* parents are compared as a whole */
+        assert_se(test_pool_find(&p, "/devices/virtual/netx/eth0", "foo") == 'd');
+        assert_se(test_pool_find(&p, "/devices/virtual/ne/eth0", "foo") == 'd');
+
+        /* then one of the same subsystem */
+        assert_se(test_pool_find(&p, "/devices/pci0000:00/0000:00:1d.0/usb2/2-1", "usb") == 'a');
+        assert_se(test_pool_find(&p, "/devices/pci0000:00/0000:00:1f.2/ata1/host1", "scsi") == 'b');
+
+        /* then the most recently used one */
+        assert_se(test_pool_find(&p, "/devices/platform/i8042/serio0/input/input0", "input") == 'd');
+        assert_se(test_pool_find(&p, "/devices/platform/i8042/serio0/input/input0", NULL) == 'd');
+
+        /* the most recently used one among siblings */
+        test_pool_handle(&p, 'c', "/devices/virtual/block/loop1", "block");
+        assert_se(test_pool_find(&p, "/devices/virtual/block/loop2", "block") == 'c');
+        test_pool_handle(&p, 'd', "/devices/virtual/block/loop0", "block");
+        assert_se(test_pool_find(&p, "/devices/virtual/block/loop2", "block") == 'd');
+
+        /* and among the ones of the same subsystem */
+        test_pool_handle(&p, 'a', "/devices/pci0000:00/0000:00:1f.2/ata1/host0/target0:0:0/0:0:0:0/block/sda", "block");
+        assert_se(test_pool_find(&p, "/devices/pci0000:00/0000:00:1f.2/ata2/host1/target1:0:0/1:0:0:0/block/sdb", "block") == 'a');
+
+        /* a busy sibling is not waited for */
+        udev_worker_pool_unmake_idle(&p.pool, &p.workers[3].pooled);
+        assert_se(test_pool_find(&p, "/devices/virtual/block/loop2", "block") == 'c');
+        udev_worker_pool_unmake_idle(&p.pool, &p.workers[2].pooled);
+        assert_se(test_pool_find(&p, "/devices/virtual/block/loop2", "block") == 'a');
+        udev_worker_pool_unmake_idle(&p.pool, &p.workers[0].pooled);
+        assert_se(test_pool_find(&p, "/devices/virtual/block/loop2", "block") == 'b');
+
+        test_pool_done(&p);
+}
+
+int main(int argc, char *argv[]) {
+        log_parse_environment();
+        log_open();
+
+        test_recently_used();
+        test_affinity();
+
+        return 0;
+}
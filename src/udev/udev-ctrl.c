@@ -38,6 +38,7 @@ enum udev_ctrl_msg_type {
         UDEV_CTRL_SET_CHILDREN_MAX,
         UDEV_CTRL_PING,
         UDEV_CTRL_EXIT,
+        UDEV_CTRL_GET_WORKER_STATS,
 };
 
 struct udev_ctrl_msg_wire {
@@ -92,8 +93,13 @@ struct udev_ctrl *udev_ctrl_new_from_fd(struct udev *udev, int fd) {
                         return NULL;
                 }
         } else {
+                union sockaddr_union peer;
+                socklen_t peer_len = sizeof(peer);
+
+                /* the socket of the daemon, or one already connected to it */
                 uctrl->bound = true;
                 uctrl->sock = fd;
+                uctrl->connected = getpeername(fd, &peer.sa, &peer_len) >= 0;
         }
 
         /*
@@ -235,7 +241,34 @@ struct udev_ctrl_connection *udev_ctrl_connection_unref(struct udev_ctrl_connect
         return NULL;
 }
 
-static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf, int timeout) {
+static int ctrl_receive_reply(struct udev_ctrl *uctrl, char **reply) {
+        _cleanup_free_ char *buf = NULL;
+        ssize_t size;
+
+        size = next_datagram_size_fd(uctrl->sock);
+        if (size < 0)
+                return size;
+        /* the peer closed the connection without replying */
+        if (size == 0)
+                return -EOPNOTSUPP;
+
+        buf = malloc(size + 1);
+        if (!buf)
+                return -ENOMEM;
+
+        size = recv(uctrl->sock, buf, size, 0);
+        if (size < 0)
+                return -errno;
+
+        buf[size] = '\0';
+
+        *reply = buf;
+        buf = NULL;
+
+        return 0;
+}
+
+static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int intval, const char *buf, int timeout, char **reply) {
         struct udev_ctrl_msg_wire ctrl_msg_wire;
         int err = 0;
 
@@ -283,6 +316,8 @@ static int ctrl_send(struct udev_ctrl *uctrl, enum udev_ctrl_msg_type type, int
 
                 if (r == 0)
                         err = -ETIMEDOUT;
+                else if (reply)
+                        err = ctrl_receive_reply(uctrl, reply);
                 break;
         }
 out:
@@ -290,35 +325,46 @@ out:
 }
 
 int udev_ctrl_send_set_log_level(struct udev_ctrl *uctrl, int priority, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_SET_LOG_LEVEL, priority, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_SET_LOG_LEVEL, priority, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_stop_exec_queue(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_STOP_EXEC_QUEUE, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_STOP_EXEC_QUEUE, 0, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_start_exec_queue(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_START_EXEC_QUEUE, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_START_EXEC_QUEUE, 0, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_reload(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_RELOAD, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_RELOAD, 0, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_set_env(struct udev_ctrl *uctrl, const char *key, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_SET_ENV, 0, key, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_SET_ENV, 0, key, timeout, NULL);
 }
 
 int udev_ctrl_send_set_children_max(struct udev_ctrl *uctrl, int count, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_SET_CHILDREN_MAX, count, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_SET_CHILDREN_MAX, count, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_ping(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_PING, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_PING, 0, NULL, timeout, NULL);
 }
 
 int udev_ctrl_send_exit(struct udev_ctrl *uctrl, int timeout) {
-        return ctrl_send(uctrl, UDEV_CTRL_EXIT, 0, NULL, timeout);
+        return ctrl_send(uctrl, UDEV_CTRL_EXIT, 0, NULL, timeout, NULL);
+}
+
+int udev_ctrl_send_get_worker_stats(struct udev_ctrl *uctrl, int timeout, char **ret) {
+        return ctrl_send(uctrl, UDEV_CTRL_GET_WORKER_STATS, 0, NULL, timeout, ret);
+}
+
+int udev_ctrl_connection_send_reply(struct udev_ctrl_connection *conn, const char *reply) {
+        if (send(conn->sock, reply, strlen(reply), MSG_NOSIGNAL) < 0)
+                return -errno;
+
+        return 0;
 }
 
 struct udev_ctrl_msg *udev_ctrl_receive_msg(struct udev_ctrl_connection *conn) {
@@ -460,3 +506,9 @@ int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg) {
                 return 1;
         return -1;
 }
+
+int udev_ctrl_get_worker_stats(struct udev_ctrl_msg *ctrl_msg) {
+        if (ctrl_msg->ctrl_msg_wire.type == UDEV_CTRL_GET_WORKER_STATS)
+                return 1;
+        return -1;
+}
@@ -0,0 +1,374 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "alloc-util.h"
+#include "siphash24.h"
+#include "string-util.h"
+#include "udev.h"
+
+/* A component of the devpath of queued events: events of parent and child devices are found by walking up
+ * and down the tree, rather than by comparing the devpaths of all events in the queue */
+struct udev_devpath_node {
+        struct udev_event_queue *queue;
+        char *devpath;
+        struct udev_devpath_node *parent;
+        LIST_HEAD(struct udev_devpath_node, children);
+        LIST_FIELDS(struct udev_devpath_node, siblings);
+        LIST_HEAD(struct udev_queued_event, events);
+        /* number of events of this device and of all devices below it */
+        unsigned n_events;
+        /* position of the last event queued below this device; it never goes down when events are freed */
+        unsigned long long int last_position_below;
+};
+
+static void event_devnum_hash_func(const void *p, struct siphash *state) {
+        const struct udev_queued_event *event = p;
+
+        siphash24_compress(&event->devnum, sizeof(event->devnum), state);
+        siphash24_compress(&event->is_block, sizeof(event->is_block), state);
+}
+
+static int event_devnum_compare_func(const void *_a, const void *_b) {
+        const struct udev_queued_event *a = _a, *b = _b;
+
+        if (a->devnum != b->devnum)
+                return a->devnum < b->devnum ? -1 : 1;
+
+        return (int) a->is_block - (int) b->is_block;
+}
+
+static const struct hash_ops event_devnum_hash_ops = {
+        .hash = event_devnum_hash_func,
+        .compare = event_devnum_compare_func,
+};
+
+/* free the nodes without events below them, from the bottom up */
+static void devpath_node_trim(struct udev_devpath_node *node) {
+        struct udev_devpath_node *parent;
+
+        for (; node && node->n_events == 0; node = parent) {
+                parent = node->parent;
+
+                assert(!node->children);
+                assert(!node->events);
+
+                hashmap_remove(node->queue->devpaths, node->devpath);
+                if (parent)
+                        LIST_REMOVE(siblings, parent->children, node);
+
+                free(node->devpath);
+                free(node);
+        }
+}
+
+static int devpath_node_get(struct udev_event_queue *queue, const char *devpath, struct udev_devpath_node **ret) {
+        struct udev_devpath_node *node = NULL, *parent = NULL;
+        char *path, *p;
+        int r;
+
+        assert(queue);
+        assert(devpath);
+        assert(ret);
+
+        r = hashmap_ensure_allocated(&queue->devpaths, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        /* look up the nodes of all components of the devpath from the top down, creating missing ones */
+        path = strdupa(devpath);
+        p = path;
+        do {
+                char c;
+
+                p = strchrnul(p + 1, '/');
+                c = *p;
+                *p = '\0';
+
+                node = hashmap_get(queue->devpaths, path);
+                if (!node) {
+                        node = new0(struct udev_devpath_node, 1);
+                        if (!node) {
+                                devpath_node_trim(parent);
+                                return -ENOMEM;
+                        }
+
+                        node->queue = queue;
+                        node->devpath = strdup(path);
+                        if (!node->devpath) {
+                                free(node);
+                                devpath_node_trim(parent);
+                                return -ENOMEM;
+                        }
+
+                        r = hashmap_put(queue->devpaths, node->devpath, node);
+                        if (r < 0) {
+                                free(node->devpath);
+                                free(node);
+                                devpath_node_trim(parent);
+                                return r;
+                        }
+
+                        node->parent = parent;
+                        if (parent)
+                                LIST_PREPEND(siblings, parent->children, node);
+                }
+
+                *p = c;
+                parent = node;
+        } while (*p);
+
+        *ret = node;
+
+        return 0;
+}
+
+static void event_make_ready(struct udev_queued_event *event) {
+        struct udev_event_queue *queue = event->queue;
+
+        assert(!event->is_ready);
+
+        LIST_INSERT_AFTER(ready, queue->ready, queue->ready_tail, event);
+        queue->ready_tail = event;
+        event->is_ready = true;
+}
+
+void udev_event_queue_unmake_ready(struct udev_queued_event *event) {
+        struct udev_event_queue *queue = event->queue;
+
+        if (!event->is_ready)
+                return;
+
+        if (queue->ready_tail == event)
+                queue->ready_tail = event->ready_prev;
+        LIST_REMOVE(ready, queue->ready, event);
+        event->is_ready = false;
+}
+
+static int event_add_blocker(struct udev_queued_event *event, struct udev_queued_event *blocker) {
+        int r;
+
+        if (blocker == event)
+                return 0;
+
+        r = set_ensure_allocated(&event->blocked_by, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_ensure_allocated(&blocker->blocking, NULL);
+        if (r < 0)
+                return r;
+
+        r = set_put(event->blocked_by, blocker);
+        if (r <= 0)
+                return r;
+
+        r = set_put(blocker->blocking, event);
+        if (r < 0) {
+                set_remove(event->blocked_by, blocker);
+                return r;
+        }
+
+        return 0;
+}
+
+static int event_add_blockers_below(struct udev_queued_event *event, struct udev_devpath_node *node) {
+        struct udev_devpath_node *child;
+        struct udev_queued_event *blocker;
+        int r;
+
+        LIST_FOREACH(siblings, child, node->children) {
+                LIST_FOREACH(same_devpath, blocker, child->events) {
+                        r = event_add_blocker(event, blocker);
+                        if (r < 0)
+                                return r;
+                }
+
+                /* The newest event of a device waits for all events queued below it before, hence if nothing
+                 * was queued below it since, waiting for that event covers the whole branch. */
+                if (child->events && child->events->position > child->last_position_below)
+                        continue;
+
+                r = event_add_blockers_below(event, child);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+/* lookup the events of identical, parent and child devices queued before a new one */
+static int event_add_blockers(struct udev_event_queue *queue, struct udev_queued_event *event) {
+        struct udev_devpath_node *node;
+        struct udev_queued_event *blocker;
+        int r;
+
+        /* check major/minor; the newest event of a device number waits for all earlier ones */
+        if (major(event->devnum) != 0) {
+                blocker = hashmap_get(queue->events_by_devnum, event);
+                if (blocker) {
+                        r = event_add_blocker(event, blocker);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        /* check network device ifindex */
+        if (event->ifindex > 0) {
+                blocker = hashmap_get(queue->events_by_ifindex, INT_TO_PTR(event->ifindex));
+                if (blocker) {
+                        r = event_add_blocker(event, blocker);
+                        if (r < 0)
+                                return r;
+                }
+        }
+
+        /* check our old name */
+        if (event->devpath_old) {
+                node = hashmap_get(queue->devpaths, event->devpath_old);
+                if (node)
+                        LIST_FOREACH(same_devpath, blocker, node->events) {
+                                r = event_add_blocker(event, blocker);
+                                if (r < 0)
+                                        return r;
+                        }
+        }
+
+        /* identical device events */
+        LIST_FOREACH(same_devpath, blocker, event->devpath_node->events) {
+                /* devices names might have changed/swapped in the meantime */
+                if (major(event->devnum) != 0 && (event->devnum != blocker->devnum || event->is_block != blocker->is_block))
+                        continue;
+                if (event->ifindex != 0 && event->ifindex != blocker->ifindex)
+                        continue;
+
+                r = event_add_blocker(event, blocker);
+                if (r < 0)
+                        return r;
+        }
+
+        /* parent device events */
+        for (node = event->devpath_node->parent; node; node = node->parent)
+                LIST_FOREACH(same_devpath, blocker, node->events) {
+                        r = event_add_blocker(event, blocker);
+                        if (r < 0)
+                                return r;
+                }
+
+        /* child device events */
+        return event_add_blockers_below(event, event->devpath_node);
+}
+
+int udev_event_queue_link(struct udev_event_queue *queue, struct udev_queued_event *event) {
+        struct udev_devpath_node *node;
+        int r;
+
+        assert(queue);
+        assert(event);
+        assert(event->devpath);
+
+        r = devpath_node_get(queue, event->devpath, &node);
+        if (r < 0)
+                return r;
+
+        event->queue = queue;
+        event->position = ++queue->n_positions;
+        event->devpath_node = node;
+        LIST_PREPEND(same_devpath, node->events, event);
+        for (; node; node = node->parent) {
+                node->n_events++;
+                if (node != event->devpath_node)
+                        node->last_position_below = event->position;
+        }
+
+        r = event_add_blockers(queue, event);
+        if (r < 0)
+                return r;
+
+        if (major(event->devnum) != 0) {
+                r = hashmap_ensure_allocated(&queue->events_by_devnum, &event_devnum_hash_ops);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_replace(queue->events_by_devnum, event, event);
+                if (r < 0)
+                        return r;
+        }
+
+        if (event->ifindex > 0) {
+                r = hashmap_ensure_allocated(&queue->events_by_ifindex, NULL);
+                if (r < 0)
+                        return r;
+
+                r = hashmap_replace(queue->events_by_ifindex, INT_TO_PTR(event->ifindex), event);
+                if (r < 0)
+                        return r;
+        }
+
+        if (set_isempty(event->blocked_by))
+                event_make_ready(event);
+
+        return 0;
+}
+
+void udev_event_queue_unlink(struct udev_queued_event *event) {
+        struct udev_event_queue *queue = event->queue;
+        struct udev_devpath_node *node;
+        struct udev_queued_event *e;
+        Iterator i;
+
+        if (!queue)
+                return;
+
+        udev_event_queue_unmake_ready(event);
+
+        if (major(event->devnum) != 0)
+                hashmap_remove_value(queue->events_by_devnum, event, event);
+        if (event->ifindex > 0)
+                hashmap_remove_value(queue->events_by_ifindex, INT_TO_PTR(event->ifindex), event);
+
+        if (event->devpath_node) {
+                LIST_REMOVE(same_devpath, event->devpath_node->events, event);
+                for (node = event->devpath_node; node; node = node->parent)
+                        node->n_events--;
+                devpath_node_trim(event->devpath_node);
+                event->devpath_node = NULL;
+        }
+
+        SET_FOREACH(e, event->blocked_by, i)
+                set_remove(e->blocking, event);
+        event->blocked_by = set_free(event->blocked_by);
+
+        /* release the events which were only waiting for us */
+        SET_FOREACH(e, event->blocking, i) {
+                set_remove(e->blocked_by, event);
+                if (set_isempty(e->blocked_by))
+                        event_make_ready(e);
+        }
+        event->blocking = set_free(event->blocking);
+
+        event->queue = NULL;
+}
+
+void udev_event_queue_done(struct udev_event_queue *queue) {
+        assert(queue);
+
+        queue->events_by_devnum = hashmap_free(queue->events_by_devnum);
+        queue->events_by_ifindex = hashmap_free(queue->events_by_ifindex);
+        queue->devpaths = hashmap_free(queue->devpaths);
+}
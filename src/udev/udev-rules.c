@@ -36,6 +36,7 @@
 #include "fd-util.h"
 #include "fs-util.h"
 #include "glob-util.h"
+#include "hashmap.h"
 #include "path-util.h"
 #include "proc-cmdline.h"
 #include "stat-util.h"
@@ -67,6 +68,7 @@ static const char* const rules_dirs[] = {
 
 struct udev_rules {
         struct udev *udev;
+        const char* const* dirs;
         usec_t dirs_ts_usec;
         int resolve_names;
 
@@ -85,6 +87,10 @@ struct udev_rules {
         struct uid_gid *gids;
         unsigned int gids_cur;
         unsigned int gids_max;
+
+        /* the rules which can match a combination of ACTION, SUBSYSTEM and DRIVER, looked up on first use */
+        Hashmap *candidates;
+        bool has_driver_keys;
 };
 
 static char *rules_str(struct udev_rules *rules, unsigned int off) {
@@ -116,6 +122,7 @@ enum string_glob_type {
         GL_SPLIT,                       /* multi-value A|B */
         GL_SPLIT_GLOB,                  /* multi-value with glob A*|B* */
         GL_SOMETHING,                   /* commonly used "?*" */
+        GL_PREFIX,                      /* glob with only a trailing "*" */
 };
 
 enum string_subst_type {
@@ -256,6 +263,7 @@ static const char *string_glob_str(enum string_glob_type type) {
                 [GL_SPLIT] =            "split",
                 [GL_SPLIT_GLOB] =       "split-glob",
                 [GL_SOMETHING] =        "split-glob",
+                [GL_PREFIX] =           "prefix",
         };
 
         return string_glob_strs[type];
@@ -941,8 +949,12 @@ static void rule_add_key(struct rule_tmp *rule_tmp, enum token_type type,
                 } else if (has_split) {
                         glob = GL_SPLIT;
                 } else if (has_glob) {
+                        size_t len = strlen(value);
+
                         if (streq(value, "?*"))
                                 glob = GL_SOMETHING;
+                        else if (strcspn(value, "*?[\\") == len - 1 && value[len - 1] == '*')
+                                glob = GL_PREFIX;
                         else
                                 glob = GL_GLOB;
                 } else {
@@ -1530,16 +1542,23 @@ static int parse_file(struct udev_rules *rules, const char *filename) {
 }
 
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
+        return udev_rules_new_from_dirs(udev, resolve_names, NULL);
+}
+
+/* Loads the rules from dirs, which must stay around as long as the rules, instead of the usual directories */
+struct udev_rules *udev_rules_new_from_dirs(struct udev *udev, int resolve_names, const char* const* dirs) {
         struct udev_rules *rules;
         struct udev_list file_list;
         struct token end_token;
         char **files, **f;
+        unsigned int i;
         int r;
 
         rules = new0(struct udev_rules, 1);
         if (rules == NULL)
                 return NULL;
         rules->udev = udev;
+        rules->dirs = dirs ?: rules_dirs;
         rules->resolve_names = resolve_names;
         udev_list_init(udev, &file_list, true);
 
@@ -1555,7 +1574,7 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
 
         udev_rules_check_timestamp(rules);
 
-        r = conf_files_list_strv(&files, ".rules", NULL, 0, rules_dirs);
+        r = conf_files_list_strv(&files, ".rules", NULL, 0, rules->dirs);
         if (r < 0) {
                 log_error_errno(r, "failed to enumerate rules files: %m");
                 return udev_rules_unref(rules);
@@ -1576,6 +1595,14 @@ struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names) {
         memzero(&end_token, sizeof(struct token));
         end_token.type = TK_END;
         add_token(rules, &end_token);
+
+        /* the DRIVER of a device is only looked up to find the rules to apply to it, if a rule asks for it */
+        for (i = 0; i < rules->token_cur; i++)
+                if (rules->tokens[i].type == TK_M_DRIVER) {
+                        rules->has_driver_keys = true;
+                        break;
+                }
+
         log_debug("rules contain %zu bytes tokens (%u * %zu bytes), %zu bytes strings",
                   rules->token_max * sizeof(struct token), rules->token_max, sizeof(struct token), rules->strbuf->len);
 
@@ -1604,6 +1631,7 @@ struct udev_rules *udev_rules_unref(struct udev_rules *rules) {
         strbuf_cleanup(rules->strbuf);
         free(rules->uids);
         free(rules->gids);
+        hashmap_free_free_free(rules->candidates);
         return mfree(rules);
 }
 
@@ -1611,7 +1639,7 @@ bool udev_rules_check_timestamp(struct udev_rules *rules) {
         if (!rules)
                 return false;
 
-        return paths_check_timestamp(rules_dirs, &rules->dirs_ts_usec, true);
+        return paths_check_timestamp(rules->dirs, &rules->dirs_ts_usec, true);
 }
 
 static int match_key(struct udev_rules *rules, struct token *token, const char *val) {
@@ -1676,6 +1704,9 @@ static int match_key(struct udev_rules *rules, struct token *token, const char *
         case GL_SOMETHING:
                 match = (val[0] != '\0');
                 break;
+        case GL_PREFIX:
+                match = strneq(key_value, val, strlen(key_value) - 1);
+                break;
         case GL_UNSET:
                 return -1;
         }
@@ -1735,6 +1766,87 @@ static int match_attr(struct udev_rules *rules, struct udev_device *dev, struct
         return match_key(rules, cur, value);
 }
 
+static bool rule_can_match(struct udev_rules *rules, struct token *rule,
+                           const char *action, const char *subsystem, const char *driver) {
+        struct token *cur;
+
+        /* the keys are sorted by type, nothing before DRIVER changes the event */
+        for (cur = rule + 1; cur < rule + rule->rule.token_count && cur->type <= TK_M_DRIVER; cur++) {
+                switch (cur->type) {
+                case TK_M_ACTION:
+                        if (match_key(rules, cur, action) != 0)
+                                return false;
+                        break;
+                case TK_M_SUBSYSTEM:
+                        if (match_key(rules, cur, subsystem) != 0)
+                                return false;
+                        break;
+                case TK_M_DRIVER:
+                        if (match_key(rules, cur, driver) != 0)
+                                return false;
+                        break;
+                default:
+                        break;
+                }
+        }
+
+        return true;
+}
+
+/* Returns the indexes of the rules which can match the ACTION, SUBSYSTEM and DRIVER of a device, followed
+ * by the index of the end token, or NULL if all rules need to be looked at. */
+static const unsigned int *rules_get_candidates(struct udev_rules *rules, struct udev_device *dev) {
+        _cleanup_free_ unsigned int *candidates = NULL;
+        _cleanup_free_ char *k = NULL;
+        const char *action, *subsystem, *driver = NULL, *key;
+        unsigned int *c, i, n = 0;
+        int r;
+
+        action = strempty(udev_device_get_action(dev));
+        subsystem = strempty(udev_device_get_subsystem(dev));
+        if (rules->has_driver_keys)
+                driver = strempty(udev_device_get_driver(dev));
+
+        key = strjoina(action, "/", subsystem, "/", strempty(driver));
+
+        c = hashmap_get(rules->candidates, key);
+        if (c)
+                return c;
+
+        r = hashmap_ensure_allocated(&rules->candidates, &string_hash_ops);
+        if (r < 0)
+                return NULL;
+
+        candidates = new(unsigned int, rules->token_cur);
+        if (!candidates)
+                return NULL;
+
+        for (i = 0; rules->tokens[i].type == TK_RULE; i += rules->tokens[i].rule.token_count)
+                if (rule_can_match(rules, &rules->tokens[i], action, subsystem, driver))
+                        candidates[n++] = i;
+
+        assert(rules->tokens[i].type == TK_END);
+        candidates[n++] = i;
+
+        c = realloc(candidates, n * sizeof(unsigned int));
+        if (c)
+                candidates = c;
+
+        k = strdup(key);
+        if (!k)
+                return NULL;
+
+        r = hashmap_put(rules->candidates, k, candidates);
+        if (r < 0)
+                return NULL;
+
+        k = NULL;
+        c = candidates;
+        candidates = NULL;
+
+        return c;
+}
+
 enum escape_type {
         ESCAPE_UNSET,
         ESCAPE_NONE,
@@ -1748,6 +1860,7 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                                struct udev_list *properties_list) {
         struct token *cur;
         struct token *rule;
+        const unsigned int *candidate;
         enum escape_type esc = ESCAPE_UNSET;
         bool can_set_name;
         int r;
@@ -1755,6 +1868,8 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
         if (rules->tokens == NULL)
                 return;
 
+        candidate = rules_get_candidates(rules, event->dev);
+
         can_set_name = ((!streq(udev_device_get_action(event->dev), "remove")) &&
                         (major(udev_device_get_devnum(event->dev)) > 0 ||
                          udev_device_get_ifindex(event->dev) > 0));
@@ -1766,6 +1881,18 @@ void udev_rules_apply_to_event(struct udev_rules *rules,
                 dump_token(rules, cur);
                 switch (cur->type) {
                 case TK_RULE:
+                        /* skip rules which can not match the ACTION, SUBSYSTEM or DRIVER of the device */
+                        if (candidate) {
+                                unsigned int idx = cur - rules->tokens;
+
+                                while (*candidate < idx)
+                                        candidate++;
+                                if (*candidate != idx) {
+                                        cur = &rules->tokens[*candidate];
+                                        continue;
+                                }
+                        }
+
                         /* current rule */
                         rule = cur;
                         /* possibly skip rules which want to set NAME, SYMLINK, OWNER, GROUP, MODE */
@@ -0,0 +1,111 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "alloc-util.h"
+#include "string-util.h"
+#include "udev.h"
+
+static size_t devpath_parent_len(const char *devpath) {
+        const char *slash;
+
+        slash = strrchr(devpath, '/');
+        return slash ? (size_t) (slash - devpath) : 0;
+}
+
+/* the most recently used workers are reused first, and the least recently used ones are killed first when
+ * there are more idle workers than needed */
+void udev_worker_pool_make_idle(struct udev_worker_pool *pool, struct udev_pooled_worker *worker) {
+        assert(pool);
+        assert(worker);
+
+        if (worker->is_idle)
+                return;
+
+        LIST_PREPEND(idle, pool->idle, worker);
+        pool->n_idle++;
+        worker->is_idle = true;
+}
+
+void udev_worker_pool_unmake_idle(struct udev_worker_pool *pool, struct udev_pooled_worker *worker) {
+        assert(pool);
+        assert(worker);
+
+        if (!worker->is_idle)
+                return;
+
+        LIST_REMOVE(idle, pool->idle, worker);
+        pool->n_idle--;
+        worker->is_idle = false;
+}
+
+/* Prefers the idle worker that last handled a sibling of the device, then one that last handled a device of
+ * the same subsystem: they are the most likely to still have the rules, programs, files and modules
+ * involved warm. Otherwise the most recently used idle worker is picked. */
+struct udev_pooled_worker *udev_worker_pool_find_idle(struct udev_worker_pool *pool, const char *devpath, const char *subsystem) {
+        struct udev_pooled_worker *worker, *same_subsystem = NULL;
+        size_t len;
+
+        assert(pool);
+        assert(devpath);
+
+        len = devpath_parent_len(devpath);
+
+        LIST_FOREACH(idle, worker, pool->idle) {
+                if (worker->last_parent_devpath &&
+                    strneq(worker->last_parent_devpath, devpath, len) &&
+                    worker->last_parent_devpath[len] == '\0')
+                        return worker;
+
+                if (!same_subsystem && subsystem && streq_ptr(worker->last_subsystem, subsystem))
+                        same_subsystem = worker;
+        }
+
+        return same_subsystem ?: pool->idle;
+}
+
+struct udev_pooled_worker *udev_worker_pool_least_recently_used(struct udev_worker_pool *pool) {
+        struct udev_pooled_worker *worker;
+
+        assert(pool);
+
+        LIST_FIND_TAIL(idle, pool->idle, worker);
+
+        return worker;
+}
+
+void udev_pooled_worker_remember(struct udev_pooled_worker *worker, const char *devpath, const char *subsystem) {
+        assert(worker);
+        assert(devpath);
+
+        /* allocation errors are ignored, the worker is just not preferred for related events then */
+        free(worker->last_parent_devpath);
+        worker->last_parent_devpath = strndup(devpath, devpath_parent_len(devpath));
+
+        free(worker->last_subsystem);
+        worker->last_subsystem = subsystem ? strdup(subsystem) : NULL;
+}
+
+void udev_pooled_worker_done(struct udev_worker_pool *pool, struct udev_pooled_worker *worker) {
+        assert(pool);
+        assert(worker);
+
+        udev_worker_pool_unmake_idle(pool, worker);
+
+        worker->last_parent_devpath = mfree(worker->last_parent_devpath);
+        worker->last_subsystem = mfree(worker->last_subsystem);
+}
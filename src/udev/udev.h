@@ -26,9 +26,12 @@
 #include "libudev.h"
 #include "sd-netlink.h"
 
+#include "hashmap.h"
 #include "label.h"
 #include "libudev-private.h"
+#include "list.h"
 #include "macro.h"
+#include "set.h"
 #include "strv.h"
 #include "util.h"
 
@@ -71,6 +74,7 @@ struct udev_watch {
 /* udev-rules.c */
 struct udev_rules;
 struct udev_rules *udev_rules_new(struct udev *udev, int resolve_names);
+struct udev_rules *udev_rules_new_from_dirs(struct udev *udev, int resolve_names, const char* const* dirs);
 struct udev_rules *udev_rules_unref(struct udev_rules *rules);
 bool udev_rules_check_timestamp(struct udev_rules *rules);
 void udev_rules_apply_to_event(struct udev_rules *rules, struct udev_event *event,
@@ -98,6 +102,67 @@ void udev_event_execute_rules(struct udev_event *event,
 void udev_event_execute_run(struct udev_event *event, usec_t timeout_usec, usec_t timeout_warn_usec);
 int udev_build_argv(struct udev *udev, char *cmd, int *argc, char *argv[]);
 
+/* udev-event-queue.c */
+struct udev_devpath_node;
+
+/* the ordering of an event relative to the other queued ones, embedded in the event of the daemon */
+struct udev_queued_event {
+        LIST_FIELDS(struct udev_queued_event, ready);
+        LIST_FIELDS(struct udev_queued_event, same_devpath);
+        struct udev_event_queue *queue;
+        const char *devpath;
+        const char *devpath_old;
+        dev_t devnum;
+        int ifindex;
+        bool is_block;
+        bool is_ready;
+        unsigned long long int position;
+        struct udev_devpath_node *devpath_node;
+        /* the earlier events we wait for, and the later ones waiting for us */
+        Set *blocked_by;
+        Set *blocking;
+};
+
+struct udev_event_queue {
+        /* queued events not waiting for any other event, in the order they became runnable */
+        LIST_HEAD(struct udev_queued_event, ready);
+        struct udev_queued_event *ready_tail;
+        /* the newest events of each device number and network interface, and the devpath components of
+         * all events in the queue */
+        Hashmap *events_by_devnum;
+        Hashmap *events_by_ifindex;
+        Hashmap *devpaths;
+        unsigned long long int n_positions;
+};
+
+int udev_event_queue_link(struct udev_event_queue *queue, struct udev_queued_event *event);
+void udev_event_queue_unlink(struct udev_queued_event *event);
+void udev_event_queue_unmake_ready(struct udev_queued_event *event);
+void udev_event_queue_done(struct udev_event_queue *queue);
+
+/* udev-worker-pool.c */
+/* what the daemon knows of a worker to pick one for an event, embedded in the worker of the daemon */
+struct udev_pooled_worker {
+        LIST_FIELDS(struct udev_pooled_worker, idle);
+        bool is_idle;
+        /* the parent devpath and the subsystem of the last event handled */
+        char *last_parent_devpath;
+        char *last_subsystem;
+};
+
+struct udev_worker_pool {
+        /* idle workers, the most recently used ones first */
+        LIST_HEAD(struct udev_pooled_worker, idle);
+        unsigned n_idle;
+};
+
+void udev_worker_pool_make_idle(struct udev_worker_pool *pool, struct udev_pooled_worker *worker);
+void udev_worker_pool_unmake_idle(struct udev_worker_pool *pool, struct udev_pooled_worker *worker);
+struct udev_pooled_worker *udev_worker_pool_find_idle(struct udev_worker_pool *pool, const char *devpath, const char *subsystem);
+struct udev_pooled_worker *udev_worker_pool_least_recently_used(struct udev_worker_pool *pool);
+void udev_pooled_worker_remember(struct udev_pooled_worker *worker, const char *devpath, const char *subsystem);
+void udev_pooled_worker_done(struct udev_worker_pool *pool, struct udev_pooled_worker *worker);
+
 /* udev-watch.c */
 int udev_watch_init(struct udev *udev);
 void udev_watch_restore(struct udev *udev);
@@ -129,10 +194,12 @@ int udev_ctrl_send_ping(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_exit(struct udev_ctrl *uctrl, int timeout);
 int udev_ctrl_send_set_env(struct udev_ctrl *uctrl, const char *key, int timeout);
 int udev_ctrl_send_set_children_max(struct udev_ctrl *uctrl, int count, int timeout);
+int udev_ctrl_send_get_worker_stats(struct udev_ctrl *uctrl, int timeout, char **ret);
 struct udev_ctrl_connection;
 struct udev_ctrl_connection *udev_ctrl_get_connection(struct udev_ctrl *uctrl);
 struct udev_ctrl_connection *udev_ctrl_connection_ref(struct udev_ctrl_connection *conn);
 struct udev_ctrl_connection *udev_ctrl_connection_unref(struct udev_ctrl_connection *conn);
+int udev_ctrl_connection_send_reply(struct udev_ctrl_connection *conn, const char *reply);
 struct udev_ctrl_msg;
 struct udev_ctrl_msg *udev_ctrl_receive_msg(struct udev_ctrl_connection *conn);
 struct udev_ctrl_msg *udev_ctrl_msg_unref(struct udev_ctrl_msg *ctrl_msg);
@@ -144,6 +211,7 @@ int udev_ctrl_get_ping(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_exit(struct udev_ctrl_msg *ctrl_msg);
 const char *udev_ctrl_get_set_env(struct udev_ctrl_msg *ctrl_msg);
 int udev_ctrl_get_set_children_max(struct udev_ctrl_msg *ctrl_msg);
+int udev_ctrl_get_worker_stats(struct udev_ctrl_msg *ctrl_msg);
 
 /* built-in commands */
 enum udev_builtin_cmd {
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "alloc-util.h"
 #include "process-util.h"
 #include "time-util.h"
 #include "udev-util.h"
@@ -39,6 +40,7 @@ static void print_help(void) {
                "  -R --reload              Reload rules and databases\n"
                "  -p --property=KEY=VALUE  Set a global property for all events\n"
                "  -m --children-max=N      Maximum number of children\n"
+               "  -w --worker-stats        Show the event processing times of the workers\n"
                "  -t --timeout=SECONDS     Maximum time to block for a reply\n"
                , program_invocation_short_name);
 }
@@ -58,6 +60,7 @@ static int adm_control(struct udev *udev, int argc, char *argv[]) {
                 { "property",         required_argument, NULL, 'p' },
                 { "env",              required_argument, NULL, 'p' }, /* alias for -p */
                 { "children-max",     required_argument, NULL, 'm' },
+                { "worker-stats",     no_argument,       NULL, 'w' },
                 { "timeout",          required_argument, NULL, 't' },
                 { "version",          no_argument,       NULL, 'V' },
                 { "help",             no_argument,       NULL, 'h' },
@@ -71,7 +74,7 @@ static int adm_control(struct udev *udev, int argc, char *argv[]) {
         if (uctrl == NULL)
                 return 2;
 
-        while ((c = getopt_long(argc, argv, "el:sSRp:m:t:Vh", options, NULL)) >= 0)
+        while ((c = getopt_long(argc, argv, "el:sSRp:m:wt:Vh", options, NULL)) >= 0)
                 switch (c) {
                 case 'e':
                         if (udev_ctrl_send_exit(uctrl, timeout) < 0)
@@ -136,6 +139,20 @@ static int adm_control(struct udev *udev, int argc, char *argv[]) {
                                 rc = 0;
                         break;
                 }
+                case 'w': {
+                        _cleanup_free_ char *stats = NULL;
+                        int r;
+
+                        r = udev_ctrl_send_get_worker_stats(uctrl, timeout, &stats);
+                        if (r < 0) {
+                                log_error_errno(r, "Failed to get worker statistics: %m");
+                                rc = 2;
+                        } else {
+                                fputs(stats, stdout);
+                                rc = 0;
+                        }
+                        break;
+                }
                 case 't': {
                         usec_t s;
                         int seconds;
@@ -59,9 +59,11 @@
 #include "parse-util.h"
 #include "proc-cmdline.h"
 #include "process-util.h"
+#include "ratelimit.h"
 #include "selinux-util.h"
 #include "signal-util.h"
 #include "socket-util.h"
+#include "string-table.h"
 #include "string-util.h"
 #include "terminal-util.h"
 #include "udev-util.h"
@@ -72,6 +74,7 @@ static bool arg_debug = false;
 static int arg_daemonize = false;
 static int arg_resolve_names = 1;
 static unsigned arg_children_max;
+static unsigned arg_children_prefork;
 static int arg_exec_delay;
 static usec_t arg_event_timeout_usec = 180 * USEC_PER_SEC;
 static usec_t arg_event_timeout_warn_usec = 180 * USEC_PER_SEC / 3;
@@ -80,7 +83,10 @@ typedef struct Manager {
         struct udev *udev;
         sd_event *event;
         Hashmap *workers;
+        struct udev_worker_pool pool;
+        RateLimit prefork_ratelimit;
         LIST_HEAD(struct event, events);
+        struct udev_event_queue queue;
         const char *cgroup;
         pid_t pid; /* the process that originally allocated the manager object */
 
@@ -99,6 +105,12 @@ typedef struct Manager {
 
         usec_t last_usec;
 
+        /* processing times of all events handled by workers, including the ones which are gone */
+        unsigned n_workers_forked;
+        unsigned n_events_done;
+        usec_t events_usec;
+        usec_t events_max_usec;
+
         bool stop_exec_queue:1;
         bool exit:1;
 } Manager;
@@ -117,14 +129,9 @@ struct event {
         struct udev_device *dev_kernel;
         struct worker *worker;
         enum event_state state;
-        unsigned long long int delaying_seqnum;
         unsigned long long int seqnum;
         const char *devpath;
-        size_t devpath_len;
-        const char *devpath_old;
-        dev_t devnum;
-        int ifindex;
-        bool is_block;
+        struct udev_queued_event queued;
         sd_event_source *timeout_warning;
         sd_event_source *timeout;
 };
@@ -145,8 +152,22 @@ struct worker {
         struct udev_monitor *monitor;
         enum worker_state state;
         struct event *event;
+        struct udev_pooled_worker pooled;
+        usec_t event_start_usec;
+        unsigned n_events;
+        usec_t events_usec;
+        usec_t events_max_usec;
+};
+
+static const char* const worker_state_table[] = {
+        [WORKER_UNDEF] = "undef",
+        [WORKER_RUNNING] = "running",
+        [WORKER_IDLE] = "idle",
+        [WORKER_KILLED] = "killed",
 };
 
+DEFINE_PRIVATE_STRING_TABLE_LOOKUP_TO_STRING(worker_state, enum worker_state);
+
 /* passed from worker to main process */
 struct worker_message {
 };
@@ -159,6 +180,7 @@ static void event_free(struct event *event) {
         assert(event->manager);
 
         LIST_REMOVE(event, event->manager->events, event);
+        udev_event_queue_unlink(&event->queued);
         udev_device_unref(event->dev);
         udev_device_unref(event->dev_kernel);
 
@@ -180,16 +202,37 @@ static void event_free(struct event *event) {
         free(event);
 }
 
+static void worker_set_state(struct worker *worker, enum worker_state state) {
+        Manager *manager;
+
+        assert(worker);
+        assert(worker->manager);
+
+        manager = worker->manager;
+
+        if (worker->state == state)
+                return;
+
+        if (state == WORKER_IDLE)
+                udev_worker_pool_make_idle(&manager->pool, &worker->pooled);
+        else
+                udev_worker_pool_unmake_idle(&manager->pool, &worker->pooled);
+
+        worker->state = state;
+}
+
 static void worker_free(struct worker *worker) {
         if (!worker)
                 return;
 
         assert(worker->manager);
 
+        worker_set_state(worker, WORKER_UNDEF);
         hashmap_remove(worker->manager->workers, PID_TO_PTR(worker->pid));
         udev_monitor_unref(worker->monitor);
         event_free(worker->event);
 
+        udev_pooled_worker_done(&worker->manager->pool, &worker->pooled);
         free(worker);
 }
 
@@ -246,7 +289,7 @@ static int on_event_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
         assert(event->worker);
 
         kill_and_sigcont(event->worker->pid, SIGKILL);
-        event->worker->state = WORKER_KILLED;
+        worker_set_state(event->worker, WORKER_KILLED);
 
         log_error("seq %llu '%s' killed", udev_device_get_seqnum(event->dev), event->devpath);
 
@@ -273,8 +316,10 @@ static void worker_attach_event(struct worker *worker, struct event *event) {
         assert(!event->worker);
         assert(!worker->event);
 
-        worker->state = WORKER_RUNNING;
+        worker_set_state(worker, WORKER_RUNNING);
         worker->event = event;
+        udev_pooled_worker_remember(&worker->pooled, event->devpath, udev_device_get_subsystem(event->dev));
+        udev_event_queue_unmake_ready(&event->queued);
         event->state = EVENT_RUNNING;
         event->worker = worker;
 
@@ -282,6 +327,8 @@ static void worker_attach_event(struct worker *worker, struct event *event) {
 
         assert_se(sd_event_now(e, CLOCK_MONOTONIC, &usec) >= 0);
 
+        worker->event_start_usec = usec;
+
         (void) sd_event_add_time(e, &event->timeout_warning, CLOCK_MONOTONIC,
                                  usec + arg_event_timeout_warn_usec, USEC_PER_SEC, on_event_timeout_warning, event);
 
@@ -289,6 +336,30 @@ static void worker_attach_event(struct worker *worker, struct event *event) {
                                  usec + arg_event_timeout_usec, USEC_PER_SEC, on_event_timeout, event);
 }
 
+static void worker_account_event(struct worker *worker) {
+        Manager *manager;
+        usec_t usec;
+
+        assert(worker);
+        assert(worker->manager);
+
+        if (!worker->event)
+                return;
+
+        manager = worker->manager;
+
+        assert_se(sd_event_now(manager->event, CLOCK_MONOTONIC, &usec) >= 0);
+        usec = usec_sub_unsigned(usec, worker->event_start_usec);
+
+        worker->n_events++;
+        worker->events_usec += usec;
+        worker->events_max_usec = MAX(worker->events_max_usec, usec);
+
+        manager->n_events_done++;
+        manager->events_usec += usec;
+        manager->events_max_usec = MAX(manager->events_max_usec, usec);
+}
+
 static void manager_free(Manager *manager) {
         if (!manager)
                 return;
@@ -304,6 +375,8 @@ static void manager_free(Manager *manager) {
         manager_workers_free(manager);
         event_queue_cleanup(manager, EVENT_UNDEF);
 
+        udev_event_queue_done(&manager->queue);
+
         udev_monitor_unref(manager->monitor);
         udev_ctrl_unref(manager->ctrl);
         udev_ctrl_connection_unref(manager->ctrl_conn_blocking);
@@ -325,8 +398,9 @@ static int worker_send_message(int fd) {
         return loop_write(fd, &message, sizeof(message), false);
 }
 
-static void worker_spawn(Manager *manager, struct event *event) {
-        struct udev *udev = event->udev;
+/* forks a worker to handle the event, or an idle one waiting for events if event is NULL */
+static int worker_spawn(Manager *manager, struct event *event) {
+        struct udev *udev = manager->udev;
         _cleanup_udev_monitor_unref_ struct udev_monitor *worker_monitor = NULL;
         pid_t pid;
         int r = 0;
@@ -334,7 +408,7 @@ static void worker_spawn(Manager *manager, struct event *event) {
         /* listen for new events */
         worker_monitor = udev_monitor_new_from_netlink(udev, NULL);
         if (worker_monitor == NULL)
-                return;
+                return -ENOMEM;
         /* allow the main daemon netlink address to send devices to the worker */
         udev_monitor_allow_unicast_sender(worker_monitor, manager->monitor);
         r = udev_monitor_enable_receiving(worker_monitor);
@@ -350,11 +424,14 @@ static void worker_spawn(Manager *manager, struct event *event) {
                 _cleanup_close_ int fd_signal = -1, fd_ep = -1;
                 struct epoll_event ep_signal = { .events = EPOLLIN };
                 struct epoll_event ep_monitor = { .events = EPOLLIN };
+                bool rules_outdated = false;
                 sigset_t mask;
 
                 /* take initial device from queue */
-                dev = event->dev;
-                event->dev = NULL;
+                if (event) {
+                        dev = event->dev;
+                        event->dev = NULL;
+                }
 
                 unsetenv("NOTIFY_SOCKET");
 
@@ -406,7 +483,67 @@ static void worker_spawn(Manager *manager, struct event *event) {
                         struct udev_event *udev_event;
                         int fd_lock = -1;
 
-                        assert(dev);
+                        /* wait for device messages from main udevd, or term signal */
+                        while (dev == NULL) {
+                                struct epoll_event ev[4];
+                                int fdcount;
+                                int i;
+
+                                fdcount = epoll_wait(fd_ep, ev, ELEMENTSOF(ev), -1);
+                                if (fdcount < 0) {
+                                        if (errno == EINTR)
+                                                continue;
+                                        r = log_error_errno(errno, "failed to poll: %m");
+                                        goto out;
+                                }
+
+                                /* Signals are handled first: udevd asks for a reload before it sends further
+                                 * devices, which have to be processed with the new rules. */
+                                for (i = 0; i < fdcount; i++) {
+                                        if (ev[i].data.fd != fd_signal || !(ev[i].events & EPOLLIN))
+                                                continue;
+
+                                        for (;;) {
+                                                struct signalfd_siginfo fdsi;
+                                                ssize_t size;
+
+                                                size = read(fd_signal, &fdsi, sizeof(struct signalfd_siginfo));
+                                                if (size != sizeof(struct signalfd_siginfo))
+                                                        break;
+                                                switch (fdsi.ssi_signo) {
+                                                case SIGTERM:
+                                                        goto out;
+                                                case SIGHUP:
+                                                        rules_outdated = true;
+                                                        break;
+                                                }
+                                        }
+                                }
+
+                                for (i = 0; i < fdcount; i++)
+                                        if (ev[i].data.fd == fd_monitor && ev[i].events & EPOLLIN) {
+                                                dev = udev_monitor_receive_device(worker_monitor);
+                                                break;
+                                        }
+                        }
+
+                        /* Reload the rules in place, rather than having udevd replace us by a worker forked
+                         * with the new rules. This is done when the next device arrives only: reloads are
+                         * often requested in bursts, e.g. by package installations, which then cost one
+                         * parse at most, and workers which are killed while idle never parse at all. */
+                        if (rules_outdated) {
+                                log_debug("reloading rules");
+                                manager->rules = udev_rules_unref(manager->rules);
+                                udev_builtin_exit(udev);
+                                udev_builtin_init(udev);
+                                manager->rules = udev_rules_new(udev, arg_resolve_names);
+                                if (!manager->rules) {
+                                        r = log_oom();
+                                        goto out;
+                                }
+
+                                rules_outdated = false;
+                        }
 
                         log_debug("seq %llu running", udev_device_get_seqnum(dev));
                         udev_event = udev_event_new(dev);
@@ -485,39 +622,6 @@ skip:
                         dev = NULL;
 
                         udev_event_unref(udev_event);
-
-                        /* wait for more device messages from main udevd, or term signal */
-                        while (dev == NULL) {
-                                struct epoll_event ev[4];
-                                int fdcount;
-                                int i;
-
-                                fdcount = epoll_wait(fd_ep, ev, ELEMENTSOF(ev), -1);
-                                if (fdcount < 0) {
-                                        if (errno == EINTR)
-                                                continue;
-                                        r = log_error_errno(errno, "failed to poll: %m");
-                                        goto out;
-                                }
-
-                                for (i = 0; i < fdcount; i++) {
-                                        if (ev[i].data.fd == fd_monitor && ev[i].events & EPOLLIN) {
-                                                dev = udev_monitor_receive_device(worker_monitor);
-                                                break;
-                                        } else if (ev[i].data.fd == fd_signal && ev[i].events & EPOLLIN) {
-                                                struct signalfd_siginfo fdsi;
-                                                ssize_t size;
-
-                                                size = read(fd_signal, &fdsi, sizeof(struct signalfd_siginfo));
-                                                if (size != sizeof(struct signalfd_siginfo))
-                                                        continue;
-                                                switch (fdsi.ssi_signo) {
-                                                case SIGTERM:
-                                                        goto out;
-                                                }
-                                        }
-                                }
-                        }
                 }
 out:
                 udev_device_unref(dev);
@@ -526,44 +630,59 @@ out:
                 _exit(r < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
         }
         case -1:
-                event->state = EVENT_QUEUED;
-                log_error_errno(errno, "fork of child failed: %m");
-                break;
+                if (event)
+                        event->state = EVENT_QUEUED;
+                return log_error_errno(errno, "fork of child failed: %m");
         default:
         {
                 struct worker *worker;
 
                 r = worker_new(&worker, manager, worker_monitor, pid);
                 if (r < 0)
-                        return;
+                        return r;
 
-                worker_attach_event(worker, event);
+                manager->n_workers_forked++;
 
-                log_debug("seq %llu forked new worker ["PID_FMT"]", udev_device_get_seqnum(event->dev), pid);
+                if (event) {
+                        worker_attach_event(worker, event);
+                        log_debug("seq %llu forked new worker ["PID_FMT"]", udev_device_get_seqnum(event->dev), pid);
+                } else {
+                        worker_set_state(worker, WORKER_IDLE);
+                        log_debug("forked idle worker ["PID_FMT"]", pid);
+                }
                 break;
         }
         }
+
+        return 0;
+}
+
+static struct worker *manager_find_idle_worker(Manager *manager, struct event *event) {
+        struct udev_pooled_worker *pooled;
+
+        assert(manager);
+        assert(event);
+
+        pooled = udev_worker_pool_find_idle(&manager->pool, event->devpath, udev_device_get_subsystem(event->dev));
+
+        return pooled ? container_of(pooled, struct worker, pooled) : NULL;
 }
 
 static void event_run(Manager *manager, struct event *event) {
         struct worker *worker;
-        Iterator i;
 
         assert(manager);
         assert(event);
 
-        HASHMAP_FOREACH(worker, manager->workers, i) {
+        while ((worker = manager_find_idle_worker(manager, event))) {
                 ssize_t count;
 
-                if (worker->state != WORKER_IDLE)
-                        continue;
-
                 count = udev_monitor_send_device(manager->monitor, worker->monitor, event->dev);
                 if (count < 0) {
                         log_error_errno(errno, "worker ["PID_FMT"] did not accept message %zi (%m), kill it",
                                         worker->pid, count);
                         kill(worker->pid, SIGKILL);
-                        worker->state = WORKER_KILLED;
+                        worker_set_state(worker, WORKER_KILLED);
                         continue;
                 }
                 worker_attach_event(worker, event);
@@ -577,7 +696,7 @@ static void event_run(Manager *manager, struct event *event) {
         }
 
         /* start new worker and pass initial device */
-        worker_spawn(manager, event);
+        (void) worker_spawn(manager, event);
 }
 
 static int event_queue_insert(Manager *manager, struct udev_device *dev) {
@@ -604,11 +723,11 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
         udev_device_copy_properties(event->dev_kernel, dev);
         event->seqnum = udev_device_get_seqnum(dev);
         event->devpath = udev_device_get_devpath(dev);
-        event->devpath_len = strlen(event->devpath);
-        event->devpath_old = udev_device_get_devpath_old(dev);
-        event->devnum = udev_device_get_devnum(dev);
-        event->is_block = streq("block", udev_device_get_subsystem(dev));
-        event->ifindex = udev_device_get_ifindex(dev);
+        event->queued.devpath = event->devpath;
+        event->queued.devpath_old = udev_device_get_devpath_old(dev);
+        event->queued.devnum = udev_device_get_devnum(dev);
+        event->queued.is_block = streq("block", udev_device_get_subsystem(dev));
+        event->queued.ifindex = udev_device_get_ifindex(dev);
 
         log_debug("seq %llu queued, '%s' '%s'", udev_device_get_seqnum(dev),
              udev_device_get_action(dev), udev_device_get_subsystem(dev));
@@ -623,6 +742,14 @@ static int event_queue_insert(Manager *manager, struct udev_device *dev) {
 
         LIST_APPEND(event, manager->events, event);
 
+        r = udev_event_queue_link(&manager->queue, &event->queued);
+        if (r < 0) {
+                /* the caller keeps its reference to the device */
+                event->dev = NULL;
+                event_free(event);
+                return r;
+        }
+
         return 0;
 }
 
@@ -636,79 +763,141 @@ static void manager_kill_workers(Manager *manager) {
                 if (worker->state == WORKER_KILLED)
                         continue;
 
-                worker->state = WORKER_KILLED;
+                worker_set_state(worker, WORKER_KILLED);
                 kill(worker->pid, SIGTERM);
         }
 }
 
-/* lookup event for identical, parent, child device */
-static bool is_devpath_busy(Manager *manager, struct event *event) {
-        struct event *loop_event;
-        size_t common;
+/* The workers reload the rules in place before they handle their next event, so that the pool of
+ * idle workers survives a reload */
+static void manager_reload_workers(Manager *manager) {
+        struct worker *worker;
+        Iterator i;
 
-        /* check if queue contains events we depend on */
-        LIST_FOREACH(event, loop_event, manager->events) {
-                /* we already found a later event, earlier can not block us, no need to check again */
-                if (loop_event->seqnum < event->delaying_seqnum)
+        assert(manager);
+
+        HASHMAP_FOREACH(worker, manager->workers, i) {
+                if (worker->state == WORKER_KILLED)
                         continue;
 
-                /* event we checked earlier still exists, no need to check again */
-                if (loop_event->seqnum == event->delaying_seqnum)
-                        return true;
+                kill(worker->pid, SIGHUP);
+        }
+}
+
+static int manager_load_rules(Manager *manager) {
+        assert(manager);
+
+        udev_builtin_init(manager->udev);
 
-                /* found ourself, no later event can block us */
-                if (loop_event->seqnum >= event->seqnum)
+        if (!manager->rules) {
+                manager->rules = udev_rules_new(manager->udev, arg_resolve_names);
+                if (!manager->rules)
+                        return -ENOMEM;
+        }
+
+        return 0;
+}
+
+/* Keeps arg_children_prefork idle workers around, so that events do not have to wait for a worker to be
+ * forked. Workers are forked with the rules already loaded, and reload them in place when asked to. */
+static void manager_adjust_idle_workers(Manager *manager) {
+        struct worker *worker;
+
+        assert(manager);
+
+        while (manager->pool.n_idle > arg_children_prefork) {
+                worker = container_of(udev_worker_pool_least_recently_used(&manager->pool), struct worker, pooled);
+
+                worker_set_state(worker, WORKER_KILLED);
+                kill(worker->pid, SIGTERM);
+        }
+
+        if (manager->pool.n_idle >= arg_children_prefork ||
+            hashmap_size(manager->workers) >= arg_children_max)
+                return;
+
+        /* do not fork in a loop if the workers keep dying */
+        if (!ratelimit_test(&manager->prefork_ratelimit)) {
+                log_debug("not refilling the pool of idle workers, workers exited too often");
+                return;
+        }
+
+        if (manager_load_rules(manager) < 0)
+                return;
+
+        while (manager->pool.n_idle < arg_children_prefork &&
+               hashmap_size(manager->workers) < arg_children_max)
+                if (worker_spawn(manager, NULL) < 0)
                         break;
+}
 
-                /* check major/minor */
-                if (major(event->devnum) != 0 && event->devnum == loop_event->devnum && event->is_block == loop_event->is_block)
-                        return true;
+static int manager_format_worker_stats(Manager *manager, char **ret) {
+        _cleanup_fclose_ FILE *f = NULL;
+        _cleanup_free_ char *buf = NULL;
+        char a[FORMAT_TIMESPAN_MAX], b[FORMAT_TIMESPAN_MAX];
+        struct worker *worker;
+        Iterator i;
+        size_t size;
 
-                /* check network device ifindex */
-                if (event->ifindex != 0 && event->ifindex == loop_event->ifindex)
-                        return true;
+        assert(manager);
+        assert(ret);
 
-                /* check our old name */
-                if (event->devpath_old != NULL && streq(loop_event->devpath, event->devpath_old)) {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        f = open_memstream(&buf, &size);
+        if (!f)
+                return -ENOMEM;
 
-                /* compare devpath */
-                common = MIN(loop_event->devpath_len, event->devpath_len);
+        fprintf(f, "%-10s %-8s %8s %12s %12s\n", "WORKER", "STATE", "EVENTS", "AVERAGE", "MAX");
 
-                /* one devpath is contained in the other? */
-                if (memcmp(loop_event->devpath, event->devpath, common) != 0)
-                        continue;
+        HASHMAP_FOREACH(worker, manager->workers, i)
+                fprintf(f, "%-10"PID_PRI" %-8s %8u %12s %12s\n",
+                        worker->pid, worker_state_to_string(worker->state), worker->n_events,
+                        format_timespan(a, sizeof(a), worker->n_events > 0 ? worker->events_usec / worker->n_events : 0, 1),
+                        format_timespan(b, sizeof(b), worker->events_max_usec, 1));
+
+        fprintf(f, "\n%u workers (%u idle, %u preforked at most), %u forked in total\n"
+                "%u events, %s on average, %s at most\n",
+                hashmap_size(manager->workers), manager->pool.n_idle, arg_children_prefork,
+                manager->n_workers_forked, manager->n_events_done,
+                format_timespan(a, sizeof(a), manager->n_events_done > 0 ? manager->events_usec / manager->n_events_done : 0, 1),
+                format_timespan(b, sizeof(b), manager->events_max_usec, 1));
+
+        if (fflush_and_check(f) < 0)
+                return -ENOMEM;
 
-                /* identical device event found */
-                if (loop_event->devpath_len == event->devpath_len) {
-                        /* devices names might have changed/swapped in the meantime */
-                        if (major(event->devnum) != 0 && (event->devnum != loop_event->devnum || event->is_block != loop_event->is_block))
-                                continue;
-                        if (event->ifindex != 0 && event->ifindex != loop_event->ifindex)
-                                continue;
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        f = safe_fclose(f);
 
-                /* parent device event found */
-                if (event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
-                }
+        *ret = buf;
+        buf = NULL;
+
+        return 0;
+}
+
+static void manager_kill_left_over_processes(Manager *manager) {
+        _cleanup_set_free_ Set *pids = NULL;
+        struct udev_pooled_worker *pooled;
+        int r;
+
+        assert(manager);
+        assert(manager->cgroup);
 
-                /* child device event found */
-                if (loop_event->devpath[common] == '/') {
-                        event->delaying_seqnum = loop_event->seqnum;
-                        return true;
+        /* the idle workers are kept */
+        if (manager->pool.idle) {
+                pids = set_new(NULL);
+                if (!pids) {
+                        log_oom();
+                        return;
                 }
 
-                /* no matching device */
-                continue;
+                LIST_FOREACH(idle, pooled, manager->pool.idle) {
+                        r = set_put(pids, PID_TO_PTR(container_of(pooled, struct worker, pooled)->pid));
+                        if (r < 0) {
+                                log_oom();
+                                return;
+                        }
+                }
         }
 
-        return false;
+        (void) cg_kill(SYSTEMD_CGROUP_CONTROLLER, manager->cgroup, SIGKILL, CGROUP_IGNORE_SELF, pids, NULL, NULL);
 }
 
 static int on_exit_timeout(sd_event_source *s, uint64_t usec, void *userdata) {
@@ -766,7 +955,7 @@ static void manager_reload(Manager *manager) {
                   "RELOADING=1\n"
                   "STATUS=Flushing configuration...");
 
-        manager_kill_workers(manager);
+        manager_reload_workers(manager);
         manager->rules = udev_rules_unref(manager->rules);
         udev_builtin_exit(manager->udev);
 
@@ -776,7 +965,7 @@ static void manager_reload(Manager *manager) {
 }
 
 static void event_queue_start(Manager *manager) {
-        struct event *event;
+        struct udev_queued_event *queued, *tmp;
         usec_t usec;
 
         assert(manager);
@@ -796,23 +985,18 @@ static void event_queue_start(Manager *manager) {
                 manager->last_usec = usec;
         }
 
-        udev_builtin_init(manager->udev);
-
-        if (!manager->rules) {
-                manager->rules = udev_rules_new(manager->udev, arg_resolve_names);
-                if (!manager->rules)
-                        return;
-        }
-
-        LIST_FOREACH(event,event,manager->events) {
-                if (event->state != EVENT_QUEUED)
-                        continue;
+        if (manager_load_rules(manager) < 0)
+                return;
 
-                /* do not start event if parent or child event is still running */
-                if (is_devpath_busy(manager, event))
-                        continue;
+        /* events of parent or child devices still queued or running are not in the ready queue */
+        LIST_FOREACH_SAFE(ready, queued, tmp, manager->queue.ready) {
+                struct event *event = container_of(queued, struct event, queued);
 
                 event_run(manager, event);
+
+                /* no worker available, the remaining events have to wait as well */
+                if (event->state == EVENT_QUEUED)
+                        break;
         }
 }
 
@@ -886,8 +1070,10 @@ static int on_worker(sd_event_source *s, int fd, uint32_t revents, void *userdat
                         continue;
                 }
 
+                worker_account_event(worker);
+
                 if (worker->state != WORKER_KILLED)
-                        worker->state = WORKER_IDLE;
+                        worker_set_state(worker, WORKER_IDLE);
 
                 /* worker returned */
                 event_free(worker->event);
@@ -926,7 +1112,7 @@ static int on_ctrl_msg(sd_event_source *s, int fd, uint32_t revents, void *userd
         _cleanup_udev_ctrl_connection_unref_ struct udev_ctrl_connection *ctrl_conn = NULL;
         _cleanup_udev_ctrl_msg_unref_ struct udev_ctrl_msg *ctrl_msg = NULL;
         const char *str;
-        int i;
+        int i, r;
 
         assert(manager);
 
@@ -999,6 +1185,21 @@ static int on_ctrl_msg(sd_event_source *s, int fd, uint32_t revents, void *userd
         if (udev_ctrl_get_ping(ctrl_msg) > 0)
                 log_debug("udevd message (SYNC) received");
 
+        if (udev_ctrl_get_worker_stats(ctrl_msg) > 0) {
+                _cleanup_free_ char *stats = NULL;
+
+                log_debug("udevd message (GET_WORKER_STATS) received");
+
+                r = manager_format_worker_stats(manager, &stats);
+                if (r < 0)
+                        log_warning_errno(r, "could not format worker statistics: %m");
+                else {
+                        r = udev_ctrl_connection_send_reply(ctrl_conn, stats);
+                        if (r < 0)
+                                log_warning_errno(r, "could not send worker statistics: %m");
+                }
+        }
+
         if (udev_ctrl_get_exit(ctrl_msg) > 0) {
                 log_debug("udevd message (EXIT) received");
                 manager_exit(manager);
@@ -1238,25 +1439,43 @@ static int on_post(sd_event_source *s, void *userdata) {
 
         if (LIST_IS_EMPTY(manager->events)) {
                 /* no pending events */
-                if (!hashmap_isempty(manager->workers)) {
-                        /* there are idle workers */
-                        log_debug("cleanup idle workers");
-                        manager_kill_workers(manager);
-                } else {
-                        /* we are idle */
-                        if (manager->exit) {
+                if (manager->exit) {
+                        if (!hashmap_isempty(manager->workers)) {
+                                /* there are idle workers */
+                                log_debug("cleanup idle workers");
+                                manager_kill_workers(manager);
+                        } else {
                                 r = sd_event_exit(manager->event, 0);
                                 if (r < 0)
                                         return r;
-                        } else if (manager->cgroup)
+                        }
+                } else {
+                        /* keep the pool of idle workers, and cleanup the other ones */
+                        manager_adjust_idle_workers(manager);
+
+                        /* we are idle */
+                        if (manager->cgroup && hashmap_size(manager->workers) == manager->pool.n_idle)
                                 /* cleanup possible left-over processes in our cgroup */
-                                cg_kill(SYSTEMD_CGROUP_CONTROLLER, manager->cgroup, SIGKILL, CGROUP_IGNORE_SELF, NULL, NULL, NULL);
+                                manager_kill_left_over_processes(manager);
                 }
         }
 
         return 1;
 }
 
+static int on_start(sd_event_source *s, void *userdata) {
+        Manager *manager = userdata;
+
+        assert(manager);
+
+        /* Workers are forked from within the event loop only: the loop holds a reference to the event
+         * object while dispatching, so the workers dropping theirs does not tear down the signalfd they
+         * share with the main process. */
+        manager_adjust_idle_workers(manager);
+
+        return 1;
+}
+
 static int listen_fds(int *rctrl, int *rnetlink) {
         _cleanup_udev_unref_ struct udev *udev = NULL;
         int ctrl_fd = -1, netlink_fd = -1;
@@ -1349,6 +1568,7 @@ static int listen_fds(int *rctrl, int *rnetlink) {
  * read the kernel command line, in case we need to get into debug mode
  *   udev.log_priority=<level>                 syslog priority
  *   udev.children_max=<number of workers>     events are fully serialized if set to 1
+ *   udev.children_prefork=<number of workers> idle workers to keep ready for new events
  *   udev.exec_delay=<number of seconds>       delay execution of every executed program
  *   udev.event_timeout=<number of seconds>    seconds to wait before terminating an event
  */
@@ -1387,6 +1607,13 @@ static int parse_proc_cmdline_item(const char *key, const char *value, void *dat
 
                 r = safe_atou(value, &arg_children_max);
 
+        } else if (proc_cmdline_key_streq(key, "udev.children_prefork")) {
+
+                if (proc_cmdline_value_missing(key, value))
+                        return 0;
+
+                r = safe_atou(value, &arg_children_prefork);
+
         } else if (proc_cmdline_key_streq(key, "udev.exec_delay")) {
 
                 if (proc_cmdline_value_missing(key, value))
@@ -1411,6 +1638,7 @@ static void help(void) {
                "  -d --daemon                 Detach and run in the background\n"
                "  -D --debug                  Enable debug output\n"
                "  -c --children-max=INT       Set maximum number of workers\n"
+               "  -p --children-prefork=INT   Set number of idle workers to keep ready\n"
                "  -e --exec-delay=SECONDS     Seconds to wait before executing RUN=\n"
                "  -t --event-timeout=SECONDS  Seconds to wait before terminating an event\n"
                "  -N --resolve-names=early|late|never\n"
@@ -1423,6 +1651,7 @@ static int parse_argv(int argc, char *argv[]) {
                 { "daemon",             no_argument,            NULL, 'd' },
                 { "debug",              no_argument,            NULL, 'D' },
                 { "children-max",       required_argument,      NULL, 'c' },
+                { "children-prefork",   required_argument,      NULL, 'p' },
                 { "exec-delay",         required_argument,      NULL, 'e' },
                 { "event-timeout",      required_argument,      NULL, 't' },
                 { "resolve-names",      required_argument,      NULL, 'N' },
@@ -1436,7 +1665,7 @@ static int parse_argv(int argc, char *argv[]) {
         assert(argc >= 0);
         assert(argv);
 
-        while ((c = getopt_long(argc, argv, "c:de:Dt:N:hV", options, NULL)) >= 0) {
+        while ((c = getopt_long(argc, argv, "c:p:de:Dt:N:hV", options, NULL)) >= 0) {
                 int r;
 
                 switch (c) {
@@ -1449,6 +1678,11 @@ static int parse_argv(int argc, char *argv[]) {
                         if (r < 0)
                                 log_warning("Invalid --children-max ignored: %s", optarg);
                         break;
+                case 'p':
+                        r = safe_atou(optarg, &arg_children_prefork);
+                        if (r < 0)
+                                log_warning("Invalid --children-prefork ignored: %s", optarg);
+                        break;
                 case 'e':
                         r = safe_atoi(optarg, &arg_exec_delay);
                         if (r < 0)
@@ -1522,6 +1756,7 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
                 return log_error_errno(ENOMEM, "error reading rules");
 
         LIST_HEAD_INIT(manager->events);
+        RATELIMIT_INIT(manager->prefork_ratelimit, 10 * USEC_PER_SEC, 10);
         udev_list_init(manager->udev, &manager->properties, true);
 
         manager->cgroup = cgroup;
@@ -1606,6 +1841,10 @@ static int manager_new(Manager **ret, int fd_ctrl, int fd_uevent, const char *cg
         if (r < 0)
                 return log_error_errno(r, "error creating post event source: %m");
 
+        r = sd_event_add_defer(manager->event, NULL, on_start, manager);
+        if (r < 0)
+                return log_error_errno(r, "error creating start event source: %m");
+
         *ret = manager;
         manager = NULL;
 